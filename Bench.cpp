@@ -0,0 +1,376 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <Eigen/Eigen>
+#include "TopOpt.h"
+#include "MMA.h"
+#include "EigenPeetz.h"
+#include <slepceps.h>
+#include "Functions.h"
+
+static char help[] = "Times the main kernels of the optimization on a generated problem.\n\n"
+  "  -Bench_Problem <cantilever|bridge>: Problem to generate\n"
+  "  -Bench_Nel <nx,ny[,nz]>: Number of elements in each dimension\n"
+  "  -Bench_Functions <2-4>: Compliance, Volume, Stability, Frequency\n"
+  "  -Bench_Modes <n>: Number of eigenvalues in Stability and Frequency\n"
+  "  -Bench_Iterations <n>: Number of optimization iterations to time\n"
+  "  -Bench_Output <file>: Where to write the JSON results\n\n";
+
+using namespace std;
+
+/// Wall times of one phase, one entry per iteration
+struct Phase
+{
+  string name;
+  vector<double> times;
+};
+
+/********************************************************************
+ * Write an input file for a cantilever or bridge problem
+ *
+ * @param filename: Input file to write
+ * @param problem: cantilever or bridge
+ * @param nel: Number of elements in each dimension
+ * @param nFunctions: Number of functions to include
+ * @param modes: Number of eigenvalues in the eigenvalue functions
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+static PetscErrorCode Write_Input(const char *filename, string problem,
+                                  vector<PetscInt> &nel, PetscInt nFunctions,
+                                  PetscInt modes)
+{
+  PetscErrorCode ierr = 0;
+
+  // Elements are one unit wide
+  size_t dims = nel.size();
+  ostringstream limits, dimensions, elements;
+  for (size_t i = 0; i < dims; i++) {
+    limits << (i ? ", " : "") << "-1e10, 1e10";
+    dimensions << (i ? ", " : "") << "0, " << nel[i];
+    elements << (i ? ", " : "") << nel[i];
+  }
+  double Lx = nel[0], Ly = nel[1], Lz = dims > 2 ? nel[2] : 0;
+  ostringstream zCenter, zRadius, zValue;
+  if (dims > 2) {
+    zCenter << ", " << Lz/2;
+    zRadius << ", " << Lz;
+    zValue << ", 0";
+  }
+
+  ofstream file(filename);
+  if (!file.is_open())
+    SETERRQ1(PETSC_COMM_SELF, PETSC_ERR_FILE_OPEN, "Could not write %s", filename);
+
+  file << "[Params]\n";
+  file << "  Dimensions: " << dimensions.str() << "\n";
+  file << "  NEL: " << elements.str() << "\n";
+  file << "  E0: 1000\n  Nu0: 0.3\n  Density: 1900\n";
+  file << "  Penalty: 3, 1, 3\n  Void_Penalty: 1, 0, 1\n";
+  file << "  Material: SIMP_CUT 0.1\n";
+  file << "  RMinFactor: 1.5\n  RMaxFactor: 6\n";
+  file << "  Verbose: 0\n";
+  file << "[/Params]\n";
+
+  // Compliance objective and volume constraint, then eigenvalue objectives
+  ostringstream weights;
+  for (PetscInt i = 0; i < modes; i++)
+    weights << (i ? ", " : "") << 1.0/modes;
+  file << "[Functions]\n";
+  file << "  Compliance\n    Objective\n    Values: 1\n    Range: 0, 1\n";
+  file << "  Volume\n    Constraint\n    Values: 0.5\n    Range: 0, 1\n";
+  if (nFunctions > 2)
+    file << "  Stability\n    Objective\n    Values: " << weights.str()
+         << "\n    Range: 0, 1\n";
+  if (nFunctions > 3)
+    file << "  Frequency\n    Objective\n    Values: " << weights.str()
+         << "\n    Range: 0, 1\n";
+  file << "[/Functions]\n";
+
+  file << "[BC]\n";
+  if (problem == "bridge") {
+    // Pinned at both bottom corners and loaded along the top
+    file << "  Support\n    Center: 0, 0" << zCenter.str() << "\n";
+    file << "    Radius: 1.01, 1e-10" << zRadius.str() << "\n";
+    file << "    Limits: " << limits.str() << "\n";
+    file << "    Values: 1, 1" << (dims > 2 ? ", 1" : "") << "\n";
+    file << "  Support\n    Center: " << Lx << ", 0" << zCenter.str() << "\n";
+    file << "    Radius: 1.01, 1e-10" << zRadius.str() << "\n";
+    file << "    Limits: " << limits.str() << "\n";
+    file << "    Values: 1, 1" << (dims > 2 ? ", 1" : "") << "\n";
+    file << "  Load\n    Center: " << Lx/2 << ", " << Ly << zCenter.str() << "\n";
+    file << "    Radius: " << Lx/2 << ", 1e-10" << zRadius.str() << "\n";
+    file << "    Limits: " << limits.str() << "\n";
+    file << "    Values: 0, -1" << zValue.str() << "\n";
+  }
+  else {
+    // Clamped on the left and loaded at the middle of the right side
+    file << "  Support\n    Center: 0, " << Ly/2 << zCenter.str() << "\n";
+    file << "    Radius: 1e-10, " << Ly << zRadius.str() << "\n";
+    file << "    Limits: " << limits.str() << "\n";
+    file << "    Values: 1, 1" << (dims > 2 ? ", 1" : "") << "\n";
+    file << "  Load\n    Center: " << Lx << ", " << Ly/2 << zCenter.str() << "\n";
+    file << "    Radius: 1e-10, 0.51" << zRadius.str() << "\n";
+    file << "    Limits: " << limits.str() << "\n";
+    file << "    Values: 0, -1" << zValue.str() << "\n";
+  }
+  file << "[/BC]\n";
+  file.close();
+
+  return ierr;
+}
+
+/********************************************************************
+ * Record the time of a phase in one iteration
+ *
+ * @param phases: Timings of all phases
+ * @param name: Name of the phase
+ * @param it: Iteration number
+ * @param nIt: Total number of iterations
+ * @param time: Wall time of the phase
+ *
+ * @return void
+ *
+ *******************************************************************/
+static void Record(vector<Phase> &phases, string name, int it, int nIt,
+                   double time)
+{
+  unsigned int i = 0;
+  while (i < phases.size() && phases[i].name != name)
+    i++;
+  if (i == phases.size()) {
+    phases.push_back(Phase());
+    phases[i].name = name;
+    phases[i].times.assign(nIt, 0);
+  }
+  phases[i].times[it] += time;
+}
+
+/********************************************************************
+ * Write the timings as JSON
+ *
+ * @param comm: Communicator of the benchmark
+ * @param fp: File to write to
+ * @param problem: cantilever or bridge
+ * @param nel: Number of elements in each dimension
+ * @param topOpt: The topology optimization object
+ * @param modes: Number of eigenvalues in the eigenvalue functions
+ * @param tInit: Time of FEInitialize
+ * @param phases: Timings of all phases, slowest process of each iteration
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+static PetscErrorCode Write_JSON(MPI_Comm comm, FILE *fp, string problem,
+                                 vector<PetscInt> &nel, TopOpt *topOpt,
+                                 PetscInt modes, double tInit,
+                                 vector<Phase> &phases)
+{
+  PetscErrorCode ierr = 0;
+  int nproc;
+  MPI_Comm_size(comm, &nproc);
+
+  ierr = PetscFPrintf(comm, fp, "{\n  \"problem\": \"%s\",\n  \"nel\": [",
+                      problem.c_str()); CHKERRQ(ierr);
+  for (size_t i = 0; i < nel.size(); i++) {
+    ierr = PetscFPrintf(comm, fp, "%s%i", i ? ", " : "", nel[i]); CHKERRQ(ierr);
+  }
+  ierr = PetscFPrintf(comm, fp, "],\n  \"elements\": %i,\n  \"nodes\": %i,\n"
+                      "  \"processes\": %i,\n  \"modes\": %i,\n  \"functions\": [",
+                      topOpt->nElem, topOpt->nNode, nproc, modes); CHKERRQ(ierr);
+  for (unsigned int i = 0; i < topOpt->function_list.size(); i++) {
+    ierr = PetscFPrintf(comm, fp, "%s\"%s\"", i ? ", " : "",
+           Function_Base::name[topOpt->function_list[i]->func_type]); CHKERRQ(ierr);
+  }
+  ierr = PetscFPrintf(comm, fp, "],\n  \"FEInitialize\": %1.6e,\n  \"phases\": {",
+                      tInit); CHKERRQ(ierr);
+
+  for (unsigned int i = 0; i < phases.size(); i++) {
+    vector<double> &t = phases[i].times;
+    double total = 0, tMin = t[0], tMax = t[0];
+    for (unsigned int j = 0; j < t.size(); j++) {
+      total += t[j];
+      tMin = min(tMin, t[j]);
+      tMax = max(tMax, t[j]);
+    }
+    ierr = PetscFPrintf(comm, fp, "%s\n    \"%s\": {\"total\": %1.6e, \"mean\": %1.6e, "
+                        "\"min\": %1.6e, \"max\": %1.6e, \"samples\": [",
+                        i ? "," : "", phases[i].name.c_str(), total,
+                        total/t.size(), tMin, tMax); CHKERRQ(ierr);
+    for (unsigned int j = 0; j < t.size(); j++) {
+      ierr = PetscFPrintf(comm, fp, "%s%1.6e", j ? ", " : "", t[j]); CHKERRQ(ierr);
+    }
+    ierr = PetscFPrintf(comm, fp, "]}"); CHKERRQ(ierr);
+  }
+  ierr = PetscFPrintf(comm, fp, "\n  }\n}\n"); CHKERRQ(ierr);
+
+  return ierr;
+}
+
+int main(int argc, char **args)
+{
+  /// MPI Variables
+  int myid, nproc;
+  PetscErrorCode ierr = 0;
+  SlepcInitialize(&argc,&args,(char*)0,help);
+  ierr = EigenPeetz::Initialize(); CHKERRQ(ierr);
+  MPI_Comm Opt_Comm = MPI_COMM_WORLD;
+  MPI_Comm_rank(Opt_Comm, &myid);
+  MPI_Comm_size(Opt_Comm, &nproc);
+
+  /// Benchmark options
+  char name[256] = "cantilever";
+  ierr = PetscOptionsGetString(NULL, NULL, "-Bench_Problem", name, 256, NULL); CHKERRQ(ierr);
+  string problem = name;
+  if (problem != "cantilever" && problem != "bridge")
+    SETERRQ1(Opt_Comm, PETSC_ERR_ARG_OUTOFRANGE, "Unknown problem %s", name);
+  PetscInt nelArray[3] = {64, 32, 0}, nDims = 3;
+  PetscBool set;
+  ierr = PetscOptionsGetIntArray(NULL, NULL, "-Bench_Nel", nelArray, &nDims, &set);
+            CHKERRQ(ierr);
+  if (!set)
+    nDims = 2;
+  if (nDims < 2)
+    SETERRQ(Opt_Comm, PETSC_ERR_ARG_SIZ, "Need 2 or 3 values for -Bench_Nel");
+  vector<PetscInt> nel(nelArray, nelArray+nDims);
+  PetscInt nFunctions = 2, modes = 1, nIt = 10;
+  ierr = PetscOptionsGetInt(NULL, NULL, "-Bench_Functions", &nFunctions, NULL); CHKERRQ(ierr);
+  if (nFunctions < 2 || nFunctions > 4)
+    SETERRQ(Opt_Comm, PETSC_ERR_ARG_OUTOFRANGE, "Need 2 to 4 functions");
+  ierr = PetscOptionsGetInt(NULL, NULL, "-Bench_Modes", &modes, NULL); CHKERRQ(ierr);
+  modes = max(modes, 1);
+  ierr = PetscOptionsGetInt(NULL, NULL, "-Bench_Iterations", &nIt, NULL); CHKERRQ(ierr);
+  nIt = max(nIt, 1);
+  char jsonName[256] = "Bench.json";
+  ierr = PetscOptionsGetString(NULL, NULL, "-Bench_Output", jsonName, 256, NULL); CHKERRQ(ierr);
+
+  /// Generate the problem
+  // Every process must learn if the first one failed before returning
+  PetscErrorCode writeErr = 0;
+  if (myid == 0)
+    writeErr = Write_Input("Bench_Input", problem, nel, nFunctions, modes);
+  ierr = MPI_Bcast(&writeErr, 1, MPI_INT, 0, Opt_Comm); CHKERRQ(ierr);
+  if (writeErr != 0)
+    SETERRQ(Opt_Comm, PETSC_ERR_FILE_WRITE, "Unable to write Bench_Input");
+
+  TopOpt * topOpt = new TopOpt;
+  MMA * optmma = new MMA;
+  optmma->Set_Comm(Opt_Comm);
+  topOpt->filename = "Bench_Input";
+
+  Eigen::VectorXd Dimensions;
+  ArrayXPI Nel;
+  double Rmin=1.5, Rmax=3;
+  PetscBool Normalization = PETSC_FALSE, Reorder_Mesh = PETSC_TRUE;
+  ierr = topOpt->Def_Param(optmma, Dimensions, Nel, Rmin, Rmax,
+                           Normalization, Reorder_Mesh); CHKERRQ(ierr);
+  ierr = topOpt->Set_Funcs(); CHKERRQ(ierr);
+  ierr = topOpt->Get_CL_Options(); CHKERRQ(ierr);
+  ierr = topOpt->CreateMesh(Dimensions, Nel, Rmin, Rmax,
+                            Reorder_Mesh); CHKERRQ(ierr);
+  ierr = topOpt->Def_BC(); CHKERRQ(ierr);
+  topOpt->active.setOnes(topOpt->nLocElem);
+
+  optmma->Set_Lower_Bound(Eigen::VectorXd::Constant(topOpt->nLocElem, 0));
+  optmma->Set_Upper_Bound(Eigen::VectorXd::Ones(topOpt->nLocElem));
+  optmma->Set_Values(0.5*Eigen::VectorXd::Ones(topOpt->nLocElem));
+  optmma->Set_n(topOpt->nLocElem);
+
+  /// Initialze functions and FEM structures
+  double t0 = MPI_Wtime();
+  ierr = topOpt->FEInitialize(); CHKERRQ(ierr);
+  double tInit = MPI_Wtime() - t0;
+  ierr = MPI_Allreduce(MPI_IN_PLACE, &tInit, 1, MPI_DOUBLE, MPI_MAX, Opt_Comm);
+            CHKERRQ(ierr);
+  PetscInt ncon = 0;
+  for (unsigned int ii = 0; ii < topOpt->function_list.size(); ii++) {
+    if (topOpt->function_list[ii]->objective == PETSC_FALSE)
+      ncon++;
+  }
+  double f;
+  VectorXPS dfdx(topOpt->nLocElem), g(ncon);
+  MatrixXPS dgdx(topOpt->nLocElem, ncon);
+  topOpt->bucklingShape.resize(topOpt->node.size(), topOpt->bucklingShape.cols());
+  topOpt->dynamicShape.resize(topOpt->node.size(), topOpt->dynamicShape.cols());
+  for (unsigned int i = 0; i < topOpt->function_list.size(); i++) {
+    ierr = topOpt->function_list[i]->Initialize_Arrays(topOpt->nLocElem); CHKERRQ(ierr);
+  }
+  topOpt->penal = topOpt->penalties[0];
+  topOpt->vdPenal = topOpt->void_penalties[0];
+  optmma->Set_It(0);
+
+  // Sensitivities to run through the filter on their own
+  Vec dfdV, dfdE;
+  ierr = VecDuplicate(topOpt->x, &dfdV); CHKERRQ(ierr);
+  ierr = VecDuplicate(topOpt->x, &dfdE); CHKERRQ(ierr);
+
+  /// Time each phase of the optimization loop
+  vector<Phase> phases;
+  for (int it = 0; it < nIt; it++) {
+    if (it > 0) {
+      t0 = MPI_Wtime();
+      ierr = optmma->Set_Active(topOpt->active); CHKERRQ(ierr);
+      ierr = optmma->Update( dfdx, g, dgdx ); CHKERRQ(ierr);
+      Record(phases, "MMA::Update", it, nIt, MPI_Wtime() - t0);
+    }
+
+    t0 = MPI_Wtime();
+    ierr = topOpt->MatIntFnc( optmma->Get_x() ); CHKERRQ(ierr);
+    Record(phases, "MatIntFnc", it, nIt, MPI_Wtime() - t0);
+
+    if (topOpt->needK) {
+      t0 = MPI_Wtime();
+      ierr = topOpt->FEAssemble(); CHKERRQ(ierr);
+      Record(phases, "FEAssemble", it, nIt, MPI_Wtime() - t0);
+    }
+    if (topOpt->needU) {
+      t0 = MPI_Wtime();
+      ierr = topOpt->FESolve(); CHKERRQ(ierr);
+      Record(phases, "FESolve", it, nIt, MPI_Wtime() - t0);
+    }
+
+    ierr = Function_Base::Function_Call( topOpt, f, dfdx, g, dgdx ); CHKERRQ(ierr);
+    for (unsigned int i = 0; i < topOpt->function_list.size(); i++) {
+      Function_Base *function = topOpt->function_list[i];
+      Record(phases, string(Function_Base::name[function->func_type]) + "::Function",
+             it, nIt, function->time);
+    }
+
+    ierr = VecSet(dfdV, 1); CHKERRQ(ierr);
+    ierr = VecSet(dfdE, 1); CHKERRQ(ierr);
+    t0 = MPI_Wtime();
+    ierr = topOpt->Chain_Filter(dfdV, dfdE); CHKERRQ(ierr);
+    Record(phases, "Chain_Filter", it, nIt, MPI_Wtime() - t0);
+  }
+  // The MMA update of the first iteration is not timed
+  for (unsigned int i = 0; i < phases.size(); i++) {
+    if (phases[i].name == "MMA::Update")
+      phases[i].times.erase(phases[i].times.begin());
+  }
+
+  /// Report the slowest process of each iteration
+  for (unsigned int i = 0; i < phases.size(); i++) {
+    ierr = MPI_Allreduce(MPI_IN_PLACE, phases[i].times.data(), phases[i].times.size(),
+                         MPI_DOUBLE, MPI_MAX, Opt_Comm); CHKERRQ(ierr);
+  }
+  FILE *fp;
+  ierr = PetscFOpen(Opt_Comm, jsonName, "w", &fp); CHKERRQ(ierr);
+  ierr = Write_JSON(Opt_Comm, fp, problem, nel, topOpt, modes, tInit, phases); CHKERRQ(ierr);
+  ierr = PetscFClose(Opt_Comm, fp); CHKERRQ(ierr);
+  ierr = Write_JSON(Opt_Comm, PETSC_STDOUT, problem, nel, topOpt, modes, tInit, phases);
+            CHKERRQ(ierr);
+
+  /// Wrap up and finish
+  ierr = VecDestroy(&dfdV); CHKERRQ(ierr);
+  ierr = VecDestroy(&dfdE); CHKERRQ(ierr);
+  delete topOpt;
+  delete optmma;
+
+  ierr = EigenPeetz::Finalize(); CHKERRQ(ierr);
+  ierr = SlepcFinalize(); CHKERRQ(ierr);
+
+  return ierr;
+}
@@ -55,37 +55,51 @@ PetscErrorCode Stability::Function(TopOpt *topOpt)
     ierr = PCSetUp(sub_pc); CHKERRQ(ierr);
   }
 
-  // Set ouptput parameters for lopgmres
-  lopgmres.Set_Verbose(topOpt->verbose);
-  lopgmres.Set_File(topOpt->output);
+  // Create the eigensolver on first use
+  bool fresh = (eigen == NULL);
+  if (fresh) {
+    ierr = EigenPeetz::Create(eigen_type, topOpt->comm, &eigen); CHKERRQ(ierr);
+  }
+
+  // Set ouptput parameters for eigensolver
+  eigen->Set_Verbose(topOpt->verbose);
+  eigen->Set_File(topOpt->output);
 
   // Set the preconditioner
   ierr = KSPGetPC(topOpt->KUF, &pc); CHKERRQ(ierr);
-  ierr = lopgmres.Set_PC(pc); CHKERRQ(ierr);
+  ierr = eigen->Set_PC(pc); CHKERRQ(ierr);
 
-  // Set Operators
-  lopgmres.Set_Operators(Ks, topOpt->K);
+  // Set Operators and the hierarchy from the FEM problem
+  eigen->Set_Operators(Ks, topOpt->K);
+  ierr = eigen->Set_Hierarchy(topOpt->PR, topOpt->MG_comms); CHKERRQ(ierr);
   // Set target eigenvalues
   Nev_Type target_type = TOTAL_NEV;
-  lopgmres.Set_Target(LR, nvals, target_type);
-  lopgmres.Set_MaxIt(500);//150*(PetscInt)std::log(topOpt->nElem));
-  lopgmres.Set_Tol(std::pow(10,std::log10(2*topOpt->nNode)/2-9));
+  eigen->Set_Target(LR, nvals, target_type);
+  eigen->Set_MaxIt(500);//150*(PetscInt)std::log(topOpt->nElem));
+  eigen->Set_Tol(std::pow(10,std::log10(2*topOpt->nNode)/2-9));
+  // A new solver starts from any stored modes (e.g. from a checkpoint)
+  if (fresh) {
+    ierr = Seed_Eigen(topOpt, eigen, topOpt->bucklingShape); CHKERRQ(ierr);
+  }
   // Compute the eigenvalues
   double tEigStart = MPI_Wtime();
-  ierr = lopgmres.Compute(); CHKERRQ(ierr);
+  ierr = eigen->Compute(); CHKERRQ(ierr);
   double tEigEnd = MPI_Wtime();
-  PetscInt itEig = lopgmres.Get_It();
+  PetscInt itEig = eigen->Get_It();
 
   // Get the results
-  PetscInt nev_conv = lopgmres.Get_nev_conv();
+  PetscInt nev_conv = eigen->Get_nev_conv();
+  eigenReq = nvals; eigenConv = nev_conv; eigenIts = itEig;
+  eigenTime = tEigEnd-tEigStart;
   if (nev_conv == 0) {
     char name_suffix[30];
     sprintf(name_suffix, "_eigen_failure");
     ierr = topOpt->PrintVals(name_suffix); CHKERRQ(ierr);
+    ierr = topOpt->snapshot->Wait(); CHKERRQ(ierr);
     SETERRQ(topOpt->comm, PETSC_ERR_CONV_FAILED, "Eigensolver found 0 eigenvalues\n");
   } 
   ArrayXPS lambda(nev_conv);
-  lopgmres.Get_Eigenvalues(lambda.data());
+  eigen->Get_Eigenvalues(lambda.data());
 
   // Aggregate eigenvalues
   PetscScalar p = 8; //TODO: make this an option to set
@@ -97,7 +111,7 @@ PetscErrorCode Stability::Function(TopOpt *topOpt)
 
   // Make sure we have enough room for all eigenvectors
   Vec *phi, phi_copy;
-  lopgmres.Get_Eigenvectors(&phi);
+  eigen->Get_Eigenvectors(&phi);
   topOpt->bucklingShape.resize(topOpt->bucklingShape.rows(), nev_conv);
   ierr = VecDuplicate(topOpt->U, &phi_copy); CHKERRQ(ierr);
   for (int i = 0; i < nev_conv; i++) {
@@ -113,6 +127,7 @@ PetscErrorCode Stability::Function(TopOpt *topOpt)
   /// Dot product of eigenvectors expanded to triplet form
   /// to match unassembled stiffness matrices
   MatrixXPS phim((DE*DE)*topOpt->gElem.rows(), nev_conv);
+  phimSize = phim.size();
   for (long el = 0; el < topOpt->gElem.rows(); el++) {
     ArrayXPI eDof(DE);
     for (int i = 0; i < NE; i++) {
@@ -196,7 +211,9 @@ PetscErrorCode Stability::Function(TopOpt *topOpt)
     ierr = VecPlaceArray(v_vec, v.data() + i*dKsdU.rows()); CHKERRQ(ierr);
     ierr = VecSet(v_vec, 0.0); CHKERRQ(ierr);
     double t0 = MPI_Wtime();
+    ierr = PetscLogEventBegin(topOpt->adjointEvent, 0, 0, 0, 0); CHKERRQ(ierr);
     ierr = KSPSolve(topOpt->KUF, dKsdU_vec, v_vec); CHKERRQ(ierr);
+    ierr = PetscLogEventEnd(topOpt->adjointEvent, 0, 0, 0, 0); CHKERRQ(ierr);
     double t1 = MPI_Wtime();
     PetscInt its;
     ierr = KSPGetIterationNumber(topOpt->KUF, &its); CHKERRQ(ierr);
@@ -204,6 +221,8 @@ PetscErrorCode Stability::Function(TopOpt *topOpt)
     itAdjoint += its;
     KSPConvergedReason reason;
     ierr = KSPGetConvergedReason(topOpt->KUF, &reason); CHKERRQ(ierr);
+    if (i == 0 || reason < adjointReason)
+      adjointReason = reason;
     if (topOpt->verbose >= 1 and reason > 0) {
       ierr = PetscFPrintf(topOpt->comm, topOpt->output, "Solve for adjoint "
                     "equation #%i converged in %i iterations with reason: %i\n",
@@ -220,6 +239,7 @@ PetscErrorCode Stability::Function(TopOpt *topOpt)
   }
   ierr = VecDestroy(&dKsdU_vec); CHKERRQ(ierr);
   ierr = VecDestroy(&v_vec); CHKERRQ(ierr);
+  adjointIts = itAdjoint; adjointTime = tAdjoint;
 
   // dlamdrhof
   VectorXPS U_loc(DE);
@@ -412,3 +432,38 @@ MatrixXPS Stability::sigtos(VectorXPS sigma)
 
   return sigma;
 }
+
+/********************************************************************
+ * Bytes held by the function, by structure. The mode shape products
+ * are only allocated during an evaluation.
+ * 
+ * @param usage: Name and bytes of each structure (appended to)
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode Stability::Memory(std::vector<std::pair<std::string, double> > &usage)
+{
+  PetscErrorCode ierr = 0;
+  ierr = Function_Base::Memory(usage); CHKERRQ(ierr);
+
+  std::string prefix = std::string(name[func_type]) + " ";
+  double bytes;
+  ierr = Mat_Memory(Ks, bytes); CHKERRQ(ierr);
+  usage.push_back(std::make_pair(prefix + "Ks", bytes));
+  usage.push_back(std::make_pair(prefix + "dKsdy",
+                  (double)dKsdy.size()*sizeof(PetscScalar)));
+  bytes = 0;
+  for (unsigned int i = 0; i < dKsdu.size(); i++)
+    bytes += dKsdu[i].size()*sizeof(PetscScalar);
+  usage.push_back(std::make_pair(prefix + "dKsdu", bytes));
+  usage.push_back(std::make_pair(prefix + "adjoint",
+                  (double)v.size()*sizeof(PetscScalar)));
+  usage.push_back(std::make_pair(prefix + "phim",
+                  (double)phimSize*sizeof(PetscScalar)));
+  if (eigen) {
+    ierr = eigen->Memory(prefix, usage); CHKERRQ(ierr);
+  }
+
+  return ierr;
+}
@@ -0,0 +1,269 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <petscviewer.h>
+#include "Snapshot.h"
+
+static char help[] = "Converts compact snapshots to PETSc binary files.\n\n"
+  "  -Decode_Files <a.snap,b.snap,...>: Snapshots to convert; each is\n"
+  "      written next to itself with the extension .bin\n"
+  "  -Decode_Test <n>: Write snapshots of n values per process in\n"
+  "      every encoding and check them against full precision copies\n\n";
+
+using namespace std;
+
+// Encodings and fields written by the round trip test
+static const char *encNames[3] = {"float", "uint16", "uint8"};
+static const SNAPSHOT_ENCODING encodings[3] = {SNAP_FLOAT, SNAP_UINT16, SNAP_UINT8};
+static const char *fieldNames[2] = {"x", "U"};
+
+/********************************************************************
+ * Decode a compact snapshot and write it in the same layout as
+ * VecView, which is how full precision snapshots are stored
+ *
+ * @param snapname: Name of the compact snapshot
+ * @param binname: Name of the file to write
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+static PetscErrorCode Convert(const string &snapname, const string &binname)
+{
+  PetscErrorCode ierr = 0;
+
+  vector<PetscScalar> values;
+  ierr = Snapshot::Decode(snapname.c_str(), values); CHKERRQ(ierr);
+
+  Vec v;
+  PetscViewer view;
+  ierr = VecCreateSeqWithArray(PETSC_COMM_SELF, 1, values.size(), values.data(), &v);
+            CHKERRQ(ierr);
+  ierr = PetscViewerBinaryOpen(PETSC_COMM_SELF, binname.c_str(), FILE_MODE_WRITE,
+                               &view); CHKERRQ(ierr);
+  ierr = VecView(v, view); CHKERRQ(ierr);
+  ierr = PetscViewerDestroy(&view); CHKERRQ(ierr);
+  ierr = VecDestroy(&v); CHKERRQ(ierr);
+
+  return ierr;
+}
+
+/********************************************************************
+ * Read a full precision snapshot
+ *
+ * @param filename: Name of the file
+ * @param values: All values in global order (output)
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+static PetscErrorCode Load(const string &filename, vector<PetscScalar> &values)
+{
+  PetscErrorCode ierr = 0;
+
+  Vec v;
+  PetscViewer view;
+  PetscInt n;
+  const PetscScalar *p_v;
+  ierr = VecCreate(PETSC_COMM_SELF, &v); CHKERRQ(ierr);
+  ierr = VecSetType(v, VECSEQ); CHKERRQ(ierr);
+  ierr = PetscViewerBinaryOpen(PETSC_COMM_SELF, filename.c_str(), FILE_MODE_READ,
+                               &view); CHKERRQ(ierr);
+  ierr = VecLoad(v, view); CHKERRQ(ierr);
+  ierr = PetscViewerDestroy(&view); CHKERRQ(ierr);
+  ierr = VecGetSize(v, &n); CHKERRQ(ierr);
+  ierr = VecGetArrayRead(v, &p_v); CHKERRQ(ierr);
+  values.assign(p_v, p_v+n);
+  ierr = VecRestoreArrayRead(v, &p_v); CHKERRQ(ierr);
+  ierr = VecDestroy(&v); CHKERRQ(ierr);
+
+  return ierr;
+}
+
+/********************************************************************
+ * Write a few steps of a smoothly changing density-like field in
+ * [0, 1] and a signed displacement-like field in every encoding, each
+ * alongside a full precision copy. The keyframe interval makes the
+ * middle steps delta snapshots.
+ *
+ * @param comm: Communicator to write with
+ * @param nLocal: Number of values on this process
+ * @param nSteps: Number of steps to write
+ * @param keyframe: Keyframe interval
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+static PetscErrorCode Write_Test(MPI_Comm comm, PetscInt nLocal, int nSteps,
+                                 int keyframe)
+{
+  PetscErrorCode ierr = 0;
+
+  PetscInt first = 0;
+  ierr = MPI_Exscan(&nLocal, &first, 1, MPIU_INT, MPI_SUM, comm); CHKERRQ(ierr);
+  int myid;
+  MPI_Comm_rank(comm, &myid);
+  if (myid == 0)
+    first = 0;
+
+  vector<PetscScalar> x(nLocal), U(nLocal);
+  char filename[100];
+  for (short e = 0; e < 3; e++) {
+    Snapshot snapshot(comm);
+    snapshot.Set_Encoding(encodings[e], keyframe);
+    for (int step = 0; step < nSteps; step++) {
+      for (PetscInt i = 0; i < nLocal; i++) {
+        PetscScalar t = 0.01*(first+i) + 0.05*step;
+        x[i] = 0.5 + 0.45*sin(t);
+        U[i] = 3*sin(t)*cos(0.3*t);
+      }
+      PetscScalar *fields[2] = {x.data(), U.data()};
+      for (short f = 0; f < 2; f++) {
+        sprintf(filename, "Decode_Test_%s_%s%i.snap", encNames[e], fieldNames[f], step);
+        ierr = snapshot.Add_Compact(filename, fieldNames[f], fields[f], nLocal);
+                  CHKERRQ(ierr);
+        sprintf(filename, "Decode_Test_%s_%s%i.bin", encNames[e], fieldNames[f], step);
+        ierr = snapshot.Add(filename, fields[f], nLocal); CHKERRQ(ierr);
+      }
+      ierr = snapshot.Start(); CHKERRQ(ierr);
+    }
+    ierr = snapshot.Wait(); CHKERRQ(ierr);
+  }
+
+  return ierr;
+}
+
+/********************************************************************
+ * Decode the snapshots from Write_Test and compare them with the full
+ * precision copies. Floats must match to single precision, and
+ * quantized values to half a quantization step of the range the
+ * encoder picks. The files are removed if everything matches.
+ *
+ * @param nSteps: Number of steps written
+ * @param keyframe: Keyframe interval
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+static PetscErrorCode Check_Test(int nSteps, int keyframe)
+{
+  PetscErrorCode ierr = 0;
+
+  char snapname[100], binname[100];
+  vector<PetscScalar> decoded, exact;
+  for (short e = 0; e < 3; e++) {
+    PetscReal worst = 0;
+    int nDelta = 0;
+    for (int step = 0; step < nSteps; step++) {
+      for (short f = 0; f < 2; f++) {
+        sprintf(snapname, "Decode_Test_%s_%s%i.snap", encNames[e], fieldNames[f], step);
+        sprintf(binname, "Decode_Test_%s_%s%i.bin", encNames[e], fieldNames[f], step);
+        ierr = Snapshot::Decode(snapname, decoded); CHKERRQ(ierr);
+        ierr = Load(binname, exact); CHKERRQ(ierr);
+        if (decoded.size() != exact.size())
+          SETERRQ1(PETSC_COMM_SELF, PETSC_ERR_PLIB, "%s has the wrong length", snapname);
+
+        // Snapshots between keyframes should refer to the previous step
+        SnapHeader header;
+        ifstream file(snapname, ios::binary);
+        file.read((char*)&header, sizeof(header));
+        bool delta = header.reference[0] != 0;
+        if (delta != ((step % keyframe) != 0))
+          SETERRQ1(PETSC_COMM_SELF, PETSC_ERR_PLIB, "%s has the wrong keyframe", snapname);
+        nDelta += delta;
+
+        PetscReal maxabs = 0, err = 0;
+        bool unit = true;
+        for (size_t i = 0; i < exact.size(); i++) {
+          maxabs = max(maxabs, (PetscReal)fabs(exact[i]));
+          unit = unit && exact[i] >= 0 && exact[i] <= 1;
+          err = max(err, (PetscReal)fabs(decoded[i] - exact[i]));
+        }
+        PetscReal tol;
+        if (encodings[e] == SNAP_FLOAT) {
+          tol = 1e-7*maxabs;
+        }
+        else {
+          PetscReal range = unit ? 1 : 2*pow(2, ceil(log2(maxabs)));
+          PetscReal Q = (encodings[e] == SNAP_UINT16) ? 65535 : 255;
+          tol = 0.5*range/Q*(1 + 1e-10);
+        }
+        if (err > tol)
+          SETERRQ3(PETSC_COMM_SELF, PETSC_ERR_PLIB, "%s differs from the full "
+                   "precision copy by %1.4g (allowed %1.4g)", snapname, err, tol);
+        worst = max(worst, err/tol);
+      }
+    }
+    ierr = PetscPrintf(PETSC_COMM_SELF, "%-6s: %i delta snapshots, largest error "
+                       "%1.3f of the allowed\n", encNames[e], nDelta, worst); CHKERRQ(ierr);
+  }
+
+  for (short e = 0; e < 3; e++) {
+    for (int step = 0; step < nSteps; step++) {
+      for (short f = 0; f < 2; f++) {
+        sprintf(snapname, "Decode_Test_%s_%s%i.snap", encNames[e], fieldNames[f], step);
+        sprintf(binname, "Decode_Test_%s_%s%i.bin", encNames[e], fieldNames[f], step);
+        remove(snapname);
+        remove(binname);
+      }
+    }
+  }
+
+  return ierr;
+}
+
+int main(int argc, char **args)
+{
+  /// MPI Variables
+  int myid;
+  PetscErrorCode ierr = 0;
+  PetscInitialize(&argc, &args, (char*)0, help);
+  MPI_Comm comm = PETSC_COMM_WORLD;
+  MPI_Comm_rank(comm, &myid);
+
+  /// Round trip test in every encoding
+  PetscInt nTest = 0;
+  PetscBool test;
+  ierr = PetscOptionsGetInt(NULL, NULL, "-Decode_Test", &nTest, &test); CHKERRQ(ierr);
+  if (test) {
+    int nSteps = 4, keyframe = 3;
+    ierr = Write_Test(comm, nTest > 0 ? nTest : 1000, nSteps, keyframe); CHKERRQ(ierr);
+    // Every process must learn if the first one failed before returning
+    PetscErrorCode checkErr = 0;
+    if (myid == 0)
+      checkErr = Check_Test(nSteps, keyframe);
+    ierr = MPI_Bcast(&checkErr, 1, MPI_INT, 0, comm); CHKERRQ(ierr);
+    if (checkErr != 0)
+      SETERRQ(comm, PETSC_ERR_PLIB, "Compact snapshot round trip failed");
+    ierr = PetscPrintf(comm, "All compact snapshots match their full precision copies\n");
+              CHKERRQ(ierr);
+  }
+
+  /// Convert the snapshots given on the command line (serial)
+  char *names[1000];
+  PetscInt nFiles = 1000;
+  ierr = PetscOptionsGetStringArray(NULL, NULL, "-Decode_Files", names, &nFiles, NULL);
+            CHKERRQ(ierr);
+  PetscErrorCode convertErr = 0;
+  for (PetscInt i = 0; i < nFiles; i++) {
+    string snapname = names[i], binname = snapname;
+    if (binname.size() > 5 && binname.substr(binname.size()-5) == ".snap")
+      binname.erase(binname.size()-5);
+    binname += ".bin";
+    if (myid == 0 && convertErr == 0) {
+      convertErr = Convert(snapname, binname);
+      if (convertErr == 0)
+        printf("%s -> %s\n", snapname.c_str(), binname.c_str());
+    }
+    ierr = PetscFree(names[i]); CHKERRQ(ierr);
+  }
+  ierr = MPI_Bcast(&convertErr, 1, MPI_INT, 0, comm); CHKERRQ(ierr);
+  if (convertErr != 0)
+    SETERRQ(comm, PETSC_ERR_FILE_WRITE, "Unable to convert the snapshots");
+
+  ierr = PetscFinalize(); CHKERRQ(ierr);
+
+  return ierr;
+}
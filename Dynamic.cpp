@@ -54,34 +54,50 @@ PetscErrorCode Frequency::Function(TopOpt *topOpt)
     ierr = KSPSetUp(topOpt->KUF); CHKERRQ(ierr);
   }
 
-  // Set ouptput parameters for lopgmres
-  lopgmres.Set_Verbose(topOpt->verbose);
-  lopgmres.Set_File(topOpt->output);
-  
-  // Get restrictors from FEM problem
+  // Create the eigensolver on first use
+  bool fresh = (eigen == NULL);
+  if (fresh) {
+    ierr = EigenPeetz::Create(eigen_type, topOpt->comm, &eigen); CHKERRQ(ierr);
+  }
+
+  // Set ouptput parameters for eigensolver
+  eigen->Set_Verbose(topOpt->verbose);
+  eigen->Set_File(topOpt->output);
+
+  // Set the preconditioner
   PC pc;
   ierr = KSPGetPC(topOpt->KUF, &pc); CHKERRQ(ierr);
-  ierr = lopgmres.Set_PC(pc); CHKERRQ(ierr);
+  ierr = eigen->Set_PC(pc); CHKERRQ(ierr);
 
-  // Set Operators
-  lopgmres.Set_Operators(M, topOpt->K);
+  // Set Operators and the hierarchy from the FEM problem
+  eigen->Set_Operators(M, topOpt->K);
+  ierr = eigen->Set_Hierarchy(topOpt->PR, topOpt->MG_comms); CHKERRQ(ierr);
   // Set target eigenvalues
   Nev_Type target_type = UNIQUE_LAST_NEV;
-  lopgmres.Set_Target(LR, nvals, target_type);
-  lopgmres.Set_Tol(std::pow(10, std::log10(2*topOpt->nNode)/2-9));
-  lopgmres.Set_MaxIt(3*(nvals+1)*50*(PetscInt)std::log(topOpt->nElem));
-  ierr = lopgmres.Compute(); CHKERRQ(ierr);
+  eigen->Set_Target(LR, nvals, target_type);
+  eigen->Set_Tol(std::pow(10, std::log10(2*topOpt->nNode)/2-9));
+  eigen->Set_MaxIt(3*(nvals+1)*50*(PetscInt)std::log(topOpt->nElem));
+  // A new solver starts from any stored modes (e.g. from a checkpoint)
+  if (fresh) {
+    ierr = Seed_Eigen(topOpt, eigen, topOpt->dynamicShape); CHKERRQ(ierr);
+  }
+  double tEigStart = MPI_Wtime();
+  ierr = eigen->Compute(); CHKERRQ(ierr);
+  double tEigEnd = MPI_Wtime();
 
   // Get the results
-  PetscInt nev_conv = lopgmres.Get_nev_conv();
+  PetscInt nev_conv = eigen->Get_nev_conv();
+  eigenReq = nvals; eigenConv = nev_conv; eigenIts = eigen->Get_It();
+  eigenTime = tEigEnd-tEigStart;
   if (nev_conv == 0) {
     char name_suffix[30];
     sprintf(name_suffix, "_eigen_failure");
     ierr = topOpt->PrintVals(name_suffix); CHKERRQ(ierr);
+    ierr = topOpt->snapshot->Wait(); CHKERRQ(ierr);
     SETERRQ(topOpt->comm, PETSC_ERR_CONV_FAILED, "Eigensolver found 0 eigenvalues\n");
   }
   ArrayXPS lambda(nev_conv);
-  lopgmres.Get_Eigenvalues(lambda.data());
+  eigen->Get_Eigenvalues(lambda.data());
 
   // Aggregate eigenvalues
   PetscScalar p = 8; //TODO: make this an option to set
@@ -93,7 +109,7 @@ PetscErrorCode Frequency::Function(TopOpt *topOpt)
 
   // Make sure we have enough room for all eigenvectors
   Vec *phi, phi_copy;
-  lopgmres.Get_Eigenvectors(&phi);
+  eigen->Get_Eigenvectors(&phi);
   topOpt->dynamicShape.resize(topOpt->dynamicShape.rows(), nev_conv);
   ierr = VecDuplicate(topOpt->U, &phi_copy); CHKERRQ(ierr);
   for (int i = 0; i < nev_conv; i++) {
@@ -109,6 +125,7 @@ PetscErrorCode Frequency::Function(TopOpt *topOpt)
   /// Dot product of eigenvectors expanded to triplet form
   /// to match unassembled stiffness matrices
   MatrixXPS phim((DE*DE)*topOpt->nLocElem, nev_conv);
+  phimSize = phim.size();
   for (long el = 0; el < topOpt->nLocElem; el++) {
     ArrayXPI eDof(DE);
     for (int i = 0; i < NE; i++) {
@@ -233,4 +250,31 @@ PetscErrorCode Frequency::DiagMassFnc(TopOpt *topOpt)
   ierr = MatDiagonalSet(M, topOpt->MLump, ADD_VALUES); CHKERRQ(ierr);
 
   return 0;
-}
\ No newline at end of file
+}
+
+/********************************************************************
+ * Bytes held by the function, by structure. The mode shape products
+ * are only allocated during an evaluation.
+ * 
+ * @param usage: Name and bytes of each structure (appended to)
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode Frequency::Memory(vector<pair<string, double> > &usage)
+{
+  PetscErrorCode ierr = 0;
+  ierr = Function_Base::Memory(usage); CHKERRQ(ierr);
+
+  string prefix = string(name[func_type]) + " ";
+  double bytes;
+  ierr = Mat_Memory(M, bytes); CHKERRQ(ierr);
+  usage.push_back(make_pair(prefix + "M", bytes));
+  usage.push_back(make_pair(prefix + "dMdy", (double)dMdy.size()*sizeof(PetscScalar)));
+  usage.push_back(make_pair(prefix + "phim", (double)phimSize*sizeof(PetscScalar)));
+  if (eigen) {
+    ierr = eigen->Memory(prefix, usage); CHKERRQ(ierr);
+  }
+
+  return ierr;
+}
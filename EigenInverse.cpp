@@ -19,6 +19,9 @@ extern "C" {
  * @param pc: preconditioner instance
  * 
  * @return ierr: PetscErrorCode
+ * 
+ * @options: -eigen_shell_update_tol: Relative size of the off-diagonal
+ *           part of Q'*A*Q below which only the spectrum is updated
  *******************************************************************/
 PetscErrorCode CreateEigenShell(PC pc)
 {
@@ -27,9 +30,24 @@ PetscErrorCode CreateEigenShell(PC pc)
   EigenShellPC *eigenPC = new EigenShellPC;
   eigenPC->n = 0;
   eigenPC->nLoc = 0;
+  eigenPC->nRigid = 0;
+  eigenPC->Aref = NULL;
+  eigenPC->nzState = 0;
+  eigenPC->nLocCol = 0;
   eigenPC->lam = NULL;
+  eigenPC->lamInv = NULL;
   eigenPC->Q = NULL;
+  eigenPC->Aseq = NULL;
+  eigenPC->scatter = NULL;
+  eigenPC->xseq = NULL;
+  eigenPC->yseq = NULL;
+  eigenPC->updateTol = 1e-2;
   eigenPC->SetUp = false;
+  MPI_Comm_rank(PetscObjectComm((PetscObject)pc), &eigenPC->rank);
+  const char *prefix;
+  ierr = PCGetOptionsPrefix(pc, &prefix); CHKERRQ(ierr);
+  ierr = PetscOptionsGetReal(NULL, prefix, "-eigen_shell_update_tol",
+                             &eigenPC->updateTol, NULL); CHKERRQ(ierr);
 
   ierr = PCShellSetContext(pc, eigenPC); CHKERRQ(ierr);
 
@@ -37,51 +55,67 @@ PetscErrorCode CreateEigenShell(PC pc)
 }
 
 /********************************************************************
- * Setup the shell preconditioner (perform the eigendecomposition)
+ * Free the gathered operator and the scatter to the first process
  * 
- * @param pc: preconditioner instance
+ * @param eigenPC: shell preconditioner context
  * 
  * @return ierr: PetscErrorCode
  *******************************************************************/
-PetscErrorCode EigenShellSetUp(PC pc)
+static PetscErrorCode EigenShellResetGather(EigenShellPC *eigenPC)
 {
   PetscErrorCode ierr = 0;
 
-  EigenShellPC *eigenPC;
-  ierr = PCShellGetContext(pc, (void**)&eigenPC); CHKERRQ(ierr);
+  if (eigenPC->Aseq != NULL) {
+    ierr = MatDestroySubMatrices(1, &eigenPC->Aseq); CHKERRQ(ierr);
+    eigenPC->Aseq = NULL;
+  }
+  ierr = VecScatterDestroy(&eigenPC->scatter); CHKERRQ(ierr);
+  ierr = VecDestroy(&eigenPC->xseq); CHKERRQ(ierr);
+  ierr = VecDestroy(&eigenPC->yseq); CHKERRQ(ierr);
+  ierr = MatDestroy(&eigenPC->Aref); CHKERRQ(ierr);
 
-  Mat A;
-  ierr = PCGetOperators(pc, &A, NULL); CHKERRQ(ierr);
-  ierr = MatGetSize(A, &eigenPC->n, NULL); CHKERRQ(ierr);
-  ierr = MatGetLocalSize(A, &eigenPC->nLoc, NULL); CHKERRQ(ierr);
+  return ierr;
+}
 
-  if (eigenPC->nLoc == 0)
-    return 0;
-  else if (eigenPC->nLoc != eigenPC->n)
-    SETERRQ(PetscObjectComm((PetscObject)pc), PETSC_ERR_SUP,
-            "Coarsest matrix is split across multiple processes");
-  
-  // Allocate EigenShellPC data structures
-  PetscInt n = eigenPC->n;
-  if (!eigenPC->SetUp) {
-    eigenPC->Q = new PetscScalar[n*n];
-    eigenPC->lam = new PetscScalar[n];
-  }
+/********************************************************************
+ * Free the decomposition and gathered operator
+ * 
+ * @param eigenPC: shell preconditioner context
+ * 
+ * @return ierr: PetscErrorCode
+ *******************************************************************/
+static PetscErrorCode EigenShellReset(EigenShellPC *eigenPC)
+{
+  PetscErrorCode ierr = 0;
 
-  // Get A in a dense format
-  PetscInt ncols;
-  const PetscInt *cols;
-  const PetscScalar *vals;
-  std::fill(eigenPC->Q, eigenPC->Q + n*n, 0);
-  for (PetscInt i = 0; i < n; i++) {
-    ierr = MatGetRow(A, i, &ncols, &cols, &vals);
-    for (PetscInt j = 0; j < ncols; j++) {
-      eigenPC->Q[n*cols[j] + i] = vals[j];
-    }
-    ierr = MatRestoreRow(A, i, &ncols, &cols, &vals); CHKERRQ(ierr);
+  if (eigenPC->SetUp) {
+    delete[] eigenPC->Q;
+    delete[] eigenPC->lam;
+    delete[] eigenPC->lamInv;
+    eigenPC->Q = NULL; eigenPC->lam = NULL; eigenPC->lamInv = NULL;
   }
+  ierr = EigenShellResetGather(eigenPC); CHKERRQ(ierr);
+  eigenPC->SetUp = false;
+
+  return ierr;
+}
+
+/********************************************************************
+ * Full eigendecomposition of the gathered operator. Small eigenvalues
+ * (rigid modes) are counted so they can be left out of the inverse.
+ * 
+ * @param eigenPC: shell preconditioner context
+ * @param A: dense coarse operator (column major)
+ * 
+ * @return ierr: PetscErrorCode
+ *******************************************************************/
+static PetscErrorCode EigenShellDecompose(EigenShellPC *eigenPC, PetscScalar *A)
+{
+  PetscErrorCode ierr = 0;
 
   // Call lapack routines to calculate eigenvalues and eigenvectors of system
+  PetscInt n = eigenPC->n;
+  std::copy(A, A + n*n, eigenPC->Q);
   PetscScalar *e = new PetscScalar[n-1];
   PetscScalar *tau = new PetscScalar[n-1], *work = new PetscScalar[n*n];
   PetscBLASInt lwork = n*n, info = 0;
@@ -90,33 +124,199 @@ PetscErrorCode EigenShellSetUp(PC pc)
   dorgtr_(&c, &n, eigenPC->Q, &n, tau, work, &lwork, &info);
   c = 'V';
   dsteqr_(&c, &n, eigenPC->lam, e, eigenPC->Q, &n, work, &info);
+  delete[] e; delete[] tau; delete[] work;
 
-  // Invert eigenvalues. Small eigenvalues (rigid modes) are set to zero
+  // Small eigenvalues (rigid modes) are skipped in the inverse
   PetscInt ind = 0;
   while (true) {
     if (std::abs(eigenPC->lam[ind] / eigenPC->lam[ind+1]) < 1e-3) {
-      eigenPC->lam[ind++] = 0;
+      ind++;
       break;
     }
     else {
-      eigenPC->lam[ind++] = 0;
+      ind++;
     }
     if (ind == n-1) {
-      eigenPC->lam[ind] = 0;
-      ierr = PetscPrintf(PetscObjectComm((PetscObject)pc), "Warning, all eigenvalues are "
+      ierr = PetscPrintf(PETSC_COMM_SELF, "Warning, all eigenvalues are "
                         "of similar magnitude in coarse operator.\nRoutines will assume "
                         "that the coarse operator has no non-rigid modes\n"); CHKERRQ(ierr);
       ind++;
       break;
     }
   }
-  while (ind < n) {
-    eigenPC->lam[ind] = 1/eigenPC->lam[ind];
-    ind++;
+  eigenPC->nRigid = ind;
+
+  return ierr;
+}
+
+/********************************************************************
+ * Update only the eigenvalues using the previous eigenvectors. This
+ * is used when Q'*A*Q is still nearly diagonal. Since Q is orthogonal,
+ * the off-diagonal part of Q'*A*Q has the same norm as A*Q - Q*diag(lam),
+ * so only the sparse product A*Q is needed rather than two dense
+ * matrix-matrix products.
+ * 
+ * @param eigenPC: shell preconditioner context
+ * @param A: sparse coarse operator on this process
+ * @param updated: flag indicating if the update was accepted
+ * 
+ * @return ierr: PetscErrorCode
+ *******************************************************************/
+static PetscErrorCode EigenShellUpdate(EigenShellPC *eigenPC, Mat A,
+                                       bool &updated)
+{
+  PetscErrorCode ierr = 0;
+
+  // AQ = A*Q, one row at a time
+  PetscInt n = eigenPC->n;
+  PetscScalar *Q = eigenPC->Q, *AQ = new PetscScalar[n*n];
+  PetscInt ncols;
+  const PetscInt *cols;
+  const PetscScalar *vals;
+  for (PetscInt i = 0; i < n; i++) {
+    ierr = MatGetRow(A, i, &ncols, &cols, &vals); CHKERRQ(ierr);
+    for (PetscInt k = 0; k < n; k++) {
+      PetscScalar sum = 0;
+      for (PetscInt j = 0; j < ncols; j++)
+        sum += vals[j]*Q[n*k+cols[j]];
+      AQ[n*k+i] = sum;
+    }
+    ierr = MatRestoreRow(A, i, &ncols, &cols, &vals); CHKERRQ(ierr);
+  }
+
+  // Rayleigh quotients and the residual of each eigenpair
+  PetscScalar *lam = new PetscScalar[n];
+  PetscReal diag = 0, offdiag = 0;
+  for (PetscInt k = 0; k < n; k++) {
+    lam[k] = 0;
+    for (PetscInt i = 0; i < n; i++)
+      lam[k] += Q[n*k+i]*AQ[n*k+i];
+    for (PetscInt i = 0; i < n; i++) {
+      PetscScalar r = AQ[n*k+i] - lam[k]*Q[n*k+i];
+      offdiag += r*r;
+    }
+    diag += lam[k]*lam[k];
+  }
+  updated = (offdiag <= eigenPC->updateTol*eigenPC->updateTol*diag);
+  if (updated)
+    std::copy(lam, lam + n, eigenPC->lam);
+  delete[] AQ; delete[] lam;
+
+  return ierr;
+}
+
+/********************************************************************
+ * Setup the shell preconditioner (perform the eigendecomposition).
+ * The coarse operator is gathered onto the first process so it does
+ * not need to be stored on a single process beforehand. If the
+ * operator changed only slightly since the last setup, only the
+ * eigenvalues are recomputed.
+ * 
+ * @param pc: preconditioner instance
+ * 
+ * @return ierr: PetscErrorCode
+ *******************************************************************/
+PetscErrorCode EigenShellSetUp(PC pc)
+{
+  PetscErrorCode ierr = 0;
+
+  EigenShellPC *eigenPC;
+  ierr = PCShellGetContext(pc, (void**)&eigenPC); CHKERRQ(ierr);
+
+  Mat A;
+  PetscInt n, nLoc, nLocCol;
+  PetscObjectState nzState;
+  ierr = PCGetOperators(pc, &A, NULL); CHKERRQ(ierr);
+  ierr = MatGetSize(A, &n, NULL); CHKERRQ(ierr);
+  ierr = MatGetLocalSize(A, &nLoc, &nLocCol); CHKERRQ(ierr);
+  ierr = MatGetNonzeroState(A, &nzState); CHKERRQ(ierr);
+  if (eigenPC->SetUp && n != eigenPC->n) {
+    ierr = EigenShellReset(eigenPC); CHKERRQ(ierr);
+  }
+
+  // The gathered operator and scatter can only be reused for the same
+  // operator with the same nonzero pattern and layout. The layout may
+  // change on some processes only, so they must agree on rebuilding.
+  // The decomposition is kept as the starting point of an update.
+  PetscMPIInt changed = (A != eigenPC->Aref) || (nzState != eigenPC->nzState) ||
+                        (nLoc != eigenPC->nLoc) || (nLocCol != eigenPC->nLocCol);
+  ierr = MPI_Allreduce(MPI_IN_PLACE, &changed, 1, MPI_INT, MPI_LOR,
+                       PetscObjectComm((PetscObject)pc)); CHKERRQ(ierr);
+  if (changed) {
+    ierr = EigenShellResetGather(eigenPC); CHKERRQ(ierr);
+  }
+  eigenPC->n = n;
+  eigenPC->nLoc = nLoc;
+  eigenPC->nLocCol = nLocCol;
+  eigenPC->nzState = nzState;
+  if (eigenPC->Aref == NULL) {
+    ierr = PetscObjectReference((PetscObject)A); CHKERRQ(ierr);
+    eigenPC->Aref = A;
   }
 
+  // Gather the operator onto the first process
+  IS is;
+  ierr = ISCreateStride(PETSC_COMM_SELF, eigenPC->rank == 0 ? n : 0, 0, 1, &is);
+    CHKERRQ(ierr);
+  if (eigenPC->Aseq == NULL) {
+    ierr = MatCreateSubMatrices(A, 1, &is, &is, MAT_INITIAL_MATRIX,
+                                &eigenPC->Aseq); CHKERRQ(ierr);
+  }
+  else {
+    ierr = MatCreateSubMatrices(A, 1, &is, &is, MAT_REUSE_MATRIX,
+                                &eigenPC->Aseq); CHKERRQ(ierr);
+  }
+  ierr = ISDestroy(&is); CHKERRQ(ierr);
+  if (eigenPC->scatter == NULL) {
+    Vec x;
+    ierr = MatCreateVecs(A, &x, NULL); CHKERRQ(ierr);
+    ierr = VecScatterCreateToZero(x, &eigenPC->scatter, &eigenPC->xseq); CHKERRQ(ierr);
+    ierr = VecDuplicate(eigenPC->xseq, &eigenPC->yseq); CHKERRQ(ierr);
+    ierr = VecDestroy(&x); CHKERRQ(ierr);
+  }
+
+  if (eigenPC->rank != 0) {
+    eigenPC->SetUp = true;
+    return 0;
+  }
+
+  // Allocate EigenShellPC data structures
+  bool full = !eigenPC->SetUp;
+  if (!eigenPC->SetUp) {
+    eigenPC->Q = new PetscScalar[n*n];
+    eigenPC->lam = new PetscScalar[n];
+    eigenPC->lamInv = new PetscScalar[n];
+  }
+
+  // Try updating the spectrum only, otherwise do the full decomposition
+  if (!full) {
+    bool updated;
+    ierr = EigenShellUpdate(eigenPC, eigenPC->Aseq[0], updated); CHKERRQ(ierr);
+    full = !updated;
+  }
+  if (full) {
+    // Get A in a dense format
+    PetscInt ncols;
+    const PetscInt *cols;
+    const PetscScalar *vals;
+    PetscScalar *Adense = new PetscScalar[n*n];
+    std::fill(Adense, Adense + n*n, 0);
+    for (PetscInt i = 0; i < n; i++) {
+      ierr = MatGetRow(eigenPC->Aseq[0], i, &ncols, &cols, &vals); CHKERRQ(ierr);
+      for (PetscInt j = 0; j < ncols; j++) {
+        Adense[n*cols[j] + i] = vals[j];
+      }
+      ierr = MatRestoreRow(eigenPC->Aseq[0], i, &ncols, &cols, &vals); CHKERRQ(ierr);
+    }
+    ierr = EigenShellDecompose(eigenPC, Adense); CHKERRQ(ierr);
+    delete[] Adense;
+  }
+
+  // Invert eigenvalues. Rigid modes are set to zero
+  for (PetscInt i = 0; i < n; i++)
+    eigenPC->lamInv[i] = (i < eigenPC->nRigid) ? 0 : 1/eigenPC->lam[i];
+
   eigenPC->SetUp = true;
-  delete[] e; delete[] tau; delete[] work;
 
   return ierr;
 }
@@ -136,30 +336,40 @@ PetscErrorCode EigenShellApply(PC pc, Vec x, Vec y)
 
   EigenShellPC *eigenPC;
   ierr = PCShellGetContext(pc, (void**)&eigenPC); CHKERRQ(ierr);
-  if (eigenPC->nLoc == 0)
-    return 0;
 
-  const PetscScalar *p_x;
-  PetscScalar *p_y, *p_z;
-  ierr = VecGetArrayRead(x, &p_x); CHKERRQ(ierr);
-  ierr = VecGetArray(y, &p_y); CHKERRQ(ierr);
-  p_z = new PetscScalar[eigenPC->n];
-
-  PetscBLASInt inc = 1;
-  PetscScalar one = 1, zero = 0;
-  char c = 'T';
-  dgemv_(&c, &eigenPC->n, &eigenPC->n, &one, eigenPC->Q,
-         &eigenPC->n, p_x, &inc, &zero, p_z, &inc);
-  for (PetscInt i = 0; i < eigenPC->n; i++)
-    p_z[i] = p_z[i] * eigenPC->lam[i];
-  c = 'N';
-  dgemv_(&c, &eigenPC->n, &eigenPC->n, &one, eigenPC->Q,
-         &eigenPC->n, p_z, &inc, &zero, p_y, &inc);
-  
-  delete[] p_z;
-  ierr = VecRestoreArray(y, &p_y); CHKERRQ(ierr);
-  ierr = VecRestoreArrayRead(x, &p_x); CHKERRQ(ierr);
-  
+  ierr = VecScatterBegin(eigenPC->scatter, x, eigenPC->xseq, INSERT_VALUES,
+                         SCATTER_FORWARD); CHKERRQ(ierr);
+  ierr = VecScatterEnd(eigenPC->scatter, x, eigenPC->xseq, INSERT_VALUES,
+                       SCATTER_FORWARD); CHKERRQ(ierr);
+
+  if (eigenPC->rank == 0) {
+    const PetscScalar *p_x;
+    PetscScalar *p_y, *p_z;
+    ierr = VecGetArrayRead(eigenPC->xseq, &p_x); CHKERRQ(ierr);
+    ierr = VecGetArray(eigenPC->yseq, &p_y); CHKERRQ(ierr);
+    p_z = new PetscScalar[eigenPC->n];
+
+    PetscBLASInt inc = 1;
+    PetscScalar one = 1, zero = 0;
+    char c = 'T';
+    dgemv_(&c, &eigenPC->n, &eigenPC->n, &one, eigenPC->Q,
+           &eigenPC->n, p_x, &inc, &zero, p_z, &inc);
+    for (PetscInt i = 0; i < eigenPC->n; i++)
+      p_z[i] = p_z[i] * eigenPC->lamInv[i];
+    c = 'N';
+    dgemv_(&c, &eigenPC->n, &eigenPC->n, &one, eigenPC->Q,
+           &eigenPC->n, p_z, &inc, &zero, p_y, &inc);
+
+    delete[] p_z;
+    ierr = VecRestoreArray(eigenPC->yseq, &p_y); CHKERRQ(ierr);
+    ierr = VecRestoreArrayRead(eigenPC->xseq, &p_x); CHKERRQ(ierr);
+  }
+
+  ierr = VecScatterBegin(eigenPC->scatter, eigenPC->yseq, y, INSERT_VALUES,
+                         SCATTER_REVERSE); CHKERRQ(ierr);
+  ierr = VecScatterEnd(eigenPC->scatter, eigenPC->yseq, y, INSERT_VALUES,
+                       SCATTER_REVERSE); CHKERRQ(ierr);
+
   return ierr;
 }
 
@@ -176,11 +386,8 @@ PetscErrorCode EigenShellDestroy(PC pc)
 
   EigenShellPC *eigenPC;
   ierr = PCShellGetContext(pc, (void**)&eigenPC); CHKERRQ(ierr);
-  if (eigenPC->SetUp) {
-    delete[] eigenPC->Q;
-    delete[] eigenPC->lam;
-  }
+  ierr = EigenShellReset(eigenPC); CHKERRQ(ierr);
   delete eigenPC;
 
   return ierr;
-}
\ No newline at end of file
+}
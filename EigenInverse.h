@@ -1,8 +1,22 @@
 #include <petscksp.h>
 
 typedef struct {
-  PetscInt n, nLoc;
-  PetscScalar *lam, *Q;
+  PetscInt n, nLoc, nRigid;
+  PetscMPIInt rank;
+  // Operator (referenced), nonzero pattern, and column layout the
+  // gathered operator and scatter were built for
+  Mat Aref;
+  PetscObjectState nzState;
+  PetscInt nLocCol;
+  // Eigenvalues, inverted eigenvalues and eigenvectors (column major)
+  PetscScalar *lam, *lamInv, *Q;
+  // Coarse operator gathered onto the first process of the PC
+  Mat *Aseq;
+  // Scatter to/from the first process for applying the PC
+  VecScatter scatter;
+  Vec xseq, yseq;
+  // Relative off-diagonal size allowed for a spectrum-only update
+  PetscReal updateTol;
   bool SetUp;
 } EigenShellPC;
 
@@ -10,4 +24,4 @@ typedef struct {
 PetscErrorCode CreateEigenShell(PC pc);
 PetscErrorCode EigenShellSetUp(PC pc);
 PetscErrorCode EigenShellApply(PC pc, Vec x, Vec y);
-PetscErrorCode EigenShellDestroy(PC pc);
\ No newline at end of file
+PetscErrorCode EigenShellDestroy(PC pc);
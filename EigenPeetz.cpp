@@ -3,6 +3,9 @@
 #include <sstream>
 #include <numeric>
 #include "EigenPeetz.h"
+#include "LOPGMRES.h"
+#include "JDMG.h"
+#include "EigenSLEPc.h"
 #include "EigLab.h"
 
 using namespace std;
@@ -17,6 +20,8 @@ void daxpy_(const int *N, const double *a, const double *x, const int *incx,
 //TODO: Investigate the whether eigensolver in Eigen is sufficient or if solvers
 // in BLAS/LAPACK are necessary for performance (for subspace problem)
 
+const char *EigenPeetz::name[] = {"LOPGMRES", "JDMG", "SLEPc", "LOBPCG"};
+
 /********************************************************************
  * Initialize Variables and Petsc logging functionality (called
  * when program starts, similar to PetscInitialize)
@@ -40,6 +45,7 @@ PetscErrorCode EigenPeetz::Initialize()
   ierr = PetscLogEventRegister("EIG_MGSetup", 0, &EIG_MGSetup); CHKERRQ(ierr);
   ierr = PetscLogEventRegister("EIG_Precondition", 0, &EIG_Precondition); CHKERRQ(ierr);
   ierr = PetscLogEventRegister("EIG_Jacobi", 0, &EIG_Jacobi); CHKERRQ(ierr);
+  ierr = PetscLogEventRegister("EIG_Chebyshev", 0, &EIG_Chebyshev); CHKERRQ(ierr);
 
   PetscInt mg_levels = 30;
   EIG_ApplyOP  = new PetscLogEvent[mg_levels-1];
@@ -82,6 +88,98 @@ PetscErrorCode EigenPeetz::Finalize()
   return ierr;
 }
 
+/********************************************************************
+ * Bytes held by the local part of a matrix, counting the values and
+ * column indices allocated and the row offsets
+ * 
+ * @param A: The matrix (may be NULL)
+ * @param bytes: Bytes held on this process (output)
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode Mat_Memory(Mat A, double &bytes)
+{
+  PetscErrorCode ierr = 0;
+  bytes = 0;
+  if (A == NULL)
+    return ierr;
+
+  MatInfo info;
+  PetscInt m, n;
+  ierr = MatGetInfo(A, MAT_LOCAL, &info); CHKERRQ(ierr);
+  ierr = MatGetLocalSize(A, &m, &n); CHKERRQ(ierr);
+  bytes = info.nz_allocated*(sizeof(PetscScalar)+sizeof(PetscInt)) +
+          (m+1)*sizeof(PetscInt);
+
+  return ierr;
+}
+
+/********************************************************************
+ * Bytes held by the local part of a vector, including ghost values
+ * 
+ * @param v: The vector (may be NULL)
+ * @param bytes: Bytes held on this process (output)
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode Vec_Memory(Vec v, double &bytes)
+{
+  PetscErrorCode ierr = 0;
+  bytes = 0;
+  if (v == NULL)
+    return ierr;
+
+  Vec local;
+  PetscInt n;
+  ierr = VecGhostGetLocalForm(v, &local); CHKERRQ(ierr);
+  if (local) {
+    ierr = VecGetLocalSize(local, &n); CHKERRQ(ierr);
+    ierr = VecGhostRestoreLocalForm(v, &local); CHKERRQ(ierr);
+  }
+  else {
+    ierr = VecGetLocalSize(v, &n); CHKERRQ(ierr);
+  }
+  bytes = n*sizeof(PetscScalar);
+
+  return ierr;
+}
+
+/********************************************************************
+ * Create an eigensolver of the requested type
+ * 
+ * @param type: The solver to use (LOPGMRES, JDMG, SLEPc, or LOBPCG)
+ * @param comm: MPI communicator for the solver
+ * @param solver: The new solver, to be deleted by the caller
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode EigenPeetz::Create(EIGEN_TYPE type, MPI_Comm comm, EigenPeetz **solver)
+{
+  switch (type) {
+    case LOPGMRES_SOLVER:
+      *solver = new LOPGMRES(comm);
+      break;
+    case JDMG_SOLVER:
+      *solver = new JDMG(comm);
+      break;
+    case SLEPC_SOLVER:
+      *solver = new EigenSLEPc(comm);
+      break;
+    case LOBPCG_SOLVER: {
+      EigenSLEPc *lobpcg = new EigenSLEPc(comm);
+      lobpcg->Set_Type(EPSLOBPCG);
+      *solver = lobpcg;
+      break;
+    }
+    default:
+      SETERRQ1(comm, PETSC_ERR_SUP, "Unknown eigensolver type %i", (int)type);
+  }
+  return 0;
+}
+
 /********************************************************************
  * The main constructor
  * 
@@ -89,6 +187,7 @@ PetscErrorCode EigenPeetz::Finalize()
 EigenPeetz::EigenPeetz()
 {
   n = 0;
+  phi = NULL;
   nev_req = 6; nev_conv = 0;
   tau = LM;
   tau_num = 0;
@@ -116,6 +215,43 @@ EigenPeetz::~EigenPeetz()
   PetscErrorCode ierr = Close_File(); CHKERRV(ierr);
 }
 
+/********************************************************************
+ * Bytes held by the solver: the coarse operators of the hierarchy
+ * and the converged eigenvectors
+ * 
+ * @param prefix: Prepended to the name of each structure
+ * @param usage: Name and bytes of each structure (appended to)
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode EigenPeetz::Memory(std::string prefix,
+                                  std::vector<std::pair<std::string, double> > &usage)
+{
+  PetscErrorCode ierr = 0;
+  double bytes, total = 0;
+
+  // The finest operators belong to the caller
+  for (unsigned int ii = 1; ii < A.size(); ii++) {
+    ierr = Mat_Memory(A[ii], bytes); CHKERRQ(ierr);
+    total += bytes;
+  }
+  for (unsigned int ii = 1; ii < B.size(); ii++) {
+    ierr = Mat_Memory(B[ii], bytes); CHKERRQ(ierr);
+    total += bytes;
+  }
+  usage.push_back(std::make_pair(prefix + "coarse operators", total));
+
+  total = 0;
+  if (phi != NULL && nev_conv > 0) {
+    ierr = Vec_Memory(phi[0], bytes); CHKERRQ(ierr);
+    total = nev_conv*bytes;
+  }
+  usage.push_back(std::make_pair(prefix + "eigenvectors", total));
+
+  return ierr;
+}
+
 /********************************************************************
  * Set how much information the subroutines print
  * 
@@ -287,6 +423,33 @@ PetscErrorCode EigenPeetz::Set_MaxIt(PetscInt maxit)
   return ierr;
 }
 
+/********************************************************************
+ * Provide approximate eigenvectors (e.g. from a checkpoint) to start
+ * the next compute step from. They are kept as the previous solution.
+ * 
+ * @param nvec: Number of vectors
+ * @param vecs: The vectors, with the layout of the operators
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode EigenPeetz::Set_Initial_Space(PetscInt nvec, Vec *vecs)
+{
+  PetscErrorCode ierr = 0;
+  if (nev_conv > 0) {
+    ierr = VecDestroyVecs(nev_conv, &phi); CHKERRQ(ierr);
+  }
+  nev_conv = nvec;
+  if (nvec == 0)
+    return 0;
+  ierr = VecDuplicateVecs(vecs[0], nvec, &phi); CHKERRQ(ierr);
+  for (PetscInt ii = 0; ii < nvec; ii++) {
+    ierr = VecCopy(vecs[ii], phi[ii]); CHKERRQ(ierr);
+  }
+  lambda.setZero(nvec);
+  return ierr;
+}
+
 /********************************************************************
  * Check if all eigenvalues have been found
  * 
@@ -378,33 +541,50 @@ PetscErrorCode EigenPeetz::Icgsm(Vec *Q, Mat M, Vec u, PetscScalar &r, PetscInt
   Vec um;
   ierr = VecDuplicate(u, &um); CHKERRQ(ierr);
   ierr = MatMult(M, u, um); CHKERRQ(ierr);
-  PetscScalar r0;
-  ierr = VecDot(u, um, &r0); CHKERRQ(ierr);
+  // The norm of each pass and the projections for the next pass share
+  // one reduction. The caller may pass an entry of TempScal as r, so the
+  // projections and norms are kept in local storage until the end.
+  ArrayXPS proj(k);
+  PetscScalar r0, r1;
+  ierr = VecDotBegin(u, um, &r0); CHKERRQ(ierr);
+  ierr = VecMDotBegin(um, k, Q, proj.data()); CHKERRQ(ierr);
+  ierr = PetscCommSplitReductionBegin(PetscObjectComm((PetscObject)u)); CHKERRQ(ierr);
+  ierr = VecDotEnd(u, um, &r0); CHKERRQ(ierr);
+  ierr = VecMDotEnd(um, k, Q, proj.data()); CHKERRQ(ierr);
   r0 = sqrt(r0);
   while (true) {
-    ierr = VecMDot(um, k, Q, TempScal.data()); CHKERRQ(ierr);
-    TempScal *= -1;
-    ierr = VecMAXPY(u, k, TempScal.data(), Q); CHKERRQ(ierr);
+    proj *= -1;
+    ierr = VecMAXPY(u, k, proj.data(), Q); CHKERRQ(ierr);
     //ierr = GS(Q, um, u, k); CHKERRQ(ierr);
     ierr = MatMult(M, u, um); CHKERRQ(ierr);
-    ierr = VecDot(u, um, &r); CHKERRQ(ierr);
-    r = sqrt(r);
-    if (r > alpha*r0 || it > itmax)
+    ierr = VecDotBegin(u, um, &r1); CHKERRQ(ierr);
+    // No further pass is possible after the last one
+    if (it <= itmax) {
+      ierr = VecMDotBegin(um, k, Q, proj.data()); CHKERRQ(ierr);
+    }
+    ierr = PetscCommSplitReductionBegin(PetscObjectComm((PetscObject)u)); CHKERRQ(ierr);
+    ierr = VecDotEnd(u, um, &r1); CHKERRQ(ierr);
+    if (it <= itmax) {
+      ierr = VecMDotEnd(um, k, Q, proj.data()); CHKERRQ(ierr);
+    }
+    r1 = sqrt(r1);
+    if (r1 > alpha*r0 || it > itmax)
       break;
-    it++; r0 = r;
+    it++; r0 = r1;
   }
-  if (r <= alpha*r0) {
+  r = r1;
+  ierr = VecDestroy(&um); CHKERRQ(ierr);
+  if (r1 <= alpha*r0) {
     ierr = PetscFPrintf(this->comm, this->output, "Breakdown in ICGSM routine\n");
     return -1;
   }
 
-  ierr = VecDestroy(&um); CHKERRQ(ierr);
-
   return 0;
 }
 
 /********************************************************************
- * Modified M-orthogonal Gram-Schmidt 
+ * M-orthogonal Gram-Schmidt against converged (M-orthonormal) vectors.
+ * All projections are computed in a single reduction
  * 
  * @param Q: Vectors to orthogonalize against
  * @param BQ: Vectors multiplied by matrix defining the inner product
@@ -418,10 +598,9 @@ PetscErrorCode EigenPeetz::Mgsm(Vec* Q, Vec* BQ, Vec u, PetscInt k)
 {
   PetscErrorCode ierr = 0;
 
-  for (int ii = 0; ii < k; ii++) {
-    ierr = VecDot(u, BQ[ii], TempScal.data()); CHKERRQ(ierr);
-    ierr = VecAXPY(u, -TempScal(0), Q[ii]); CHKERRQ(ierr);
-  }
+  ierr = VecMDot(u, k, BQ, TempScal.data()); CHKERRQ(ierr);
+  TempScal.segment(0,k) *= -1;
+  ierr = VecMAXPY(u, k, TempScal.data(), Q); CHKERRQ(ierr);
 
   return 0;
 }
@@ -3,6 +3,7 @@
 
 #include <slepceps.h>
 #include <vector>
+#include <string>
 #include <Eigen/Eigen>
 #include <algorithm>
 
@@ -17,11 +18,16 @@ typedef Eigen::Array<PetscScalar, -1, 1>  ArrayXPS;
 extern PetscLogEvent EIG_Compute;
 extern PetscLogEvent EIG_Initialize, EIG_Prep, EIG_Convergence, EIG_Expand, EIG_Update;
 extern PetscLogEvent EIG_Comp_Init, EIG_Hierarchy, EIG_Setup_Coarse, EIG_Comp_Coarse;
-extern PetscLogEvent EIG_MGSetup, EIG_Precondition, EIG_Jacobi, *EIG_ApplyOP;
+extern PetscLogEvent EIG_MGSetup, EIG_Precondition, EIG_Jacobi, EIG_Chebyshev, *EIG_ApplyOP;
 extern PetscLogEvent *EIG_ApplyOP1, *EIG_ApplyOP2, *EIG_ApplyOP3, *EIG_ApplyOP4;
 
 enum Tau {NUMERIC, LM, LR, LA, SM, SR, SA };
 enum Nev_Type {TOTAL_NEV, UNIQUE_NEV, UNIQUE_LAST_NEV};
+enum EIGEN_TYPE {LOPGMRES_SOLVER, JDMG_SOLVER, SLEPC_SOLVER, LOBPCG_SOLVER};
+
+// Bytes held by the local part of a matrix or vector (0 if it doesn't exist)
+PetscErrorCode Mat_Memory(Mat A, double &bytes);
+PetscErrorCode Vec_Memory(Vec v, double &bytes);
 
 /// The master structure containing all information to be carried between iterations
 class EigenPeetz
@@ -39,7 +45,11 @@ public:
   EigenPeetz();
   EigenPeetz(MPI_Comm comm);
   // Destructor
-  ~EigenPeetz();
+  virtual ~EigenPeetz();
+  // Create a solver of the requested type
+  static PetscErrorCode Create(EIGEN_TYPE type, MPI_Comm comm, EigenPeetz **solver);
+  // Names of solver types
+  static const char *name[];
   // How much information to print
   virtual PetscErrorCode Set_Verbose(PetscInt verbose);
   // Where to print the information
@@ -56,6 +66,12 @@ public:
   PetscErrorCode Set_Tol(PetscScalar tol);
   PetscErrorCode Set_MaxIt(PetscInt maxit);
   PetscInt Get_It() {return it;}
+  // Preconditioner and multigrid hierarchy (ignored by solvers that don't use them)
+  virtual PetscErrorCode Set_PC(PC pc) {return 0;}
+  virtual PetscErrorCode Set_Hierarchy(std::vector<Mat> P,
+    const std::vector<MPI_Comm> MG_comms = std::vector<MPI_Comm>()) {return 0;}
+  // Approximate eigenvectors to start the next compute step from
+  virtual PetscErrorCode Set_Initial_Space(PetscInt nvec, Vec *vecs);
   // Solver
   virtual PetscErrorCode Compute() = 0;
   // Get results
@@ -64,6 +80,9 @@ public:
   void Get_Eigenvectors(Vec** phi) {*phi = this->phi;}
   void Get_Eigenvalues(PetscScalar* lambda)
     {std::copy(this->lambda.data(), this->lambda.data()+this->nev_conv, lambda);}
+  // Bytes held by the solver, by structure
+  virtual PetscErrorCode Memory(std::string prefix,
+                                std::vector<std::pair<std::string, double> > &usage);
 
   // Loggers
   static PetscErrorCode Initialize();
@@ -0,0 +1,276 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <numeric>
+#include "EigenSLEPc.h"
+
+using namespace std;
+
+/********************************************************************
+ * Apply the wrapped preconditioner inside the spectral transformation
+ *
+ * @param shell: Shell preconditioner holding the wrapped PC
+ * @param x: vector to apply preconditioner to
+ * @param y: vector that will store the result of applying pc to x
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+static PetscErrorCode EigenSLEPcPCApply(PC shell, Vec x, Vec y)
+{
+  PetscErrorCode ierr = 0;
+  PC pc;
+  ierr = PCShellGetContext(shell, (void**)&pc); CHKERRQ(ierr);
+  ierr = PCApply(pc, x, y); CHKERRQ(ierr);
+  return ierr;
+}
+
+/********************************************************************
+ * Main constructor
+ *
+ * @param comm: MPI communicator for the object
+ *
+ *******************************************************************/
+EigenSLEPc::EigenSLEPc(MPI_Comm comm)
+{
+  this->comm = comm; Set_ID();
+  eps_solver = NULL;
+  pc = NULL;
+  type = EPSKRYLOVSCHUR;
+  tSolve = 0; lin_it = 0;
+  PetscOptionsGetInt(NULL, NULL, "-EigenSLEPc_Verbose", &verbose, NULL);
+  PetscFOpen(this->comm, "stdout", "w", &output);
+  file_opened = 1;
+}
+
+/********************************************************************
+ * Main destructor
+ *
+ *******************************************************************/
+EigenSLEPc::~EigenSLEPc()
+{
+  PetscErrorCode ierr = EPSDestroy(&eps_solver); CHKERRV(ierr);
+  ierr = PCDestroy(&pc); CHKERRV(ierr);
+}
+
+/********************************************************************
+ * How much information to print
+ *
+ * @param verbose: The higher the number, the more to print
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode EigenSLEPc::Set_Verbose(PetscInt verbose)
+{
+  this->verbose = verbose;
+  PetscErrorCode ierr = PetscOptionsGetInt(NULL, NULL, "-EigenSLEPc_Verbose",
+                                           &this->verbose, NULL);
+  CHKERRQ(ierr);
+  return 0;
+}
+
+/********************************************************************
+ * Set the preconditioner used in the spectral transformation. It
+ * should approximate the inverse of the B operator (e.g. the KUF PC)
+ *
+ * @param pc: The preconditioner
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode EigenSLEPc::Set_PC(PC pc)
+{
+  PetscErrorCode ierr = 0;
+  ierr = PetscObjectReference((PetscObject)pc); CHKERRQ(ierr);
+  ierr = PCDestroy(&this->pc); CHKERRQ(ierr);
+  this->pc = pc;
+  return ierr;
+}
+
+/********************************************************************
+ * Compute the eigenmodes of the specified system
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode EigenSLEPc::Compute()
+{
+  PetscErrorCode ierr = 0;
+  ierr = PetscLogEventBegin(EIG_Compute, 0, 0, 0, 0); CHKERRQ(ierr);
+  if (this->verbose >= 3)
+    ierr = PetscFPrintf(comm, output, "Computing\n"); CHKERRQ(ierr);
+
+  ierr = PetscLogEventBegin(EIG_Initialize, 0, 0, 0, 0); CHKERRQ(ierr);
+  ierr = Compute_Init(); CHKERRQ(ierr);
+  ierr = PetscLogEventEnd(EIG_Initialize, 0, 0, 0, 0); CHKERRQ(ierr);
+
+  // Track wall time and inner iterations for comparison with other solvers
+  ST st; KSP ksp; PetscInt lin_it0;
+  ierr = EPSGetST(eps_solver, &st); CHKERRQ(ierr);
+  ierr = STGetKSP(st, &ksp); CHKERRQ(ierr);
+  ierr = KSPGetTotalIterations(ksp, &lin_it0); CHKERRQ(ierr);
+  double t0 = MPI_Wtime();
+  ierr = EPSSolve(eps_solver); CHKERRQ(ierr);
+  tSolve = MPI_Wtime() - t0;
+  ierr = EPSGetIterationNumber(eps_solver, &it); CHKERRQ(ierr);
+  ierr = KSPGetTotalIterations(ksp, &lin_it); CHKERRQ(ierr);
+  lin_it -= lin_it0;
+
+  ierr = Extract_Eigenpairs(); CHKERRQ(ierr);
+  if (this->verbose >= 1) {
+    ierr = Print_Result(); CHKERRQ(ierr);
+  }
+
+  ierr = PetscLogEventEnd(EIG_Compute, 0, 0, 0, 0); CHKERRQ(ierr);
+  return 0;
+}
+
+/********************************************************************
+ * Preps the EPS object for computing the eigenmodes
+ *
+ * @return ierr: PetscErrorCode
+ *
+ * @options: Any EPS option with the prefix -EigenSLEPc_ (e.g.
+ *           -EigenSLEPc_eps_type, -EigenSLEPc_st_ksp_type)
+ *
+ *******************************************************************/
+PetscErrorCode EigenSLEPc::Compute_Init()
+{
+  PetscErrorCode ierr = 0;
+  if (this->verbose >= 3)
+    ierr = PetscFPrintf(comm, output, "Initializing compute structures\n"); CHKERRQ(ierr);
+
+  ierr = PetscLogEventBegin(EIG_Comp_Init, 0, 0, 0, 0); CHKERRQ(ierr);
+
+  if (eps_solver == NULL) {
+    ierr = EPSCreate(comm, &eps_solver); CHKERRQ(ierr);
+    ierr = EPSSetOptionsPrefix(eps_solver, "EigenSLEPc_"); CHKERRQ(ierr);
+  }
+  ierr = EPSSetType(eps_solver, type); CHKERRQ(ierr);
+  ierr = EPSSetOperators(eps_solver, A[0], B[0]); CHKERRQ(ierr);
+  ierr = EPSSetProblemType(eps_solver, EPS_GHEP); CHKERRQ(ierr);
+  ierr = Setup_ST(); CHKERRQ(ierr);
+
+  // Translate the target eigenvalues
+  switch (tau) {
+    case NUMERIC:
+      ierr = EPSSetTarget(eps_solver, tau_num); CHKERRQ(ierr);
+      ierr = EPSSetWhichEigenpairs(eps_solver, EPS_TARGET_MAGNITUDE); CHKERRQ(ierr);
+      break;
+    case LM:
+      ierr = EPSSetWhichEigenpairs(eps_solver, EPS_LARGEST_MAGNITUDE); CHKERRQ(ierr);
+      break;
+    case SM:
+      ierr = EPSSetWhichEigenpairs(eps_solver, EPS_SMALLEST_MAGNITUDE); CHKERRQ(ierr);
+      break;
+    case LR: case LA:
+      ierr = EPSSetWhichEigenpairs(eps_solver, EPS_LARGEST_REAL); CHKERRQ(ierr);
+      break;
+    case SR: case SA:
+      ierr = EPSSetWhichEigenpairs(eps_solver, EPS_SMALLEST_REAL); CHKERRQ(ierr);
+      break;
+  }
+  // Extra modes are requested when unique eigenvalues are needed
+  ierr = EPSSetDimensions(eps_solver, Qsize, PETSC_DEFAULT, PETSC_DEFAULT); CHKERRQ(ierr);
+  ierr = EPSSetTolerances(eps_solver, eps, maxit); CHKERRQ(ierr);
+
+  // Start from the last set of eigenvectors if there are any
+  if (nev_conv > 0) {
+    ierr = EPSSetInitialSpace(eps_solver, nev_conv, phi); CHKERRQ(ierr);
+    ierr = VecDestroyVecs(nev_conv, &phi); CHKERRQ(ierr);
+  }
+  nev_conv = 0;
+
+  ierr = EPSSetFromOptions(eps_solver); CHKERRQ(ierr);
+
+  ierr = PetscLogEventEnd(EIG_Comp_Init, 0, 0, 0, 0); CHKERRQ(ierr);
+
+  return 0;
+}
+
+/********************************************************************
+ * Use the preconditioner in the spectral transformation. Krylov-Schur
+ * works on inv(B)*A (shift-and-invert of the B problem about zero)
+ * with a CG solve on B, while LOBPCG uses the preconditioner directly.
+ * The PC is wrapped in a shell so that the ST never resets the
+ * operators of the original PC.
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode EigenSLEPc::Setup_ST()
+{
+  PetscErrorCode ierr = 0;
+  if (pc == NULL)
+    return 0;
+
+  ST st; KSP ksp; PC shell;
+  ierr = EPSGetST(eps_solver, &st); CHKERRQ(ierr);
+  ierr = STGetKSP(st, &ksp); CHKERRQ(ierr);
+  ierr = KSPGetPC(ksp, &shell); CHKERRQ(ierr);
+  ierr = PCSetType(shell, PCSHELL); CHKERRQ(ierr);
+  ierr = PCShellSetContext(shell, pc); CHKERRQ(ierr);
+  ierr = PCShellSetApply(shell, EigenSLEPcPCApply); CHKERRQ(ierr);
+  ierr = PCShellSetName(shell, "EigenSLEPc"); CHKERRQ(ierr);
+
+  PetscBool isLOBPCG;
+  ierr = PetscStrcmp(type, EPSLOBPCG, &isLOBPCG); CHKERRQ(ierr);
+  if (isLOBPCG) {
+    ierr = STSetType(st, STPRECOND); CHKERRQ(ierr);
+    ierr = KSPSetType(ksp, KSPPREONLY); CHKERRQ(ierr);
+  }
+  else {
+    ierr = STSetType(st, STSHIFT); CHKERRQ(ierr);
+    ierr = STSetShift(st, 0.0); CHKERRQ(ierr);
+    ierr = KSPSetType(ksp, KSPCG); CHKERRQ(ierr);
+    ierr = KSPSetTolerances(ksp, std::min(eps*1e-2, 1e-8), PETSC_DEFAULT,
+                            PETSC_DEFAULT, PETSC_DEFAULT); CHKERRQ(ierr);
+  }
+
+  return 0;
+}
+
+/********************************************************************
+ * Get the converged eigenpairs from the EPS object and B-normalize
+ * the eigenvectors to match the other EigenPeetz solvers
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode EigenSLEPc::Extract_Eigenpairs()
+{
+  PetscErrorCode ierr = 0;
+  if (this->verbose >= 3)
+    ierr = PetscFPrintf(comm, output, "Extracting eigenpairs\n"); CHKERRQ(ierr);
+
+  PetscInt nconv;
+  ierr = EPSGetConverged(eps_solver, &nconv); CHKERRQ(ierr);
+  lambda.resize(nconv);
+  for (PetscInt ii = 0; ii < nconv; ii++) {
+    ierr = EPSGetEigenvalue(eps_solver, ii, lambda.data()+ii, NULL); CHKERRQ(ierr);
+  }
+
+  // Only keep as many modes as the target requires
+  for (nev_conv = std::min(nconv, (PetscInt)1); nev_conv < nconv; nev_conv++) {
+    if (Done())
+      break;
+  }
+  lambda.conservativeResize(nev_conv);
+  if (nev_conv == 0)
+    return 0;
+
+  Vec Bphi;
+  ierr = MatCreateVecs(A[0], &Bphi, NULL); CHKERRQ(ierr);
+  ierr = VecDuplicateVecs(Bphi, nev_conv, &phi); CHKERRQ(ierr);
+  PetscScalar norm;
+  for (PetscInt ii = 0; ii < nev_conv; ii++) {
+    ierr = EPSGetEigenvector(eps_solver, ii, phi[ii], NULL); CHKERRQ(ierr);
+    ierr = MatMult(B[0], phi[ii], Bphi); CHKERRQ(ierr);
+    ierr = VecDot(phi[ii], Bphi, &norm); CHKERRQ(ierr);
+    ierr = VecScale(phi[ii], 1/sqrt(norm)); CHKERRQ(ierr);
+  }
+  ierr = VecDestroy(&Bphi); CHKERRQ(ierr);
+
+  return 0;
+}
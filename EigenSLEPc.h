@@ -0,0 +1,59 @@
+#ifndef EigenSLEPc_H_INCLUDED
+#define EigenSLEPc_H_INCLUDED
+
+#include <slepceps.h>
+#include <vector>
+#include <Eigen/Eigen>
+#include <algorithm>
+#include "EigenPeetz.h"
+
+/// Wrapper around a SLEPc EPS object using the EigenPeetz interface
+class EigenSLEPc : public EigenPeetz
+{
+  /// Class variables
+public:
+  /// Class methods
+  // Constructors
+  EigenSLEPc(MPI_Comm comm=MPI_COMM_WORLD);
+  // Destructor
+  ~EigenSLEPc();
+  // How much information to print
+  PetscErrorCode Set_Verbose(PetscInt verbose);
+  // Set the preconditioner instance (used for the spectral transformation)
+  PetscErrorCode Set_PC(PC pc);
+  // Set the SLEPc solver (Krylov-Schur or LOBPCG)
+  void Set_Type(EPSType type) {this->type = type;}
+  // Solver
+  PetscErrorCode Compute();
+  // Wall time and linear solver iterations of last compute step
+  double Get_Time() {return tSolve;}
+  PetscInt Get_Linear_It() {return lin_it;}
+
+private:
+  /// Class variables
+  // SLEPc eigensolver
+  EPS eps_solver;
+  EPSType type;
+  // Preconditioner instance
+  PC pc;
+  // Wall time and inner iterations
+  double tSolve;
+  PetscInt lin_it;
+  /// Private methods
+  // Prepare EPS object for compute step
+  PetscErrorCode Compute_Init();
+  // Set up the spectral transformation with the preconditioner
+  PetscErrorCode Setup_ST();
+  // Extract and normalize the converged eigenpairs
+  PetscErrorCode Extract_Eigenpairs();
+  // Output information
+  PetscErrorCode Print_Result() {
+    return PetscFPrintf(comm, output, "SLEPc %s found %i of a requested %i "
+                        "eigenvalues after %i iterations (%i linear iterations) "
+                        "in %1.4g seconds\n\n", type, nev_conv, nev_req, it,
+                        lin_it, tSolve);
+  }
+
+};
+
+#endif // EigenSLEPc_H_INCLUDED
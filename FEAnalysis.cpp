@@ -59,7 +59,8 @@ PetscErrorCode TopOpt::GetNearNullSpace(Vec **NullVecs)
 }
 
 /********************************************************************
- * Constructs an AMG preconditioner for the coarse GMG solver
+ * Constructs an AMG preconditioner for the coarse GMG solver, on only
+ * the processes holding the coarsest level if it was agglomerated
  * 
  * @param pc: The GMG preconditioner
  * 
@@ -71,21 +72,16 @@ PetscErrorCode TopOpt::SetUpHybridPC(PC pc)
   PetscErrorCode ierr = 0;
 
   KSP smooth_ksp;
-  PC smooth_pc;
+  PC smooth_pc, amg_pc;
   Mat A;
   PetscInt levels;
 
-  // Grab the coarse solver and set it to be GAMG
+  // Grab the coarse solver
   ierr = PCMGGetLevels(pc, &levels); CHKERRQ(ierr);
   ierr = PCMGGetCoarseSolve(pc, &smooth_ksp); CHKERRQ(ierr);
   ierr = KSPSetType(smooth_ksp, KSPPREONLY); CHKERRQ(ierr);
   ierr = KSPGetPC(smooth_ksp, &smooth_pc); CHKERRQ(ierr);
   ierr = KSPGetOperators(smooth_ksp, &A, NULL); CHKERRQ(ierr);
-  ierr = PCSetType(smooth_pc, PCGAMG); CHKERRQ(ierr);
-  PetscReal threshold = 0.003;
-  ierr = PetscOptionsGetReal(NULL, "kuf_mg_coarse_", "-pc_gamg_threshold",
-                            &threshold, NULL); CHKERRQ(ierr);
-  ierr = PCGAMGSetThreshold(smooth_pc, &threshold, 1); CHKERRQ(ierr);
 
   // Project the Nullspace vectors to the coarse level
   Vec *NullVecs;
@@ -137,23 +133,53 @@ PetscErrorCode TopOpt::SetUpHybridPC(PC pc)
   ierr = MatNullSpaceDestroy(&Rigid); CHKERRQ(ierr);
   ierr = VecDestroyVecs(nRBM, &NullVecs); CHKERRQ(ierr);
 
+  // If the coarsest level was agglomerated onto fewer processes, the AMG
+  // solve runs on a communicator of only those processes
+  PetscInt nLocRows;
+  PetscMPIInt active, nActive;
+  ierr = MatGetLocalSize(A, &nLocRows, NULL); CHKERRQ(ierr);
+  active = (nLocRows > 0);
+  ierr = MPI_Allreduce(&active, &nActive, 1, MPI_INT, MPI_SUM, comm); CHKERRQ(ierr);
+  amg_pc = smooth_pc;
+  if (nActive < this->nprocs) {
+    KSP inner_ksp;
+    ierr = PCSetType(smooth_pc, PCTELESCOPE); CHKERRQ(ierr);
+    ierr = PCTelescopeSetSubcommType(smooth_pc, PETSC_SUBCOMM_CONTIGUOUS); CHKERRQ(ierr);
+    ierr = PCTelescopeSetReductionFactor(smooth_pc,
+                            (this->nprocs + nActive - 1)/nActive); CHKERRQ(ierr);
+    ierr = PCSetUp(smooth_pc); CHKERRQ(ierr);
+    ierr = PCTelescopeGetKSP(smooth_pc, &inner_ksp); CHKERRQ(ierr);
+    // Nothing else to set up on processes left out of the coarse solve
+    if (inner_ksp == NULL)
+      return ierr;
+    ierr = KSPSetType(inner_ksp, KSPPREONLY); CHKERRQ(ierr);
+    ierr = KSPGetPC(inner_ksp, &amg_pc); CHKERRQ(ierr);
+  }
+
+  // Set the coarse solver to be GAMG
+  ierr = PCSetType(amg_pc, PCGAMG); CHKERRQ(ierr);
+  PetscReal threshold = 0.003;
+  ierr = PetscOptionsGetReal(NULL, "kuf_mg_coarse_", "-pc_gamg_threshold",
+                            &threshold, NULL); CHKERRQ(ierr);
+  ierr = PCGAMGSetThreshold(amg_pc, &threshold, 1); CHKERRQ(ierr);
+
   // Command line options
   PetscInt lvls=30, coarseLim=50;
   ierr = PetscOptionsGetInt(NULL, "kuf_mg_coarse_", "-pc_gamg_levels", &lvls, NULL);
     CHKERRQ(ierr);
-  ierr = PCGAMGSetNlevels(smooth_pc, lvls); CHKERRQ(ierr);
+  ierr = PCGAMGSetNlevels(amg_pc, lvls); CHKERRQ(ierr);
   ierr = PetscOptionsGetInt(NULL, "kuf_mg_coarse_", "-pc_gamg_coarse_eq_limit",
                             &coarseLim, NULL); CHKERRQ(ierr);
-  ierr = PCGAMGSetCoarseEqLim(smooth_pc, coarseLim); CHKERRQ(ierr);
-  ierr = PCSetUp(smooth_pc); CHKERRQ(ierr);
+  ierr = PCGAMGSetCoarseEqLim(amg_pc, coarseLim); CHKERRQ(ierr);
+  ierr = PCSetUp(amg_pc); CHKERRQ(ierr);
 
   // Describe the sub GAMG preconditioner
-  ierr = PCMGGetLevels(smooth_pc, &lvls); CHKERRQ(ierr);
+  ierr = PCMGGetLevels(amg_pc, &lvls); CHKERRQ(ierr);
   KSP subKSP; KSPType smooth_ksp_type;
   PC subPC; PCType smooth_pc_type;
   // Concise smoother information
   if (this->verbose == 2) {
-    ierr = PCMGGetSmoother(smooth_pc, 1, &subKSP); CHKERRQ(ierr);
+    ierr = PCMGGetSmoother(amg_pc, 1, &subKSP); CHKERRQ(ierr);
     ierr = KSPGetType(subKSP, &smooth_ksp_type); CHKERRQ(ierr);
     ierr = KSPGetPC(subKSP, &subPC); CHKERRQ(ierr);
     ierr = PCGetType(subPC, &smooth_pc_type); CHKERRQ(ierr);
@@ -164,11 +190,11 @@ PetscErrorCode TopOpt::SetUpHybridPC(PC pc)
   // Verbose smoother information
   if (this->verbose > 2) {
     PCMGType mg_type; PetscInt Asize;
-    ierr = PCMGGetType(smooth_pc, &mg_type); CHKERRQ(ierr);
+    ierr = PCMGGetType(amg_pc, &mg_type); CHKERRQ(ierr);
     ierr = PetscFPrintf(comm, output, "GAMG coarse multigrid is cycling through levels using"
                         " %s scheme\n", MGTypes[mg_type].c_str()); CHKERRQ(ierr);
     for (PetscInt i = lvls-1; i > 0; i--) {
-        ierr = PCMGGetSmoother(smooth_pc, i, &subKSP); CHKERRQ(ierr);
+        ierr = PCMGGetSmoother(amg_pc, i, &subKSP); CHKERRQ(ierr);
         ierr = KSPGetType(subKSP, &smooth_ksp_type); CHKERRQ(ierr);
         ierr = KSPGetPC(subKSP, &subPC); CHKERRQ(ierr);
         ierr = PCGetType(subPC, &smooth_pc_type); CHKERRQ(ierr);
@@ -182,7 +208,7 @@ PetscErrorCode TopOpt::SetUpHybridPC(PC pc)
   }
   // Coarse grid
   if (this->verbose >= 2) {
-    ierr = PCMGGetCoarseSolve(smooth_pc, &subKSP); CHKERRQ(ierr);
+    ierr = PCMGGetCoarseSolve(amg_pc, &subKSP); CHKERRQ(ierr);
     ierr = KSPGetType(subKSP, &smooth_ksp_type); CHKERRQ(ierr);
     ierr = KSPGetPC(subKSP, &subPC); CHKERRQ(ierr);
     ierr = PCGetType(subPC, &smooth_pc_type); CHKERRQ(ierr);
@@ -435,6 +461,7 @@ PetscErrorCode TopOpt::FEAssemble()
   if (this->verbose >= 3) {
     ierr = PetscFPrintf(comm, output, "Assembling Stiffness matrix\n"); CHKERRQ(ierr);
   }
+  ierr = PetscLogEventBegin(assembleEvent, 0, 0, 0, 0); CHKERRQ(ierr);
 
   // Grab element stiffnesses;
   const PetscScalar *p_E;
@@ -485,6 +512,7 @@ PetscErrorCode TopOpt::FEAssemble()
   
   // Set KSP operators
   ierr = KSPSetOperators(this->KUF, this->K, this->K); CHKERRQ(ierr);
+  ierr = PetscLogEventEnd(assembleEvent, 0, 0, 0, 0); CHKERRQ(ierr);
 
   return ierr;
 }
@@ -502,6 +530,8 @@ PetscErrorCode TopOpt::FEAssemble()
  * or more concisely by setting verbosity >2 in input file or from 
  * command line. If using bjacobi as coarse grid preconditioner
  * (recommended), set block solver with -kuf_mg_coarse_sub_pc_type <type>.
+ * Unsupported problems with GAMG use an eigendecomposition of the coarse
+ * operator if it has fewer than -kuf_eigen_shell_max_size rows.
  * 
  *******************************************************************/
 PetscErrorCode TopOpt::FESolve()
@@ -525,6 +555,7 @@ PetscErrorCode TopOpt::FESolve()
   }
 
   double tSetupStart = MPI_Wtime();
+  ierr = PetscLogEventBegin(PCSetupEvent, 0, 0, 0, 0); CHKERRQ(ierr);
   // Set near nullspace and strength of connection metric for gamg
   if (!strcmp(pctype,PCGAMG)) {
     levels = 30;
@@ -572,13 +603,15 @@ PetscErrorCode TopOpt::FESolve()
       ierr = PCSetUp(sub_pc); CHKERRQ(ierr);
     }
     else if (!strcmp(pctype,PCGAMG) && this->nFixDof == 0) {
-      Mat A; PetscInt coarseSize;
+      Mat A; PetscInt coarseSize, maxSize = 500;
       ierr = PCMGGetCoarseSolve(pc, &smooth_ksp); CHKERRQ(ierr);
       ierr = KSPSetType(smooth_ksp, KSPPREONLY); CHKERRQ(ierr);
       ierr = KSPGetPC(smooth_ksp, &smooth_pc); CHKERRQ(ierr);
       ierr = PCGetOperators(smooth_pc, &A, NULL); CHKERRQ(ierr);
       ierr = MatGetSize(A, &coarseSize, NULL); CHKERRQ(ierr);
-      if (coarseSize < 100) { // This is an expensive solver but good if no Dirichlet BC
+      ierr = PetscOptionsGetInt(NULL, "kuf_", "-eigen_shell_max_size", &maxSize, NULL);
+        CHKERRQ(ierr);
+      if (coarseSize < maxSize) { // This is an expensive solver but good if no Dirichlet BC
         ierr = PCSetType(smooth_pc, PCSHELL); CHKERRQ(ierr);
         ierr = CreateEigenShell(smooth_pc); CHKERRQ(ierr);
         ierr = PCShellSetSetUp(smooth_pc, EigenShellSetUp); CHKERRQ(ierr);
@@ -662,6 +695,7 @@ PetscErrorCode TopOpt::FESolve()
       ierr = SetUpHybridPC(pc); CHKERRQ(ierr);
     }
   }
+  ierr = PetscLogEventEnd(PCSetupEvent, 0, 0, 0, 0); CHKERRQ(ierr);
   double tSetupEnd = MPI_Wtime();
 
   // Isolate disconnected rigid bodies and set nullspace if necessary
@@ -670,13 +704,17 @@ PetscErrorCode TopOpt::FESolve()
 
   // Solve for displacements
   double tSolveStart = MPI_Wtime();
+  ierr = PetscLogEventBegin(solveEvent, 0, 0, 0, 0); CHKERRQ(ierr);
   ierr = KSPSolve(this->KUF, this->F, this->U); CHKERRQ(ierr);
+  ierr = PetscLogEventEnd(solveEvent, 0, 0, 0, 0); CHKERRQ(ierr);
   double tSolveEnd = MPI_Wtime();
 
   // Check if we converged properly
   ierr = KSPGetConvergedReason(this->KUF, &KUF_reason); CHKERRQ(ierr);
   PetscInt its;
   ierr = KSPGetIterationNumber(this->KUF, &its); CHKERRQ(ierr);
+  KUF_its = its;
+  KUF_solved = PETSC_TRUE;
   if (this->verbose >= 1) {
     ierr = PetscFPrintf(comm, output, "Solve for displacements %s after %i iterations"
                         " with reason: %i\n", KUF_reason < 0 ? "failed" : "succeeded",
@@ -694,6 +732,13 @@ PetscErrorCode TopOpt::FESolve()
       // If using AMG on coarse grid, report that too
       if (hybrid) {
         KSP subKSP; PC subPC; PetscInt lvls;
+        PetscBool telescope;
+        ierr = PetscObjectTypeCompare((PetscObject)coarsePC, PCTELESCOPE,
+                                      &telescope); CHKERRQ(ierr);
+        if (telescope) {
+          ierr = PCTelescopeGetKSP(coarsePC, &subKSP); CHKERRQ(ierr);
+          ierr = KSPGetPC(subKSP, &coarsePC); CHKERRQ(ierr);
+        }
         ierr = PCMGGetLevels(coarsePC, &lvls); CHKERRQ(ierr);
         allLevels += lvls-1;
         ierr = PCMGGetCoarseSolve(coarsePC, &subKSP); CHKERRQ(ierr);
@@ -721,6 +766,9 @@ PetscErrorCode TopOpt::FESolve()
     ierr = PCReset(pc); CHKERRQ(ierr);
     ierr = MatDestroy(this->PR.data() + this->PR.size()-1); CHKERRQ(ierr);
     this->PR.pop_back();
+    if (this->MG_comms.back() != this->comm && this->MG_comms.back() != MPI_COMM_NULL)
+      MPI_Comm_free(&this->MG_comms.back());
+    this->MG_comms.pop_back();
     ierr = PCMGSetLevels(pc, this->PR.size()+1, NULL); CHKERRQ(ierr);
     ierr = PCMGSetGalerkin(pc, PC_MG_GALERKIN_BOTH); CHKERRQ(ierr);
     for (int i = 1; i <= this->PR.size(); i++) {
@@ -26,6 +26,9 @@ Function_Base::Function_Base(std::vector<PetscScalar> &values, PetscScalar min_v
   this->max_val = max_val;
   this->objective = objective;
   this->calc_gradient = calc_gradient;
+  time = 0;
+  eigenReq = 0; eigenConv = 0; eigenIts = 0; adjointIts = 0;
+  eigenTime = 0; adjointTime = 0; adjointReason = KSP_CONVERGED_ITERATING;
 }
 
 /********************************************************************
@@ -43,7 +46,13 @@ PetscErrorCode Function_Base::Compute(TopOpt *topOpt)
     ierr = PetscFPrintf(topOpt->comm, topOpt->output, "Calling %s function\n",
                         name[this->func_type]); CHKERRQ(ierr);
   }
+  eigenReq = 0; eigenConv = 0; eigenIts = 0; adjointIts = 0;
+  eigenTime = 0; adjointTime = 0; adjointReason = KSP_CONVERGED_ITERATING;
+  double t0 = MPI_Wtime();
+  ierr = PetscLogEventBegin(topOpt->functionEvent[func_type], 0, 0, 0, 0); CHKERRQ(ierr);
   ierr = Function(topOpt); CHKERRQ(ierr);
+  ierr = PetscLogEventEnd(topOpt->functionEvent[func_type], 0, 0, 0, 0); CHKERRQ(ierr);
+  time = MPI_Wtime() - t0;
 
   // Calculate combined function value and gradient
   if (topOpt->verbose >= 3) {
@@ -148,3 +157,51 @@ PetscErrorCode Function_Base::Normalization(TopOpt *topOpt)
 
   return ierr;
 }
+
+/********************************************************************
+ * Give stored mode shapes (with ghost entries) to an eigensolver as
+ * its starting space
+ * 
+ * @param topOpt: The topology optimization object
+ * @param eigen: The eigensolver
+ * @param shape: The mode shapes, one per column
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode Function_Base::Seed_Eigen(TopOpt *topOpt, EigenPeetz *eigen,
+                                         MatrixXPS &shape)
+{
+  PetscErrorCode ierr = 0;
+  if (shape.cols() == 0)
+    return 0;
+
+  std::vector<Vec> phi(shape.cols());
+  for (int i = 0; i < shape.cols(); i++) {
+    ierr = VecCreateMPIWithArray(topOpt->comm, 1, topOpt->numDims*topOpt->nLocNode,
+        topOpt->numDims*topOpt->nNode, shape.data() + shape.rows()*i,
+        phi.data()+i); CHKERRQ(ierr);
+  }
+  ierr = eigen->Set_Initial_Space(phi.size(), phi.data()); CHKERRQ(ierr);
+  for (int i = 0; i < shape.cols(); i++) {
+    ierr = VecDestroy(phi.data()+i); CHKERRQ(ierr);
+  }
+
+  return ierr;
+}
+
+/********************************************************************
+ * Bytes held by the function, by structure
+ * 
+ * @param usage: Name and bytes of each structure (appended to)
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode Function_Base::Memory(vector<pair<string, double> > &usage)
+{
+  PetscErrorCode ierr = 0;
+  usage.push_back(make_pair(string(name[func_type]) + " gradients",
+                  (double)(gradients.size()+gradient.size())*sizeof(PetscScalar)));
+  return ierr;
+}
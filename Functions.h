@@ -3,8 +3,7 @@
 
 #include <Eigen/Eigen>
 #include <slepceps.h>
-#include "JDMG.h"
-#include "LOPGMRES.h"
+#include "EigenPeetz.h"
 
 typedef Eigen::Matrix<PetscScalar, -1, -1> MatrixXPS;
 typedef Eigen::Matrix<PetscScalar, -1, 1>  VectorXPS;
@@ -30,11 +29,23 @@ public:
   PetscBool objective;
   // Gradient calculation needed
   PetscBool calc_gradient;
+  // Wall time of the last evaluation
+  double time;
+  // Eigenvalues requested and found, eigensolver iterations and time, and
+  // adjoint solve iterations, time, and worst convergence reason of the
+  // last evaluation (zero for functions without them)
+  PetscInt eigenReq, eigenConv, eigenIts, adjointIts;
+  double eigenTime, adjointTime;
+  KSPConvergedReason adjointReason;
 
   // Initialize gradient arrays
   PetscErrorCode Initialize_Arrays(PetscInt nElem) {
     gradients.resize(nElem, nvals); gradient.resize(nElem); return 0;
   }
+  // Drop anything built on the mesh (e.g. after repartitioning)
+  virtual PetscErrorCode Reset() {return 0;}
+  // Bytes held by the function, by structure
+  virtual PetscErrorCode Memory(std::vector<std::pair<std::string, double> > &usage);
   // Assemble all function values and gradients
   static PetscErrorCode Function_Call(TopOpt *topOpt, double &f, VectorXPS &g,
                                       VectorXPS &dgdx, MatrixXPS &dfdx);
@@ -60,6 +71,9 @@ protected:
 
   // Compute internal function values
   virtual PetscErrorCode Function(TopOpt* topOpt) = 0;
+  // Start an eigensolver from stored mode shapes (e.g. after a restart)
+  static PetscErrorCode Seed_Eigen(TopOpt *topOpt, EigenPeetz *eigen,
+                                   MatrixXPS &shape);
 };
 
 class Compliance : public Function_Base
@@ -95,12 +109,15 @@ class Stability : public Function_Base
 public:
   Stability(std::vector<PetscScalar> &values, PetscScalar min_val,
             PetscScalar max_val, PetscBool objective,
-            PetscBool calc_gradient=PETSC_TRUE) :
+            PetscBool calc_gradient=PETSC_TRUE,
+            EIGEN_TYPE eigen_type=LOPGMRES_SOLVER) :
               Function_Base(values, min_val, max_val, objective,
-                            calc_gradient), lopgmres() {
-              Ks = NULL; func_type = STABILITY;
+                            calc_gradient), eigen_type(eigen_type) {
+              Ks = NULL; eigen = NULL; func_type = STABILITY; phimSize = 0;
             }
-  ~Stability() {MatDestroy(&Ks);}
+  ~Stability() {MatDestroy(&Ks); delete eigen;}
+  PetscErrorCode Reset() {delete eigen; eigen = NULL; return MatDestroy(&Ks);}
+  PetscErrorCode Memory(std::vector<std::pair<std::string, double> > &usage);
 
 protected:
   // Stress Stiffness matrix
@@ -111,8 +128,11 @@ protected:
   std::vector<MatrixXPS> dKsdu;
   // Adjoint vector
   MatrixXPS v;
+  // Size of the mode shape products in the last evaluation
+  PetscInt phimSize;
   // Eigensolver
-  LOPGMRES lopgmres;
+  EIGEN_TYPE eigen_type;
+  EigenPeetz *eigen;
   // Internal functions
   PetscErrorCode StressFnc(TopOpt *topOpt);
   MatrixXPS sigtos(VectorXPS sigma);
@@ -124,19 +144,25 @@ class Frequency : public Function_Base
 public:
   Frequency(std::vector<PetscScalar> &values, PetscScalar min_val,
             PetscScalar max_val, PetscBool objective,
-            PetscBool calc_gradient=PETSC_TRUE) :
+            PetscBool calc_gradient=PETSC_TRUE,
+            EIGEN_TYPE eigen_type=LOPGMRES_SOLVER) :
               Function_Base(values, min_val, max_val, objective,
-                            calc_gradient), lopgmres() {
-              M = NULL; func_type = FREQUENCY;}
-  ~Frequency() {MatDestroy(&M);}
+                            calc_gradient), eigen_type(eigen_type) {
+              M = NULL; eigen = NULL; func_type = FREQUENCY; phimSize = 0;}
+  ~Frequency() {MatDestroy(&M); delete eigen;}
+  PetscErrorCode Reset() {delete eigen; eigen = NULL; return MatDestroy(&M);}
+  PetscErrorCode Memory(std::vector<std::pair<std::string, double> > &usage);
 
 protected:
   // Mass matrix
   Mat M;
   // Mass matrix partial sensitivity
   VectorXPS dMdy;
+  // Size of the mode shape products in the last evaluation
+  PetscInt phimSize;
   // Eigensolver
-  LOPGMRES lopgmres;
+  EIGEN_TYPE eigen_type;
+  EigenPeetz *eigen;
   // Internal functions
   PetscErrorCode DiagMassFnc(TopOpt *topOpt);
   PetscErrorCode Function(TopOpt *topOpt);
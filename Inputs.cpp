@@ -1,6 +1,7 @@
 #include <Eigen/Eigen>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include "EigLab.h"
 #include "Functions.h"
 #include "Domain.h"
@@ -50,6 +51,34 @@ vector<PetscScalar> Get_Values(string line)
   return vals;
 }
 
+/********************************************************************
+ * Get the encoding of printed values from its name
+ *
+ * @param comm: Communicator for any error
+ * @param name: DOUBLE, FLOAT, 16 (bit), or 8 (bit)
+ * @param encoding: The encoding (output)
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode Parse_Encoding(MPI_Comm comm, string name, SNAPSHOT_ENCODING &encoding)
+{
+  for (string::size_type i = 0; i < name.length(); ++i)
+    name[i] = toupper(name[i]);
+  if (!name.compare(0,6,"DOUBLE"))
+    encoding = SNAP_DOUBLE;
+  else if (!name.compare(0,5,"FLOAT"))
+    encoding = SNAP_FLOAT;
+  else if (!name.compare(0,2,"16") || !name.compare(0,6,"UINT16"))
+    encoding = SNAP_UINT16;
+  else if (!name.compare(0,1,"8") || !name.compare(0,5,"UINT8"))
+    encoding = SNAP_UINT8;
+  else {
+    SETERRQ1(comm, PETSC_ERR_SUP, "Unknown print encoding \"%s\" specified",
+             name.c_str()); }
+
+  return 0;
+}
 
 /********************************************************************
  * Get all local node indices describing all the elements faces
@@ -222,6 +251,111 @@ PetscErrorCode TopOpt::Set_BC(ArrayXPS center, ArrayXPS radius,
   return ierr;
 }
 
+/********************************************************************
+ * Read the input file on the first process, split it into its
+ * bracketed sections, and share them with every process
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::Read_Input()
+{
+  PetscErrorCode ierr = 0;
+
+  // Sections packed as name and text pairs, each null-terminated
+  vector<char> packed;
+  int found = 1;
+  if (myid == 0) {
+    ifstream file(filename.c_str());
+    found = file.is_open();
+    string line, name, closing, text;
+    while (found && getline(file, line)) {
+      istringstream first(line);
+      string token;
+      first >> token;
+      if (name.size() == 0) {
+        // Look for the start of a section, e.g. [Params]
+        if (token.size() > 2 && token[0] == '[' && token[1] != '/' &&
+            token[token.size()-1] == ']') {
+          name = token.substr(1, token.size()-2);
+          closing = "[/" + name + "]";
+          for (string::size_type i = 0; i < closing.length(); ++i)
+            closing[i] = toupper(closing[i]);
+          text = line + "\n";
+        }
+        continue;
+      }
+      text += line + "\n";
+      for (string::size_type i = 0; i < token.length(); ++i)
+        token[i] = toupper(token[i]);
+      if (!token.compare(closing)) {
+        // Only the first section with a name is used
+        if (inputSections.find(name) == inputSections.end()) {
+          packed.insert(packed.end(), name.begin(), name.end());
+          packed.push_back(0);
+          packed.insert(packed.end(), text.begin(), text.end());
+          packed.push_back(0);
+          inputSections[name] = text;
+        }
+        name.clear();
+      }
+    }
+    // An unclosed section runs to the end of the file
+    if (name.size() > 0 && inputSections.find(name) == inputSections.end()) {
+      packed.insert(packed.end(), name.begin(), name.end());
+      packed.push_back(0);
+      packed.insert(packed.end(), text.begin(), text.end());
+      packed.push_back(0);
+      inputSections[name] = text;
+    }
+  }
+
+  ierr = MPI_Bcast(&found, 1, MPI_INT, 0, comm); CHKERRQ(ierr);
+  if (!found)
+    SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Could not find specified input file");
+  long size = packed.size();
+  ierr = MPI_Bcast(&size, 1, MPI_LONG, 0, comm); CHKERRQ(ierr);
+  packed.resize(size);
+  ierr = MPI_Bcast(packed.data(), size, MPI_CHAR, 0, comm); CHKERRQ(ierr);
+
+  if (myid != 0) {
+    for (long i = 0; i < size; ) {
+      string name(packed.data()+i);
+      i += name.size()+1;
+      inputSections[name] = string(packed.data()+i);
+      i += inputSections[name].size()+1;
+    }
+  }
+  // Remember that the file was read even if it has no sections
+  inputSections[""] = "";
+
+  return ierr;
+}
+
+/********************************************************************
+ * Get a section of the input file to parse, reading the file the
+ * first time a section is needed
+ * 
+ * @param section: Name of the section, e.g. Params for [Params]
+ * @param file: Stream over the section, empty if it is missing (output)
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::Get_Input(string section, istringstream &file)
+{
+  PetscErrorCode ierr = 0;
+  if (inputSections.size() == 0) {
+    ierr = Read_Input(); CHKERRQ(ierr);
+  }
+
+  map<string, string>::iterator it = inputSections.find(section);
+  file.str(it == inputSections.end() ? "" : it->second);
+  file.clear();
+
+  return ierr;
+}
+
 /********************************************************************
  * Set various parameters/options from input file
  * 
@@ -244,9 +378,8 @@ PetscErrorCode TopOpt::Def_Param(MMA *optmma, Eigen::VectorXd &Dimensions,
   PetscErrorCode ierr = 0;
 
   // Variables needed for parsing input file
-  ifstream file(filename.c_str());
-  if (!file.is_open())
-    SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Could not find specified input file");
+  istringstream file;
+  ierr = Get_Input("Params", file); CHKERRQ(ierr);
   string line;
   file >> line;
   bool active_section = false;
@@ -399,6 +532,10 @@ PetscErrorCode TopOpt::Def_Param(MMA *optmma, Eigen::VectorXd &Dimensions,
         file >> line;
         optmma->Set_Step_Limit(strtod(line.c_str(), NULL));
       }
+      else if (!line.compare(0,12,"SPARSE_LIMIT")) {
+        file >> line;
+        optmma->Set_Sparse_Limit(strtol(line.c_str(), NULL, 0));
+      }
       else if (!line.compare(0,13,"NORMALIZATION")) {
         file >> line;
         if (line[0] == 'Y' || line[0] == 'y' || line[0] == 'T' || line[0] == 't')
@@ -413,6 +550,13 @@ PetscErrorCode TopOpt::Def_Param(MMA *optmma, Eigen::VectorXd &Dimensions,
         else
           Reorder_Mesh = PETSC_FALSE;
       }
+      else if (!line.compare(0,13,"BOX_PARTITION")) {
+        file >> line;
+        if (line[0] == 'Y' || line[0] == 'y' || line[0] == 'T' || line[0] == 't')
+          box_partition = PETSC_TRUE;
+        else
+          box_partition = PETSC_FALSE;
+      }
       else if (!line.compare(0,8,"SMOOTHER")) {
         string smoother; file >> smoother;
         for (string::size_type i = 0; i < smoother.length(); ++i)
@@ -434,10 +578,44 @@ PetscErrorCode TopOpt::Def_Param(MMA *optmma, Eigen::VectorXd &Dimensions,
         file.ignore();
         getline(file, this->folder);
       }
+      else if (!line.compare(0,9,"VISUALIZE")) {
+        file >> line;
+        if (line[0] == 'Y' || line[0] == 'y' || line[0] == 'T' || line[0] == 't')
+          visualize = PETSC_TRUE;
+        else
+          visualize = PETSC_FALSE;
+      }
+      else if (!line.compare(0,9,"TELEMETRY")) {
+        file >> line;
+        if (line[0] == 'Y' || line[0] == 'y' || line[0] == 'T' || line[0] == 't')
+          telemetry = PETSC_TRUE;
+        else
+          telemetry = PETSC_FALSE;
+      }
+      else if (!line.compare(0,14,"PRINT_ENCODING")) {
+        file >> line;
+        ierr = Parse_Encoding(comm, line, print_encoding); CHKERRQ(ierr);
+      }
+      else if (!line.compare(0,14,"PRINT_KEYFRAME")) {
+        file >> line;
+        print_keyframe = strtol(line.c_str(), NULL, 0);
+      }
       else if (!line.compare(0,5,"PRINT")) {
         file >> line;
         print_every = strtol(line.c_str(), NULL, 0);
       }
+      else if (!line.compare(0,10,"CHECKPOINT")) {
+        file >> line;
+        checkpoint_every = strtol(line.c_str(), NULL, 0);
+      }
+      else if (!line.compare(0,18,"REPARTITION_WEIGHT")) {
+        file >> line;
+        repartition_weight = strtod(line.c_str(), NULL);
+      }
+      else if (!line.compare(0,11,"REPARTITION")) {
+        file >> line;
+        repartition_every = strtol(line.c_str(), NULL, 0);
+      }
 
       file >> line;
     }
@@ -462,6 +640,29 @@ PetscErrorCode TopOpt::Get_CL_Options()
   ierr = PetscOptionsGetInt(NULL, NULL, "-Verbose", &verbose, NULL); CHKERRQ(ierr);
   ierr = PetscOptionsGetInt(NULL, NULL, "-Print_Every", &print_every, NULL);
          CHKERRQ(ierr);
+  ierr = PetscOptionsGetBool(NULL, NULL, "-Async_Print", &async_print, NULL);
+         CHKERRQ(ierr);
+  char encoding[20];
+  PetscBool set = PETSC_FALSE;
+  ierr = PetscOptionsGetString(NULL, NULL, "-Print_Encoding", encoding, 20, &set);
+         CHKERRQ(ierr);
+  if (set) {
+    ierr = Parse_Encoding(comm, encoding, print_encoding); CHKERRQ(ierr);
+  }
+  ierr = PetscOptionsGetInt(NULL, NULL, "-Print_Keyframe", &print_keyframe, NULL);
+         CHKERRQ(ierr);
+  ierr = PetscOptionsGetBool(NULL, NULL, "-Visualize", &visualize, NULL);
+         CHKERRQ(ierr);
+  ierr = PetscOptionsGetBool(NULL, NULL, "-Telemetry", &telemetry, NULL);
+         CHKERRQ(ierr);
+  ierr = PetscOptionsGetInt(NULL, NULL, "-Checkpoint_Every", &checkpoint_every, NULL);
+         CHKERRQ(ierr);
+  ierr = PetscOptionsGetBool(NULL, NULL, "-box_partition", &box_partition, NULL);
+         CHKERRQ(ierr);
+  ierr = PetscOptionsGetInt(NULL, NULL, "-Repartition_Every", &repartition_every, NULL);
+         CHKERRQ(ierr);
+  ierr = PetscOptionsGetReal(NULL, NULL, "-Repartition_Weight", &repartition_weight,
+                             NULL); CHKERRQ(ierr);
   return ierr;
 }
 
@@ -475,9 +676,8 @@ PetscErrorCode TopOpt::Set_Funcs()
 {
   PetscErrorCode ierr = 0;
   // Variables needed for parsing input file
-  ifstream file(filename.c_str());
-  if (!file.is_open())
-    SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Could not find specified input file");
+  istringstream file;
+  ierr = Get_Input("Functions", file); CHKERRQ(ierr);
   string line;
   file >> line;
   bool active_section = false;
@@ -515,6 +715,7 @@ PetscErrorCode TopOpt::Set_Funcs()
       PetscScalar min = 0, max = 0;
       vector<PetscScalar> values;
       PetscBool objective = PETSC_TRUE;
+      EIGEN_TYPE eigen_type = LOPGMRES_SOLVER;
 
       while (true) {
         if (!line.compare(0,9,"Objective")) {
@@ -545,6 +746,24 @@ PetscErrorCode TopOpt::Set_Funcs()
           file >> line;
           continue;
         }
+        else if (!line.compare(0,11,"Eigensolver")) {
+          file >> line;
+          for (string::size_type i = 0; i < line.length(); ++i)
+            line[i] = toupper(line[i]);
+          if (!line.compare(0,8,"LOPGMRES"))
+            eigen_type = LOPGMRES_SOLVER;
+          else if (!line.compare(0,4,"JDMG"))
+            eigen_type = JDMG_SOLVER;
+          else if (!line.compare(0,5,"SLEPC") || !line.compare(0,3,"EPS"))
+            eigen_type = SLEPC_SOLVER;
+          else if (!line.compare(0,6,"LOBPCG"))
+            eigen_type = LOBPCG_SOLVER;
+          else
+            SETERRQ1(comm, PETSC_ERR_SUP, "Unknown eigensolver \"%s\" specified",
+                     line.c_str());
+          file >> line;
+          continue;
+        }
         else if (!line.compare(0,3,"Nev")) {
           // To prevent errors from old input files
           getline(file, line);
@@ -567,12 +786,14 @@ PetscErrorCode TopOpt::Set_Funcs()
           function_list.push_back(new Volume(values, min, max, objective));
           break;
         case STABILITY :
-          function_list.push_back(new Stability(values, min, max, objective));
+          function_list.push_back(new Stability(values, min, max, objective,
+                                                PETSC_TRUE, eigen_type));
           needK = PETSC_TRUE; needU = PETSC_TRUE;
           bucklingShape.resize(1, values.size());
           break;
         case FREQUENCY :
-          function_list.push_back(new Frequency(values, min, max, objective));
+          function_list.push_back(new Frequency(values, min, max, objective,
+                                                PETSC_TRUE, eigen_type));
           needK = PETSC_TRUE;
           dynamicShape.resize(1, values.size());
           break;
@@ -597,9 +818,8 @@ PetscErrorCode TopOpt::Domain(MatrixXPS &Points, Eigen::Array<bool, -1, 1> &elem
 {
   PetscErrorCode ierr = 0;
   // Variables needed for parsing input file
-  ifstream file(filename.c_str());
-  if (!file.is_open())
-    SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Could not find specified input file");
+  istringstream file;
+  ierr = Get_Input(key, file); CHKERRQ(ierr);
   string line;
   file >> line;
   bool active_section = false;
@@ -786,9 +1006,8 @@ PetscErrorCode TopOpt::Def_BC()
 {
   PetscErrorCode ierr = 0;
   // Variables needed for parsing input file
-  ifstream file(filename.c_str());
-  if (!file.is_open())
-    SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Could not find specified input file");
+  istringstream file;
+  ierr = Get_Input("BC", file); CHKERRQ(ierr);
   string line;
   file >> line;
   bool active_section = false;
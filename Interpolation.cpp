@@ -176,7 +176,8 @@ PetscErrorCode TopOpt::Create_Interpolation(ArrayXPI &first, ArrayXPI &last,
  * @param K: interpolation coefficients
  * @param cList: the coarse nodes on each level
  * @param mg_levels: The number of multigrid levels to create
- * @param min_size: Minimum matrix size on each process
+ * @param min_size: Minimum number of dof on each process. Coarse levels
+ *                  below this are agglomerated onto fewer processes
  * 
  * @return ierr: PetscErrorCode
  * 
@@ -199,10 +200,16 @@ PetscErrorCode TopOpt::Assemble_Interpolation(ArrayXPI *I, ArrayXPI *J,
   // List of interpolation matrices
   this->PR.resize(mg_levels-1);
   // List of communicators on each level
-  this->MG_comms.resize(mg_levels);
+  this->MG_comms.assign(mg_levels, MPI_COMM_NULL);
   this->MG_comms[0] = this->comm;
   // How the dof are split between processors at each level
   ArrayXPI nddist = this->nddist;
+  // Number of active processes and dof at each level for the layout report
+  std::vector<PetscInt> nActive(1, this->nprocs), nDof(1, numDims*nNode);
+
+  // If we're using gamg as as the coarse solver, let coarse grid be parallel
+  PetscBool set, hybrid=PETSC_FALSE;
+  ierr = PetscOptionsGetBool(NULL, NULL, "-use_hybrid_MG", &hybrid, &set); CHKERRQ(ierr);
   
   for (int i = 0; i < mg_levels-1; i++) {
     // Sort all the coarse nodes to determine their numbers at this level
@@ -220,28 +227,25 @@ PetscErrorCode TopOpt::Assemble_Interpolation(ArrayXPI *I, ArrayXPI *J,
     ierr = MatSetOptionsPrefix(this->PR[i], "PR_"); CHKERRQ(ierr);
     ierr = MatSetFromOptions(this->PR[i]); CHKERRQ(ierr);
 
-    // Create communicators for each level of hierarchy
-    PetscInt nprocs = std::max(gCols/min_size,1);
-    if (this->verbose >= 2)
-      ierr = PetscFPrintf(comm, output, "Level %i is split over %i processors\n",
-                          i+1, min(this->nprocs, nprocs)); CHKERRQ(ierr);
-    if (i == mg_levels-2)
-      MPI_Comm_split(this->comm, myid == 0 ? 0 : MPI_UNDEFINED, 0, this->MG_comms.data()+i+1);
+    // Agglomerate levels below the dof threshold onto progressively fewer
+    // processes (the coarsest level is always on the first process)
+    PetscInt nprocs = std::max(numDims*gCols/min_size, (PetscInt)1);
+    nprocs = std::min(nprocs, nActive.back());
+    if (i == mg_levels-2 && !hybrid)
+      nprocs = 1;
+    nActive.push_back(nprocs); nDof.push_back(numDims*gCols);
     if (nprocs < this->nprocs) {
-      MPI_Comm_split(this->comm, myid < nprocs ? 0 : MPI_UNDEFINED, 0, this->MG_comms.data()+i+1);
+      MPI_Comm_split(this->comm, myid < nprocs ? 0 : MPI_UNDEFINED, myid,
+                     this->MG_comms.data()+i+1);
       nddist.setConstant(this->nNode);
       nddist.segment(0, nprocs+1) = ArrayXPI::LinSpaced(nprocs+1, 0, this->nNode);
     }
     else
-      this->MG_comms[i] = this->comm;
+      this->MG_comms[i+1] = this->comm;
 
     // Initialize preallocation arrays
     fill(onDiag, onDiag+gRows, 0);
     fill(offDiag, offDiag+gRows, 0);
-
-    // If we're using gamg as as the coarse solver, let coarse grid be parallel
-    PetscBool set, hybrid=PETSC_FALSE;
-    ierr = PetscOptionsGetBool(NULL, NULL, "-use_hybrid_MG", &hybrid, &set); CHKERRQ(ierr);
     // Coarsest interpolator works a little different
     if (i == mg_levels-2 && !hybrid) {
       // Set matrix size
@@ -337,6 +341,12 @@ PetscErrorCode TopOpt::Assemble_Interpolation(ArrayXPI *I, ArrayXPI *J,
     ierr = VecMin(rowSum, &location, &minimum); CHKERRQ(ierr);
     if (minimum == 0.0) {
       this->PR.resize(i);
+      for (unsigned int j = i+1; j < this->MG_comms.size(); j++) {
+        if (this->MG_comms[j] != this->comm && this->MG_comms[j] != MPI_COMM_NULL)
+          MPI_Comm_free(this->MG_comms.data()+j);
+      }
+      this->MG_comms.resize(i+1);
+      nActive.resize(i+1); nDof.resize(i+1);
       break;
       ierr = PetscPrintf(comm, "Fine node #%i in interpolation matrix %i is ", location, i); CHKERRQ(ierr);
       ierr = PetscPrintf(comm, " not attached to any coarse nodes, restricting to %i levels", i); CHKERRQ(ierr);
@@ -351,5 +361,17 @@ PetscErrorCode TopOpt::Assemble_Interpolation(ArrayXPI *I, ArrayXPI *J,
   }
   delete[] onDiag; delete[] offDiag;
 
+  // Report the layout of the hierarchy
+  if (this->verbose >= 2) {
+    ierr = PetscFPrintf(comm, output, "Multigrid process layout (at least %i "
+                        "dof per process):\n", min_size); CHKERRQ(ierr);
+    for (unsigned int i = 0; i < nActive.size(); i++) {
+      ierr = PetscFPrintf(comm, output, "  Level %i: %i dof on %i of %i "
+                          "processes (%i dof per process)\n", i, nDof[i],
+                          nActive[i], this->nprocs, nDof[i]/nActive[i]);
+      CHKERRQ(ierr);
+    }
+  }
+
   return 0;
 }
@@ -7,7 +7,7 @@
 
 using namespace std;
 
-PetscLogEvent EIG_Setup_Coarse, EIG_Comp_Coarse, EIG_MGSetup;
+PetscLogEvent EIG_Setup_Coarse, EIG_Comp_Coarse, EIG_MGSetup, EIG_Chebyshev;
 PetscLogEvent *EIG_ApplyOP1, *EIG_ApplyOP2, *EIG_ApplyOP3, *EIG_ApplyOP4;
 
 // BLAS routines
@@ -34,7 +34,13 @@ JDMG::JDMG(MPI_Comm comm)
   PetscFOpen(this->comm, "stdout", "w", &output);
   file_opened = 1;
   cycle = FMGCycle;
+  smoother = WJacobi;
   levels = 0;
+  eps_coarse = NULL; ksp_coarse = NULL;
+  x_end = NULL; f_end = NULL;
+  coarse_phi = NULL; ncoarse_phi = 0;
+  Anz = -1; Bnz = -1;
+  A_extracted = false; B_extracted = false;
   nsweep = 5;
   w = 4.0/7;
 }
@@ -45,6 +51,7 @@ JDMG::JDMG(MPI_Comm comm)
  *******************************************************************/
 JDMG::~JDMG()
 {
+  Clear_Hierarchy();
   for (unsigned int ii = 0; ii < P.size(); ii++)
     MatDestroy(P.data()+ii);
 }
@@ -66,6 +73,89 @@ PetscErrorCode JDMG::Set_Verbose(PetscInt verbose)
   return 0;
 }
 
+/********************************************************************
+ * Set the operators. If the fine operators are the same objects with
+ * the same nonzero structure as before, the coarse operators and the
+ * coarse solvers are kept so their values can be updated in place.
+ * 
+ * @param A: The first matrix
+ * @param B: The second matrix
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode JDMG::Set_Operators(Mat A, Mat B)
+{
+  PetscErrorCode ierr = 0;
+
+  PetscObjectState Astate, Bstate;
+  ierr = MatGetNonzeroState(A, &Astate); CHKERRQ(ierr);
+  ierr = MatGetNonzeroState(B, &Bstate); CHKERRQ(ierr);
+  bool reuse = (this->A.size() > 1) && (A == this->A[0]) && (B == this->B[0])
+               && (Astate == Anz) && (Bstate == Bnz);
+  if (!reuse) {
+    ierr = Clear_Hierarchy(); CHKERRQ(ierr);
+  }
+  Anz = Astate; Bnz = Bstate;
+
+  // Hold on to the coarse operators while the fine operators are replaced
+  std::vector<Mat> Acoarse, Bcoarse;
+  if (this->A.size() > 1)
+    Acoarse.assign(this->A.begin()+1, this->A.end());
+  if (this->B.size() > 1)
+    Bcoarse.assign(this->B.begin()+1, this->B.end());
+  this->A.resize(std::min(this->A.size(), (size_t)1));
+  this->B.resize(std::min(this->B.size(), (size_t)1));
+
+  ierr = PRINVIT::Set_Operators(A, B); CHKERRQ(ierr);
+  this->A.insert(this->A.end(), Acoarse.begin(), Acoarse.end());
+  this->B.insert(this->B.end(), Bcoarse.begin(), Bcoarse.end());
+
+  return 0;
+}
+
+/********************************************************************
+ * Destroy the coarse operators, level matrices, coarse solvers and
+ * smoother work vectors that are kept between compute steps
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode JDMG::Clear_Hierarchy()
+{
+  PetscErrorCode ierr = 0;
+
+  for (unsigned int ii = 1; ii < A.size(); ii++) {
+    ierr = MatDestroy(A.data()+ii); CHKERRQ(ierr);
+  }
+  for (unsigned int ii = 1; ii < B.size(); ii++) {
+    ierr = MatDestroy(B.data()+ii); CHKERRQ(ierr);
+  }
+  for (unsigned int ii = 0; ii < K.size(); ii++) {
+    ierr = MatDestroy(K.data()+ii); CHKERRQ(ierr);
+  }
+  for (unsigned int ii = 0; ii < Bcopy.size(); ii++) {
+    ierr = MatDestroy(Bcopy.data()+ii); CHKERRQ(ierr);
+  }
+  ierr = KSPDestroy(&ksp_coarse); CHKERRQ(ierr);
+  ierr = EPSDestroy(&eps_coarse); CHKERRQ(ierr);
+  if (ncoarse_phi > 0) {
+    ierr = VecDestroyVecs(ncoarse_phi, &coarse_phi); CHKERRQ(ierr);
+  }
+  ncoarse_phi = 0;
+  ierr = VecDestroy(&x_end); CHKERRQ(ierr);
+  ierr = VecDestroy(&f_end); CHKERRQ(ierr);
+  for (unsigned int ii = 0; ii < smooth_work.size(); ii++) {
+    if (smooth_work[ii] != NULL) {
+      ierr = VecDestroyVecs(2, smooth_work.data()+ii); CHKERRQ(ierr);
+    }
+  }
+  smooth_work.resize(0);
+  A_extracted = false; B_extracted = false;
+
+  return 0;
+}
+
 /********************************************************************
  * Extract MG hierarchy from a Petsc PC object
  * 
@@ -84,17 +174,14 @@ PetscErrorCode JDMG::PCMG_Extract(PC pcmg, bool isB, bool isA)
                         "PC object\n"); CHKERRQ(ierr);
 
   KSP smoother;
+  ierr = Clear_Hierarchy(); CHKERRQ(ierr);
+  for (unsigned int ii = 0; ii < P.size(); ii++) {
+    ierr = MatDestroy(P.data()+ii); CHKERRQ(ierr);
+  }
   ierr = PCMGGetLevels(pcmg, &levels); CHKERRQ(ierr);
   P.resize(levels-1, NULL);
-  for (unsigned int ii = 1; ii < A.size(); ii++) {
-    ierr = MatDestroy(A.data()+ii); CHKERRQ(ierr);
-    A[ii] = NULL;
-  }
-  for (unsigned int ii = 1; ii < B.size(); ii++) {
-    ierr = MatDestroy(B.data()+ii); CHKERRQ(ierr);
-    B[ii] = NULL;
-  }
   A.resize(levels, NULL); B.resize(levels, NULL);
+  A_extracted = isA; B_extracted = isB;
   for (PetscInt ii = levels-1, jj = 0; ii > 0; ii--, jj++) {
     ierr = PCMGGetInterpolation(pcmg, ii, P.data()+jj); CHKERRQ(ierr);
     ierr = PetscObjectReference((PetscObject)P[jj]); CHKERRQ(ierr);
@@ -131,21 +218,21 @@ PetscErrorCode JDMG::Set_Hierarchy(const std::vector<Mat> P,
     ierr = PetscFPrintf(comm, output, "Setting hierarchy from list of "
                         "interpolators\n"); CHKERRQ(ierr);
 
-  this->P = P;
-  for (unsigned int ii = 0; ii < this->P.size(); ii++) {
-    ierr = PetscObjectReference((PetscObject)this->P[ii]); CHKERRQ(ierr);
-  }
-
-  for (unsigned int ii = 1; ii < A.size(); ii++) {
-    ierr = MatDestroy(A.data()+ii); CHKERRQ(ierr);
-    A[ii] = NULL;
-  }
-  for (unsigned int ii = 1; ii < B.size(); ii++) {
-    ierr = MatDestroy(B.data()+ii); CHKERRQ(ierr);
-    B[ii] = NULL;
+  // The same interpolators keep the existing coarse operators
+  bool same = (levels == (PetscInt)P.size()+1) && (this->P.size() == P.size())
+              && std::equal(P.begin(), P.end(), this->P.begin());
+  if (!same) {
+    ierr = Clear_Hierarchy(); CHKERRQ(ierr);
+    for (unsigned int ii = 0; ii < this->P.size(); ii++) {
+      ierr = MatDestroy(this->P.data()+ii); CHKERRQ(ierr);
+    }
+    this->P = P;
+    for (unsigned int ii = 0; ii < this->P.size(); ii++) {
+      ierr = PetscObjectReference((PetscObject)this->P[ii]); CHKERRQ(ierr);
+    }
+    levels = P.size()+1; A.resize(levels, NULL); B.resize(levels, NULL);
   }
 
-  levels = P.size()+1; A.resize(levels, NULL); B.resize(levels, NULL);
   this->MG_comms.resize(levels);
   if (MG_comms.size() == 0)
     std::fill(this->MG_comms.begin(), this->MG_comms.end(), comm);
@@ -161,7 +248,8 @@ PetscErrorCode JDMG::Set_Hierarchy(const std::vector<Mat> P,
 }
 
 /********************************************************************
- * Create the multigrid hierarchy from internal grid transfer operators
+ * Create the multigrid hierarchy from internal grid transfer operators.
+ * Existing Galerkin operators reuse their symbolic products.
  * 
  * @return ierr: PetscErrorCode
  * 
@@ -178,9 +266,15 @@ PetscErrorCode JDMG::Create_Hierarchy()
     if (this->A[i+1] == NULL) {
       ierr = MatPtAP(A[i], P[i], MAT_INITIAL_MATRIX, 1.0, A.data()+i+1); CHKERRQ(ierr);
     }
+    else if (!A_extracted) {
+      ierr = MatPtAP(A[i], P[i], MAT_REUSE_MATRIX, 1.0, A.data()+i+1); CHKERRQ(ierr);
+    }
     if (this->B[i+1] == NULL) {
       ierr = MatPtAP(B[i], P[i], MAT_INITIAL_MATRIX, 1.0, B.data()+i+1); CHKERRQ(ierr);
     }
+    else if (!B_extracted) {
+      ierr = MatPtAP(B[i], P[i], MAT_REUSE_MATRIX, 1.0, B.data()+i+1); CHKERRQ(ierr);
+    }
   }
   ierr = PetscLogEventEnd(EIG_Hierarchy, 0, 0, 0, 0); CHKERRQ(ierr);
 
@@ -233,6 +327,27 @@ PetscErrorCode JDMG::Compute_Init()
                   "\"FULL\" or \"V\"", cycle_type);
   }
 
+  // Check if MG smoother was set at command line
+  const PetscInt st_length = 7;
+  char smoother_type[st_length];
+  PetscBool smoother_type_set = PETSC_FALSE;
+  ierr = PetscOptionsGetString(NULL, NULL, "-JDMG_Smoother", smoother_type,
+                               st_length, &smoother_type_set); CHKERRQ(ierr);
+  if (smoother_type_set) {
+    for (int i = 0; i < st_length; i++) {
+      if (smoother_type[i] == '\0')
+        break;
+      smoother_type[i] = toupper(smoother_type[i]);
+    }
+    if (!strcmp(smoother_type, "WJAC") || !strcmp(smoother_type, "JACOBI"))
+      smoother = WJacobi;
+    else if (!strcmp(smoother_type, "CHEBY"))
+      smoother = Chebyshev;
+    else
+      PetscPrintf(comm, "Bad JDMG_Smoother given %s, should be "
+                  "\"WJAC\" or \"CHEBY\"", smoother_type);
+  }
+
   // Check for options in MG preconditioner
   ierr = PetscOptionsGetInt(NULL, NULL, "-JDMG_Jacobi_nSweep", &nsweep, NULL); CHKERRQ(ierr);
   ierr = PetscOptionsGetReal(NULL, NULL, "-JDMG_Jacobi_Weight", &w, NULL); CHKERRQ(ierr);
@@ -243,25 +358,47 @@ PetscErrorCode JDMG::Compute_Init()
   flist.resize(levels);
   QMatP.resize(levels-1);
   OPx.resize(levels-1);
+  // Smoother work vectors are kept as long as the hierarchy is (see
+  // Clear_Hierarchy). Chebyshev bounds are estimated in each MGSetup.
+  if ((PetscInt)smooth_work.size() != levels-1)
+    smooth_work.assign(levels-1, NULL);
+  cheb_emin.assign(levels-1, 0.0);
+  cheb_emax.assign(levels-1, 0.0);
   ierr = Setup_Coarse(); CHKERRQ(ierr);
   for (int ii = 0; ii < levels-1; ii++) {
-    // Combined matrices at each level
-    ierr = MatDuplicate(B[ii], MAT_DO_NOT_COPY_VALUES, K.data()+ii); CHKERRQ(ierr);
-    ierr = MatZeroEntries(K[ii]); CHKERRQ(ierr);
-    ierr = MatAXPY(K[ii], 1.0, A[ii], DIFFERENT_NONZERO_PATTERN); CHKERRQ(ierr);
-    /*ierr = MatDuplicate(K[ii], MAT_SHARE_NONZERO_PATTERN, Acopy.data()+ii); CHKERRQ(ierr);
-    ierr = MatZeroEntries(Acopy[ii]); CHKERRQ(ierr);
-    ierr = MatCopy(A[ii], Acopy[ii], DIFFERENT_NONZERO_PATTERN); CHKERRQ(ierr);*/
-    ierr = MatDuplicate(K[ii], MAT_SHARE_NONZERO_PATTERN, Bcopy.data()+ii); CHKERRQ(ierr);
-    ierr = MatZeroEntries(Bcopy[ii]); CHKERRQ(ierr);
-    ierr = MatCopy(B[ii], Bcopy[ii], DIFFERENT_NONZERO_PATTERN); CHKERRQ(ierr);
+    // Combined matrices at each level (only values change between calls)
+    if (K[ii] == NULL) {
+      ierr = MatDuplicate(B[ii], MAT_DO_NOT_COPY_VALUES, K.data()+ii); CHKERRQ(ierr);
+      ierr = MatZeroEntries(K[ii]); CHKERRQ(ierr);
+      ierr = MatAXPY(K[ii], 1.0, A[ii], DIFFERENT_NONZERO_PATTERN); CHKERRQ(ierr);
+      /*ierr = MatDuplicate(K[ii], MAT_SHARE_NONZERO_PATTERN, Acopy.data()+ii); CHKERRQ(ierr);
+      ierr = MatZeroEntries(Acopy[ii]); CHKERRQ(ierr);
+      ierr = MatCopy(A[ii], Acopy[ii], DIFFERENT_NONZERO_PATTERN); CHKERRQ(ierr);*/
+      ierr = MatDuplicate(K[ii], MAT_SHARE_NONZERO_PATTERN, Bcopy.data()+ii); CHKERRQ(ierr);
+      ierr = MatZeroEntries(Bcopy[ii]); CHKERRQ(ierr);
+      ierr = MatCopy(B[ii], Bcopy[ii], DIFFERENT_NONZERO_PATTERN); CHKERRQ(ierr);
+    }
+    else {
+      ierr = MatZeroEntries(K[ii]); CHKERRQ(ierr);
+      ierr = MatAXPY(K[ii], 1.0, A[ii], SUBSET_NONZERO_PATTERN); CHKERRQ(ierr);
+      ierr = MatZeroEntries(Bcopy[ii]); CHKERRQ(ierr);
+      ierr = MatAXPY(Bcopy[ii], 1.0, B[ii], SUBSET_NONZERO_PATTERN); CHKERRQ(ierr);
+    }
     // Vectors
     ierr = MatCreateVecs(A[ii+1], xlist.data()+ii+1, flist.data()+ii+1); CHKERRQ(ierr);
     ierr = MatCreateVecs(A[ii], Dlist.data()+ii, OPx.data()+ii); CHKERRQ(ierr);
     ierr = VecDuplicateVecs(Q[ii][0], Qsize, QMatP.data()+ii); CHKERRQ(ierr);
+    if (smooth_work[ii] == NULL) {
+      ierr = VecDuplicateVecs(Dlist[ii], 2, smooth_work.data()+ii); CHKERRQ(ierr);
+    }
   }
 
-  // Prep coarse problem
+  // Prep coarse problem, the KSP is kept as long as the hierarchy is
+  if (ksp_coarse != NULL) {
+    ierr = KSPSetOperators(ksp_coarse, K.back(), K.back()); CHKERRQ(ierr);
+    ierr = PetscLogEventEnd(EIG_Comp_Init, 0, 0, 0, 0); CHKERRQ(ierr);
+    return 0;
+  }
   ierr = KSPCreate(comm, &ksp_coarse); CHKERRQ(ierr);
   ierr = KSPSetType(ksp_coarse, KSPPREONLY); CHKERRQ(ierr);
   ierr = KSPSetTolerances(ksp_coarse, PETSC_DEFAULT, PETSC_DEFAULT,
@@ -293,7 +430,8 @@ PetscErrorCode JDMG::Compute_Init()
 }
 
 /********************************************************************
- * Setup the Mat and KSP objects for coarse solve
+ * Setup the Mat and KSP objects for coarse solve. The matrix is only
+ * created and preallocated when its size changes.
  * 
  * @return ierr: PetscErrorCode
  * 
@@ -320,49 +458,67 @@ PetscErrorCode JDMG::Setup_Coarse()
     lrows += Qsize;
     lcols += Qsize;
   }
-  // Initialize the matrix
-  ierr = MatCreate(comm, &K.back()); CHKERRQ(ierr);
-  ierr = MatSetSizes(K.back(), lrows, lcols, rows+Qsize, cols+Qsize); CHKERRQ(ierr);
-  ierr = MatSetOptionsPrefix(K.back(), "JDMG_K_"); CHKERRQ(ierr);
-  ierr = MatSetFromOptions(K.back()); CHKERRQ(ierr);
 
-  // Preallocation
+  // Rebuild the matrix if the number of Q rows changed
+  if (K.back() != NULL) {
+    PetscInt Krows;
+    ierr = MatGetSize(K.back(), &Krows, NULL); CHKERRQ(ierr);
+    if (Krows != rows+Qsize) {
+      ierr = MatDestroy(&K.back()); CHKERRQ(ierr);
+      ierr = KSPDestroy(&ksp_coarse); CHKERRQ(ierr);
+      ierr = VecDestroy(&x_end); CHKERRQ(ierr);
+      ierr = VecDestroy(&f_end); CHKERRQ(ierr);
+    }
+  }
+
   PetscInt rstart = 0, rend = 0, nz;
-  std::vector<PetscInt> columns;
-  std::vector<PetscInt>::iterator it;
   const PetscInt *cwork;
   const PetscScalar *vwork;
   ierr = MatGetOwnershipRange(A.back(), &rstart, &rend); CHKERRQ(ierr);
-  PetscInt *onDiag  = new PetscInt[lrows];
-  PetscInt *offDiag = new PetscInt[lrows];
-  for (int ii = rstart; ii < rend; ii++) {
-    // Get all columns in this row
-    columns.resize(0);
-    ierr = MatGetRow(A.back(), ii, &nz, &cwork, NULL); CHKERRQ(ierr);
-    columns.insert(columns.end(), cwork, cwork+nz);
-    ierr = MatRestoreRow(A.back(), ii, &nz, &cwork, NULL); CHKERRQ(ierr);
-    ierr = MatGetRow(B.back(), ii, &nz, &cwork, NULL); CHKERRQ(ierr);
-    columns.insert(columns.end(), cwork, cwork+nz);
-    ierr = MatRestoreRow(B.back(), ii, &nz, &cwork, NULL); CHKERRQ(ierr);
-    // Get unique columns in this row
-    sort(columns.begin(), columns.end());
-    it = unique(columns.begin(), columns.end());
-    columns.resize(distance(columns.begin(), it));
-    onDiag[ii]  = (myid==endrank)*Qsize;
-    offDiag[ii] = (myid!=endrank)*Qsize;
-    for (it = columns.begin(); it != columns.end(); it++) {
-      if (*it >= rstart && *it < rend)
-        onDiag[ii]++;
-      else
-        offDiag[ii]++;
+  if (K.back() == NULL) {
+    // Initialize the matrix
+    ierr = MatCreate(comm, &K.back()); CHKERRQ(ierr);
+    ierr = MatSetSizes(K.back(), lrows, lcols, rows+Qsize, cols+Qsize); CHKERRQ(ierr);
+    ierr = MatSetOptionsPrefix(K.back(), "JDMG_K_"); CHKERRQ(ierr);
+    ierr = MatSetFromOptions(K.back()); CHKERRQ(ierr);
+
+    // Preallocation
+    std::vector<PetscInt> columns;
+    std::vector<PetscInt>::iterator it;
+    PetscInt *onDiag  = new PetscInt[lrows];
+    PetscInt *offDiag = new PetscInt[lrows];
+    for (int ii = rstart; ii < rend; ii++) {
+      // Get all columns in this row
+      columns.resize(0);
+      ierr = MatGetRow(A.back(), ii, &nz, &cwork, NULL); CHKERRQ(ierr);
+      columns.insert(columns.end(), cwork, cwork+nz);
+      ierr = MatRestoreRow(A.back(), ii, &nz, &cwork, NULL); CHKERRQ(ierr);
+      ierr = MatGetRow(B.back(), ii, &nz, &cwork, NULL); CHKERRQ(ierr);
+      columns.insert(columns.end(), cwork, cwork+nz);
+      ierr = MatRestoreRow(B.back(), ii, &nz, &cwork, NULL); CHKERRQ(ierr);
+      // Get unique columns in this row
+      sort(columns.begin(), columns.end());
+      it = unique(columns.begin(), columns.end());
+      columns.resize(distance(columns.begin(), it));
+      onDiag[ii]  = (myid==endrank)*Qsize;
+      offDiag[ii] = (myid!=endrank)*Qsize;
+      for (it = columns.begin(); it != columns.end(); it++) {
+        if (*it >= rstart && *it < rend)
+          onDiag[ii]++;
+        else
+          offDiag[ii]++;
+      }
     }
+    if (myid == endrank) {
+      fill(onDiag+nlcoarse, onDiag+lrows, nlcoarse+1);
+      fill(offDiag+nlcoarse, offDiag+lrows, nlcoarse);
+    }
+    MatXAIJSetPreallocation(K.back(), 1, onDiag, offDiag, NULL, NULL); CHKERRQ(ierr);
+    delete[] onDiag; delete[] offDiag;
+
+    // Solution and rhs vectors at coarse level
+    ierr = MatCreateVecs(K.back(), &x_end, &f_end); CHKERRQ(ierr);
   }
-  if (myid == endrank) {
-    fill(onDiag+nlcoarse, onDiag+lrows, nlcoarse+1);
-    fill(offDiag+nlcoarse, offDiag+lrows, nlcoarse);
-  }
-  MatXAIJSetPreallocation(K.back(), 1, onDiag, offDiag, NULL, NULL); CHKERRQ(ierr);
-  delete[] onDiag; delete[] offDiag;
 
   // Add "Q" rows/columns
   if (myid == endrank) {
@@ -392,8 +548,6 @@ PetscErrorCode JDMG::Setup_Coarse()
   ierr = MatAssemblyBegin(K.back(), MAT_FINAL_ASSEMBLY); CHKERRQ(ierr);
   ierr = MatAssemblyEnd(K.back(), MAT_FINAL_ASSEMBLY); CHKERRQ(ierr);
 
-  // Solution and rhs vectors at coarse level
-  ierr = MatCreateVecs(K.back(), &x_end, &f_end); CHKERRQ(ierr);
   ierr = VecSet(f_end, 0.0); CHKERRQ(ierr);
   ierr = PetscLogEventEnd(EIG_Setup_Coarse, 0, 0, 0, 0); CHKERRQ(ierr);
 
@@ -414,15 +568,18 @@ PetscErrorCode JDMG::Compute_Coarse()
                         "coarse level\n"); CHKERRQ(ierr);
 
   ierr = PetscLogEventBegin(EIG_Comp_Coarse, 0, 0, 0, 0); CHKERRQ(ierr);
-  // Initialize
-  ierr = EPSCreate(comm, &eps_coarse); CHKERRQ(ierr);
-  if (ncoarse < 500) {
-    ierr = EPSSetType(eps_coarse, EPSLAPACK); CHKERRQ(ierr);
-  }
-  else {
-    ierr = EPSSetType(eps_coarse, EPSKRYLOVSCHUR); CHKERRQ(ierr);
+  // Initialize, the EPS object is kept as long as the hierarchy is
+  if (eps_coarse == NULL) {
+    ierr = EPSCreate(comm, &eps_coarse); CHKERRQ(ierr);
+    if (ncoarse < 500) {
+      ierr = EPSSetType(eps_coarse, EPSLAPACK); CHKERRQ(ierr);
+    }
+    else {
+      ierr = EPSSetType(eps_coarse, EPSKRYLOVSCHUR); CHKERRQ(ierr);
+    }
+    ierr = EPSSetProblemType(eps_coarse, EPS_GHEP); CHKERRQ(ierr);
+    ierr = EPSSetOptionsPrefix(eps_coarse, "coarse_"); CHKERRQ(ierr);
   }
-  ierr = EPSSetProblemType(eps_coarse, EPS_GHEP); CHKERRQ(ierr);
   if (tau == NUMERIC)
     ierr = EPSSetWhichEigenpairs(eps_coarse, EPS_TARGET_REAL);
   else if (tau == SM || tau == LM)
@@ -440,7 +597,10 @@ PetscErrorCode JDMG::Compute_Coarse()
   ierr = EPSSetDimensions(eps_coarse, nev_req, PETSC_DEFAULT,
                           PETSC_DEFAULT); CHKERRQ(ierr);
   ierr = EPSSetTolerances(eps_coarse, 1e-6, PETSC_DEFAULT); CHKERRQ(ierr);
-  ierr = EPSSetOptionsPrefix(eps_coarse, "coarse_"); CHKERRQ(ierr);
+  // Warm start from the coarse eigenvectors of the last compute step
+  if (ncoarse_phi > 0) {
+    ierr = EPSSetInitialSpace(eps_coarse, ncoarse_phi, coarse_phi); CHKERRQ(ierr);
+  }
   ierr = EPSSetFromOptions(eps_coarse); CHKERRQ(ierr);
 
   // Solve
@@ -458,12 +618,19 @@ PetscErrorCode JDMG::Compute_Coarse()
   for (short ii = 0; ii < nev_conv; ii++) {
     ierr = EPSGetEigenvector(eps_coarse, ii, Q.back()[ii], 0); CHKERRQ(ierr);
   }
+  if (ncoarse_phi > 0) {
+    ierr = VecDestroyVecs(ncoarse_phi, &coarse_phi); CHKERRQ(ierr);
+  }
+  ncoarse_phi = nev_conv;
+  ierr = VecDuplicateVecs(Q.back()[0], ncoarse_phi, &coarse_phi); CHKERRQ(ierr);
+  for (PetscInt ii = 0; ii < ncoarse_phi; ii++) {
+    ierr = VecCopy(Q.back()[ii], coarse_phi[ii]); CHKERRQ(ierr);
+  }
 
   for (short ii = levels-2; ii >=0; ii--) {
     for (short jj = 0; jj < nev_conv; jj++)
       ierr = MatMult(P[ii], Q[ii+1][jj], Q[ii][jj]); CHKERRQ(ierr);
   }
-  ierr = EPSDestroy(&eps_coarse); CHKERRQ(ierr);
   ierr = PetscLogEventEnd(EIG_Comp_Coarse, 0, 0, 0, 0); CHKERRQ(ierr);
 
   return 0;
@@ -541,10 +708,14 @@ PetscErrorCode JDMG::Update_Preconditioner(Vec residual,
               p_BQ, INSERT_VALUES); CHKERRQ(ierr);
   ierr = MatSetValue(K.back(), col, col, 0.0, INSERT_VALUES); CHKERRQ(ierr);
   ierr = VecRestoreArray(BQ.back()[nev_conv], &p_BQ); CHKERRQ(ierr);
+  // Both norms share one reduction, overlapped with the assembly
+  ierr = VecNormBegin(residual, NORM_2, &rnorm); CHKERRQ(ierr);
+  ierr = VecNormBegin(AQ[0][nev_conv], NORM_2, &Au_norm); CHKERRQ(ierr);
+  ierr = PetscCommSplitReductionBegin(PetscObjectComm((PetscObject)residual)); CHKERRQ(ierr);
   ierr = MatAssemblyBegin(K.back(), MAT_FINAL_ASSEMBLY); CHKERRQ(ierr);
-  ierr = VecNorm(residual, NORM_2, &rnorm); CHKERRQ(ierr);
-  ierr = VecNorm(AQ[0][nev_conv], NORM_2, &Au_norm); CHKERRQ(ierr);
   ierr = MatAssemblyEnd(K.back(), MAT_FINAL_ASSEMBLY); CHKERRQ(ierr);
+  ierr = VecNormEnd(residual, NORM_2, &rnorm); CHKERRQ(ierr);
+  ierr = VecNormEnd(AQ[0][nev_conv], NORM_2, &Au_norm); CHKERRQ(ierr);
 
   return 0;
 }
@@ -602,20 +773,15 @@ PetscErrorCode JDMG::Compute_Clean()
   // Destroy eigenvector storage space at each level
   ierr = Destroy_Q(); CHKERRQ(ierr);
 
-  // Destroy coarse problem
-  ierr = KSPDestroy(&ksp_coarse); CHKERRQ(ierr);
-
-  // Destroy Operators
+  // Destroy work vectors, operators and coarse solvers are kept for the
+  // next compute step (see Clear_Hierarchy)
   for (int ii = 0; ii < levels-1; ii++) {
-    //ierr = MatDestroy(Acopy.data()+ii); CHKERRQ(ierr);
-    ierr = MatDestroy(Bcopy.data()+ii); CHKERRQ(ierr);
     ierr = VecDestroy(xlist.data()+ii+1); CHKERRQ(ierr);
     ierr = VecDestroy(flist.data()+ii+1); CHKERRQ(ierr);
     ierr = VecDestroy(Dlist.data()+ii); CHKERRQ(ierr);
     ierr = VecDestroy(OPx.data()+ii); CHKERRQ(ierr);
     ierr = VecDestroyVecs(Qsize, QMatP.data()+ii); CHKERRQ(ierr);
   }
-  ierr = VecDestroy(&x_end); CHKERRQ(ierr); ierr = VecDestroy(&f_end); CHKERRQ(ierr);
   Q.resize(0);
 
   return 0;
@@ -704,13 +870,17 @@ PetscErrorCode JDMG::MGSetup(Vec f, PetscReal fnorm)
       ierr = VecCopy(AQ[ii][jj], QMatP[ii][jj]); CHKERRQ(ierr);
       ierr = VecAXPY(QMatP[ii][jj], -sigma, BQ[ii][jj]); CHKERRQ(ierr);
     }
+    // The level operator depends on the shift and converged vectors
+    if (smoother == Chebyshev) {
+      ierr = Cheby_Estimate(ii); CHKERRQ(ierr);
+    }
 
     if ((ii + nev_conv == 0) && !vicinity) {
       Vec x;
       ierr = VecDuplicate(f, &x); CHKERRQ(ierr); 
       ArrayXPS QMatQ = lambda.segment(0,nev_conv+1) - sigma;
       ierr = VecSet(x, 0.0); CHKERRQ(ierr);
-      ierr = WJac(f, x, ii); CHKERRQ(ierr);
+      ierr = Smooth(f, x, ii); CHKERRQ(ierr);
       ierr = ApplyOP(x, OPx[ii], ii); CHKERRQ(ierr);
       ierr = VecAYPX(OPx[ii], -1.0, f); CHKERRQ(ierr);
       PetscReal OPx_norm;
@@ -866,11 +1036,13 @@ PetscErrorCode JDMG::ApplyOP(Vec x, Vec y, PetscInt level)
   ierr = VecRestoreArrays(BQ[level], nev_conv+1, &p_BQ); CHKERRQ(ierr);
   ierr = VecRestoreArrays(QMatP[level], nev_conv+1, &p_QMatP); CHKERRQ(ierr);
 
-  // Reduction for dot products
-  MPI_Iallreduce(MPI_IN_PLACE, PQBx.data(), nev_conv+1, MPI_DOUBLE,
-                MPI_SUM, MG_comms[level], &request1);
-  MPI_Iallreduce(MPI_IN_PLACE, QMatPx.data(), nev_conv+1, MPI_DOUBLE,
-                MPI_SUM, MG_comms[level], &request2);
+  // Reduction for dot products (only processes with part of this level)
+  if (MG_comms[level] != MPI_COMM_NULL) {
+    MPI_Iallreduce(MPI_IN_PLACE, PQBx.data(), nev_conv+1, MPI_DOUBLE,
+                  MPI_SUM, MG_comms[level], &request1);
+    MPI_Iallreduce(MPI_IN_PLACE, QMatPx.data(), nev_conv+1, MPI_DOUBLE,
+                  MPI_SUM, MG_comms[level], &request2);
+  }
   // This is so VecMAXPY doesn't throw an error when debugging
   #if defined(PETSC_USE_DEBUG)
   MPI_Wait(&request1, MPI_STATUS_IGNORE);
@@ -940,7 +1112,7 @@ PetscErrorCode JDMG::FullMGSolve(Vec x, Vec f)
         ierr = Coarse_Solve(); CHKERRQ(ierr);
       }
       else {
-        ierr = WJac(flist[jj], xlist[jj], jj); CHKERRQ(ierr);
+        ierr = Smooth(flist[jj], xlist[jj], jj); CHKERRQ(ierr);
         ierr = ApplyOP(xlist[jj], OPx[jj], jj); CHKERRQ(ierr);
         ierr = VecAYPX(OPx[jj], -1.0, flist[jj]); CHKERRQ(ierr);
         ierr = MatMultTranspose(P[jj], OPx[jj], flist[jj+1]); CHKERRQ(ierr);
@@ -950,7 +1122,7 @@ PetscErrorCode JDMG::FullMGSolve(Vec x, Vec f)
     //Upcycling
     for (int jj = levels-2; jj >= ii; jj--) {
       ierr = MatMultAdd(P[jj], xlist[jj+1], xlist[jj], xlist[jj]); CHKERRQ(ierr);
-      ierr = WJac(flist[jj], xlist[jj], jj); CHKERRQ(ierr);
+      ierr = Smooth(flist[jj], xlist[jj], jj); CHKERRQ(ierr);
     }
     if (ii > 0) {
       ierr = MatMult(P[ii-1], xlist[ii], xlist[ii-1]); CHKERRQ(ierr);
@@ -984,7 +1156,7 @@ PetscErrorCode JDMG::MGSolve(Vec x, Vec f)
   // Downcycle
   for (int ii = 0; ii < levels-1; ii++) {
     ierr = VecSet(xlist[ii], 0.0); CHKERRQ(ierr);
-    ierr = WJac(flist[ii], xlist[ii], ii); CHKERRQ(ierr);
+    ierr = Smooth(flist[ii], xlist[ii], ii); CHKERRQ(ierr);
     ierr = ApplyOP(xlist[ii], OPx[ii], ii); CHKERRQ(ierr);
     ierr = VecAYPX(OPx[ii], -1.0, flist[ii]); CHKERRQ(ierr);
     ierr = MatMultTranspose(P[ii], OPx[ii], flist[ii+1]); CHKERRQ(ierr);
@@ -1001,13 +1173,30 @@ PetscErrorCode JDMG::MGSolve(Vec x, Vec f)
       TempScal *= -1;
       ierr = VecMAXPY(xlist[ii], nev_conv+1, TempScal.data(), Q[ii]); CHKERRQ(ierr);
     }
-    ierr = WJac(flist[ii], xlist[ii], ii); CHKERRQ(ierr);
+    ierr = Smooth(flist[ii], xlist[ii], ii); CHKERRQ(ierr);
   }
 
   ierr = PetscLogEventEnd(EIG_Precondition, 0, 0, 0, 0); CHKERRQ(ierr);
   return 0;
 }
 
+/********************************************************************
+ * Apply the selected smoother
+ * 
+ * @param y: Right-hand-side
+ * @param x: Solution to smooth
+ * @param level: Level of the multigrid to smooth
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode JDMG::Smooth(Vec y, Vec x, PetscInt level)
+{
+  if (smoother == Chebyshev)
+    return Cheby(y, x, level);
+  return WJac(y, x, level);
+}
+
 /********************************************************************
  * Weighted Jacobi smoother
  * 
@@ -1022,20 +1211,106 @@ PetscErrorCode JDMG::WJac(Vec y, Vec x, PetscInt level)
 {
   // The y being fed in is -r, as it should be
   PetscErrorCode ierr = 0;
-  ierr = PetscLogEventBegin(EIG_Jacobi, 0, 0, 0, 0); CHKERRQ(ierr);
   if (nsweep == 0)
     return 0;
+  ierr = PetscLogEventBegin(EIG_Jacobi, 0, 0, 0, 0); CHKERRQ(ierr);
 
-  Vec r;
-  ierr = VecDuplicate(y, &r); CHKERRQ(ierr);
+  Vec r = smooth_work[level][0];
   for (int ii = 0; ii < nsweep; ii++) {
     ierr = ApplyOP(x, r, level); CHKERRQ(ierr);
     ierr = VecAYPX(r, -1.0, y); CHKERRQ(ierr);
     ierr = VecPointwiseDivide(r, r, Dlist[level]); CHKERRQ(ierr);
     ierr = VecAXPY(x, w, r); CHKERRQ(ierr);
   }
-  VecDestroy(&r);
   ierr = PetscLogEventEnd(EIG_Jacobi, 0, 0, 0, 0); CHKERRQ(ierr);
 
+  return 0;
+}
+
+/********************************************************************
+ * Jacobi preconditioned Chebyshev smoother. Uses the same number of
+ * sweeps as the weighted Jacobi smoother
+ * 
+ * @param y: Right-hand-side
+ * @param x: Solution to smooth
+ * @param level: Level of the multigrid to smooth
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode JDMG::Cheby(Vec y, Vec x, PetscInt level)
+{
+  PetscErrorCode ierr = 0;
+  if (nsweep == 0)
+    return 0;
+  ierr = PetscLogEventBegin(EIG_Chebyshev, 0, 0, 0, 0); CHKERRQ(ierr);
+
+  Vec r = smooth_work[level][0], d = smooth_work[level][1];
+  PetscScalar theta = (cheb_emax[level] + cheb_emin[level])/2;
+  PetscScalar delta = (cheb_emax[level] - cheb_emin[level])/2;
+  PetscScalar rho_old = delta/theta, rho_new;
+  for (int ii = 0; ii < nsweep; ii++) {
+    ierr = ApplyOP(x, r, level); CHKERRQ(ierr);
+    ierr = VecAYPX(r, -1.0, y); CHKERRQ(ierr);
+    ierr = VecPointwiseDivide(r, r, Dlist[level]); CHKERRQ(ierr);
+    if (ii == 0) {
+      ierr = VecAXPBY(d, 1/theta, 0.0, r); CHKERRQ(ierr);
+    }
+    else {
+      rho_new = 1/(2*theta/delta - rho_old);
+      ierr = VecAXPBY(d, 2*rho_new/delta, rho_new*rho_old, r); CHKERRQ(ierr);
+      rho_old = rho_new;
+    }
+    ierr = VecAXPY(x, 1.0, d); CHKERRQ(ierr);
+  }
+  ierr = PetscLogEventEnd(EIG_Chebyshev, 0, 0, 0, 0); CHKERRQ(ierr);
+
+  return 0;
+}
+
+/********************************************************************
+ * Estimate the largest eigenvalue of the Jacobi preconditioned
+ * operator with a few power iterations to set the Chebyshev bounds
+ * 
+ * @param level: Level of the multigrid to estimate bounds for
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ * @options: -JDMG_Cheby_nEst: Number of power iterations
+ *           -JDMG_Cheby_Ratio: Ratio of lower to upper bound
+ * 
+ *******************************************************************/
+PetscErrorCode JDMG::Cheby_Estimate(PetscInt level)
+{
+  PetscErrorCode ierr = 0;
+  ierr = PetscLogEventBegin(EIG_Chebyshev, 0, 0, 0, 0); CHKERRQ(ierr);
+
+  PetscInt nest = 10;
+  PetscScalar ratio = 0.1;
+  ierr = PetscOptionsGetInt(NULL, NULL, "-JDMG_Cheby_nEst", &nest, NULL); CHKERRQ(ierr);
+  ierr = PetscOptionsGetReal(NULL, NULL, "-JDMG_Cheby_Ratio", &ratio, NULL); CHKERRQ(ierr);
+
+  Vec x = smooth_work[level][0], y = smooth_work[level][1];
+  PetscReal xnorm, ynorm;
+  ierr = VecSetRandom(x, NULL); CHKERRQ(ierr);
+  ierr = VecNorm(x, NORM_2, &xnorm); CHKERRQ(ierr);
+  ierr = VecScale(x, 1/xnorm); CHKERRQ(ierr);
+  PetscScalar emax = 0;
+  for (int ii = 0; ii < nest; ii++) {
+    ierr = ApplyOP(x, y, level); CHKERRQ(ierr);
+    ierr = VecPointwiseDivide(y, y, Dlist[level]); CHKERRQ(ierr);
+    ierr = VecNorm(y, NORM_2, &ynorm); CHKERRQ(ierr);
+    emax = ynorm;
+    ierr = VecAXPBY(x, 1/ynorm, 0.0, y); CHKERRQ(ierr);
+  }
+  // Safety factor since power iterations underestimate the bound
+  cheb_emax[level] = 1.1*emax;
+  cheb_emin[level] = ratio*cheb_emax[level];
+  if (this->verbose >= 3) {
+    ierr = PetscFPrintf(comm, output, "Chebyshev bounds on level %i: [%1.4g, %1.4g]\n",
+                        level, cheb_emin[level], cheb_emax[level]); CHKERRQ(ierr);
+  }
+
+  ierr = PetscLogEventEnd(EIG_Chebyshev, 0, 0, 0, 0); CHKERRQ(ierr);
   return 0;
 }
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include "PRINVIT.h"
 
 enum MG_Cycle_Type {VCycle, FMGCycle};
+enum MG_Smoother_Type {WJacobi, Chebyshev};
 
 /// The master structure containing all information to be carried between iterations
 class JDMG : public PRINVIT
@@ -21,12 +22,16 @@ public:
   ~JDMG();
   // How much information to print
   PetscErrorCode Set_Verbose(PetscInt verbose);
+  // Set operators, keeping the coarse operators if the structure is unchanged
+  PetscErrorCode Set_Operators(Mat A, Mat B);
   // Get hierarchy from existing PCMG object
   PetscErrorCode PCMG_Extract(PC pcmg, bool isB=true, bool isA=false);
   PetscErrorCode Set_Hierarchy(std::vector<Mat> P,
     const std::vector<MPI_Comm> MG_comms = std::vector<MPI_Comm>());
   // Set which multigrid cycle to use
   void Set_Cycle(MG_Cycle_Type cycle) {this->cycle = cycle;}
+  // Set which multigrid smoother to use
+  void Set_Smoother(MG_Smoother_Type smoother) {this->smoother = smoother;}
   // Settings for the preconditioner
   void Set_Jacobi_Weight(PetscScalar w) {this->w = w;}
   void Set_Jacobi_nSweep(PetscInt nsweep) {this->nsweep = nsweep;}
@@ -34,6 +39,8 @@ public:
 private:
   // Multigrid cyle to use
   MG_Cycle_Type cycle;
+  // Multigrid smoother to use
+  MG_Smoother_Type smoother;
   // Multigrid prolongation operators
   std::vector<Mat> P;
   // Operator Matrices in multigrid
@@ -50,6 +57,13 @@ private:
   bool prepped;
   // EPS object for coarse scale eigenvalue problem and KSP for solver
   EPS eps_coarse;
+  // Coarse eigenvectors from the last compute step (warm start)
+  Vec *coarse_phi;
+  PetscInt ncoarse_phi;
+  // Nonzero states of the fine operators the hierarchy was built from
+  PetscObjectState Anz, Bnz;
+  // Flags if coarse operators were taken from a PCMG object
+  bool A_extracted, B_extracted;
 
   /// Variables only needed in compute step
   std::vector<Mat> Acopy, Bcopy;
@@ -58,6 +72,10 @@ private:
   // Number of sweeps and weight for weighted Jacobi smoother
   PetscInt nsweep;
   PetscScalar w;
+  // Chebyshev eigenvalue bounds at each level for the current shift
+  std::vector<PetscScalar> cheb_emin, cheb_emax;
+  // Smoother work vectors at each level
+  std::vector<Vec*> smooth_work;
   // Number of levels in hierarchy
   PetscInt levels;
   // KSP for coarse solver
@@ -76,6 +94,8 @@ private:
   PetscErrorCode Compute_Init();
   PetscErrorCode Setup_Coarse();
   PetscErrorCode Create_Hierarchy();
+  // Destroy operators and solvers that are kept between compute steps
+  PetscErrorCode Clear_Hierarchy();
   PetscErrorCode Initialize_V();
   // Update the search space with the correction equation
   PetscErrorCode Update_Search(Vec x, Vec residual, PetscReal rnorm);
@@ -89,8 +109,13 @@ private:
   // Multigrid cycles
   PetscErrorCode FullMGSolve(Vec x, Vec f);
   PetscErrorCode MGSolve(Vec x, Vec f);
+  // Smoothing with the selected smoother
+  PetscErrorCode Smooth(Vec y, Vec x, PetscInt level);
   // Weighted Jacobi smoothing
   PetscErrorCode WJac(Vec y, Vec x, PetscInt level);
+  // Jacobi preconditioned Chebyshev smoothing
+  PetscErrorCode Cheby(Vec y, Vec x, PetscInt level);
+  PetscErrorCode Cheby_Estimate(PetscInt level);
   // Apply Operator at a given level
   PetscErrorCode ApplyOP(Vec x, Vec y, PetscInt level);
   // Coarse solver in multigrid
@@ -26,6 +26,7 @@ void daxpy_(const int *N, const double *a, const double *x, const int *incx,
 LOPGMRES::LOPGMRES(MPI_Comm comm)
 {
   this->comm = comm; Set_ID();
+  pc = NULL;
   PetscOptionsGetInt(NULL, NULL, "-LOPGMRES_Verbose", &verbose, NULL);
   PetscFOpen(this->comm, "stdout", "w", &output);
   file_opened = 1;
@@ -100,8 +101,12 @@ PetscErrorCode LOPGMRES::Update_Preconditioner(Vec residual,
 {
   PetscErrorCode ierr = 0;
 
-  ierr = VecNorm(residual, NORM_2, &rnorm); CHKERRQ(ierr);
-  ierr = VecNorm(AQ[0][nev_conv], NORM_2, &Au_norm); CHKERRQ(ierr);
+  // Both norms share one reduction. The preconditioner is applied in
+  // Update_Search, which is skipped when the eigenvalue has converged
+  ierr = VecNormBegin(residual, NORM_2, &rnorm); CHKERRQ(ierr);
+  ierr = VecNormBegin(AQ[0][nev_conv], NORM_2, &Au_norm); CHKERRQ(ierr);
+  ierr = VecNormEnd(residual, NORM_2, &rnorm); CHKERRQ(ierr);
+  ierr = VecNormEnd(AQ[0][nev_conv], NORM_2, &Au_norm); CHKERRQ(ierr);
 
   return 0;
 }
@@ -20,9 +20,10 @@ public:
   // How much information to print
   PetscErrorCode Set_Verbose(PetscInt verbose);
   // Set the preconditioner instance
-  PetscErrorCode Set_PC(PC pc) {this->pc = pc; 
-        PetscErrorCode ierr = PetscObjectReference((PetscObject)pc);
-        CHKERRQ(ierr); return ierr;}
+  PetscErrorCode Set_PC(PC pc) {
+        PetscErrorCode ierr = PetscObjectReference((PetscObject)pc); CHKERRQ(ierr);
+        ierr = PCDestroy(&this->pc); CHKERRQ(ierr);
+        this->pc = pc; return ierr;}
 
 private:
   /// Class variables
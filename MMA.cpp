@@ -16,14 +16,14 @@ using namespace std;
 void MMA::Initialize()
 {
   /// These variables are usually not going to change, but the user should have the option
-  zzz.resize(nloc);
   low.resize(nloc);
   upp.resize(nloc);
   if (xval.size() != nloc)
     xval.setZero(nloc);
   xold1 = xval; xold2 = xval;
   active.resize(nloc);
-  fill(active.begin(), active.end(), true);
+  for (long i = 0; i < nloc; i++)
+    active[i] = i;
   nactive = nloc;
 }
 
@@ -49,6 +49,228 @@ void MMA::Set_m(uint mval)
   return;
 }
 
+/********************************************************************
+ * Write the optimizer state (design variables of the last three
+ * iterations, asymptotes, and counters) to a binary file. Each array
+ * is stored in global order so all ranks write at once. A failure on
+ * any rank is returned on all of them.
+ * 
+ * @param filename: Name of the state file
+ * 
+ * @return ierr: ErrorCode
+ * 
+ *******************************************************************/
+int MMA::Write_State(const char *filename)
+{
+  int ierr = 0;
+  long header[4] = {(long)n, (long)m, (long)iter, (long)fresh_start};
+  long start = 0;
+  ierr = MPI_Exscan(&nloc, &start, 1, MPI_LONG, MPI_SUM, Comm);
+  if (myid == 0)
+    start = 0;
+
+  MPI_File fh;
+  ierr = MPI_File_open(Comm, filename, MPI_MODE_WRONLY | MPI_MODE_CREATE,
+                       MPI_INFO_NULL, &fh);
+  if (ierr != 0) {
+    if (myid == 0)
+      printf("Unable to open optimizer state file %s\n", filename);
+    return ierr;
+  }
+  // Every rank takes part in each collective call even after a failure,
+  // and the first error on any rank is reported by all of them
+  int err = MPI_File_set_size(fh, 0);
+  if (myid == 0 && err == 0)
+    err = MPI_File_write_at(fh, 0, header, 4, MPI_LONG, MPI_STATUS_IGNORE);
+
+  Eigen::VectorXd *arrays[5] = {&xval, &xold1, &xold2, &low, &upp};
+  MPI_Offset offset = sizeof(header) + start*sizeof(double);
+  for (short i = 0; i < 5; i++) {
+    ierr = MPI_File_write_at_all(fh, offset, arrays[i]->data(), nloc, MPI_DOUBLE,
+                                 MPI_STATUS_IGNORE);
+    if (err == 0)
+      err = ierr;
+    offset += n*sizeof(double);
+  }
+  ierr = MPI_File_close(&fh);
+  if (err == 0)
+    err = ierr;
+
+  int failed = (err != 0);
+  MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_LOR, Comm);
+  if (failed) {
+    if (myid == 0)
+      printf("Unable to write optimizer state file %s\n", filename);
+    return (err != 0) ? err : 60;
+  }
+
+  return 0;
+}
+
+/********************************************************************
+ * Read the optimizer state written by Write_State. The local sizes
+ * must already be set (Set_n), but may differ from the run that wrote
+ * the file as long as the global size is the same. The number of
+ * constraints must already be set (Set_m) and match the file.
+ * 
+ * @param filename: Name of the state file
+ * 
+ * @return ierr: ErrorCode
+ * 
+ *******************************************************************/
+int MMA::Read_State(const char *filename)
+{
+  int ierr = 0;
+  long header[4];
+  long start = 0;
+  ierr = MPI_Exscan(&nloc, &start, 1, MPI_LONG, MPI_SUM, Comm);
+  if (myid == 0)
+    start = 0;
+
+  MPI_File fh;
+  ierr = MPI_File_open(Comm, filename, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+  if (ierr != 0) {
+    if (myid == 0)
+      printf("Unable to open optimizer state file %s\n", filename);
+    return ierr;
+  }
+  MPI_Status status;
+  int count = 0;
+  ierr = MPI_File_read_at_all(fh, 0, header, 4, MPI_LONG, &status);
+  if (ierr == 0)
+    ierr = MPI_Get_count(&status, MPI_LONG, &count);
+  if (ierr != 0 || count != 4) {
+    if (myid == 0)
+      printf("Unable to read the header of optimizer state file %s\n", filename);
+    MPI_File_close(&fh);
+    return (ierr != 0) ? ierr : 60;
+  }
+  if (header[0] != (long)n) {
+    if (myid == 0) {
+      printf("Error dectected at line %i in file %s\n", __LINE__, __FILE__);
+      printf("Optimizer state has %li design variables instead of %lu\n",
+             header[0], n);
+    }
+    MPI_File_close(&fh);
+    return 60;
+  }
+  if (header[1] != (long)m) {
+    if (myid == 0) {
+      printf("Error dectected at line %i in file %s\n", __LINE__, __FILE__);
+      printf("Optimizer state has %li constraints instead of %i\n",
+             header[1], m);
+    }
+    MPI_File_close(&fh);
+    return 60;
+  }
+  // Collective reads past the end of the file do not always show up in
+  // the element count, so check the size up front
+  MPI_Offset size = 0;
+  ierr = MPI_File_get_size(fh, &size);
+  if (ierr != 0 || size < (MPI_Offset)(sizeof(header) + 5*n*sizeof(double))) {
+    if (myid == 0)
+      printf("Optimizer state file %s is truncated\n", filename);
+    MPI_File_close(&fh);
+    return (ierr != 0) ? ierr : 60;
+  }
+
+  // Same pattern as Write_State: finish the collective reads, then
+  // agree on whether any rank failed
+  Eigen::VectorXd *arrays[5] = {&xval, &xold1, &xold2, &low, &upp};
+  MPI_Offset offset = sizeof(header) + start*sizeof(double);
+  int err = 0;
+  for (short i = 0; i < 5; i++) {
+    arrays[i]->resize(nloc);
+    ierr = MPI_File_read_at_all(fh, offset, arrays[i]->data(), nloc, MPI_DOUBLE,
+                                &status);
+    if (ierr == 0)
+      ierr = MPI_Get_count(&status, MPI_DOUBLE, &count);
+    if (err == 0)
+      err = (ierr != 0) ? ierr : (count != (int)nloc ? 60 : 0);
+    offset += n*sizeof(double);
+  }
+  ierr = MPI_File_close(&fh);
+  if (err == 0)
+    err = ierr;
+
+  int failed = (err != 0);
+  MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_LOR, Comm);
+  if (failed) {
+    if (myid == 0)
+      printf("Unable to read optimizer state file %s\n", filename);
+    return (err != 0) ? err : 60;
+  }
+  iter = header[2];
+  fresh_start = header[3];
+
+  return 0;
+}
+
+/********************************************************************
+ * Get the state of each local design variable: the values of the last
+ * three iterations, the asymptotes, and the bounds
+ * 
+ * @param state: One row per local variable with columns xval, xold1,
+ *               xold2, low, upp, xmin, xmax (output)
+ * 
+ * @return void
+ * 
+ *******************************************************************/
+void MMA::Get_State(Eigen::MatrixXd &state)
+{
+  state.resize(nloc, 7);
+  state.col(0) = xval; state.col(1) = xold1; state.col(2) = xold2;
+  state.col(3) = low; state.col(4) = upp;
+  state.col(5) = xmin; state.col(6) = xmax;
+
+  return;
+}
+
+/********************************************************************
+ * Replace the local design variables with the state from Get_State,
+ * possibly for a different set of local variables. The global number
+ * of variables must not change.
+ * 
+ * @param state: One row per local variable, as given by Get_State
+ * 
+ * @return void
+ * 
+ *******************************************************************/
+void MMA::Set_State(Eigen::MatrixXd &state)
+{
+  xval = state.col(0);
+  Set_n(state.rows());
+  xold1 = state.col(1); xold2 = state.col(2);
+  low = state.col(3); upp = state.col(4);
+  xmin = state.col(5); xmax = state.col(6);
+
+  return;
+}
+
+/********************************************************************
+ * Bytes held by the local arrays of the optimizer
+ * 
+ * @return bytes: Bytes held on this process
+ * 
+ *******************************************************************/
+double MMA::Memory()
+{
+  Eigen::VectorXd *vectors[] = {&xval, &xold1, &xold2, &xmin, &xmax, &a, &b, &c, &d,
+                                &low, &upp, &x_act, &x1_act, &x2_act, &xmin_act,
+                                &xmax_act, &low_act, &upp_act, &alfa, &beta, &p0, &q0,
+                                &plam, &qlam, &lambda, &eta, &ymma, &lamma, &xsimma,
+                                &etamma, &mumma, &smma, &residual};
+  double bytes = 0;
+  for (unsigned int i = 0; i < sizeof(vectors)/sizeof(vectors[0]); i++)
+    bytes += vectors[i]->size()*sizeof(double);
+  bytes += (P.size() + Q.size())*sizeof(double);
+  bytes += (Ps.nonZeros() + Qs.nonZeros())*(sizeof(double) + sizeof(int)) +
+           (Ps.outerSize() + Qs.outerSize() + 2)*sizeof(int);
+  bytes += active.capacity()*sizeof(long);
+
+  return bytes;
+}
+
 /********************************************************************
  * Generic optimization update routine
  * 
@@ -84,12 +306,55 @@ int MMA::Update(Eigen::VectorXd &dfdx, Eigen::VectorXd &g, Eigen::MatrixXd &dgdx
     OCeta = 0.5;
     ierr = OCsub(dfdx, g, dgdx);
   }
+  else if ((uint)m > sparse_limit) {
+    // The gradients arrive dense, but the sparse subsolver still avoids
+    // the m x m systems; zero gradients are dropped on the way
+    Eigen::SparseMatrix<double> dgdx_sparse = dgdx.sparseView();
+    ierr = MMAsub(dfdx, g, dgdx_sparse);
+  }
   else
     ierr = MMAsub(dfdx, g, dgdx);
 
   return ierr;
 }
 
+/********************************************************************
+ * Optimization update routine for many (local) constraints. Callers
+ * that have the gradients in sparse form should use this directly;
+ * Function_Call assembles them densely since every function in this
+ * code has a gradient over the whole design.
+ * 
+ * @param dfdx: Objective gradient (size nx1)
+ * @param g: Constraint values (size mx1)
+ * @param dgdx: Sparse constraint gradients (size nxm)
+ * 
+ * @return ierr: ErrorCode
+ * 
+ *******************************************************************/
+int MMA::Update(Eigen::VectorXd &dfdx, Eigen::VectorXd &g,
+                Eigen::SparseMatrix<double> &dgdx)
+{
+  if (nactive != dfdx.size()) {
+    if (myid == 0) {
+      printf("Error dectected at line %i in file %s\n", __LINE__, __FILE__);
+      printf("Objective gradient vector size (%li) does not match number of "
+             "active design variables (%lu)\n", dfdx.size(), nactive);
+    }
+    return 60;
+  }
+  if (nactive != dgdx.rows() || g.size() != dgdx.cols()) {
+    if (myid == 0) {
+      printf("Error dectected at line %i in file %s\n", __LINE__, __FILE__);
+      printf("Constraint gradient matrix size (%lix%li) does not match number "
+             "of active design variables (%lu) and constraints (%li)\n",
+             (long)dgdx.rows(), (long)dgdx.cols(), nactive, (long)g.size());
+    }
+    return 60;
+  }
+  Set_m(g.size());
+  return MMAsub(dfdx, g, dgdx);
+}
+
 /********************************************************************
  * OC update routine
  * 
@@ -105,28 +370,8 @@ int MMA::OCsub(Eigen::VectorXd &dfdx, Eigen::VectorXd &g, Eigen::MatrixXd &dgdx)
   int ierr = 0;
 
   // Grab active design variables
-  Eigen::VectorXd *p_x, x, *p_xmin, xmin_act, *p_xmax, xmax_act;
-  if (nactive == nloc) {
-    xold1 = xval;
-    p_x = &xval;
-    p_xmin = &xmin;
-    p_xmax = &xmax;
-  }
-  else {
-    x.resize(nactive); xmin_act.resize(nactive); xmax_act.resize(nactive);
-    ulong ind = 0;
-    for (long i = 0; i < nloc; i++) {
-      if (active[i]) {
-        xmin_act(ind) = xmin(i);
-        xmax_act(ind) = xmax(i);
-        x(ind++) = xval(i);
-      }
-    }
-    p_x = &x;
-    p_xmin = &xmin_act;
-    p_xmax = &xmax_act;
-    xold1 = x;
-  }
+  Gather_Active();
+  *p_x1 = *p_x;
 
   Eigen::VectorXd step = move*(*p_xmax-*p_xmin);
   Eigen::VectorXd temp(nactive), B(nactive), xCnd(nactive);
@@ -135,10 +380,10 @@ int MMA::OCsub(Eigen::VectorXd &dfdx, Eigen::VectorXd &g, Eigen::MatrixXd &dgdx)
     double lmid = 0.5*(l1+l2);
     dfdx = dfdx.cwiseMin(Eigen::VectorXd::Zero(dfdx.size()));
     B = (-dfdx.cwiseQuotient(dgdx)/lmid).array().pow(OCeta).matrix();
-    xCnd = *p_xmin + (xold1-*p_xmin).cwiseProduct(B);
-    *p_x = xCnd.cwiseMin(xold1+step).cwiseMin(*p_xmax).cwiseMax(xold1-step).cwiseMax(*p_xmin);
+    xCnd = *p_xmin + (*p_x1-*p_xmin).cwiseProduct(B);
+    *p_x = xCnd.cwiseMin(*p_x1+step).cwiseMin(*p_xmax).cwiseMax(*p_x1-step).cwiseMax(*p_xmin);
 
-    dg = dgdx.col(0).dot(*p_x-xold1);
+    dg = dgdx.col(0).dot(*p_x-*p_x1);
     ierr = MPI_Allreduce(MPI_IN_PLACE, &dg, 1, MPI_DOUBLE, MPI_SUM, Comm);
     if (ierr != 0) {
       if (myid == 0)
@@ -153,43 +398,28 @@ int MMA::OCsub(Eigen::VectorXd &dfdx, Eigen::VectorXd &g, Eigen::MatrixXd &dgdx)
       l2 = lmid;
   }
 
-  if (nactive != nloc) {
-    ulong ind = 0;
-    for (long i = 0; i < nloc; i++) {
-      if (active[i])
-        xval(i) = x(ind++);
-    }
-  }
+  Scatter_Active();
 
-  for (long i = 0; i < nloc; i++) {
-    if (active[i] && xval(i) < 1e-6)
-      xval(i) = 0;
+  for (long i = 0; i < nactive; i++) {
+    if (xval(active[i]) < 1e-6)
+      xval(active[i]) = 0;
   }
 
-  Change = ((*p_x-xold1).cwiseQuotient(*p_xmax-*p_xmin)).cwiseAbs().maxCoeff();
+  Change = ((*p_x-*p_x1).cwiseQuotient(*p_xmax-*p_xmin)).cwiseAbs().maxCoeff();
   ierr = MPI_Allreduce(MPI_IN_PLACE, &Change, 1, MPI_DOUBLE, MPI_MAX, Comm);
 
   return ierr;
 }
 
 /********************************************************************
- * Construct MMA subproblem
- * 
- * @param dfdx: Objective gradient (size nx1)
- * @param g: Constraint values (size mx1)
- * @param dgdx: Constraint gradients (size nxm)
+ * Point to (or gather) the active design variables, bounds, and
+ * asymptotes used by the MMA subproblem
  * 
- * @return ierr: ErrorCode
+ * @return void
  * 
  *******************************************************************/
-int MMA::MMAsub(Eigen::VectorXd &dfdx, Eigen::VectorXd &g, Eigen::MatrixXd &dgdx)
+void MMA::Gather_Active()
 {
-  int ierr = 0;
-
-  // Grab active design variables
-  Eigen::VectorXd *p_x, x, *p_x1, x1, *p_x2, x2;
-  Eigen::VectorXd *p_xmin, xmin_act, *p_xmax, xmax_act;
-  Eigen::VectorXd low_act, upp_act;
   if (nactive == nloc) {
     p_x = &xval;
     p_x1 = &xold1;
@@ -200,119 +430,131 @@ int MMA::MMAsub(Eigen::VectorXd &dfdx, Eigen::VectorXd &g, Eigen::MatrixXd &dgdx
     p_upp = &upp;
   }
   else {
-    x.resize(nactive); x1.resize(nactive); x2.resize(nactive);
-    xmin_act.resize(nactive); xmax_act.resize(nactive);
-    low_act.resize(nactive); upp_act.resize(nactive);
-    ulong ind = 0;
-    for (long i = 0; i < nloc; i++) {
-      if (active[i]) {
-        upp_act(ind) = upp(i);
-        low_act(ind) = low(i);
-        xmax_act(ind) = xmax(i);
-        xmin_act(ind) = xmin(i);
-        x2(ind) = xold2(i);
-        x1(ind) = xold1(i);
-        x(ind++) = xval(i);
-      }
-    }
-    p_x = &x;
-    p_x1 = &x1;
-    p_x2 = &x2;
+    Gather(upp, upp_act);
+    Gather(low, low_act);
+    Gather(xmax, xmax_act);
+    Gather(xmin, xmin_act);
+    Gather(xold2, x2_act);
+    Gather(xold1, x1_act);
+    Gather(xval, x_act);
+    p_x = &x_act;
+    p_x1 = &x1_act;
+    p_x2 = &x2_act;
     p_xmin = &xmin_act;
     p_xmax = &xmax_act;
     p_low = &low_act;
     p_upp = &upp_act;
   }
+}
 
-  /// Asymptote Calculation (low and upp)
-  if (fresh_start && iter < 3) {
-    *p_low = *p_x-asyinit*(*p_xmax-*p_xmin);
-    *p_upp = *p_x+asyinit*(*p_xmax-*p_xmin);
+/********************************************************************
+ * Update active values in full local arrays after the subproblem
+ * 
+ * @return void
+ * 
+ *******************************************************************/
+void MMA::Scatter_Active()
+{
+  if (nactive != nloc) {
+    Scatter(upp_act, upp);
+    Scatter(low_act, low);
+    Scatter(x2_act, xold2);
+    Scatter(x1_act, xold1);
+    Scatter(x_act, xval);
   }
-  else {
+}
+
+/********************************************************************
+ * Move the asymptotes and compute alfa, beta, p0, and q0
+ * 
+ * @param dfdx: Objective gradient (size nx1)
+ * 
+ * @return void
+ * 
+ *******************************************************************/
+void MMA::Asymptotes(Eigen::VectorXd &dfdx)
+{
+  bool init = fresh_start && iter < 3;
+  if (!init)
     fresh_start = false;
-    zzz = (*p_x-*p_x1).cwiseProduct(*p_x1-*p_x2);
-    factor = Eigen::VectorXd::Ones(nactive);
-    for (uint i = 0; i < nactive; i++)
-    {
-      if (zzz[i] > 0)
-        factor[i] = asyincr;
-      else if(zzz[i] < 0)
-        factor[i] = asydecr;
+  alfa.resize(nactive); beta.resize(nactive);
+  p0.resize(nactive); q0.resize(nactive);
+  const double *x = p_x->data(), *x1 = p_x1->data(), *x2 = p_x2->data();
+  const double *xmn = p_xmin->data(), *xmx = p_xmax->data();
+  double *lo = p_low->data(), *up = p_upp->data();
+
+  // Each variable is independent, so the loop is threaded with OPENMP=yes
+  #pragma omp parallel for
+  for (long i = 0; i < nactive; i++) {
+    /// Asymptote Calculation (low and upp)
+    double xrange = xmx[i] - xmn[i];
+    if (init) {
+      lo[i] = x[i] - asyinit*xrange;
+      up[i] = x[i] + asyinit*xrange;
     }
-    *p_low = *p_x - factor.cwiseProduct(*p_x1-*p_low);
-    *p_upp = *p_x + factor.cwiseProduct(*p_upp-*p_x1);
-    Eigen::VectorXd lowmin = *p_x - 10 * (*p_xmax-*p_xmin);
-    Eigen::VectorXd lowmax = *p_x - 0.01*(*p_xmax-*p_xmin);
-    Eigen::VectorXd uppmin = *p_x + 0.01*(*p_xmax-*p_xmin);
-    Eigen::VectorXd uppmax = *p_x + 10 * (*p_xmax-*p_xmin);
-    for (uint i = 0; i < nactive; i++)
-    {
-      (*p_low)(i) = std::max((*p_low)(i), lowmin(i));
-      (*p_low)(i) = std::min((*p_low)(i), lowmax(i));
-      (*p_upp)(i) = std::min((*p_upp)(i), uppmax(i));
-      (*p_upp)(i) = std::max((*p_upp)(i), uppmin(i));
+    else {
+      double zzz = (x[i]-x1[i])*(x1[i]-x2[i]);
+      double factor = (zzz > 0) ? asyincr : ((zzz < 0) ? asydecr : 1);
+      lo[i] = std::min(std::max(x[i] - factor*(x1[i]-lo[i]), x[i] - 10*xrange),
+                       x[i] - 0.01*xrange);
+      up[i] = std::max(std::min(x[i] + factor*(up[i]-x1[i]), x[i] + 10*xrange),
+                       x[i] + 0.01*xrange);
     }
+
+    /// Calculation of the bounds alfa and beta
+    alfa(i) = std::max(std::max(lo[i] + albefa*(x[i]-lo[i]), x[i] - move*xrange),
+                       xmn[i]);
+    beta(i) = std::min(std::min(up[i] - albefa*(up[i]-x[i]), x[i] + move*xrange),
+                       xmx[i]);
+
+    /// Calculations of p0 and q0
+    double xmamiinv = 1/std::max(up[i]-lo[i], 1e-5);
+    double p = std::max(dfdx(i), 0.0), q = std::max(-dfdx(i), 0.0);
+    double pq = 0.001*(p + q) + 0.5*raa0*xmamiinv;
+    p0(i) = (p + pq)*((up[i]-x[i])*(up[i]-x[i]));
+    q0(i) = (q + pq)*((x[i]-lo[i])*(x[i]-lo[i]));
   }
+}
+
+/********************************************************************
+ * Construct MMA subproblem
+ * 
+ * @param dfdx: Objective gradient (size nx1)
+ * @param g: Constraint values (size mx1)
+ * @param dgdx: Constraint gradients (size nxm)
+ * 
+ * @return ierr: ErrorCode
+ * 
+ *******************************************************************/
+int MMA::MMAsub(Eigen::VectorXd &dfdx, Eigen::VectorXd &g, Eigen::MatrixXd &dgdx)
+{
+  int ierr = 0;
+
+  // Grab active design variables
+  Gather_Active();
 
-  /// Calculation of the bounds alfa and beta
-  Eigen::VectorXd zzz1 = *p_low + albefa*(*p_x-*p_low);
-  Eigen::VectorXd zzz2 = *p_x - move*(*p_xmax-*p_xmin);
-  alfa.resize(nactive);
-  for (uint i = 0; i < nactive; i++) {
-    zzz(i) = std::max(zzz1(i),zzz2(i));
-    alfa(i) = std::max(zzz(i),(*p_xmin)(i));
-  }
-  zzz1 = *p_upp - albefa*(*p_upp-*p_x);
-  zzz2 = *p_x + move*(*p_xmax-*p_xmin);
-  beta.resize(nactive);
-  for (uint i = 0; i < nactive; i++) {
-    zzz(i) = std::min(zzz1(i),zzz2(i));
-    beta(i) = std::min(zzz(i),(*p_xmax)(i));
-  }
-
-  /// Calculations of p0, q0, P, Q, and b
-  Eigen::VectorXd xmami = *p_upp-*p_low;
-  Eigen::VectorXd xmamieps = Eigen::VectorXd::Constant(n, 1e-5);
-  for (uint i = 0; i < nactive; i++)
-    xmami[i] = std::max(xmami[i],xmamieps[i]);
-  Eigen::VectorXd xmamiinv = xmami.cwiseInverse();
+  /// Asymptotes, bounds, p0, and q0
+  Asymptotes(dfdx);
+
+  /// Calculations of P, Q, and b
   Eigen::VectorXd ux1 = *p_upp-*p_x;
   Eigen::VectorXd ux2 = ux1.cwiseProduct(ux1);
   Eigen::VectorXd xl1 = *p_x-*p_low;
   Eigen::VectorXd xl2 = xl1.cwiseProduct(xl1);
 
-  p0.setZero(nactive);
-  q0.setZero(nactive);
-  for (uint i = 0; i < nactive; i++) {
-    p0(i) = std::max(dfdx(i),0.0);
-    q0(i) = std::max(-dfdx(i),0.0);
-  }
-  Eigen::VectorXd pq0 = 0.001*(p0 + q0) + 0.5*raa0*xmamiinv;
-  p0 = p0 + pq0;
-  q0 = q0 + pq0;
-  p0 = p0.cwiseProduct(ux2);
-  q0 = q0.cwiseProduct(xl2);
-
   P.resize(nactive, m);
   Q.resize(nactive, m);
-  for (long i = 0; i < nactive; i++) {
-    for (int j = 0; j < m; j++) {
-      P(i, j) = std::max(dgdx(i,j),0.0);
-      Q(i, j) = std::max(-dgdx(i,j),0.0);
-    }
-  }
   //Eigen::MatrixXd PQ = 0.001*(P + Q) + raa0*xmamiinv.replicate(1,m);
   //P = P + PQ;
   //Q = Q + PQ;
+  #pragma omp parallel for
   for (int i = 0; i < m; i++) {
-    P.col(i) = P.col(i).cwiseProduct(ux2);
-    Q.col(i) = Q.col(i).cwiseProduct(xl2);
+    P.col(i) = dgdx.col(i).cwiseMax(0.0).cwiseProduct(ux2);
+    Q.col(i) = (-dgdx.col(i)).cwiseMax(0.0).cwiseProduct(xl2);
   }
 
   //b = P*uxinv + Q*xlinv - g; If not done in parallel
-  for (int i = 0; i < m; i++)
-    b(i) = (P.col(i).cwiseQuotient(ux1) + Q.col(i).cwiseQuotient(xl1)).sum();
+  b = P.transpose()*ux1.cwiseInverse() + Q.transpose()*xl1.cwiseInverse();
   MPI_Allreduce(MPI_IN_PLACE, b.data(), m, MPI_DOUBLE, MPI_SUM, Comm);
   b -= g;
 
@@ -327,18 +569,55 @@ int MMA::MMAsub(Eigen::VectorXd &dfdx, Eigen::VectorXd &g, Eigen::MatrixXd &dgdx
   ierr = MPI_Allreduce(MPI_IN_PLACE,&Change,1,MPI_DOUBLE,MPI_MAX,Comm);
 
   // Update active values in full local arrays
-  if (nactive != nloc) {
-    ulong ind = 0;
-    for (long i = 0; i < nloc; i++) {
-      if (active[i]) {
-        upp(i)   = upp_act(ind);
-        low(i)   = low_act(ind);
-        xold2(i) = x2(ind);
-        xold1(i) = x1(ind);
-        xval(i)  = x(ind++);
-      }
-    }
-  }
+  Scatter_Active();
+  return ierr;
+}
+
+/********************************************************************
+ * Construct MMA subproblem with sparse constraint gradients. P and Q
+ * keep the sparsity of dgdx and the subproblem is solved with the
+ * distributed primal-dual method, so nothing of size n x m or m x m
+ * is ever formed densely.
+ * 
+ * @param dfdx: Objective gradient (size nx1)
+ * @param g: Constraint values (size mx1)
+ * @param dgdx: Sparse constraint gradients (size nxm)
+ * 
+ * @return ierr: ErrorCode
+ * 
+ *******************************************************************/
+int MMA::MMAsub(Eigen::VectorXd &dfdx, Eigen::VectorXd &g,
+                Eigen::SparseMatrix<double> &dgdx)
+{
+  int ierr = 0;
+
+  // Grab active design variables
+  Gather_Active();
+
+  /// Asymptotes, bounds, p0, and q0
+  Asymptotes(dfdx);
+
+  /// Calculations of P, Q, and b
+  Eigen::VectorXd ux1 = *p_upp-*p_x;
+  Eigen::VectorXd xl1 = *p_x-*p_low;
+  Ps = ux1.cwiseAbs2().asDiagonal()*dgdx.unaryExpr(
+       [](double v) {return std::max(v, 0.0);});
+  Qs = xl1.cwiseAbs2().asDiagonal()*dgdx.unaryExpr(
+       [](double v) {return std::max(-v, 0.0);});
+  Ps.prune(0.0); Qs.prune(0.0);
+
+  b = Ps.transpose()*ux1.cwiseInverse() + Qs.transpose()*xl1.cwiseInverse();
+  MPI_Allreduce(MPI_IN_PLACE, b.data(), m, MPI_DOUBLE, MPI_SUM, Comm);
+  b -= g;
+
+  *p_x2 = *p_x1; *p_x1 = *p_x;
+  ierr = Sparse_Solve(*p_x);
+
+  Change = ((*p_x-*p_x1).cwiseQuotient(*p_xmax-*p_xmin)).cwiseAbs().maxCoeff();
+  ierr = MPI_Allreduce(MPI_IN_PLACE,&Change,1,MPI_DOUBLE,MPI_MAX,Comm);
+
+  // Update active values in full local arrays
+  Scatter_Active();
   return ierr;
 }
 
@@ -356,7 +635,6 @@ int MMA::DualSolve(Eigen::VectorXd &x)
   /// Dual Solver as described in Aage and Lazarov (2013)
   double epsi = 1, Theta;
 
-  Eigen::VectorXd ux1, xl1, ux2, xl2, ux3, xl3;
   Eigen::MatrixXd Hess(m,m);
   Eigen::VectorXd epsvec(m), Grad(m);
 
@@ -369,13 +647,8 @@ int MMA::DualSolve(Eigen::VectorXd &x)
   qlam    = q0 + Q*lambda;
   XYZofLam(x, y, z, lambda);
 
-  ux1   = *p_upp-x;
-  ux2   = ux1.cwiseProduct(ux1);
-  ux3   = ux1.cwiseProduct(ux2);
-  xl1   = x-*p_low;
-  xl2   = xl1.cwiseProduct(xl1);
-  xl3   = xl1.cwiseProduct(xl2);
-  ierr = DualGrad(ux1, xl1, y, z, Grad); if (ierr!=0) {return ierr;}
+  // Gradient and Hessian at each point share one reduction
+  ierr = DualGradHess(x, y, z, Grad, Hess); if (ierr!=0) {return ierr;}
 
   while (epsi > epsimin) {
     epsvec.setConstant(epsi);
@@ -386,8 +659,6 @@ int MMA::DualSolve(Eigen::VectorXd &x)
     while (residumax > 0.9*epsi && ittt < 100) {
       ittt++;
 
-      ierr = DualHess(ux2, xl2, ux3, xl3, x, Hess); if (ierr!=0) {return ierr;}
-
       SearchDir(Hess, Grad, lambda, eta, dellam, deleta, epsvec);
       Theta = SearchDis(lambda, eta, dellam, deleta);
 
@@ -398,14 +669,7 @@ int MMA::DualSolve(Eigen::VectorXd &x)
       qlam    = q0 + Q*lambda;
       XYZofLam(x, y, z, lambda);
 
-      ux1     = *p_upp-x;
-      xl1     = x-*p_low;
-      ux2     = ux1.cwiseProduct(ux1);
-      xl2     = xl1.cwiseProduct(xl1);
-      ux3     = ux2.cwiseProduct(ux1);
-      xl3     = xl2.cwiseProduct(xl1);
-
-      ierr = DualGrad(ux1, xl1, y, z, Grad); if (ierr!=0) {return ierr;}
+      ierr = DualGradHess(x, y, z, Grad, Hess); if (ierr!=0) {return ierr;}
 
       DualResidual(Grad, eta, lambda, epsvec);
     }
@@ -451,15 +715,15 @@ void MMA::DualResidual(Eigen::VectorXd &Grad, Eigen::VectorXd &eta,
  *******************************************************************/
 void MMA::XYZofLam(Eigen::VectorXd &x, Eigen::VectorXd &y, double &z, Eigen::VectorXd &lambda)
 {
-  Eigen::VectorXd plamrt = plam.cwiseSqrt();
-  Eigen::VectorXd qlamrt = qlam.cwiseSqrt();
-  x = (plamrt.cwiseProduct(*p_low)+qlamrt.cwiseProduct(*p_upp)).cwiseQuotient(plamrt+qlamrt);
-  for (long i = 0; i < nactive; i++)
-    x(i) = std::max(std::min(x(i),beta(i)),alfa(i));
+  x.resize(nactive);
+  #pragma omp parallel for
+  for (long i = 0; i < nactive; i++) {
+    double plamrt = sqrt(plam(i)), qlamrt = sqrt(qlam(i));
+    x(i) = std::max(std::min((plamrt*(*p_low)(i) + qlamrt*(*p_upp)(i))/(plamrt+qlamrt),
+                             beta(i)), alfa(i));
+  }
 
-  y = (lambda-c).cwiseQuotient(d);
-  for (int i = 0; i < m; i++)
-    y(i) = std::max(y(i), 0.0);
+  y = (lambda-c).cwiseQuotient(d).cwiseMax(0.0);
 
   z = 10*std::max((lambda.dot(a)-a0)/b0, 0.0);
 
@@ -467,66 +731,71 @@ void MMA::XYZofLam(Eigen::VectorXd &x, Eigen::VectorXd &y, double &z, Eigen::Vec
 }
 
 /********************************************************************
- * Gradient of the dual subproblem
+ * Gradient and Hessian of the dual subproblem. The local contributions
+ * are packed into a single non-blocking reduction so each dual Newton
+ * step costs one allreduce. The Hessian is computed at the same point
+ * as the gradient and used for the next step.
  * 
- * @param ux1: upp - design variables
- * @param xl1: design variables - low
+ * @param x: Design variables
  * @param y:
  * @param z:
  * @param Grad: Gradient of the dual subproblem
- * 
- * @return ierr: ErrorCode
- * 
- *******************************************************************/
-int MMA::DualGrad(Eigen::VectorXd &ux1, Eigen::VectorXd &xl1,
-                   Eigen::VectorXd &y, double &z, Eigen::VectorXd &Grad)
-{
-  int ierr = 0;
-  /// fi(x(lambda))+b
-  for (int i = 0; i < m; i++)
-    Grad(i) = (P.col(i).cwiseQuotient(ux1) + Q.col(i).cwiseQuotient(xl1)).sum();
-  ierr = MPI_Allreduce(MPI_IN_PLACE, Grad.data(), m, MPI_DOUBLE, MPI_SUM, Comm);
-  /// -b-a*z(lambda)-y(lambda)
-  Grad -= b + a*z + y;
-
-  return ierr;
-}
-
-/********************************************************************
- * Hessian of the dual subproblem
- * 
- * @param ux2: (upp - design variables)^2
- * @param xl2: (design variables - low)^2
- * @param ux3: (upp - design variables)^3
- * @param xl3: (design variables - low)^3
- * @param x: Design variables
  * @param Hess: Hessian of the dual subproblem
  * 
  * @return ierr: ErrorCode
  * 
  *******************************************************************/
-int MMA::DualHess(Eigen::VectorXd &ux2, Eigen::VectorXd &xl2,
-                   Eigen::VectorXd &ux3, Eigen::VectorXd &xl3,
-                   Eigen::VectorXd &x,   Eigen::MatrixXd &Hess)
+int MMA::DualGradHess(Eigen::VectorXd &x, Eigen::VectorXd &y, double &z,
+                      Eigen::VectorXd &Grad, Eigen::MatrixXd &Hess)
 {
   int ierr = 0;
-  Eigen::MatrixXd dhdx(m,nactive);
+  Eigen::VectorXd uxinv1(nactive), xlinv1(nactive), uxinv2(nactive), xlinv2(nactive);
+  Eigen::VectorXd dLdxx(nactive);
+  #pragma omp parallel for
+  for (long i = 0; i < nactive; i++) {
+    uxinv1(i) = 1/((*p_upp)(i)-x(i));
+    xlinv1(i) = 1/(x(i)-(*p_low)(i));
+    uxinv2(i) = uxinv1(i)*uxinv1(i);
+    xlinv2(i) = xlinv1(i)*xlinv1(i);
+    dLdxx(i) = (x(i) > alfa(i) && x(i) < beta(i)) ?
+               1/(2*plam(i)*uxinv2(i)*uxinv1(i) + 2*qlam(i)*xlinv2(i)*xlinv1(i)) : 0.0;
+  }
 
-  for (int i = 0; i < m; i++)
-     dhdx.row(i) = P.col(i).cwiseQuotient(ux2) - Q.col(i).cwiseQuotient(xl2);
-  Eigen::VectorXd dLdxx = (x.array()>alfa.array() && x.array()<beta.array())
-            .cast<double>().matrix()
-            .cwiseQuotient(2*plam.cwiseQuotient(ux3) + 2*qlam.cwiseQuotient(xl3));
+  /// Packed local contributions: fi(x(lambda)) followed by the Hessian
+  Eigen::VectorXd buffer(m + m*m);
+  buffer.segment(0,m) = P.transpose()*uxinv1 + Q.transpose()*xlinv1;
 
-  Hess = -dhdx*dLdxx.asDiagonal()*dhdx.transpose();
-  ierr = MPI_Allreduce(MPI_IN_PLACE, Hess.data(), m*m, MPI_DOUBLE, MPI_SUM, Comm);
+  // dh/dx is stored transposed (nactive x m) so columns are contiguous
+  Eigen::MatrixXd dhdx(nactive,m);
+  #pragma omp parallel for
+  for (int i = 0; i < m; i++)
+    dhdx.col(i) = P.col(i).cwiseProduct(uxinv2) - Q.col(i).cwiseProduct(xlinv2);
+  Eigen::Map<Eigen::MatrixXd>(buffer.data()+m, m, m) =
+            -dhdx.transpose()*dLdxx.asDiagonal()*dhdx;
+
+  MPI_Request request;
+  ierr = MPI_Iallreduce(MPI_IN_PLACE, buffer.data(), m+m*m, MPI_DOUBLE,
+                        MPI_SUM, Comm, &request);
+  if (ierr != 0) {
+    if (myid == 0)
+      printf("Error in MPI_Iallreduce at line %i in file %s\n",
+             __LINE__, __FILE__);
+    return ierr;
+  }
 
+  /// Replicated terms while the reduction is in flight
   Eigen::VectorXd Hessdy = Eigen::VectorXd::Zero(m);
   for (int i = 0; i < m; i++)
     Hessdy(i) = (double)lambda(i)>c(i);
+  Eigen::VectorXd Gradshift = b + a*z + y;
 
-  Hess -= Hessdy.asDiagonal();
+  ierr = MPI_Wait(&request, MPI_STATUS_IGNORE);
+
+  /// -b-a*z(lambda)-y(lambda)
+  Grad = buffer.segment(0,m) - Gradshift;
 
+  Hess = Eigen::Map<Eigen::MatrixXd>(buffer.data()+m, m, m);
+  Hess -= Hessdy.asDiagonal();
   if (lambda.dot(a) > 0)
     Hess -= 10*(a*a.transpose());
 
@@ -862,6 +1131,308 @@ void MMA::primaldual_subsolve(Eigen::VectorXd &x)
   return;
 }
 
+/********************************************************************
+ * Solve the MMA subproblem with sparse constraint gradients using a
+ * primal-dual interior point method (Svanberg's subsolv) distributed
+ * across the ranks. The design variables and their multipliers stay
+ * local and the m constraint multipliers are replicated. The Newton
+ * system is reduced to the Schur complement in lambda, which is solved
+ * matrix-free with PCG so each iteration needs one allreduce of
+ * length 2m.
+ * 
+ * @param x: Vector of design variables
+ * 
+ * @return ierr: ErrorCode
+ * 
+ *******************************************************************/
+int MMA::Sparse_Solve(Eigen::VectorXd &x)
+{
+  int ierr = 0;
+  double epsi = 1, z = 1, zet = 1;
+  Eigen::VectorXd y = Eigen::VectorXd::Ones(m), s = y;
+  lambda = y;
+  Eigen::VectorXd mu = (0.5*c).cwiseMax(1.0);
+  x = 0.5*(alfa+beta);
+  Eigen::VectorXd xsi = (x-alfa).cwiseInverse().cwiseMax(1.0);
+  eta = (beta-x).cwiseInverse().cwiseMax(1.0);
+
+  while (epsi > epsimin) {
+    ierr = Sparse_Residual(x, y, z, lambda, xsi, eta, mu, zet, s, epsi);
+    if (ierr != 0)
+      return ierr;
+
+    for (uint ittt = 0; residumax > 0.9*epsi && ittt < 200; ittt++) {
+      /// Newton direction
+      Eigen::ArrayXd ux1 = (*p_upp-x).array(), xl1 = (x-*p_low).array();
+      Eigen::ArrayXd ux2 = ux1.square(), xl2 = xl1.square();
+      Eigen::ArrayXd xa = (x-alfa).array(), bx = (beta-x).array();
+      plam = p0 + Ps*lambda;
+      qlam = q0 + Qs*lambda;
+      Eigen::SparseMatrix<double> Gt = ux2.inverse().matrix().asDiagonal()*Ps -
+                                       xl2.inverse().matrix().asDiagonal()*Qs;
+      Eigen::VectorXd delx = (plam.array()/ux2 - qlam.array()/xl2 -
+                              epsi/xa + epsi/bx).matrix();
+      Eigen::VectorXd diagxinv = (2*(plam.array()/(ux1*ux2) + qlam.array()/(xl1*xl2))
+                                  + xsi.array()/xa + eta.array()/bx).inverse().matrix();
+
+      // gvec, G*inv(Dx)*delx, and diag(G*inv(Dx)*G') in one reduction
+      Eigen::MatrixXd red(m, 3);
+      red.col(0) = Ps.transpose()*ux1.inverse().matrix() +
+                   Qs.transpose()*xl1.inverse().matrix();
+      red.col(1) = Gt.transpose()*diagxinv.cwiseProduct(delx);
+      red.col(2) = Gt.cwiseAbs2().transpose()*diagxinv;
+      ierr = MPI_Allreduce(MPI_IN_PLACE, red.data(), 3*m, MPI_DOUBLE, MPI_SUM, Comm);
+      if (ierr != 0)
+        return ierr;
+
+      Eigen::VectorXd dely = c + d.cwiseProduct(y) - lambda - epsi*y.cwiseInverse();
+      double delz = a0 - a.dot(lambda) - epsi/z;
+      Eigen::VectorXd dellam = red.col(0) - z*a - y - b + epsi*lambda.cwiseInverse();
+      Eigen::VectorXd diagy = d + mu.cwiseQuotient(y);
+      Eigen::VectorXd diaglamyi = s.cwiseQuotient(lambda) + diagy.cwiseInverse();
+
+      // Schur complement in lambda; z is eliminated with a second right-hand side
+      Eigen::MatrixXd B(m, 2), W;
+      B.col(0) = dellam + dely.cwiseQuotient(diagy) - red.col(1);
+      B.col(1) = a;
+      Eigen::VectorXd Minv = (diaglamyi + red.col(2)).cwiseInverse();
+      bool converged;
+      ierr = Sparse_PCG(Gt, diagxinv, diaglamyi, Minv, B, W, converged);
+      if (ierr != 0)
+        return ierr;
+      // Near the end of the barrier sequence the reduced matrix can be
+      // too ill-conditioned for CG, so factor it instead
+      if (!converged) {
+        ierr = Sparse_Direct(Gt, diagxinv, diaglamyi, B, W);
+        if (ierr != 0)
+          return ierr;
+      }
+
+      double dz = (a.dot(W.col(0)) - delz)/(a.dot(W.col(1)) + zet/z);
+      Eigen::VectorXd dlam = W.col(0) - dz*W.col(1);
+      Eigen::VectorXd dx = -diagxinv.cwiseProduct(delx + Gt*dlam);
+      Eigen::VectorXd dy = (dlam - dely).cwiseQuotient(diagy);
+      Eigen::VectorXd dxsi = (-xsi.array() + (epsi - xsi.array()*dx.array())/xa).matrix();
+      Eigen::VectorXd deta = (-eta.array() + (epsi + eta.array()*dx.array())/bx).matrix();
+      Eigen::VectorXd dmu = (-mu.array() + (epsi - mu.array()*dy.array())/y.array()).matrix();
+      double dzet = -zet + (epsi - zet*dz)/z;
+      Eigen::VectorXd ds = (-s.array() + (epsi - s.array()*dlam.array())/lambda.array()).matrix();
+
+      /// Step length to stay in the interior
+      double stmloc = 0;
+      if (nactive > 0)
+        stmloc = std::max(std::max((-1.01*dxsi.array()/xsi.array()).maxCoeff(),
+                                   (-1.01*deta.array()/eta.array()).maxCoeff()),
+                          std::max((-1.01*dx.array()/xa).maxCoeff(),
+                                   (1.01*dx.array()/bx).maxCoeff()));
+      ierr = MPI_Allreduce(MPI_IN_PLACE, &stmloc, 1, MPI_DOUBLE, MPI_MAX, Comm);
+      if (ierr != 0)
+        return ierr;
+      double stmxx = std::max(std::max((-1.01*dy.array()/y.array()).maxCoeff(),
+                                       (-1.01*dlam.array()/lambda.array()).maxCoeff()),
+                              std::max((-1.01*dmu.array()/mu.array()).maxCoeff(),
+                                       (-1.01*ds.array()/s.array()).maxCoeff()));
+      stmxx = std::max(stmxx, std::max(-1.01*dz/z, -1.01*dzet/zet));
+      double steg = 1/std::max(std::max(stmloc, stmxx), 1.0);
+
+      /// Line search on the residual norm
+      Eigen::VectorXd xold = x, yold = y, lamold = lambda, xsiold = xsi;
+      Eigen::VectorXd etaold = eta, muold = mu, sold = s;
+      double zold = z, zetold = zet, resiold = residunorm;
+      for (uint itto = 0; itto < 50; itto++) {
+        x = xold + steg*dx;
+        y = yold + steg*dy;
+        z = zold + steg*dz;
+        lambda = lamold + steg*dlam;
+        xsi = xsiold + steg*dxsi;
+        eta = etaold + steg*deta;
+        mu = muold + steg*dmu;
+        zet = zetold + steg*dzet;
+        s = sold + steg*ds;
+        ierr = Sparse_Residual(x, y, z, lambda, xsi, eta, mu, zet, s, epsi);
+        if (ierr != 0)
+          return ierr;
+        if (residunorm <= resiold)
+          break;
+        steg /= 2;
+      }
+    }
+    epsi *= 0.1;
+  }
+
+  return ierr;
+}
+
+/********************************************************************
+ * Residual norms of the KKT conditions of the sparse subproblem
+ * (stored in residunorm and residumax)
+ * 
+ * @param x, y, z, lam, xsi, eta, mu, zet, s: Primal-dual iterate
+ * @param epsi: Current barrier parameter
+ * 
+ * @return ierr: ErrorCode
+ * 
+ *******************************************************************/
+int MMA::Sparse_Residual(Eigen::VectorXd &x, Eigen::VectorXd &y, double z,
+                         Eigen::VectorXd &lam, Eigen::VectorXd &xsi,
+                         Eigen::VectorXd &eta, Eigen::VectorXd &mu, double zet,
+                         Eigen::VectorXd &s, double epsi)
+{
+  int ierr = 0;
+  Eigen::ArrayXd ux1 = (*p_upp-x).array(), xl1 = (x-*p_low).array();
+  Eigen::ArrayXd rex = (p0 + Ps*lam).array()/ux1.square() -
+                       (q0 + Qs*lam).array()/xl1.square() - xsi.array() + eta.array();
+  Eigen::ArrayXd rexsi = xsi.array()*(x-alfa).array() - epsi;
+  Eigen::ArrayXd reeta = eta.array()*(beta-x).array() - epsi;
+
+  // Local contributions to gvec and the norms are reduced together
+  Eigen::VectorXd sum(m+1);
+  sum.segment(0, m) = Ps.transpose()*ux1.inverse().matrix() +
+                      Qs.transpose()*xl1.inverse().matrix();
+  sum(m) = rex.square().sum() + rexsi.square().sum() + reeta.square().sum();
+  double maxloc = 0;
+  if (nactive > 0)
+    maxloc = std::max(rex.abs().maxCoeff(),
+                      std::max(rexsi.abs().maxCoeff(), reeta.abs().maxCoeff()));
+  MPI_Request requests[2];
+  ierr = MPI_Iallreduce(MPI_IN_PLACE, sum.data(), m+1, MPI_DOUBLE, MPI_SUM,
+                        Comm, requests);
+  if (ierr != 0)
+    return ierr;
+  ierr = MPI_Iallreduce(MPI_IN_PLACE, &maxloc, 1, MPI_DOUBLE, MPI_MAX,
+                        Comm, requests+1);
+  if (ierr != 0)
+    return ierr;
+
+  // Replicated parts while the reductions are in flight
+  Eigen::ArrayXd rey = (c + d.cwiseProduct(y) - mu - lam).array();
+  double rez = a0 - zet - a.dot(lam);
+  Eigen::ArrayXd remu = mu.array()*y.array() - epsi;
+  double rezet = zet*z - epsi;
+  Eigen::ArrayXd res = lam.array()*s.array() - epsi;
+
+  ierr = MPI_Waitall(2, requests, MPI_STATUSES_IGNORE);
+  if (ierr != 0)
+    return ierr;
+  Eigen::ArrayXd relam = (sum.segment(0, m) - z*a - y + s - b).array();
+
+  residunorm = sqrt(sum(m) + rey.square().sum() + rez*rez + relam.square().sum() +
+                    remu.square().sum() + rezet*rezet + res.square().sum());
+  residumax = std::max(std::max(maxloc, std::max(fabs(rez), fabs(rezet))),
+                       std::max(std::max(rey.abs().maxCoeff(), relam.abs().maxCoeff()),
+                                std::max(remu.abs().maxCoeff(), res.abs().maxCoeff())));
+
+  return ierr;
+}
+
+/********************************************************************
+ * Apply the reduced Newton matrix diag(diaglamyi) + G*inv(Dx)*G' to a
+ * block of replicated m-vectors
+ * 
+ * @param Gt: Local rows of G' (nactive x m)
+ * @param diagxinv: Inverse of the local x diagonal
+ * @param diaglamyi: Diagonal lambda/y contribution
+ * @param V: Vectors to multiply (m x k)
+ * @param AV: Result (m x k)
+ * 
+ * @return ierr: ErrorCode
+ * 
+ *******************************************************************/
+int MMA::Sparse_Alam(Eigen::SparseMatrix<double> &Gt, Eigen::VectorXd &diagxinv,
+                     Eigen::VectorXd &diaglamyi, Eigen::MatrixXd &V,
+                     Eigen::MatrixXd &AV)
+{
+  int ierr = 0;
+  AV = Gt.transpose()*(diagxinv.asDiagonal()*(Gt*V));
+  ierr = MPI_Allreduce(MPI_IN_PLACE, AV.data(), AV.size(), MPI_DOUBLE,
+                       MPI_SUM, Comm);
+  AV += diaglamyi.asDiagonal()*V;
+  return ierr;
+}
+
+/********************************************************************
+ * Jacobi-preconditioned CG on the reduced Newton matrix for several
+ * right-hand sides at once, so they share the matvec reductions
+ * 
+ * @param Gt: Local rows of G' (nactive x m)
+ * @param diagxinv: Inverse of the local x diagonal
+ * @param diaglamyi: Diagonal lambda/y contribution
+ * @param Minv: Inverse of the diagonal of the reduced matrix
+ * @param B: Right-hand sides (m x k)
+ * @param W: Solutions (m x k)
+ * @param converged: Whether every right-hand side converged within
+ *                   cg_maxit iterations (output, same on all ranks)
+ * 
+ * @return ierr: ErrorCode
+ * 
+ *******************************************************************/
+int MMA::Sparse_PCG(Eigen::SparseMatrix<double> &Gt, Eigen::VectorXd &diagxinv,
+                    Eigen::VectorXd &diaglamyi, Eigen::VectorXd &Minv,
+                    Eigen::MatrixXd &B, Eigen::MatrixXd &W, bool &converged)
+{
+  int ierr = 0;
+  long k = B.cols();
+  W.setZero(m, k);
+  Eigen::MatrixXd R = B, Z = Minv.asDiagonal()*R, D = Z, AD;
+  Eigen::ArrayXd rz = R.cwiseProduct(Z).colwise().sum().transpose();
+  Eigen::ArrayXd tol = cg_rtol*B.colwise().norm().transpose().array();
+
+  // The residuals are replicated, so every rank reaches the same verdict
+  converged = false;
+  for (uint it = 0; it <= cg_maxit; it++) {
+    Eigen::Array<bool, -1, 1> conv = R.colwise().norm().transpose().array() <= tol;
+    converged = conv.all();
+    if (converged || it == cg_maxit)
+      break;
+    ierr = Sparse_Alam(Gt, diagxinv, diaglamyi, D, AD);
+    if (ierr != 0)
+      return ierr;
+    for (long j = 0; j < k; j++) {
+      if (conv(j))
+        continue;
+      double alpha = rz(j)/D.col(j).dot(AD.col(j));
+      W.col(j) += alpha*D.col(j);
+      R.col(j) -= alpha*AD.col(j);
+      Z.col(j) = Minv.cwiseProduct(R.col(j));
+      double rznew = R.col(j).dot(Z.col(j));
+      D.col(j) = Z.col(j) + (rznew/rz(j))*D.col(j);
+      rz(j) = rznew;
+    }
+  }
+
+  return ierr;
+}
+
+/********************************************************************
+ * Solve the reduced Newton system by forming diag(diaglamyi) +
+ * G*inv(Dx)*G' densely (one allreduce of size m x m) and factoring it.
+ * Used when Sparse_PCG does not converge.
+ * 
+ * @param Gt: Local rows of G' (nactive x m)
+ * @param diagxinv: Inverse of the local x diagonal
+ * @param diaglamyi: Diagonal lambda/y contribution
+ * @param B: Right-hand sides (m x k)
+ * @param W: Solutions (m x k)
+ * 
+ * @return ierr: ErrorCode
+ * 
+ *******************************************************************/
+int MMA::Sparse_Direct(Eigen::SparseMatrix<double> &Gt, Eigen::VectorXd &diagxinv,
+                       Eigen::VectorXd &diaglamyi, Eigen::MatrixXd &B,
+                       Eigen::MatrixXd &W)
+{
+  int ierr = 0;
+  Eigen::SparseMatrix<double> DGt = diagxinv.asDiagonal()*Gt;
+  Eigen::MatrixXd Alam = Eigen::MatrixXd(Gt.transpose()*DGt);
+  ierr = MPI_Allreduce(MPI_IN_PLACE, Alam.data(), Alam.size(), MPI_DOUBLE,
+                       MPI_SUM, Comm);
+  if (ierr != 0)
+    return ierr;
+  Alam.diagonal() += diaglamyi;
+  W = Alam.partialPivLu().solve(B);
+  return ierr;
+}
+
 /********************************************************************
  * KKT check for primal-dual method
  * 
@@ -14,13 +14,16 @@ class MMA
 {
   public:
     // Constructors
-    MMA() {miniter = 0; minchange = 0; iter = 0; Set_Defaults(); return;}
+    MMA() {miniter = 0; minchange = 0; iter = 0; Change = 1;
+           residunorm = 0; residumax = 0; Set_Defaults(); return;}
     MMA(ulong nvar) {
-      Set_n(nvar); Initialize(); iter = 0; Set_Defaults(); return;
+      Set_n(nvar); Initialize(); iter = 0; Change = 1;
+      residunorm = 0; residumax = 0; Set_Defaults(); return;
     }
     void Set_Defaults() {epsimin = 1e-7; raa0 = 1e-5; move = 0.5;
                          albefa = 0.1; asyinit = 0.5; asyincr = 1.2;
-                         asydecr = 0.7; fresh_start = true;}
+                         asydecr = 0.7; fresh_start = true;
+                         sparse_limit = 50; cg_rtol = 1e-10; cg_maxit = 1000;}
     // Preallocate arrays of size n
     void Initialize();
     // Set MPI communicator
@@ -53,23 +56,39 @@ class MMA
     void Set_Change_Limit(double minimum) {minchange = minimum;}
     // Set maximum setp size
     void Set_Step_Limit(double step) {move = step;}
+    // Set number of constraints above which the sparse primal-dual
+    // subsolver is used for dense constraint gradients
+    void Set_Sparse_Limit(uint limit) {sparse_limit = limit;}
+    // Set tolerance and iteration limit of the distributed PCG solve
+    void Set_PCG_Limits(double rtol, uint maxit) {cg_rtol = rtol; cg_maxit = maxit;}
     // Set DV values (for initialization)
     void Set_Values(Eigen::VectorXd xIni) {xval = xIni; xold1 = xIni; xold2 = xIni;}
     // Set DV values to active or passive
     int Set_Active(std::vector<bool> &active) {
-      this->active = active;
-      nactive = std::count(active.begin(), active.end(), true);
+      this->active.resize(0);
+      for (long i = 0; i < (long)active.size(); i++)
+        if (active[i]) this->active.push_back(i);
+      nactive = this->active.size();
       return 0;
     }
     int Set_Active(Eigen::Array<bool, -1, 1> &active) {
-      std::copy(active.data(), active.data()+active.size(), this->active.begin());
-      nactive = std::count(this->active.begin(), this->active.end(), true);
+      this->active.resize(0);
+      for (long i = 0; i < active.size(); i++)
+        if (active(i)) this->active.push_back(i);
+      nactive = this->active.size();
       return 0;}
 
     // Set current iteration number
     void Set_It(uint it) {iter = it; return;}
     // Set a flag to check if asymptotes are valid or need to be set to defaults
     void Restart() {fresh_start = true; return;}
+    // Save or restore the complete optimizer state (collective)
+    int Write_State(const char *filename);
+    int Read_State(const char *filename);
+    // Copy the state of each local variable to or from the columns of an
+    // array (e.g. to move it to a new distribution of the variables)
+    void Get_State(Eigen::MatrixXd &state);
+    void Set_State(Eigen::MatrixXd &state);
 
     // Get various items from optimizer object
     long            &Get_nloc()    {return nloc;}
@@ -78,6 +97,11 @@ class MMA
     int             &Get_m()       {return m;}
     Eigen::VectorXd &Get_x()       {return xval;}
     uint            &Get_It()      {return iter;}
+    // Largest design change and KKT residual of the subproblem in the last update
+    double          Get_Change()   {return Change;}
+    double          Get_Residual() {return residunorm;}
+    // Bytes held by the local arrays of the optimizer
+    double Memory();
 
     // Checking convergence
     bool Check() {return (Check_Conv() || Check_It());}
@@ -86,11 +110,19 @@ class MMA
 
     // Update the design variables
     int Update(Eigen::VectorXd &dfdx, Eigen::VectorXd &g, Eigen::MatrixXd &dgdx);
+    int Update(Eigen::VectorXd &dfdx, Eigen::VectorXd &g,
+               Eigen::SparseMatrix<double> &dgdx);
 
 
   private:
     // MMA solver
     int MMAsub(Eigen::VectorXd &dfdx, Eigen::VectorXd &g, Eigen::MatrixXd &dgdx);
+    int MMAsub(Eigen::VectorXd &dfdx, Eigen::VectorXd &g,
+               Eigen::SparseMatrix<double> &dgdx);
+    // Steps shared by the dense and sparse MMA subproblems
+    void Gather_Active();
+    void Scatter_Active();
+    void Asymptotes(Eigen::VectorXd &dfdx);
     // OC solver
     int OCsub(Eigen::VectorXd &dfdx, Eigen::VectorXd &g, Eigen::MatrixXd &dgdx);
     // Auxiliary functions for MMA subsolvers
@@ -99,11 +131,8 @@ class MMA
                       Eigen::VectorXd &lambda, Eigen::VectorXd &epsvecm);
     void XYZofLam(Eigen::VectorXd &x, Eigen::VectorXd &y, double &z,
                   Eigen::VectorXd &lambda);
-    int  DualGrad(Eigen::VectorXd &ux1, Eigen::VectorXd &xl1,
-                  Eigen::VectorXd &y, double &z, Eigen::VectorXd &grad);
-    int  DualHess(Eigen::VectorXd &ux2, Eigen::VectorXd &xl2,
-                  Eigen::VectorXd &ux3, Eigen::VectorXd &xl3,
-                  Eigen::VectorXd &x,   Eigen::MatrixXd &Hess);
+    int  DualGradHess(Eigen::VectorXd &x, Eigen::VectorXd &y, double &z,
+                      Eigen::VectorXd &Grad, Eigen::MatrixXd &Hess);
     void SearchDir(Eigen::MatrixXd &Hess, Eigen::VectorXd &hvec,
                    Eigen::VectorXd &lambda, Eigen::VectorXd &eta,
                    Eigen::VectorXd &dellam, Eigen::VectorXd &deleta,
@@ -111,8 +140,35 @@ class MMA
     double SearchDis(Eigen::VectorXd &lambda, Eigen::VectorXd &eta,
                      Eigen::VectorXd &dellam, Eigen::VectorXd &deleta);
     void primaldual_subsolve(Eigen::VectorXd &x);
+    // Distributed primal-dual subsolver for sparse constraint gradients
+    int  Sparse_Solve(Eigen::VectorXd &x);
+    int  Sparse_Residual(Eigen::VectorXd &x, Eigen::VectorXd &y, double z,
+                         Eigen::VectorXd &lam, Eigen::VectorXd &xsi,
+                         Eigen::VectorXd &eta, Eigen::VectorXd &mu, double zet,
+                         Eigen::VectorXd &s, double epsi);
+    int  Sparse_Alam(Eigen::SparseMatrix<double> &Gt, Eigen::VectorXd &diagxinv,
+                     Eigen::VectorXd &diaglamyi, Eigen::MatrixXd &V,
+                     Eigen::MatrixXd &AV);
+    int  Sparse_PCG(Eigen::SparseMatrix<double> &Gt, Eigen::VectorXd &diagxinv,
+                    Eigen::VectorXd &diaglamyi, Eigen::VectorXd &Minv,
+                    Eigen::MatrixXd &B, Eigen::MatrixXd &W, bool &converged);
+    int  Sparse_Direct(Eigen::SparseMatrix<double> &Gt, Eigen::VectorXd &diagxinv,
+                       Eigen::VectorXd &diaglamyi, Eigen::MatrixXd &B,
+                       Eigen::MatrixXd &W);
     void primaldual_kktcheck(Eigen::VectorXd &dfdx, Eigen::VectorXd &g,
                              Eigen::MatrixXd &dgdx);
+    // Copy between full local arrays and compact arrays of active variables
+    void Gather(const Eigen::VectorXd &full, Eigen::VectorXd &act) {
+      act.resize(nactive);
+      #pragma omp parallel for
+      for (long i = 0; i < nactive; i++)
+        act(i) = full(active[i]);
+    }
+    void Scatter(const Eigen::VectorXd &act, Eigen::VectorXd &full) {
+      #pragma omp parallel for
+      for (long i = 0; i < nactive; i++)
+        full(active[i]) = act(i);
+    }
 
     /// MPI Variables
     MPI_Comm Comm;
@@ -120,8 +176,8 @@ class MMA
     /// Number of GLOBAL and LOCAL design variables
     ulong n;
     long nloc;
-    /// Flags indicating if each variable is subject to optimization or not
-    std::vector<bool> active;
+    /// Local indices of the variables subject to optimization
+    std::vector<long> active;
     /// Number of LOCAL active variables
     long nactive;
     /// Number of constraints
@@ -145,11 +201,17 @@ class MMA
     double epsimin, raa0, albefa, asyinit, asyincr, asydecr;
     /// Asymptotes
     Eigen::VectorXd low, upp;
-    /// Active parts of the asymptotes
-    Eigen::VectorXd *p_low, *p_upp;
+    /// Active parts of the design variables, bounds, and asymptotes (the
+    /// pointers refer to the full arrays when every variable is active)
+    Eigen::VectorXd x_act, x1_act, x2_act, xmin_act, xmax_act, low_act, upp_act;
+    Eigen::VectorXd *p_x, *p_x1, *p_x2, *p_xmin, *p_xmax, *p_low, *p_upp;
     /// Subproblem variables
-    Eigen::VectorXd zzz, factor, alfa, beta, p0, q0;
+    Eigen::VectorXd alfa, beta, p0, q0;
     Eigen::MatrixXd P, Q;
+    /// Sparse subproblem terms (nactive x m) for many local constraints
+    Eigen::SparseMatrix<double> Ps, Qs;
+    uint sparse_limit, cg_maxit;
+    double cg_rtol;
     Eigen::VectorXd plam, qlam;
     /// Lagrange Multipliers
     Eigen::VectorXd lambda, eta;
@@ -46,6 +46,11 @@ int main(int argc, char **args)
   ierr = topOpt->Set_Funcs(); CHKERRQ(ierr);
   ierr = topOpt->Get_CL_Options(); CHKERRQ(ierr);
 
+  /// Everything before the optimization is timed as one stage
+  PetscLogStage setupStage;
+  ierr = PetscLogStageRegister("Setup", &setupStage); CHKERRQ(ierr);
+  ierr = PetscLogStagePush(setupStage); CHKERRQ(ierr);
+
   /// Domain, Boundary Conditions, and initial design variables
   Eigen::VectorXd xIni;
   int pind = 0;
@@ -92,7 +97,9 @@ int main(int argc, char **args)
   }
 
   // Write out the mesh to file
+  ierr = PetscLogEventBegin(topOpt->outputEvent, 0, 0, 0, 0); CHKERRQ(ierr);
   ierr = topOpt->MeshOut(); CHKERRQ(ierr);
+  ierr = PetscLogEventEnd(topOpt->outputEvent, 0, 0, 0, 0); CHKERRQ(ierr);
 
   /// Design Variable Initialization
   optmma->Set_Lower_Bound(Eigen::VectorXd::Constant(topOpt->nLocElem, 0));
@@ -108,6 +115,7 @@ int main(int argc, char **args)
     if (topOpt->function_list[ii]->objective == PETSC_FALSE)
       ncon++;
   }
+  optmma->Set_m(ncon);
   double f;
   VectorXPS dfdx(topOpt->nLocElem), g(ncon);
   MatrixXPS dgdx(topOpt->nLocElem, ncon);
@@ -117,6 +125,14 @@ int main(int argc, char **args)
     ierr = topOpt->function_list[i]->Initialize_Arrays(topOpt->nLocElem); CHKERRQ(ierr);
     }
 
+  /// Continue from the optimizer state of a checkpoint if there is one
+  PetscBool resume = PETSC_FALSE;
+  if (topOpt->folder.length() > 0) {
+    ierr = topOpt->LoadCheckpoint(optmma, pind, resume); CHKERRQ(ierr);
+  }
+  ierr = topOpt->MemoryOut(optmma); CHKERRQ(ierr);
+  ierr = PetscLogStagePop(); CHKERRQ(ierr);
+
   /// Optimize
   if (topOpt->void_penalties.size() == 1) {
     topOpt->void_penalties.resize(topOpt->penalties.size());
@@ -131,50 +147,103 @@ int main(int argc, char **args)
   for (; (unsigned int)pind < topOpt->penalties.size(); pind++) {
     topOpt->penal = topOpt->penalties[pind];
     topOpt->vdPenal = topOpt->void_penalties[pind];
+    // Each penalty step is timed as its own stage
+    char stageName[30];
+    sprintf(stageName, "Penalty %1.3g", topOpt->penal);
+    PetscLogStage penalStage;
+    ierr = PetscLogStageRegister(stageName, &penalStage); CHKERRQ(ierr);
+    ierr = PetscLogStagePush(penalStage); CHKERRQ(ierr);
     ierr = PetscFPrintf(topOpt->comm, topOpt->output, "\nPenalty increased to %1.3g\n",
                 topOpt->penal); CHKERRQ(ierr);
 
-    optmma->Set_It(0);
+    if (!resume)
+      optmma->Set_It(0);
+    resume = PETSC_FALSE;
+    double t0 = MPI_Wtime();
     ierr = topOpt->MatIntFnc( optmma->Get_x() ); CHKERRQ(ierr);
+    topOpt->Add_Time("MatIntFnc", MPI_Wtime()-t0);
     ierr = PetscLogEventBegin(topOpt->FEEvent, 0, 0, 0, 0); CHKERRQ(ierr);
     if (topOpt->needK) {
+      t0 = MPI_Wtime();
       ierr = topOpt->FEAssemble(); CHKERRQ(ierr);
+      topOpt->Add_Time("FEAssemble", MPI_Wtime()-t0);
     }
     if (topOpt->needU) {
+      t0 = MPI_Wtime();
       ierr = topOpt->FESolve(); CHKERRQ(ierr);
+      topOpt->Add_Time("FESolve", MPI_Wtime()-t0);
     }
     ierr = PetscLogEventEnd(topOpt->FEEvent, 0, 0, 0, 0); CHKERRQ(ierr);
     ierr = PetscLogEventBegin(topOpt->funcEvent, 0, 0, 0, 0); CHKERRQ(ierr);
+    t0 = MPI_Wtime();
     ierr = Function_Base::Function_Call( topOpt, f, dfdx, g, dgdx ); CHKERRQ(ierr);
+    topOpt->Add_Time("Functions", MPI_Wtime()-t0);
     ierr = PetscLogEventEnd(topOpt->funcEvent, 0, 0, 0, 0); CHKERRQ(ierr);
+    t0 = MPI_Wtime();
+    ierr = PetscLogEventBegin(topOpt->outputEvent, 0, 0, 0, 0); CHKERRQ(ierr);
     ierr = topOpt->StepOut(f, g, optmma->Get_It(), optmma->Get_nactive());
               CHKERRQ(ierr);
+    ierr = PetscLogEventEnd(topOpt->outputEvent, 0, 0, 0, 0); CHKERRQ(ierr);
+    topOpt->Add_Time("StepOut", MPI_Wtime()-t0, PETSC_TRUE);
+    ierr = topOpt->Telemetry(f, g, optmma->Get_It(), optmma); CHKERRQ(ierr);
 
     do {
+      t0 = MPI_Wtime();
+      ierr = PetscLogEventBegin(topOpt->repartEvent, 0, 0, 0, 0); CHKERRQ(ierr);
+      ierr = topOpt->Repartition(optmma, dfdx, dgdx); CHKERRQ(ierr);
+      ierr = PetscLogEventEnd(topOpt->repartEvent, 0, 0, 0, 0); CHKERRQ(ierr);
+      topOpt->Add_Time("Repartition", MPI_Wtime()-t0);
+      t0 = MPI_Wtime();
+      ierr = PetscLogEventBegin(topOpt->checkpointEvent, 0, 0, 0, 0); CHKERRQ(ierr);
+      ierr = topOpt->Checkpoint(optmma, pind); CHKERRQ(ierr);
+      ierr = PetscLogEventEnd(topOpt->checkpointEvent, 0, 0, 0, 0); CHKERRQ(ierr);
+      topOpt->Add_Time("Checkpoint", MPI_Wtime()-t0, PETSC_TRUE);
       ierr = PetscLogEventBegin(topOpt->UpdateEvent, 0, 0, 0, 0); CHKERRQ(ierr);
+      t0 = MPI_Wtime();
       ierr = optmma->Set_Active(topOpt->active); CHKERRQ(ierr);
       ierr = optmma->Update( dfdx, g, dgdx ); CHKERRQ(ierr);
+      topOpt->Add_Time("Update", MPI_Wtime()-t0);
       ierr = PetscLogEventEnd(topOpt->UpdateEvent, 0, 0, 0, 0); CHKERRQ(ierr);
+      t0 = MPI_Wtime();
       ierr = topOpt->MatIntFnc( optmma->Get_x() ); CHKERRQ(ierr);
+      topOpt->Add_Time("MatIntFnc", MPI_Wtime()-t0);
       ierr = PetscLogEventBegin(topOpt->FEEvent, 0, 0, 0, 0); CHKERRQ(ierr);
       if (topOpt->needK) {
+        t0 = MPI_Wtime();
         ierr = topOpt->FEAssemble(); CHKERRQ(ierr);
+        topOpt->Add_Time("FEAssemble", MPI_Wtime()-t0);
       }
       if (topOpt->needU) {
+        t0 = MPI_Wtime();
         ierr = topOpt->FESolve(); CHKERRQ(ierr);
+        topOpt->Add_Time("FESolve", MPI_Wtime()-t0);
       }
       ierr = PetscLogEventEnd(topOpt->FEEvent, 0, 0, 0, 0); CHKERRQ(ierr);
       ierr = PetscLogEventBegin(topOpt->funcEvent, 0, 0, 0, 0); CHKERRQ(ierr);
+      t0 = MPI_Wtime();
       ierr = Function_Base::Function_Call( topOpt, f, dfdx, g, dgdx ); CHKERRQ(ierr);
+      topOpt->Add_Time("Functions", MPI_Wtime()-t0);
       ierr = PetscLogEventEnd(topOpt->funcEvent, 0, 0, 0, 0); CHKERRQ(ierr);
 
+      t0 = MPI_Wtime();
+      ierr = PetscLogEventBegin(topOpt->outputEvent, 0, 0, 0, 0); CHKERRQ(ierr);
       ierr = topOpt->StepOut(f, g, optmma->Get_It()+1, optmma->Get_nactive());
                 CHKERRQ(ierr);
+      ierr = PetscLogEventEnd(topOpt->outputEvent, 0, 0, 0, 0); CHKERRQ(ierr);
+      topOpt->Add_Time("StepOut", MPI_Wtime()-t0, PETSC_TRUE);
+      ierr = topOpt->Telemetry(f, g, optmma->Get_It()+1, optmma); CHKERRQ(ierr);
 
     } while ( !optmma->Check() );
 
     /// Print result after this penalization
+    t0 = MPI_Wtime();
+    ierr = PetscLogEventBegin(topOpt->outputEvent, 0, 0, 0, 0); CHKERRQ(ierr);
     ierr = topOpt->ResultOut(optmma->Get_It()); CHKERRQ(ierr);
+    ierr = PetscLogEventEnd(topOpt->outputEvent, 0, 0, 0, 0); CHKERRQ(ierr);
+    topOpt->Add_Time("ResultOut", MPI_Wtime()-t0, PETSC_TRUE);
+    ierr = topOpt->Telemetry_Flush("ResultOut", optmma->Get_It()); CHKERRQ(ierr);
+    ierr = topOpt->MemoryOut(optmma); CHKERRQ(ierr);
+    ierr = PetscLogStagePop(); CHKERRQ(ierr);
   }
 
   /// Print out all function values if desired
@@ -24,11 +24,13 @@ PetscErrorCode TopOpt::MatIntFnc(const Eigen::VectorXd &design)
     ierr = PetscFPrintf(comm, output, "Interpolating design variables "
                         "to material parameters\n"); CHKERRQ(ierr);
   }
+  ierr = PetscLogEventBegin(interpEvent, 0, 0, 0, 0); CHKERRQ(ierr);
 
   PetscScalar eps = 1e-10; // Minimum stiffness
   PetscScalar *p_x, *p_y; // Pointers
 
   // Apply the filter to design variables
+  ierr = PetscLogEventBegin(filterEvent, 0, 0, 0, 0); CHKERRQ(ierr);
   ierr = VecGetArray(x, &p_x); CHKERRQ(ierr);
   copy(design.data(), design.data()+design.size(), p_x);
   ierr = VecRestoreArray(x, &p_x); CHKERRQ(ierr);
@@ -51,6 +53,7 @@ PetscErrorCode TopOpt::MatIntFnc(const Eigen::VectorXd &design)
   }
   ierr = VecSet(z, 1); CHKERRQ(ierr); // z=1
   ierr = VecPointwiseMin(this->y, this->y, z); CHKERRQ(ierr); //y=min(R*z/vdmin, 1)
+  ierr = PetscLogEventEnd(filterEvent, 0, 0, 0, 0); CHKERRQ(ierr);
 
   ierr = VecSet(this->rhoq, 1); CHKERRQ(ierr);
   ierr = VecAXPY(this->rhoq, -1, this->rho); CHKERRQ(ierr);
@@ -135,6 +138,7 @@ PetscErrorCode TopOpt::MatIntFnc(const Eigen::VectorXd &design)
   
   ierr = VecGhostUpdateBegin(this->E, INSERT_VALUES, SCATTER_FORWARD); CHKERRQ(ierr);
   ierr = VecGhostUpdateEnd(this->E, INSERT_VALUES, SCATTER_FORWARD); CHKERRQ(ierr);
+  ierr = PetscLogEventEnd(interpEvent, 0, 0, 0, 0); CHKERRQ(ierr);
   
   return 0;
 }
@@ -150,6 +154,7 @@ PetscErrorCode TopOpt::MatIntFnc(const Eigen::VectorXd &design)
 PetscErrorCode TopOpt::Chain_Filter(Vec dfdV, Vec dfdE)
 {
   PetscErrorCode ierr = 0;
+  ierr = PetscLogEventBegin(chainEvent, 0, 0, 0, 0); CHKERRQ(ierr);
 
   Vec temp1, temp2;
   ierr = VecDuplicate(this->x, &temp1); CHKERRQ(ierr);
@@ -182,6 +187,7 @@ PetscErrorCode TopOpt::Chain_Filter(Vec dfdV, Vec dfdE)
 
   ierr = VecDestroy(&temp1); CHKERRQ(ierr);
   ierr = VecDestroy(&temp2); CHKERRQ(ierr);
+  ierr = PetscLogEventEnd(chainEvent, 0, 0, 0, 0); CHKERRQ(ierr);
 
   return ierr;
 }
@@ -0,0 +1,643 @@
+#include "MeshFile.h"
+#include <cstring>
+#include <string>
+
+using namespace std;
+
+static const char magic[8] = {'T','O','P','O','P','T','M','F'};
+
+/********************************************************************
+ * Main constructor
+ *
+ * @param comm: MPI communicator for the file
+ *
+ *******************************************************************/
+MeshFile::MeshFile(MPI_Comm comm)
+{
+  this->comm = comm;
+  MPI_Comm_rank(comm, &myid);
+  MPI_Comm_size(comm, &nprocs);
+  fh = MPI_FILE_NULL;
+  writing = false;
+  cursor = 0;
+  maxSections = 0;
+}
+
+/********************************************************************
+ * Start a new container, replacing any existing file
+ *
+ * @param filename: Name of the file
+ * @param maxSections: Space to reserve in the section table
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode MeshFile::Create(const char *filename, int maxSections)
+{
+  PetscErrorCode ierr = 0;
+  ierr = Close(); CHKERRQ(ierr);
+
+  ierr = MPI_File_open(comm, filename, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                       MPI_INFO_NULL, &fh);
+  if (ierr != 0)
+    SETERRQ1(comm, PETSC_ERR_FILE_OPEN, "Unable to create mesh file %s", filename);
+  ierr = MPI_File_set_size(fh, 0); CHKERRQ(ierr);
+
+  writing = true;
+  this->maxSections = maxSections;
+  sections.clear();
+  cursor = sizeof(MeshHeader) + maxSections*sizeof(MeshSection);
+
+  return ierr;
+}
+
+/********************************************************************
+ * Open an existing container and read its section table
+ *
+ * @param filename: Name of the file
+ * @param found: Whether the file exists (output)
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode MeshFile::Open(const char *filename, PetscBool &found)
+{
+  PetscErrorCode ierr = 0;
+  ierr = Close(); CHKERRQ(ierr);
+
+  found = PETSC_FALSE;
+  if (MPI_File_open(comm, filename, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != 0) {
+    fh = MPI_FILE_NULL;
+    return 0;
+  }
+  found = PETSC_TRUE;
+  writing = false;
+
+  // Only the first process reads the header and table
+  MeshHeader header;
+  if (myid == 0) {
+    ierr = MPI_File_read_at(fh, 0, &header, sizeof(header), MPI_BYTE,
+                            MPI_STATUS_IGNORE); CHKERRQ(ierr);
+  }
+  ierr = MPI_Bcast(&header, sizeof(header), MPI_BYTE, 0, comm); CHKERRQ(ierr);
+  if (memcmp(header.magic, magic, sizeof(magic)))
+    SETERRQ1(comm, PETSC_ERR_FILE_UNEXPECTED, "%s is not a mesh file", filename);
+  if (header.endian != 0x01020304)
+    SETERRQ1(comm, PETSC_ERR_FILE_UNEXPECTED, "Mesh file %s was written with "
+             "a different byte order", filename);
+  if (header.version > version)
+    SETERRQ2(comm, PETSC_ERR_FILE_UNEXPECTED, "Mesh file version %i is newer "
+             "than supported version %i", header.version, version);
+  if (header.intSize != sizeof(PetscInt) || header.scalarSize != sizeof(PetscScalar)
+      || header.boolSize != sizeof(bool))
+    SETERRQ1(comm, PETSC_ERR_FILE_UNEXPECTED, "Mesh file %s was written with "
+             "different integer or scalar sizes", filename);
+
+  maxSections = header.maxSections;
+  sections.resize(header.nSections);
+  if (myid == 0) {
+    ierr = MPI_File_read_at(fh, sizeof(header), sections.data(),
+                            sections.size()*sizeof(MeshSection), MPI_BYTE,
+                            MPI_STATUS_IGNORE); CHKERRQ(ierr);
+  }
+  ierr = MPI_Bcast(sections.data(), sections.size()*sizeof(MeshSection), MPI_BYTE,
+                   0, comm); CHKERRQ(ierr);
+
+  return ierr;
+}
+
+/********************************************************************
+ * Finish the header and table if writing and close the file
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode MeshFile::Close()
+{
+  PetscErrorCode ierr = 0;
+  if (fh == MPI_FILE_NULL)
+    return 0;
+
+  if (writing && myid == 0) {
+    MeshHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.endian = 0x01020304;
+    header.intSize = sizeof(PetscInt);
+    header.scalarSize = sizeof(PetscScalar);
+    header.boolSize = sizeof(bool);
+    header.nSections = sections.size();
+    header.maxSections = maxSections;
+    ierr = MPI_File_write_at(fh, 0, &header, sizeof(header), MPI_BYTE,
+                             MPI_STATUS_IGNORE); CHKERRQ(ierr);
+    ierr = MPI_File_write_at(fh, sizeof(header), sections.data(),
+                             sections.size()*sizeof(MeshSection), MPI_BYTE,
+                             MPI_STATUS_IGNORE); CHKERRQ(ierr);
+  }
+  ierr = MPI_File_close(&fh); CHKERRQ(ierr);
+  writing = false;
+
+  return ierr;
+}
+
+/********************************************************************
+ * Write a section of integers
+ *
+ * @param name: Name of the section
+ * @param data: Local rows, stored contiguously
+ * @param nLocal: Number of local rows
+ * @param width: Number of values in each row
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode MeshFile::Write(const char *name, const PetscInt *data,
+                               PetscInt nLocal, int width)
+{
+  return Write_Section(name, MF_INT, data, nLocal, width);
+}
+
+/********************************************************************
+ * Write a section of scalars
+ *
+ * @param name: Name of the section
+ * @param data: Local rows, stored contiguously
+ * @param nLocal: Number of local rows
+ * @param width: Number of values in each row
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode MeshFile::Write(const char *name, const PetscScalar *data,
+                               PetscInt nLocal, int width)
+{
+  return Write_Section(name, MF_SCALAR, data, nLocal, width);
+}
+
+/********************************************************************
+ * Write a section of flags
+ *
+ * @param name: Name of the section
+ * @param data: Local rows, stored contiguously
+ * @param nLocal: Number of local rows
+ * @param width: Number of values in each row
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode MeshFile::Write(const char *name, const bool *data,
+                               PetscInt nLocal, int width)
+{
+  return Write_Section(name, MF_BOOL, data, nLocal, width);
+}
+
+/********************************************************************
+ * Write a parallel matrix as the sections name.layout (local rows and
+ * columns of each process), name.rows (row lengths), name.cols, and
+ * name.vals
+ *
+ * @param name: Base name of the sections
+ * @param A: The matrix
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode MeshFile::Write(const char *name, Mat A)
+{
+  PetscErrorCode ierr = 0;
+
+  PetscInt layout[2], rstart, rend;
+  ierr = MatGetLocalSize(A, layout, layout+1); CHKERRQ(ierr);
+  ierr = MatGetOwnershipRange(A, &rstart, &rend); CHKERRQ(ierr);
+  std::vector<PetscInt> rowlen(rend-rstart), cols;
+  std::vector<PetscScalar> vals;
+  for (PetscInt row = rstart; row < rend; row++) {
+    PetscInt ncols; const PetscInt *c; const PetscScalar *v;
+    ierr = MatGetRow(A, row, &ncols, &c, &v); CHKERRQ(ierr);
+    rowlen[row-rstart] = ncols;
+    cols.insert(cols.end(), c, c+ncols);
+    vals.insert(vals.end(), v, v+ncols);
+    ierr = MatRestoreRow(A, row, &ncols, &c, &v); CHKERRQ(ierr);
+  }
+
+  string base(name);
+  ierr = Write((base + ".layout").c_str(), layout, 1, 2); CHKERRQ(ierr);
+  ierr = Write((base + ".rows").c_str(), rowlen.data(), rowlen.size()); CHKERRQ(ierr);
+  ierr = Write((base + ".cols").c_str(), cols.data(), cols.size()); CHKERRQ(ierr);
+  ierr = Write((base + ".vals").c_str(), vals.data(), vals.size()); CHKERRQ(ierr);
+
+  return ierr;
+}
+
+/********************************************************************
+ * Write a parallel vector
+ *
+ * @param name: Name of the section
+ * @param v: The vector
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode MeshFile::Write(const char *name, Vec v)
+{
+  PetscErrorCode ierr = 0;
+
+  PetscInt nLocal;
+  const PetscScalar *p_v;
+  ierr = VecGetLocalSize(v, &nLocal); CHKERRQ(ierr);
+  ierr = VecGetArrayRead(v, &p_v); CHKERRQ(ierr);
+  ierr = Write(name, p_v, nLocal); CHKERRQ(ierr);
+  ierr = VecRestoreArrayRead(v, &p_v); CHKERRQ(ierr);
+
+  return ierr;
+}
+
+/********************************************************************
+ * Write the index of a section, name.index, holding the number of rows
+ * written by each process
+ *
+ * @param name: Name of the section
+ * @param nLocal: Number of rows written by this process
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode MeshFile::Write_Index(const char *name, PetscInt nLocal)
+{
+  string index = string(name) + ".index";
+  return Write(index.c_str(), &nLocal, 1);
+}
+
+/********************************************************************
+ * Number of rows in a section
+ *
+ * @param name: Name of the section
+ *
+ * @return count: Number of rows, -1 if there is no such section
+ *
+ *******************************************************************/
+int64_t MeshFile::Count(const char *name)
+{
+  const MeshSection *section = Find(name);
+  return section == NULL ? -1 : section->count;
+}
+
+/********************************************************************
+ * Number of values in each row of a section
+ *
+ * @param name: Name of the section
+ *
+ * @return width: Row width, -1 if there is no such section
+ *
+ *******************************************************************/
+int64_t MeshFile::Width(const char *name)
+{
+  const MeshSection *section = Find(name);
+  return section == NULL ? -1 : section->width;
+}
+
+/********************************************************************
+ * Byte offset of the first row of a section
+ *
+ * @param name: Name of the section
+ *
+ * @return offset: Offset in the file, -1 if there is no such section
+ *
+ *******************************************************************/
+int64_t MeshFile::Offset(const char *name)
+{
+  const MeshSection *section = Find(name);
+  return section == NULL ? -1 : section->offset;
+}
+
+/********************************************************************
+ * Find the rows of a sorted section of integers with values in
+ * [lo, hi), e.g. the boundary condition nodes owned by this process.
+ * The index is used if it was written by as many processes, otherwise
+ * the range is found by a binary search so only the local rows are
+ * ever read.
+ *
+ * @param name: Name of the section
+ * @param lo: Smallest value wanted on this process
+ * @param hi: One past the largest value wanted on this process
+ * @param first: First row in the range (output)
+ * @param nLocal: Number of rows in the range (output)
+ * @param found: Whether the section could be searched (output)
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode MeshFile::Local_Range(const char *name, PetscInt lo, PetscInt hi,
+                                     PetscInt &first, PetscInt &nLocal,
+                                     PetscBool &found)
+{
+  PetscErrorCode ierr = 0;
+  string index = string(name) + ".index";
+  first = 0; nLocal = 0;
+  if (Count(index.c_str()) == nprocs) {
+    found = PETSC_TRUE;
+    ierr = Read(index.c_str(), &nLocal, myid, 1); CHKERRQ(ierr);
+    ierr = MPI_Exscan(&nLocal, &first, 1, MPIU_INT, MPI_SUM, comm); CHKERRQ(ierr);
+    if (myid == 0)
+      first = 0;
+    return ierr;
+  }
+
+  const MeshSection *section = Find(name);
+  found = (PetscBool)(section != NULL && section->type == MF_INT &&
+                      section->width == 1);
+  if (!found)
+    return 0;
+  PetscInt last;
+  ierr = Lower_Bound(section, lo, first); CHKERRQ(ierr);
+  ierr = Lower_Bound(section, hi, last); CHKERRQ(ierr);
+  nLocal = last - first;
+
+  return ierr;
+}
+
+/********************************************************************
+ * Read rows of a section of integers
+ *
+ * @param name: Name of the section
+ * @param data: Space for the rows (output)
+ * @param first: First row to read on this process
+ * @param nLocal: Number of rows to read on this process
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode MeshFile::Read(const char *name, PetscInt *data, PetscInt first,
+                              PetscInt nLocal)
+{
+  return Read_Section(name, MF_INT, data, first, nLocal);
+}
+
+/********************************************************************
+ * Read rows of a section of scalars
+ *
+ * @param name: Name of the section
+ * @param data: Space for the rows (output)
+ * @param first: First row to read on this process
+ * @param nLocal: Number of rows to read on this process
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode MeshFile::Read(const char *name, PetscScalar *data, PetscInt first,
+                              PetscInt nLocal)
+{
+  return Read_Section(name, MF_SCALAR, data, first, nLocal);
+}
+
+/********************************************************************
+ * Read rows of a section of flags
+ *
+ * @param name: Name of the section
+ * @param data: Space for the rows (output)
+ * @param first: First row to read on this process
+ * @param nLocal: Number of rows to read on this process
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode MeshFile::Read(const char *name, bool *data, PetscInt first,
+                              PetscInt nLocal)
+{
+  return Read_Section(name, MF_BOOL, data, first, nLocal);
+}
+
+/********************************************************************
+ * Read a matrix written by Write(name, Mat) with the same layout. The
+ * number of processes must match the run that wrote it.
+ *
+ * @param name: Base name of the sections
+ * @param A: The new matrix (output)
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode MeshFile::Read(const char *name, Mat *A)
+{
+  PetscErrorCode ierr = 0;
+
+  string base(name);
+  if (Count((base + ".layout").c_str()) != nprocs)
+    SETERRQ1(comm, PETSC_ERR_FILE_UNEXPECTED, "Matrix %s was written by a "
+             "different number of processes", name);
+  PetscInt layout[2];
+  ierr = Read((base + ".layout").c_str(), layout, myid, 1); CHKERRQ(ierr);
+
+  // Row lengths give the local rows of the column and value sections
+  PetscInt rstart = 0, nnz = 0, nzstart = 0;
+  ierr = MPI_Exscan(layout, &rstart, 1, MPIU_INT, MPI_SUM, comm); CHKERRQ(ierr);
+  if (myid == 0)
+    rstart = 0;
+  std::vector<PetscInt> rowptr(layout[0]+1, 0);
+  ierr = Read((base + ".rows").c_str(), rowptr.data()+1, rstart, layout[0]); CHKERRQ(ierr);
+  for (PetscInt row = 0; row < layout[0]; row++)
+    rowptr[row+1] += rowptr[row];
+  nnz = rowptr[layout[0]];
+  ierr = MPI_Exscan(&nnz, &nzstart, 1, MPIU_INT, MPI_SUM, comm); CHKERRQ(ierr);
+  if (myid == 0)
+    nzstart = 0;
+  std::vector<PetscInt> cols(nnz);
+  std::vector<PetscScalar> vals(nnz);
+  ierr = Read((base + ".cols").c_str(), cols.data(), nzstart, nnz); CHKERRQ(ierr);
+  ierr = Read((base + ".vals").c_str(), vals.data(), nzstart, nnz); CHKERRQ(ierr);
+
+  ierr = MatCreateMPIAIJWithArrays(comm, layout[0], layout[1], PETSC_DETERMINE,
+                                   PETSC_DETERMINE, rowptr.data(), cols.data(),
+                                   vals.data(), A); CHKERRQ(ierr);
+
+  return ierr;
+}
+
+/********************************************************************
+ * Read the local part of a parallel vector
+ *
+ * @param name: Name of the section
+ * @param v: The vector, already sized (output)
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode MeshFile::Read(const char *name, Vec v)
+{
+  PetscErrorCode ierr = 0;
+
+  PetscInt first, last;
+  PetscScalar *p_v;
+  ierr = VecGetOwnershipRange(v, &first, &last); CHKERRQ(ierr);
+  ierr = VecGetArray(v, &p_v); CHKERRQ(ierr);
+  ierr = Read(name, p_v, first, last-first); CHKERRQ(ierr);
+  ierr = VecRestoreArray(v, &p_v); CHKERRQ(ierr);
+
+  return ierr;
+}
+
+/********************************************************************
+ * Write the local rows of a section after those of lower ranks
+ *
+ * @param name: Name of the section
+ * @param type: Kind of values
+ * @param data: Local rows, stored contiguously
+ * @param nLocal: Number of local rows
+ * @param width: Number of values in each row
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode MeshFile::Write_Section(const char *name, MESHFILE_TYPE type,
+                                       const void *data, PetscInt nLocal, int width)
+{
+  PetscErrorCode ierr = 0;
+  if (!writing)
+    SETERRQ(comm, PETSC_ERR_ORDER, "Mesh file is not open for writing");
+  if ((int)sections.size() >= maxSections)
+    SETERRQ1(comm, PETSC_ERR_ARG_OUTOFRANGE, "Mesh file has room for only "
+             "%i sections", maxSections);
+
+  int64_t count = nLocal, start = 0, total = 0;
+  ierr = MPI_Exscan(&count, &start, 1, MPI_INT64_T, MPI_SUM, comm); CHKERRQ(ierr);
+  if (myid == 0)
+    start = 0;
+  ierr = MPI_Allreduce(&count, &total, 1, MPI_INT64_T, MPI_SUM, comm); CHKERRQ(ierr);
+
+  MeshSection section;
+  memset(&section, 0, sizeof(section));
+  strncpy(section.name, name, sizeof(section.name)-1);
+  section.type = type;
+  section.count = total;
+  section.width = width;
+  section.offset = cursor;
+  sections.push_back(section);
+
+  ierr = MPI_File_write_at_all(fh, cursor + start*width*Size(type), (void*)data,
+                               nLocal*width, Datatype(type),
+                               MPI_STATUS_IGNORE); CHKERRQ(ierr);
+  cursor += total*width*Size(type);
+
+  return ierr;
+}
+
+/********************************************************************
+ * Read rows of a section
+ *
+ * @param name: Name of the section
+ * @param type: Kind of values expected
+ * @param data: Space for the rows (output)
+ * @param first: First row to read on this process
+ * @param nLocal: Number of rows to read on this process
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode MeshFile::Read_Section(const char *name, MESHFILE_TYPE type,
+                                      void *data, PetscInt first, PetscInt nLocal)
+{
+  PetscErrorCode ierr = 0;
+  const MeshSection *section = Find(name);
+  if (section == NULL)
+    SETERRQ1(comm, PETSC_ERR_FILE_UNEXPECTED, "Mesh file has no section %s", name);
+  if (section->type != type)
+    SETERRQ1(comm, PETSC_ERR_FILE_UNEXPECTED, "Section %s has the wrong type", name);
+  if (first < 0 || first + nLocal > section->count)
+    SETERRQ1(comm, PETSC_ERR_FILE_UNEXPECTED, "Reading past the end of "
+             "section %s", name);
+
+  ierr = MPI_File_read_at_all(fh, section->offset + first*section->width*Size(type),
+                              data, nLocal*section->width, Datatype(type),
+                              MPI_STATUS_IGNORE); CHKERRQ(ierr);
+
+  return ierr;
+}
+
+/********************************************************************
+ * Binary search of a sorted section of integers, reading one entry at
+ * a time (not collective)
+ *
+ * @param section: The section
+ * @param value: Value to search for
+ * @param index: First row not less than value (output)
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode MeshFile::Lower_Bound(const MeshSection *section, PetscInt value,
+                                     PetscInt &index)
+{
+  PetscErrorCode ierr = 0;
+
+  PetscInt lo = 0, hi = section->count, entry;
+  while (lo < hi) {
+    PetscInt mid = lo + (hi-lo)/2;
+    ierr = MPI_File_read_at(fh, section->offset + mid*sizeof(PetscInt), &entry,
+                            1, MPIU_INT, MPI_STATUS_IGNORE); CHKERRQ(ierr);
+    if (entry < value)
+      lo = mid+1;
+    else
+      hi = mid;
+  }
+  index = lo;
+
+  return ierr;
+}
+
+/********************************************************************
+ * Find a section by name
+ *
+ * @param name: Name of the section
+ *
+ * @return section: The table entry, NULL if there is no such section
+ *
+ *******************************************************************/
+const MeshSection *MeshFile::Find(const char *name)
+{
+  for (unsigned int i = 0; i < sections.size(); i++) {
+    if (!strncmp(sections[i].name, name, sizeof(sections[i].name)))
+      return sections.data()+i;
+  }
+  return NULL;
+}
+
+/********************************************************************
+ * MPI type of the values in a section
+ *
+ * @param type: Kind of values
+ *
+ * @return datatype: The MPI type
+ *
+ *******************************************************************/
+MPI_Datatype MeshFile::Datatype(MESHFILE_TYPE type)
+{
+  switch (type) {
+    case MF_INT:
+      return MPIU_INT;
+    case MF_SCALAR:
+      return MPIU_SCALAR;
+    default:
+      return MPI::BOOL;
+  }
+}
+
+/********************************************************************
+ * Size in bytes of the values in a section
+ *
+ * @param type: Kind of values
+ *
+ * @return size: Size of one value
+ *
+ *******************************************************************/
+int MeshFile::Size(MESHFILE_TYPE type)
+{
+  switch (type) {
+    case MF_INT:
+      return sizeof(PetscInt);
+    case MF_SCALAR:
+      return sizeof(PetscScalar);
+    default:
+      return sizeof(bool);
+  }
+}
@@ -0,0 +1,105 @@
+#ifndef MeshFile_H_INCLUDED
+#define MeshFile_H_INCLUDED
+
+#include <mpi.h> // Has to precede Petsc includes to use MPI::BOOL
+#include <petscmat.h>
+#include <stdint.h>
+#include <vector>
+
+/// Kind of values stored in a section
+enum MESHFILE_TYPE {MF_INT, MF_SCALAR, MF_BOOL};
+
+/// Fixed header at the start of a mesh container
+struct MeshHeader
+{
+  char magic[8];          // "TOPOPTMF"
+  int32_t version;        // Format version
+  int32_t endian;         // 0x01020304 in the byte order of the writer
+  int32_t intSize;        // Size of PetscInt in bytes
+  int32_t scalarSize;     // Size of PetscScalar in bytes
+  int32_t boolSize;       // Size of bool in bytes
+  int32_t nSections;      // Number of sections in the table
+  int32_t maxSections;    // Space reserved for the table
+  int32_t reserved;
+};
+
+/// Entry of the section table of a mesh container
+struct MeshSection
+{
+  char name[32];          // Null-terminated section name
+  int64_t type;           // MESHFILE_TYPE of the values
+  int64_t count;          // Number of rows in the section
+  int64_t width;          // Number of values in each row
+  int64_t offset;         // Byte offset of the first row
+};
+
+/// Single-file container for the distributed mesh, boundary conditions,
+/// filters, and multigrid hierarchy. A header and a table of sections
+/// are followed by the sections, each one written collectively in
+/// global row order.
+class MeshFile
+{
+public:
+  static const int32_t version = 1;
+
+  MeshFile(MPI_Comm comm);
+  ~MeshFile() {Close();}
+
+  // Start a new container or open an existing one (collective)
+  PetscErrorCode Create(const char *filename, int maxSections=128);
+  PetscErrorCode Open(const char *filename, PetscBool &found);
+  PetscErrorCode Close();
+
+  // Write nLocal rows from each process, in rank order (collective)
+  PetscErrorCode Write(const char *name, const PetscInt *data,
+                       PetscInt nLocal, int width=1);
+  PetscErrorCode Write(const char *name, const PetscScalar *data,
+                       PetscInt nLocal, int width=1);
+  PetscErrorCode Write(const char *name, const bool *data,
+                       PetscInt nLocal, int width=1);
+  PetscErrorCode Write(const char *name, Mat A);
+  PetscErrorCode Write(const char *name, Vec v);
+  // Record how many rows of a section each process wrote
+  PetscErrorCode Write_Index(const char *name, PetscInt nLocal);
+
+  // Information about a section, -1 if it is missing
+  PetscBool Has(const char *name) {return (PetscBool)(Find(name) != NULL);}
+  int64_t Count(const char *name);
+  int64_t Width(const char *name);
+  int64_t Offset(const char *name);
+  // Rows of a sorted section of integers with values in [lo, hi)
+  PetscErrorCode Local_Range(const char *name, PetscInt lo, PetscInt hi,
+                             PetscInt &first, PetscInt &nLocal, PetscBool &found);
+
+  // Read rows first to first+nLocal-1 on each process (collective)
+  PetscErrorCode Read(const char *name, PetscInt *data, PetscInt first,
+                      PetscInt nLocal);
+  PetscErrorCode Read(const char *name, PetscScalar *data, PetscInt first,
+                      PetscInt nLocal);
+  PetscErrorCode Read(const char *name, bool *data, PetscInt first,
+                      PetscInt nLocal);
+  PetscErrorCode Read(const char *name, Mat *A);
+  PetscErrorCode Read(const char *name, Vec v);
+
+private:
+  PetscErrorCode Write_Section(const char *name, MESHFILE_TYPE type,
+                               const void *data, PetscInt nLocal, int width);
+  PetscErrorCode Read_Section(const char *name, MESHFILE_TYPE type, void *data,
+                              PetscInt first, PetscInt nLocal);
+  PetscErrorCode Lower_Bound(const MeshSection *section, PetscInt value,
+                             PetscInt &index);
+  const MeshSection *Find(const char *name);
+  MPI_Datatype Datatype(MESHFILE_TYPE type);
+  int Size(MESHFILE_TYPE type);
+
+  MPI_Comm comm;
+  int myid, nprocs;
+  MPI_File fh;
+  bool writing;
+  // Where the next section starts
+  MPI_Offset cursor;
+  int maxSections;
+  std::vector<MeshSection> sections;
+};
+
+#endif // MeshFile_H_INCLUDED
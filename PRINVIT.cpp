@@ -36,6 +36,7 @@ PRINVIT::PRINVIT()
   ierr = PetscOptionsGetInt(NULL, NULL, "-PRINVIT_jmax", &jmax, &jmax_set); CHKERRV(ierr);
   this->V = NULL;
   TempVecs = NULL;
+  Qlocal = 0;
 }
 
 /********************************************************************
@@ -104,9 +105,13 @@ PetscErrorCode PRINVIT::Setup_Q()
 
   // Preallocate eigenvector storage space
   Vec temp;
+  PetscInt nLevel;
   Q.resize(this->A.size()); AQ.resize(this->A.size()); BQ.resize(this->A.size());
+  Qlocal = 0;
   for (int ii = 0; ii < this->A.size(); ii++) {
     ierr = MatCreateVecs(A[ii], &temp, NULL); CHKERRQ(ierr);
+    ierr = VecGetLocalSize(temp, &nLevel); CHKERRQ(ierr);
+    Qlocal += nLevel;
     ierr = VecDuplicateVecs(temp, Qsize, Q.data()+ii); CHKERRQ(ierr);
     ierr = VecDuplicateVecs(temp, Qsize, AQ.data()+ii); CHKERRQ(ierr);
     ierr = VecDuplicateVecs(temp, Qsize, BQ.data()+ii); CHKERRQ(ierr);
@@ -119,6 +124,36 @@ PetscErrorCode PRINVIT::Setup_Q()
   return 0;
 }
 
+/********************************************************************
+ * Bytes held by the solver. Q, AQ, and BQ only exist while computing,
+ * so they are reported at the size of the last compute step.
+ * 
+ * @param prefix: Prepended to the name of each structure
+ * @param usage: Name and bytes of each structure (appended to)
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode PRINVIT::Memory(std::string prefix,
+                               std::vector<std::pair<std::string, double> > &usage)
+{
+  PetscErrorCode ierr = 0;
+  ierr = EigenPeetz::Memory(prefix, usage); CHKERRQ(ierr);
+
+  double bytes = 0;
+  if (V != NULL) {
+    ierr = Vec_Memory(V[0], bytes); CHKERRQ(ierr);
+    bytes *= 2*jmax; // Search space and work space
+  }
+  usage.push_back(std::make_pair(prefix + "V", bytes));
+  bytes = Qsize*Qlocal*sizeof(PetscScalar);
+  usage.push_back(std::make_pair(prefix + "Q", bytes));
+  usage.push_back(std::make_pair(prefix + "AQ", bytes));
+  usage.push_back(std::make_pair(prefix + "BQ", bytes));
+
+  return ierr;
+}
+
 /********************************************************************
  * Destroy the space to store eigenvector approximations
  * 
@@ -236,6 +271,31 @@ PetscErrorCode PRINVIT::Update_jmax(PetscInt jmax)
   return 0;
 }
 
+/********************************************************************
+ * Place approximate eigenvectors (e.g. from a checkpoint) at the
+ * start of the search space for the next compute step
+ * 
+ * @param nvec: Number of vectors
+ * @param vecs: The vectors, with the layout of the operators
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode PRINVIT::Set_Initial_Space(PetscInt nvec, Vec *vecs)
+{
+  PetscErrorCode ierr = 0;
+  if (V == NULL)
+    SETERRQ(comm, PETSC_ERR_ORDER, "Operators must be set before the initial space");
+
+  nvec = std::min(nvec, jmax);
+  for (PetscInt ii = 0; ii < nvec; ii++) {
+    ierr = VecCopy(vecs[ii], V[ii]); CHKERRQ(ierr);
+  }
+  j = std::max(j, nvec);
+
+  return ierr;
+}
+
 /********************************************************************
  * Initialize the search space
  * 
@@ -435,15 +495,8 @@ PetscErrorCode PRINVIT::Compute()
     ierr = Icgsm(V, B[0], V[j], orth_norm, j); CHKERRQ(ierr);
     ierr = Remove_NullSpace(this->B[0], V[j]); CHKERRQ(ierr);
 
-    // Re-normalize
-    ierr = MatMult(this->B[0], V[j], TempVecs[0]); CHKERRQ(ierr);
-    ierr = VecDot(V[j], TempVecs[0], &orth_norm); CHKERRQ(ierr);
-    ierr = VecScale(V[j], 1/sqrt(orth_norm)); CHKERRQ(ierr);
-
-    // Update search space
-    ierr = MatMult(A[0], V[j], TempVecs[0]); CHKERRQ(ierr);
-    ierr = VecMDot(TempVecs[0], j+1, V, G.data()+j*jmax); CHKERRQ(ierr);
-    G.block(j, 0, 1, j) = G.block(0, j, j, 1).transpose();
+    // Re-normalize and update search space
+    ierr = Expand_Subspace(G); CHKERRQ(ierr);
 
     // This is to prevent NaN breakdown if update was bad      
     if (isnan(G(j,j))) {
@@ -454,15 +507,8 @@ PetscErrorCode PRINVIT::Compute()
       ierr = Icgsm(V, B[0], V[j], orth_norm, j); CHKERRQ(ierr);
       ierr = Remove_NullSpace(this->B[0], V[j]); CHKERRQ(ierr);
 
-      // Re-normalize
-      ierr = MatMult(this->B[0], V[j], TempVecs[0]); CHKERRQ(ierr);
-      ierr = VecDot(V[j], TempVecs[0], &orth_norm); CHKERRQ(ierr);
-      ierr = VecScale(V[j], 1/sqrt(orth_norm)); CHKERRQ(ierr);
-
-      // Update search space
-      ierr = MatMult(A[0], V[j], TempVecs[0]); CHKERRQ(ierr);
-      ierr = VecMDot(TempVecs[0], j+1, V, G.data()+j*jmax); CHKERRQ(ierr);
-      G.block(j, 0, 1, j) = G.block(0, j, j, 1).transpose();
+      // Re-normalize and update search space
+      ierr = Expand_Subspace(G); CHKERRQ(ierr);
     }
      
     ierr = PetscLogEventEnd(EIG_Expand, 0, 0, 0, 0); CHKERRQ(ierr);
@@ -527,6 +573,39 @@ PetscErrorCode PRINVIT::Compute_Clean()
   return 0;
 }
 
+/********************************************************************
+ * B-normalize the newest search space vector and add its projection
+ * to the subspace matrix. The norm and all inner products are
+ * computed in a single reduction
+ * 
+ * @param G: The projected subspace matrix
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode PRINVIT::Expand_Subspace(MatrixXPS &G)
+{
+  PetscErrorCode ierr = 0;
+
+  ierr = MatMult(this->B[0], V[j], TempVecs[0]); CHKERRQ(ierr);
+  ierr = MatMult(this->A[0], V[j], TempVecs[1]); CHKERRQ(ierr);
+  PetscScalar vBv;
+  ierr = VecDotBegin(V[j], TempVecs[0], &vBv); CHKERRQ(ierr);
+  ierr = VecMDotBegin(TempVecs[1], j+1, V, G.data()+j*jmax); CHKERRQ(ierr);
+  ierr = PetscCommSplitReductionBegin(PetscObjectComm((PetscObject)V[j])); CHKERRQ(ierr);
+  ierr = VecDotEnd(V[j], TempVecs[0], &vBv); CHKERRQ(ierr);
+  ierr = VecMDotEnd(TempVecs[1], j+1, V, G.data()+j*jmax); CHKERRQ(ierr);
+
+  // Scale the new column to match the normalized vector
+  PetscScalar scale = 1/sqrt(vBv);
+  ierr = VecScale(V[j], scale); CHKERRQ(ierr);
+  G.block(0, j, j, 1) *= scale;
+  G(j, j) *= scale*scale;
+  G.block(j, 0, 1, j) = G.block(0, j, j, 1).transpose();
+
+  return 0;
+}
+
 /********************************************************************
  * Remove a matrix nullspace from a vector
  * 
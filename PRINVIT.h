@@ -25,11 +25,16 @@ public:
   // Setting target eigenvalues and number to find
   PetscErrorCode Set_Target(Tau tau, PetscInt nev, Nev_Type ntype);
   PetscErrorCode Set_Target(PetscScalar tau, PetscInt nev, Nev_Type ntype);
+  // Approximate eigenvectors are placed in the search space
+  PetscErrorCode Set_Initial_Space(PetscInt nvec, Vec *vecs);
   // Solver
   PetscErrorCode Compute();
   // Search space size
   PetscErrorCode Set_jmin(PetscInt jmin) {return Update_jmin(jmin);}
   PetscErrorCode Set_jmax(PetscInt jmax) {return Update_jmax(jmax);}
+  // Bytes held by the solver, by structure
+  PetscErrorCode Memory(std::string prefix,
+                        std::vector<std::pair<std::string, double> > &usage);
 
 protected:
   // Subspace and work array
@@ -42,6 +47,8 @@ protected:
   /// Variables only needed in compute step
   // phi, A*phi, and B*phi at each level
   std::vector<Vec*> Q, AQ, BQ;
+  // Local length of one vector at every level of Q
+  PetscInt Qlocal;
 
   /// Protected methods
   // Update the search space dimensions
@@ -52,6 +59,8 @@ protected:
   PetscErrorCode Destroy_Q();
   // Remove the nullspace of a matrix from a vector
   PetscErrorCode Remove_NullSpace(Mat A, Vec x);
+  // Normalize newest search vector and add it to the subspace matrix
+  PetscErrorCode Expand_Subspace(MatrixXPS &G);
   // Prepare solver for compute step
   virtual PetscErrorCode Compute_Init() = 0;
   virtual PetscErrorCode Initialize_V();
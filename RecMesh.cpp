@@ -3,10 +3,14 @@
 #include <fstream>
 #include <Eigen/Eigen>
 #include <numeric>
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
 #include <unsupported/Eigen/KroneckerProduct>
 #include <mpi.h> // Has to precede Petsc includes to use MPI::BOOL
 #include "TopOpt.h"
 #include "EigLab.h"
+#include "MeshFile.h"
 
 //extern "C"
 //{
@@ -23,6 +27,151 @@ typedef Eigen::Matrix<PetscScalar, -1, -1> MatrixXPS;
 typedef Eigen::Array<PetscInt, -1, -1, Eigen::RowMajor> ArrayXXPIRM;
 typedef Eigen::Matrix<double,-1,-1,Eigen::RowMajor> MatrixXdRM;
 
+/********************************************************************
+ * Read the part of a boundary condition owned by this process from a
+ * mesh container
+ * 
+ * @param mesh: The mesh container
+ * @param nodeName: Section with the global node numbers
+ * @param valueName: Section with the values at each node
+ * @param first: First node owned by this process
+ * @param last: One past the last node owned by this process
+ * @param bcNode: Local node numbers (output)
+ * @param values: Values at each node (output)
+ * @param numDims: Number of values per node
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+template <typename ArrayType>
+static PetscErrorCode Load_BC(MeshFile &mesh, const char *nodeName,
+                              const char *valueName, PetscInt first, PetscInt last,
+                              ArrayXPI &bcNode, ArrayType &values, short numDims)
+{
+  PetscErrorCode ierr = 0;
+
+  // Nodes are sorted, so the local part is contiguous and the index or
+  // a binary search says where it is
+  PetscInt begin, nLocal;
+  PetscBool found;
+  ierr = mesh.Local_Range(nodeName, first, last, begin, nLocal, found); CHKERRQ(ierr);
+  if (found) {
+    bcNode.resize(nLocal);
+    ierr = mesh.Read(nodeName, bcNode.data(), begin, nLocal); CHKERRQ(ierr);
+  }
+  else {
+    // Last resort, read everything
+    ArrayXPI temp_node(std::max(mesh.Count(nodeName), (int64_t)0));
+    if (temp_node.size() > 0) {
+      ierr = mesh.Read(nodeName, temp_node.data(), 0, temp_node.size()); CHKERRQ(ierr);
+    }
+    begin = std::lower_bound(temp_node.data(), temp_node.data() +
+                             temp_node.size(), first) - temp_node.data();
+    PetscInt finish = std::lower_bound(temp_node.data(), temp_node.data() +
+                                       temp_node.size(), last) - temp_node.data();
+    bcNode = temp_node.segment(begin, finish-begin);
+  }
+  bcNode -= first;
+  values.resize(bcNode.size(), numDims);
+  if (mesh.Count(valueName) > 0) {
+    ierr = mesh.Read(valueName, values.data(), begin, bcNode.size()); CHKERRQ(ierr);
+  }
+
+  return ierr;
+}
+
+/********************************************************************
+ * Find the first entry of a file of node numbers, grouped by owning
+ * process, that is not less than the first node of a process
+ * 
+ * @param fh: The open file
+ * @param n: Number of entries in the file
+ * @param value: First node owned by a process
+ * @param index: Position of the first entry not less than value (output)
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+static PetscErrorCode Search_Nodes(MPI_File fh, PetscInt n, PetscInt value,
+                                   PetscInt &index)
+{
+  PetscErrorCode ierr = 0;
+
+  PetscInt lo = 0, hi = n, node;
+  while (lo < hi) {
+    PetscInt mid = lo + (hi-lo)/2;
+    ierr = MPI_File_read_at(fh, mid*sizeof(PetscInt), &node, 1, MPIU_INT,
+                            MPI_STATUS_IGNORE); CHKERRQ(ierr);
+    if (node < value)
+      lo = mid+1;
+    else
+      hi = mid;
+  }
+  index = lo;
+
+  return ierr;
+}
+
+/********************************************************************
+ * Read the part of a boundary condition owned by this process from
+ * the separate node and value files. The local part is found by a
+ * binary search so only it is ever read.
+ * 
+ * @param comm: Communicator for the files
+ * @param nodeFile: File with the global node numbers
+ * @param valueFile: File with the values at each node
+ * @param type: MPI type of the values
+ * @param first: First node owned by this process
+ * @param last: One past the last node owned by this process
+ * @param bcNode: Local node numbers (output)
+ * @param values: Values at each node (output)
+ * @param numDims: Number of values per node
+ * @param found: Whether the node file exists (output)
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+template <typename ArrayType>
+static PetscErrorCode Load_BC_Files(MPI_Comm comm, string nodeFile,
+                                    string valueFile, MPI_Datatype type,
+                                    PetscInt first, PetscInt last, ArrayXPI &bcNode,
+                                    ArrayType &values, short numDims, PetscBool &found)
+{
+  PetscErrorCode ierr = 0;
+
+  bcNode.resize(0);
+  values.resize(0, numDims);
+  MPI_File fh;
+  found = PETSC_FALSE;
+  if (MPI_File_open(comm, nodeFile.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL,
+                    &fh) != 0)
+    return 0;
+  found = PETSC_TRUE;
+
+  MPI_Offset filesize;
+  PetscInt begin, finish;
+  ierr = MPI_File_get_size(fh, &filesize); CHKERRQ(ierr);
+  ierr = Search_Nodes(fh, filesize/sizeof(PetscInt), first, begin); CHKERRQ(ierr);
+  ierr = Search_Nodes(fh, filesize/sizeof(PetscInt), last, finish); CHKERRQ(ierr);
+  bcNode.resize(finish-begin);
+  ierr = MPI_File_read_at_all(fh, begin*sizeof(PetscInt), bcNode.data(),
+                              bcNode.size(), MPIU_INT, MPI_STATUS_IGNORE); CHKERRQ(ierr);
+  ierr = MPI_File_close(&fh); CHKERRQ(ierr);
+  bcNode -= first;
+
+  int typeSize;
+  ierr = MPI_Type_size(type, &typeSize); CHKERRQ(ierr);
+  values.resize(bcNode.size(), numDims);
+  if (MPI_File_open(comm, valueFile.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL,
+                    &fh) != 0)
+    SETERRQ1(comm, PETSC_ERR_FILE_OPEN, "Unable to open %s", valueFile.c_str());
+  ierr = MPI_File_read_at_all(fh, (MPI_Offset)begin*numDims*typeSize, values.data(),
+                              values.size(), type, MPI_STATUS_IGNORE); CHKERRQ(ierr);
+  ierr = MPI_File_close(&fh); CHKERRQ(ierr);
+
+  return ierr;
+}
+
 /********************************************************************
  * Load Mesh for Restart
  * 
@@ -39,50 +188,85 @@ PetscErrorCode TopOpt::LoadMesh(Eigen::VectorXd &xIni)
   PetscInt filesize = 0;
   string filename;
 
-  // Read in element distribution
-  filename = folder + "/Element_Distribution.bin";
-  input.open(filename.c_str(), ios::ate | ios::binary);
-  if (!input.is_open())
-    SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to open element distribution file");
-  filesize = input.tellg();
-  input.seekg(0);
-  elmdist.resize(filesize/sizeof(PetscInt));
-  input.read((char*)elmdist.data(), filesize);
-  input.close();
-
-  // Read in node distribution
-  filename = folder + "/Node_Distribution.bin";
-  input.open(filename.c_str(), ios::ate | ios::binary);
-  if (!input.is_open())
-    SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to open node distribution file");
-  filesize = input.tellg();
-  input.seekg(0);
-  nddist.resize(filesize/sizeof(PetscInt));
-  input.read((char*)nddist.data(), filesize);
-  input.close();
-
-  // Read in elements
-  filename = folder + "/elements.bin";
-  input.open(filename.c_str(), ios::ate | ios::binary);
-  if (!input.is_open())
-    SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to open elements file");
-  filesize = input.tellg();
-  SetDimension(log2(filesize/sizeof(PetscInt)/elmdist(elmdist.size()-1)));
-  input.seekg(elmdist(myid)*pow(2, numDims)*sizeof(PetscInt));
-  element.resize(elmdist(myid+1)-elmdist(myid), pow(2, numDims));
-  input.read((char*)element.data(), element.size()*sizeof(PetscInt));
-  input.close();
-
-  // Read in nodes
-  filename = folder + "/nodes.bin";
-  input.open(filename.c_str(), ios::ate | ios::binary);
-  if (!input.is_open())
-    SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to open nodes file");
-  filesize = input.tellg();
-  input.seekg(nddist(myid)*numDims*sizeof(PetscScalar));
-  node.resize(nddist(myid+1)-nddist(myid), numDims);
-  input.read((char*)node.data(), node.size()*sizeof(PetscScalar));
-  input.close();
+  // Use the single mesh container if the run wrote one
+  MeshFile mesh(comm);
+  PetscBool container = PETSC_FALSE;
+  filename = folder + "/Mesh.bin";
+  ierr = mesh.Open(filename.c_str(), container); CHKERRQ(ierr);
+  if (container) {
+    elmdist.resize(mesh.Count("elmdist"));
+    nddist.resize(mesh.Count("nddist"));
+    if (elmdist.size() != nprocs+1)
+      SETERRQ(comm, PETSC_ERR_FILE_UNEXPECTED, "Restart mesh was written by "
+              "a different number of processes");
+    ierr = mesh.Read("elmdist", elmdist.data(), 0, elmdist.size()); CHKERRQ(ierr);
+    ierr = mesh.Read("nddist", nddist.data(), 0, nddist.size()); CHKERRQ(ierr);
+    meshVersion = 0;
+    if (mesh.Has("meshVersion")) {
+      ierr = mesh.Read("meshVersion", &meshVersion, 0, 1); CHKERRQ(ierr);
+    }
+    SetDimension(log2(mesh.Width("elements")));
+    element.resize(elmdist(myid+1)-elmdist(myid), pow(2, numDims));
+    ierr = mesh.Read("elements", element.data(), elmdist(myid),
+                     element.rows()); CHKERRQ(ierr);
+    node.resize(nddist(myid+1)-nddist(myid), numDims);
+    ierr = mesh.Read("nodes", node.data(), nddist(myid), node.rows()); CHKERRQ(ierr);
+  }
+  else {
+    // Read in element distribution
+    filename = folder + "/Element_Distribution.bin";
+    input.open(filename.c_str(), ios::ate | ios::binary);
+    if (!input.is_open())
+      SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to open element distribution file");
+    filesize = input.tellg();
+    input.seekg(0);
+    elmdist.resize(filesize/sizeof(PetscInt));
+    input.read((char*)elmdist.data(), filesize);
+    input.close();
+
+    // Read in node distribution
+    filename = folder + "/Node_Distribution.bin";
+    input.open(filename.c_str(), ios::ate | ios::binary);
+    if (!input.is_open())
+      SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to open node distribution file");
+    filesize = input.tellg();
+    input.seekg(0);
+    nddist.resize(filesize/sizeof(PetscInt));
+    input.read((char*)nddist.data(), filesize);
+    input.close();
+
+    // Older runs have no version, their mesh was never renumbered
+    meshVersion = 0;
+    filename = folder + "/Mesh_Version.bin";
+    input.open(filename.c_str(), ios::binary);
+    if (input.is_open()) {
+      input.read((char*)&meshVersion, sizeof(PetscInt));
+      input.close();
+    }
+
+    // Read in elements
+    filename = folder + "/elements.bin";
+    input.open(filename.c_str(), ios::ate | ios::binary);
+    if (!input.is_open())
+      SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to open elements file");
+    filesize = input.tellg();
+    SetDimension(log2(filesize/sizeof(PetscInt)/elmdist(elmdist.size()-1)));
+    input.seekg(elmdist(myid)*pow(2, numDims)*sizeof(PetscInt));
+    element.resize(elmdist(myid+1)-elmdist(myid), pow(2, numDims));
+    input.read((char*)element.data(), element.size()*sizeof(PetscInt));
+    input.close();
+
+    // Read in nodes
+    filename = folder + "/nodes.bin";
+    input.open(filename.c_str(), ios::ate | ios::binary);
+    if (!input.is_open())
+      SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to open nodes file");
+    filesize = input.tellg();
+    input.seekg(nddist(myid)*numDims*sizeof(PetscScalar));
+    node.resize(nddist(myid+1)-nddist(myid), numDims);
+    input.read((char*)node.data(), node.size()*sizeof(PetscScalar));
+    input.close();
+  }
 
   // Create constitutive matrix
   switch (this->numDims)
@@ -108,180 +292,46 @@ PetscErrorCode TopOpt::LoadMesh(Eigen::VectorXd &xIni)
       break;
   }
 
-  // Read in BC's
-  // Have to read it all in and parse it later
-  // Loads first
-  filename = folder + "/loadNodes.bin";
-  input.open(filename.c_str(), ios::ate | ios::binary);
-  if (!input.is_open())
-    SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to load nodes file");
-  filesize = input.tellg();
-  input.seekg(0);
-  ArrayXPI temp_node(filesize/sizeof(PetscInt));
-  input.read((char*)temp_node.data(), filesize);
-  input.close();
-  // Now find what part is local and extract it
-  PetscInt begin = 0, finish = temp_node.rows();
-  for (int i = 0; i < temp_node.rows(); i++)
-  {
-    if (temp_node(i) < nddist(myid))
-      begin++;
-    if (temp_node(i) >= nddist(myid+1))
-    {
-      finish = i;
-      break;
-    }
+  // Read in BC's, only the part on nodes owned by this process
+  if (container) {
+    ierr = Load_BC(mesh, "loadNodes", "loads", nddist(myid), nddist(myid+1),
+                   loadNode, loads, numDims); CHKERRQ(ierr);
+    ierr = Load_BC(mesh, "massNodes", "masses", nddist(myid), nddist(myid+1),
+                   massNode, masses, numDims); CHKERRQ(ierr);
+    ierr = Load_BC(mesh, "springNodes", "springs", nddist(myid), nddist(myid+1),
+                   springNode, springs, numDims); CHKERRQ(ierr);
+    ierr = Load_BC(mesh, "supportNodes", "supports", nddist(myid), nddist(myid+1),
+                   suppNode, supports, numDims); CHKERRQ(ierr);
+    ierr = Load_BC(mesh, "eigenSupportNodes", "eigenSupports", nddist(myid),
+                   nddist(myid+1), eigenSuppNode, eigenSupports, numDims); CHKERRQ(ierr);
   }
-  loadNode = temp_node.segment(begin, finish-begin) -= nddist(myid);
-  // Now the load quantities
-  filename = folder + "/loads.bin";
-  input.open(filename.c_str(), ios::ate | ios::binary);
-  if (!input.is_open())
-    SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to open loads file");
-  filesize = input.tellg();
-  input.seekg(begin*sizeof(PetscScalar)*numDims);
-  loads.resize(loadNode.size(), numDims);
-  input.read((char*)loads.data(), loads.size()*sizeof(PetscScalar));
-  input.close();
-
-  // Masses
-  filename = folder + "/massNodes.bin";
-  input.open(filename.c_str(), ios::ate | ios::binary);
-  if (!input.is_open())
-    SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to mass nodes file");
-  filesize = input.tellg();
-  input.seekg(0);
-  temp_node.resize(filesize/sizeof(PetscInt));
-  input.read((char*)temp_node.data(), filesize);
-  input.close();
-  // Now find the local part
-  begin = 0; finish = temp_node.rows();
-  for (int i = 0; i < temp_node.rows(); i++)
-  {
-    if (temp_node(i) < nddist(myid))
-      begin++;
-    if (temp_node(i) >= nddist(myid+1))
-    {
-      finish = i;
-      break;
-    }
-  }
-  massNode = temp_node.segment(begin, finish-begin) -= nddist(myid);
-  // Load the masses
-  filename = folder + "/masses.bin";
-  input.open(filename.c_str(), ios::ate | ios::binary);
-  if (!input.is_open())
-    SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to open masses file");
-  filesize = input.tellg();
-  input.seekg(begin*sizeof(PetscScalar)*numDims);
-  masses.resize(massNode.size(), numDims);
-  input.read((char*)masses.data(), masses.size()*sizeof(PetscScalar));
-  input.close();
-
-  // Springs
-  filename = folder + "/springNodes.bin";
-  input.open(filename.c_str(), ios::ate | ios::binary);
-  if (!input.is_open())
-    SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to spring nodes file");
-  filesize = input.tellg();
-  input.seekg(0);
-  temp_node.resize(filesize/sizeof(PetscInt));
-  input.read((char*)temp_node.data(), filesize);
-  input.close();
-  // Now find the local part
-  begin = 0; finish = temp_node.rows();
-  for (int i = 0; i < temp_node.rows(); i++)
-  {
-    if (temp_node(i) < nddist(myid))
-      begin++;
-    if (temp_node(i) >= nddist(myid+1))
-    {
-      finish = i;
-      break;
-    }
-  }
-  springNode = temp_node.segment(begin, finish-begin) -= nddist(myid);
-  // Load the springs
-  filename = folder + "/springs.bin";
-  input.open(filename.c_str(), ios::ate | ios::binary);
-  if (!input.is_open())
-    SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to open springs file");
-  filesize = input.tellg();
-  input.seekg(begin*sizeof(PetscScalar)*numDims);
-  springs.resize(springNode.size(), numDims);
-  input.read((char*)springs.data(), springs.size()*sizeof(PetscScalar));
-  input.close();
-
-  // Fixed Supports
-  filename = folder + "/supportNodes.bin";
-  input.open(filename.c_str(), ios::ate | ios::binary);
-  if (!input.is_open())
-    SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to support nodes file");
-  filesize = input.tellg();
-  input.seekg(0);
-  temp_node.resize(filesize/sizeof(PetscInt));
-  input.read((char*)temp_node.data(), filesize);
-  input.close();
-  // Now find the local part
-  begin = 0; finish = temp_node.rows();
-  for (int i = 0; i < temp_node.rows(); i++)
-  {
-    if (temp_node(i) < nddist(myid))
-      begin++;
-    if (temp_node(i) >= nddist(myid+1))
-    {
-      finish = i;
-      break;
-    }
-  }
-  suppNode = temp_node.segment(begin, finish-begin) -= nddist(myid);
-  // Load the supports
-  filename = folder + "/supports.bin";
-  input.open(filename.c_str(), ios::ate | ios::binary);
-  if (!input.is_open())
-    SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to open supports file");
-  filesize = input.tellg();
-  input.seekg(begin*sizeof(bool)*numDims);
-  supports.resize(suppNode.size(), numDims);
-  input.read((char*)supports.data(), supports.size()*sizeof(bool));
-  input.close();
-
-  // Eigen Analysis Fixed Supports
-  filename = folder + "/eigenSupportNodes.bin";
-  input.open(filename.c_str(), ios::ate | ios::binary);
-  if (input.is_open()) {
-    filesize = input.tellg();
-    input.seekg(0);
-    temp_node.resize(filesize/sizeof(PetscInt));
-    input.read((char*)temp_node.data(), filesize);
-    input.close();
-    // Now find the local part
-    begin = 0; finish = temp_node.rows();
-    for (int i = 0; i < temp_node.rows(); i++)
-    {
-      if (temp_node(i) < nddist(myid))
-        begin++;
-      if (temp_node(i) >= nddist(myid+1))
-      {
-        finish = i;
-        break;
-      }
-    }
-    eigenSuppNode = temp_node.segment(begin, finish-begin) -= nddist(myid);
-    // Load the eigen analysis supports
-    filename = folder + "/eigenSupports.bin";
-    input.open(filename.c_str(), ios::ate | ios::binary);
-    if (!input.is_open())
-      SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to open eigen supports file");
-    filesize = input.tellg();
-    input.seekg(begin*sizeof(bool)*numDims);
-    eigenSupports.resize(eigenSuppNode.size(), numDims);
-    input.read((char*)eigenSupports.data(), eigenSupports.size()*sizeof(bool));
-    input.close();
-  }
-  else { // assume there are no eigen fixed dofs
-    eigenSuppNode.resize(0);
-    eigenSupports.resize(0, numDims);
+  else {
+    PetscBool found;
+    ierr = Load_BC_Files(comm, folder + "/loadNodes.bin", folder + "/loads.bin",
+                         MPIU_SCALAR, nddist(myid), nddist(myid+1), loadNode,
+                         loads, numDims, found); CHKERRQ(ierr);
+    if (!found)
+      SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to load nodes file");
+    ierr = Load_BC_Files(comm, folder + "/massNodes.bin", folder + "/masses.bin",
+                         MPIU_SCALAR, nddist(myid), nddist(myid+1), massNode,
+                         masses, numDims, found); CHKERRQ(ierr);
+    if (!found)
+      SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to mass nodes file");
+    ierr = Load_BC_Files(comm, folder + "/springNodes.bin", folder + "/springs.bin",
+                         MPIU_SCALAR, nddist(myid), nddist(myid+1), springNode,
+                         springs, numDims, found); CHKERRQ(ierr);
+    if (!found)
+      SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to spring nodes file");
+    ierr = Load_BC_Files(comm, folder + "/supportNodes.bin", folder + "/supports.bin",
+                         MPI::BOOL, nddist(myid), nddist(myid+1), suppNode,
+                         supports, numDims, found); CHKERRQ(ierr);
+    if (!found)
+      SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to support nodes file");
+    // Older runs may have no eigen analysis supports
+    ierr = Load_BC_Files(comm, folder + "/eigenSupportNodes.bin",
+                         folder + "/eigenSupports.bin", MPI::BOOL, nddist(myid),
+                         nddist(myid+1), eigenSuppNode, eigenSupports, numDims,
+                         found); CHKERRQ(ierr);
   }
 
   /// Establish Global Numbering
@@ -310,83 +360,104 @@ PetscErrorCode TopOpt::LoadMesh(Eigen::VectorXd &xIni)
     temp *= node(element(0,7),2) - node(element(0,0),2);
   elemSize.setConstant(nLocElem, temp);
 
-  // Read in the filter matrix
+  // Read in the filters, multigrid hierarchy, and active elements
   PetscViewer view;
-  filename = folder + "/Filter.bin";
-  input.open(filename.c_str(), ios::ate);
-  if (!input.is_open())
-    SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to open filter file");
-  input.close();
-  ierr = PetscViewerBinaryOpen(comm, filename.c_str(), FILE_MODE_READ, &view);
-  ierr = MatCreate(comm, &this->P); CHKERRQ(ierr);
-  ierr = MatSetType(this->P, MATAIJ); CHKERRQ(ierr);
-  ierr = MatSetSizes(this->P, nLocElem, nLocElem, nElem, nElem); CHKERRQ(ierr);
-  ierr = MatLoad(this->P, view); CHKERRQ(ierr);
-  ierr = PetscViewerDestroy(&view);
-
-  filename = folder + "/Max_Filter.bin";
-  input.open(filename.c_str(), ios::ate);
-  if (!input.is_open())
-    SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to open max feature filter file");
-  input.close();
-  ierr = PetscViewerBinaryOpen(comm, filename.c_str(), FILE_MODE_READ, &view);
-  ierr = MatCreate(comm, &this->R); CHKERRQ(ierr);
-  ierr = MatSetType(this->R, MATAIJ); CHKERRQ(ierr);
-  ierr = MatSetSizes(this->R, nLocElem, nLocElem, nElem, nElem); CHKERRQ(ierr);
-  ierr = MatLoad(this->R, view); CHKERRQ(ierr);
-  ierr = PetscViewerDestroy(&view);
-
-  filename = folder + "/Void_Edge_Volume.bin";
-  input.open(filename.c_str(), ios::ate);
-  if (!input.is_open())
-    SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to open max feature filter file");
-  input.close();
-  ierr = MatCreateVecs(this->R, NULL, &this->REdge); CHKERRQ(ierr);
-  ierr = PetscViewerBinaryOpen(comm, filename.c_str(), FILE_MODE_READ, &view);
-  ierr = VecLoad(this->REdge, view); CHKERRQ(ierr);
-  ierr = PetscViewerDestroy(&view); CHKERRQ(ierr);
-
-  // Read in the multigrid hierarchy
   this->PR.resize(0);
   this->MG_comms.resize(0);
   this->MG_comms.push_back(comm);
-  PetscInt lrow = this->numDims*nddist(myid+1)-this->numDims*nddist(myid), lcol;
-  for (int level = 0; ; level++)
-  {
-    stringstream strmlvl;
-    strmlvl << level;
-    filename = folder + "/P" + strmlvl.str() + ".bin";
+  this->active.resize(this->nLocElem);
+  if (container) {
+    ierr = mesh.Read("Filter", &this->P); CHKERRQ(ierr);
+    ierr = mesh.Read("Max_Filter", &this->R); CHKERRQ(ierr);
+    ierr = MatCreateVecs(this->R, NULL, &this->REdge); CHKERRQ(ierr);
+    ierr = mesh.Read("Void_Edge_Volume", this->REdge); CHKERRQ(ierr);
+    for (int level = 0; ; level++) {
+      stringstream strmlvl;
+      strmlvl << "P" << level;
+      if (!mesh.Has((strmlvl.str() + ".rows").c_str()))
+        break;
+      this->PR.resize(level+1);
+      ierr = mesh.Read(strmlvl.str().c_str(), this->PR.data()+level); CHKERRQ(ierr);
+      this->MG_comms.push_back(comm);
+    }
+    ierr = mesh.Read("active", this->active.data(), this->elmdist(myid),
+                     this->nLocElem); CHKERRQ(ierr);
+  }
+  else {
+    // Read in the filter matrix
+    filename = folder + "/Filter.bin";
     input.open(filename.c_str(), ios::ate);
     if (!input.is_open())
-      break;
+      SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to open filter file");
     input.close();
-    this->PR.resize(level+1);
-    ierr = PetscViewerBinaryOpen(comm, filename.c_str(), FILE_MODE_READ, &view); CHKERRQ(ierr);
-    ierr = MatCreate(comm, this->PR.data()+level); CHKERRQ(ierr);
-    ierr = MatSetType(this->PR[level], MATAIJ); CHKERRQ(ierr);
-    // Properly set local matrix dimensions
-    filename += ".split";
-    input.open(filename.c_str(), ios::binary);
-    input.seekg(myid*sizeof(PetscInt));
-    input.read((char*)&lcol, sizeof(PetscInt));
+    ierr = PetscViewerBinaryOpen(comm, filename.c_str(), FILE_MODE_READ, &view);
+    ierr = MatCreate(comm, &this->P); CHKERRQ(ierr);
+    ierr = MatSetType(this->P, MATAIJ); CHKERRQ(ierr);
+    ierr = MatSetSizes(this->P, nLocElem, nLocElem, nElem, nElem); CHKERRQ(ierr);
+    ierr = MatLoad(this->P, view); CHKERRQ(ierr);
+    ierr = PetscViewerDestroy(&view);
+
+    filename = folder + "/Max_Filter.bin";
+    input.open(filename.c_str(), ios::ate);
+    if (!input.is_open())
+      SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to open max feature filter file");
     input.close();
-    ierr = MatSetSizes(this->PR[level], lrow, lcol, PETSC_DETERMINE, PETSC_DETERMINE); CHKERRQ(ierr);
-    ierr = MatLoad(this->PR[level], view); CHKERRQ(ierr);
+    ierr = PetscViewerBinaryOpen(comm, filename.c_str(), FILE_MODE_READ, &view);
+    ierr = MatCreate(comm, &this->R); CHKERRQ(ierr);
+    ierr = MatSetType(this->R, MATAIJ); CHKERRQ(ierr);
+    ierr = MatSetSizes(this->R, nLocElem, nLocElem, nElem, nElem); CHKERRQ(ierr);
+    ierr = MatLoad(this->R, view); CHKERRQ(ierr);
     ierr = PetscViewerDestroy(&view);
-    lrow = lcol;
-    this->MG_comms.push_back(comm);
+
+    filename = folder + "/Void_Edge_Volume.bin";
+    input.open(filename.c_str(), ios::ate);
+    if (!input.is_open())
+      SETERRQ(comm, PETSC_ERR_FILE_OPEN, "Unable to open max feature filter file");
+    input.close();
+    ierr = MatCreateVecs(this->R, NULL, &this->REdge); CHKERRQ(ierr);
+    ierr = PetscViewerBinaryOpen(comm, filename.c_str(), FILE_MODE_READ, &view);
+    ierr = VecLoad(this->REdge, view); CHKERRQ(ierr);
+    ierr = PetscViewerDestroy(&view); CHKERRQ(ierr);
+
+    // Read in the multigrid hierarchy
+    PetscInt lrow = this->numDims*nddist(myid+1)-this->numDims*nddist(myid), lcol;
+    for (int level = 0; ; level++)
+    {
+      stringstream strmlvl;
+      strmlvl << level;
+      filename = folder + "/P" + strmlvl.str() + ".bin";
+      input.open(filename.c_str(), ios::ate);
+      if (!input.is_open())
+        break;
+      input.close();
+      this->PR.resize(level+1);
+      ierr = PetscViewerBinaryOpen(comm, filename.c_str(), FILE_MODE_READ, &view); CHKERRQ(ierr);
+      ierr = MatCreate(comm, this->PR.data()+level); CHKERRQ(ierr);
+      ierr = MatSetType(this->PR[level], MATAIJ); CHKERRQ(ierr);
+      // Properly set local matrix dimensions
+      filename += ".split";
+      input.open(filename.c_str(), ios::binary);
+      input.seekg(myid*sizeof(PetscInt));
+      input.read((char*)&lcol, sizeof(PetscInt));
+      input.close();
+      ierr = MatSetSizes(this->PR[level], lrow, lcol, PETSC_DETERMINE, PETSC_DETERMINE); CHKERRQ(ierr);
+      ierr = MatLoad(this->PR[level], view); CHKERRQ(ierr);
+      ierr = PetscViewerDestroy(&view);
+      lrow = lcol;
+      this->MG_comms.push_back(comm);
+    }
+
+    // Read which elements are active
+    MPI_File fh;
+    ierr = MPI_File_open(this->comm, (folder + "/active.bin").c_str(), MPI_MODE_RDONLY,
+                         MPI_INFO_NULL, &fh); CHKERRQ(ierr);
+    ierr = MPI_File_seek(fh, this->elmdist(myid) * sizeof(bool), MPI_SEEK_SET); CHKERRQ(ierr);
+    ierr = MPI_File_read_all(fh, this->active.data(), this->nLocElem,
+                              MPI::BOOL, MPI_STATUS_IGNORE); CHKERRQ(ierr);
+    ierr = MPI_File_close(&fh); CHKERRQ(ierr);
   }
+  ierr = mesh.Close(); CHKERRQ(ierr);
 
-  // Read which elements are active
-  MPI_File fh;
-  this->active.resize(this->nLocElem);
-  ierr = MPI_File_open(this->comm, (folder + "/active.bin").c_str(), MPI_MODE_RDONLY,
-                       MPI_INFO_NULL, &fh); CHKERRQ(ierr);
-  ierr = MPI_File_seek(fh, this->elmdist(myid) * sizeof(bool), MPI_SEEK_SET); CHKERRQ(ierr);
-  ierr = MPI_File_read_all(fh, this->active.data(), this->nLocElem,
-                            MPI::BOOL, MPI_STATUS_IGNORE); CHKERRQ(ierr);
-  ierr = MPI_File_close(&fh); CHKERRQ(ierr);
-                                                                                                     
   // Initial design values
   xIni.setOnes(nLocElem); xIni *= 0.5;
   ierr = VecPlaceArray(this->x, xIni.data()); CHKERRQ(ierr); 
@@ -434,6 +505,8 @@ PetscErrorCode TopOpt::CreateMesh(VectorXPS dimensions, ArrayXPI Nel,
   }
 
   this->SetDimension(Nel.size());
+  meshDimensions = dimensions; meshNel = Nel;
+  meshRmin = Rmin; meshRmax = Rmax; meshReorder = Reorder_Mesh;
   Nel.conservativeResize(3);
   for (int i = numDims; i < 3; i++)
     Nel(i) = 1;
@@ -631,10 +704,6 @@ PetscErrorCode TopOpt::CreateMesh(VectorXPS dimensions, ArrayXPI Nel,
   }
 
   /// Remove unwanted elements
-  // Number of ghost elements along processor boundaries
-  int padding = 1;
-  for (short dim = 0; dim < numDims-1; dim++)
-    padding *= Nel(dim);
   // Global validity/numbering array
   Eigen::Array<bool, -1, 1> elemValidity = Eigen::Array<bool, -1, 1>::Ones(nLocElem);
   Domain(elemCenters, elemValidity, "Domain");
@@ -644,12 +713,27 @@ PetscErrorCode TopOpt::CreateMesh(VectorXPS dimensions, ArrayXPI Nel,
                         "for removal\n"); CHKERRQ(ierr);
   } 
 
+  // Box that each element belongs to in a structured decomposition
+  Eigen::Array<idx_t, -1, 1> boxPart;
+  if (box_partition) {
+    ierr = BoxPartition(first, last, Nel, boxPart); CHKERRQ(ierr);
+  }
+
+  // Structured index of the first local element, used to find the
+  // partitioning weights of the remaining elements
+  PetscInt firstIndex = elmdist(myid);
+
   // Trim domain
-  int nInterfaceNodes = 1;
-  for (int dim = 1; dim < numDims; dim++)
-    nInterfaceNodes *= Nel(dim-1)+1;
-  ierr = ApplyDomain(elemValidity, padding, nInterfaceNodes, MinFI, MinFJ, MinFK,
-                     MaxFI, MaxFJ, MaxFK, I, J, K, cList, mg_levels); CHKERRQ(ierr);
+  ierr = ApplyDomain(elemValidity, MinFI, MinFJ, MinFK, MaxFI, MaxFJ, MaxFK,
+                     I, J, K, cList, mg_levels); CHKERRQ(ierr);
+  if (box_partition) {
+    PetscInt nValid = 0;
+    for (PetscInt el = 0; el < elemValidity.size(); el++) {
+      if (elemValidity(el))
+        boxPart(nValid++) = boxPart(el);
+    }
+    boxPart.conservativeResize(nValid);
+  }
 
   if (this->verbose >= 3) {
     ierr = PetscFPrintf(this->comm, this->output, "Successfully trimmed "
@@ -658,8 +742,25 @@ PetscErrorCode TopOpt::CreateMesh(VectorXPS dimensions, ArrayXPI Nel,
   }
 
   /// Get a better distribution of elements
-  ierr = ReorderParMetis(Reorder_Mesh, MinFI, MinFJ, MinFK, MaxFI,
-                         MaxFJ, MaxFK); CHKERRQ(ierr);
+  if (box_partition) {
+    ierr = ElemDist(boxPart, MinFI, MinFJ, MinFK, MaxFI, MaxFJ, MaxFK); CHKERRQ(ierr);
+  }
+  else if (repartWeight.size() > 0) {
+    ArrayXPI weight(nLocElem);
+    for (PetscInt el = 0, nValid = 0; el < elemValidity.size(); el++) {
+      if (elemValidity(el))
+        weight(nValid++) = firstIndex + el;
+    }
+    ierr = Lookup_Numbers(repartDist, repartWeight, weight); CHKERRQ(ierr);
+    Eigen::Array<idx_t, -1, 1> elmwgt = weight.cast<idx_t>();
+    ierr = ReorderParMetis(Reorder_Mesh, MinFI, MinFJ, MinFK, MaxFI, MaxFJ,
+                           MaxFK, 0, 0, NULL, NULL, NULL, 1, elmwgt.data(),
+                           2); CHKERRQ(ierr);
+  }
+  else {
+    ierr = ReorderParMetis(Reorder_Mesh, MinFI, MinFJ, MinFK, MaxFI,
+                           MaxFJ, MaxFK); CHKERRQ(ierr);
+  }
   double temp = elemSize(0);
   elemSize.setConstant(nLocElem, temp);
   if (this->verbose >= 3) {
@@ -674,8 +775,20 @@ PetscErrorCode TopOpt::CreateMesh(VectorXPS dimensions, ArrayXPI Nel,
                         "redistributed nodes\n"); CHKERRQ(ierr);
   }
 
+  /// Order the elements and nodes on each process along a space-filling curve
+  PetscBool sfc_ordering = PETSC_TRUE;
+  ierr = PetscOptionsGetBool(NULL, NULL, "-sfc_ordering", &sfc_ordering,
+                             NULL); CHKERRQ(ierr);
+  if (sfc_ordering) {
+    ierr = SFC_Order(MinFI, MinFJ, MaxFI, MaxFJ, I, J, cList, mg_levels); CHKERRQ(ierr);
+    if (this->verbose >= 3) {
+      ierr = PetscFPrintf(this->comm, this->output, "Successfully reordered "
+                          "local elements and nodes\n"); CHKERRQ(ierr);
+    }
+  }
+
   /// Interpolation matrix assembly
-  PetscInt min_size = std::min((int)cList[mg_levels-2].size(), (int)5e3);
+  PetscInt min_size = this->numDims*std::min((int)cList[mg_levels-2].size(), (int)5e3);
   ierr = PetscOptionsGetInt(NULL, "kuf_", "-pc_mg_proc_eq_limit",
                             &min_size, NULL); CHKERRQ(ierr);
   ierr = Assemble_Interpolation(I, J, K, cList, mg_levels, min_size);
@@ -732,9 +845,6 @@ PetscErrorCode TopOpt::CreateMesh(VectorXPS dimensions, ArrayXPI Nel,
  * 
  * @param elemValidity: Flag for each element to be included (True) or
  *                      removed (False), set on output
- * @param padding: Product of number of elements in each dimension
- *                 less than n, where n is the dimensionality of the problem
- * @param nInterfaceNodes: Same as padding, but for nodes
  * @param MinFI: row indices of minimum filter matrix triplets
  * @param MinFJ: column indices of minimum filter matrix triplets
  * @param MinFK: values of minimum filter matrix triplets
@@ -751,469 +861,68 @@ PetscErrorCode TopOpt::CreateMesh(VectorXPS dimensions, ArrayXPI Nel,
  * 
  *******************************************************************/
 PetscErrorCode TopOpt::ApplyDomain(Eigen::Array<bool, -1, 1> elemValidity,
-                                   int padding, int nInterfaceNodes, ArrayXPI &MinFI,
-                                   ArrayXPI &MinFJ, ArrayXPS &MinFK, ArrayXPI &MaxFI,
-                                   ArrayXPI &MaxFJ, ArrayXPS &MaxFK, ArrayXPI *I,
-                                   ArrayXPI *J, ArrayXPS *K, ArrayXPI *cList,
-                                   int &mg_levels)
+                                   ArrayXPI &MinFI, ArrayXPI &MinFJ, ArrayXPS &MinFK,
+                                   ArrayXPI &MaxFI, ArrayXPI &MaxFJ, ArrayXPS &MaxFK,
+                                   ArrayXPI *I, ArrayXPI *J, ArrayXPS *K,
+                                   ArrayXPI *cList, int &mg_levels)
 {
   PetscErrorCode ierr = 0;
-  /// elem validity should be of size nLocElem, padding is the number of
-  /// elements along the interfaces between processes, and nInterfaceNodes is
-  /// the number of nodes on those interfaces
+  /// elem validity should be of size nLocElem. New numbers start at 1 so
+  /// that removed elements and nodes are marked with a 0 until the end
 
   /// Renumber local elements
-  // Array for new element number and total remaining elements on each process
-  ArrayXPI newElemNumber;
-  ArrayXPI number = ArrayXPI::Zero(nprocs);
-  // Setting the range of local elements amongst all relevant elements
-  PetscInt start, finish;
-  if (myid == 0) {
-    start = 0; finish = nLocElem;
-    newElemNumber.setZero(nLocElem + padding);
-  }
-  else if (myid == nprocs-1) {
-    start = padding; finish = nLocElem+padding;
-    newElemNumber.setZero(nLocElem + padding);
-  }
-  else {
-    start = padding; finish = nLocElem+padding;
-    newElemNumber.setZero(nLocElem + 2*padding);
-  }
-
+  ArrayXPI newElemNumber = ArrayXPI::Zero(nLocElem);
+  PetscInt number = 0, offset = 0;
   for (PetscInt el = 0; el < nLocElem; el++) {
     if (elemValidity(el)) {
-      newElemNumber(el+start) = ++number(myid);
+      newElemNumber(el) = ++number;
     }
   }
-
-  if (this->nprocs > 1) {
-    // Share how many are stored locally on this process
-    MPI_Allgather(MPI_IN_PLACE, 0, MPI_PETSCINT, number.data(), 1, MPI_PETSCINT, comm);
-    // Calculate first number on this process (first process starts at 1)
-    if (myid > 0)
-    {
-      newElemNumber.segment(padding, nLocElem) +=
-        number.segment(0, myid).sum()*
-        (newElemNumber.segment(padding, nLocElem)>0).cast<PetscInt>();
-    }
-
-    /// Send and receive new numbers of edge elements to adjacent processes
-    MPI_Request sendReq1 = MPI_REQUEST_NULL, sendReq2 = MPI_REQUEST_NULL,
-                recReq1 = MPI_REQUEST_NULL, recReq2 = MPI_REQUEST_NULL;
-    int sR1 = true, sR2 = true, rR1 = true, rR2 = true;
-    if (nLocElem > 0)
-    {
-      if (myid > 0 && myid != nprocs-1)
-      {
-        // Upward send
-        MPI_Isend(newElemNumber.data()+nLocElem, padding, MPI_PETSCINT,
-                  myid+1, 0, comm, &sendReq1);
-        // Downward send
-        MPI_Isend(newElemNumber.data()+padding, padding, MPI_PETSCINT,
-                  myid-1, 1, comm, &sendReq2);
-        // Receive from below
-        MPI_Irecv(newElemNumber.data(), padding, MPI_PETSCINT,
-                  myid-1, 0, comm, &recReq1);
-        // Receive from above
-        MPI_Irecv(newElemNumber.data()+nLocElem+padding, padding, MPI_PETSCINT,
-                  myid+1, 1, comm, &recReq2);
-      }
-      else if (myid == 0)
-      {
-        // Upward send
-        MPI_Isend(newElemNumber.data()+nLocElem-padding, padding, MPI_PETSCINT,
-                  myid+1, 0, comm, &sendReq1);
-        // Receive from above
-        MPI_Irecv(newElemNumber.data()+nLocElem, padding, MPI_PETSCINT,
-                  myid+1, 1, comm, &recReq2);
-      }
-      else
-      {
-        // Downward send
-        MPI_Isend(newElemNumber.data()+padding, padding, MPI_PETSCINT,
-                  myid-1, 1, comm, &sendReq2);
-        // Receive from below
-        MPI_Irecv(newElemNumber.data(), padding, MPI_PETSCINT,
-                  myid-1, 0, comm, &recReq1);
-      }
-
-      // Terminate communications before advancing
-      do {
-        MPI_Test(&sendReq1, &sR1, MPI_STATUS_IGNORE);
-        MPI_Test(&sendReq2, &sR2, MPI_STATUS_IGNORE);
-        MPI_Test(&recReq1, &rR1, MPI_STATUS_IGNORE);
-        MPI_Test(&recReq2, &rR2, MPI_STATUS_IGNORE);
-      } while (!(sR1 && sR2 && rR1 && rR2));
-    }
-    else
-    {
-      // this process currently owns zero elements - pass information along
-      ArrayXPI zeros = ArrayXPI::Zero(padding);
-      if (myid == 0)
-      {
-        rR1 = 1; sR1 = 0; rR2 = 0; sR2 = 1;
-        // Upward send
-        MPI_Isend(zeros.data(), padding, MPI_PETSCINT, myid+1, 0, comm, &sendReq1);
-        // Receive from above
-        MPI_Irecv(newElemNumber.data(), padding, MPI_PETSCINT,
-                  myid+1, 1, comm, &recReq2);
-      }
-      else if (myid == nprocs-1)
-      {
-        rR2 = 1; sR2 = 0; rR1 = 0; sR1 = 1;
-        // Downward send
-        MPI_Isend(zeros.data(), padding, MPI_PETSCINT,
-                  myid-1, 1, comm, &sendReq2);
-        // Receive from below
-        MPI_Irecv(newElemNumber.data(), padding, MPI_PETSCINT,
-                  myid-1, 0, comm, &recReq1);
-      }
-      else
-      {
-        rR2 = 0; sR2 = 0; rR1 = 0; sR1 = 0;
-        // Receive from above
-        MPI_Irecv(newElemNumber.data()+padding, padding, MPI_PETSCINT,
-                  myid+1, 1, comm, &recReq2);
-        // Receive from below
-        MPI_Irecv(newElemNumber.data(), padding, MPI_PETSCINT,
-                  myid-1, 0, comm, &recReq1);
-      }
-      do {
-        if (rR1 == 0)
-        {
-          MPI_Test(&recReq1, &rR1, MPI_STATUS_IGNORE);
-          if (rR1 == 1) // Just got the message from below
-          {
-            // Upward send
-            MPI_Isend(newElemNumber.data(), padding,
-                      MPI_PETSCINT, myid+1, 0, comm, &sendReq1);
-            sR1 = 0;
-          }
-        }
-        else if (sR1 == 0)
-        {
-          MPI_Test(&sendReq1, &sR1, MPI_STATUS_IGNORE);
-        }
-        if (rR2 == 0)
-        {
-          MPI_Test(&recReq2, &rR2, MPI_STATUS_IGNORE);
-          if (rR2 == 1) // Just got the message from above
-          {
-            // Downward send
-            MPI_Isend(newElemNumber.data()+padding, padding,
-                      MPI_PETSCINT, myid-1, 1, comm, &sendReq2);
-            sR2 = 0;
-          }
-        }
-        else if (sR2 == 0)
-        {
-          MPI_Test(&sendReq2, &sR2, MPI_STATUS_IGNORE);
-        }
-      } while (!(sR1 && sR2 && rR1 && rR2));
-    }
-  }
-
-  /// Prepare to check validity of nodes
-  // first and last+1 node needed by elements on this process
-  // start is now the first node used by this process, finish is the last
-  if (element.size() > 0)
-  {
-    start = element.minCoeff();
-    finish = element.maxCoeff()+1;
-  }
-  else
-  {
-    start = nddist(myid); finish = nddist(myid);
-  }
-  // Array to first check if node is needed and then track renumbering
-  ArrayXPI newNodeNumber;
-  if (myid > 0 && myid < nprocs-1)
-    newNodeNumber.setZero(nLocNode+2*nInterfaceNodes);
-  else
-    newNodeNumber.setZero(nLocNode+nInterfaceNodes);
-
-  /// Loop over elements to see which nodes are needed by this process' elements
-  for (int el = 0; el < nLocElem; el++)
-  {
-    if (newElemNumber(el + (myid>0)*padding) > 0)
-    {
-      for (int nd = 0; nd < element.cols(); nd++)
-        newNodeNumber(element(el,nd)-start) = 1;
-    }
-  }
-
-  if (this->nprocs > 1) {
-    /// Send and receive new numbers of edge nodes to adjacent processes
-    MPI_Request sendReq1 = MPI_REQUEST_NULL, sendReq2 = MPI_REQUEST_NULL,
-                recReq1 = MPI_REQUEST_NULL, recReq2 = MPI_REQUEST_NULL;
-    int sR1 = true, sR2 = true, rR1 = true, rR2 = true;
-    // Container to use for communications with adjacent processes
-    ArrayXPI Receptacle = ArrayXPI::Zero(4*nInterfaceNodes);
-    // Share validity of edge nodes if this process has any, pass through otherwise
-    MPI_Status sendStat1, sendStat2, recStat1, recStat2;
-    if (nLocNode > 0)
-    {
-      if (myid > 0 && myid != nprocs-1)
-      {
-        // Upward send
-        MPI_Isend(newNodeNumber.data()+nLocNode, 2*nInterfaceNodes,
-                  MPI_PETSCINT, myid+1, 0, comm, &sendReq1);
-        sR1 = 0;
-        // Downward send
-        MPI_Isend(newNodeNumber.data(), 2*nInterfaceNodes, MPI_PETSCINT,
-                  myid-1, 1, comm, &sendReq2);
-        sR2 = 0;
-        // Receive from below
-        MPI_Irecv(Receptacle.data(), 2*nInterfaceNodes, MPI_PETSCINT,
-                  myid-1, 0, comm, &recReq1);
-        rR1 = 0;
-        // Receive from above
-        MPI_Irecv(Receptacle.data()+2*nInterfaceNodes, 2*nInterfaceNodes, MPI_PETSCINT,
-                  myid+1, 1, comm, &recReq2);
-        rR2 = 0;
-      }
-      else if (myid == 0)
-      {
-        // Upward send
-        MPI_Isend(newNodeNumber.data()+nLocNode-nInterfaceNodes, 2*nInterfaceNodes,
-                  MPI_PETSCINT, myid+1, 0, comm, &sendReq1);
-        sR1 = 0;
-        // Receive from above
-        MPI_Irecv(Receptacle.data()+2*nInterfaceNodes, 2*nInterfaceNodes, MPI_PETSCINT,
-                  myid+1, 1, comm, &recReq2);
-        rR2 = 0;
-
-      }
-      else // last process
-      {
-        // Downward send
-        MPI_Isend(newNodeNumber.data(), 2*nInterfaceNodes, MPI_PETSCINT,
-                  myid-1, 1, comm, &sendReq2);
-        sR2 = 0;
-        // Receive from below
-        MPI_Irecv(Receptacle.data(), 2*nInterfaceNodes, MPI_PETSCINT,
-                  myid-1, 0, comm, &recReq1);
-        rR1 = 0;
-      }
-
-      do {
-        if (sR1 == 0)
-        {
-          MPI_Test(&sendReq1, &sR1, &sendStat1);
-        }
-        if (sR2 == 0)
-        {
-          MPI_Test(&sendReq2, &sR2, &sendStat2);
-        }
-        if (rR1 == 0)
-        {
-          MPI_Test(&recReq1, &rR1, &recStat1);
-          if (rR1 == 1) // Just got the message from below
-          {
-            // Combine indicators from both processes
-            newNodeNumber.segment(0, 2*nInterfaceNodes) =
-              newNodeNumber.segment(0, 2*nInterfaceNodes).max(
-              Receptacle.segment(0, 2*nInterfaceNodes) );
-          }
-        }
-        if (rR2 == 0)
-        {
-          MPI_Test(&recReq2, &rR2, &recStat2);
-          if (rR2 == 1) // Just got the message from above
-          {
-            // Combine indicators from both processes
-            newNodeNumber.segment(newNodeNumber.size()-2*nInterfaceNodes,
-                                  2*nInterfaceNodes) = newNodeNumber.segment
-              (newNodeNumber.size()-2*nInterfaceNodes, 2*nInterfaceNodes).max
-              (Receptacle.segment(2*nInterfaceNodes, 2*nInterfaceNodes) );
-          }
-        }
-      } while (!(sR1 && sR2 && rR1 && rR2));
-    }
-    else
-    {
-      // this process owns no nodes currently - receive from adjacent
-      // processes and pass through
-      ArrayXPI zeros = ArrayXPI::Zero(2*nInterfaceNodes);
-      if (myid == 0)
-      {
-        rR1 = 1; sR1 = 0; rR2 = 0; sR2 = 1;
-        // Upward send
-        MPI_Isend(zeros.data(), 2*nInterfaceNodes,
-                  MPI_PETSCINT, myid+1, 0, comm, &sendReq1);
-        // Receive from above
-        MPI_Irecv(Receptacle.data(), 2*nInterfaceNodes, MPI_PETSCINT,
-                  myid+1, 1, comm, &recReq2);
-      }
-      else if (myid == nprocs-1)
-      {
-        rR2 = 1; sR2 = 0; rR1 = 0; sR1 = 1;
-        // Downward send
-        MPI_Isend(zeros.data(), 2*nInterfaceNodes, MPI_PETSCINT,
-                  myid-1, 1, comm, &sendReq2);
-        // Receive from below
-        MPI_Irecv(Receptacle.data(), 2*nInterfaceNodes, MPI_PETSCINT,
-                  myid-1, 0, comm, &recReq1);
-      }
-      else
-      {
-        rR2 = 0; sR2 = 0; rR1 = 0; sR1 = 0;
-        // Receive from above
-        MPI_Irecv(Receptacle.data()+2*nInterfaceNodes, 2*nInterfaceNodes, MPI_PETSCINT,
-                  myid+1, 1, comm, &recReq2);
-        // Receive from below
-        MPI_Irecv(Receptacle.data(), 2*nInterfaceNodes, MPI_PETSCINT,
-                  myid-1, 0, comm, &recReq1);
-      }
-
-      do {
-        if (rR1 == 0)
-        {
-          MPI_Test(&recReq1, &rR1, &recStat1);
-          if (rR1 == 1) // Just got the message from below
-          {
-            // Upward send
-            MPI_Isend(Receptacle.data(), 2*nInterfaceNodes,
-                      MPI_PETSCINT, myid+1, 0, comm, &sendReq1);
-            sR1 = 0;
-          }
-        }
-        else if (sR1 == 0)
-        {
-          MPI_Test(&sendReq1, &sR1, &sendStat1);
-        }
-        if (rR2 == 0)
-        {
-          MPI_Test(&recReq2, &rR2, &recStat2);
-          if (rR2 == 1) // Just got the message from above
-          {
-            // Downward send
-            MPI_Isend(Receptacle.data()+2*nInterfaceNodes, 2*nInterfaceNodes,
-                      MPI_PETSCINT, myid-1, 1, comm, &sendReq2);
-            sR2 = 0;
-          }
-        }
-        else if (sR2 == 0)
-        {
-          MPI_Test(&sendReq2, &sR2, &sendStat2);
-        }
-      } while (!(sR1 && sR2 && rR1 && rR2));
+  // Calculate first number on this process (first process starts at 1)
+  ierr = MPI_Exscan(&number, &offset, 1, MPI_PETSCINT, MPI_SUM, comm); CHKERRQ(ierr);
+  if (myid == 0)
+    offset = 0;
+  newElemNumber += offset*(newElemNumber > 0).cast<PetscInt>();
+
+  /// Mark the nodes needed by remaining elements on the processes owning them
+  ArrayXPI keys(element.size()), requests;
+  Eigen::ArrayXi sendcnt, recvcnt;
+  PetscInt nKeys = 0;
+  for (PetscInt el = 0; el < nLocElem; el++) {
+    if (elemValidity(el)) {
+      for (short nd = 0; nd < element.cols(); nd++)
+        keys(nKeys++) = element(el,nd);
     }
   }
+  keys.conservativeResize(nKeys);
+  ierr = Owner_Requests(nddist, keys, sendcnt, requests, recvcnt); CHKERRQ(ierr);
+  ArrayXPI newNodeNumber = ArrayXPI::Zero(nLocNode);
+  for (PetscInt i = 0; i < requests.size(); i++)
+    newNodeNumber(requests(i) - nddist(myid)) = 1;
 
-  /// Validity of all nodes and elements has been determined
   /// Renumber local nodes
-  number(myid) = 0;
-  for (PetscInt nd = nddist(myid)-start; nd < nddist(myid+1)-start; nd++) {
-    if (newNodeNumber(nd) > 0) {
-      newNodeNumber(nd) = ++number(myid);
-    }
-  }
-  // Share how many nodes are stored locally on this process
-  MPI_Allgather(MPI_IN_PLACE, 0, MPI_PETSCINT, number.data(), 1, MPI_PETSCINT, comm);
-
-  /// Renumber nonlocal nodes
-  // Nodes on higher-numbered processes
-  for (PetscInt nd = nddist(myid+1)-start; nd < finish-start; nd++) {
-    if (newNodeNumber(nd) > 0) {
-      newNodeNumber(nd) = ++number(myid);
-    }
-  }
-  number(myid) = 0;
-  // Nodes on lower-numbered processes
-  for (PetscInt nd = nddist(myid)-start-1; nd >= 0; nd--) {
+  number = 0; offset = 0;
+  for (PetscInt nd = 0; nd < nLocNode; nd++) {
     if (newNodeNumber(nd) > 0) {
-      newNodeNumber(nd) = --number(myid);
-    }
-  }
-
-  // Calculate first number on this process (first process starts at 1)
-  number(myid) = number.segment(0, myid).sum();
-  // Apply this offset to already calculated node numberings
-  newNodeNumber += number(myid)*(newNodeNumber!=0).cast<PetscInt>();
-
-  // Remove unwanted elements
-  if (myid > 0)
-    newElemNumber = newElemNumber.segment(padding, nLocElem).eval();
-  else
-    newElemNumber = newElemNumber.segment(0, nLocElem).eval();
-  EigLab::RemoveSlices(element, newElemNumber, 1);
-
-  // Reassign node numbers to remaining Elements
-  for (int el = 0; el < element.rows(); el++) {
-    for (int nd = 0; nd < element.cols(); nd++) {
-      PetscInt newNum = newNodeNumber(element(el,nd)-start);
-      if (newNum >= number(myid))
-        element(el,nd) = newNum-1;
-      else
-        element(el,nd) = newNum;
-    }
-  }
-
-  /// Reassign node numbers in projection matrices
-  // Start by getting a global list of the new node numbers
-  ArrayXPI allNodeNumber = ArrayXPI::Zero(nNode);
-  allNodeNumber.segment(nddist(myid),nddist(myid+1)-nddist(myid)) = 
-      newNodeNumber.segment(nddist(myid)-start,nddist(myid+1)-nddist(myid));
-  // ArrayXPI displs = ArrayXPI::Zero(nprocs);
-  // partial_sum(nddist.data(), nddist.data()+nprocs-1, displs.data()+1);
-  // ArrayXPI sizes = nddist.segment(1,nprocs)-nddist.segment(0,nprocs);
-  // MPI_Allgatherv(newNodeNumber.data()+nddist(myid)-start,
-  //                nddist(myid+1)-nddist(myid), MPI_PETSCINT, allNodeNumber.data(),
-  //                sizes.data(), displs.data(), MPI_PETSCINT, comm);
-  MPI_Allreduce(MPI_IN_PLACE, allNodeNumber.data(), nNode, MPI_PETSCINT,
-                MPI_SUM, comm);
-  // Now update numbers in the lists
-  for (int level = 0; level < mg_levels-1; level++)
-  { 
-    int IJKind = 0, cind = 0;
-    for (int j = 0; j < I[level].size(); j++)
-    {
-      if ((allNodeNumber(I[level](j)) > 0) && (allNodeNumber(J[level](j)) > 0))
-      {
-        I[level](IJKind) = allNodeNumber(I[level](j))-1;
-        J[level](IJKind) = allNodeNumber(J[level](j))-1;
-        K[level](IJKind) = K[level](j);
-        IJKind++;
-      }
+      newNodeNumber(nd) = ++number;
     }
-    for (int j = 0; j < cList[level].size(); j++)
-      if (allNodeNumber(cList[level](j)) > 0)
-        cList[level](cind++) = allNodeNumber(cList[level](j))-1;
-    I[level].conservativeResize(IJKind); J[level].conservativeResize(IJKind);
-    K[level].conservativeResize(IJKind);
-    cList[level].conservativeResize(cind);
-    if (cind == 0)
-      mg_levels = level;
   }
-  allNodeNumber.resize(0); // Free up the space
+  ierr = MPI_Exscan(&number, &offset, 1, MPI_PETSCINT, MPI_SUM, comm); CHKERRQ(ierr);
+  if (myid == 0)
+    offset = 0;
+  newNodeNumber += offset*(newNodeNumber > 0).cast<PetscInt>();
 
   /// Get new element numbers for each triplet of the filter matrices
-  PetscInt ghostStart, ghostEnd;
-  if (MinFJ.size() > 0)
-  {
-    ghostStart = std::min(MinFJ.minCoeff(), MaxFJ.minCoeff());
-    ghostEnd   = std::max(MinFJ.maxCoeff(), MaxFJ.maxCoeff());
-  }
-  else
-  {
-    ghostStart = elmdist(myid);
-    ghostEnd = elmdist(myid+1)-1;
-  }
-  ArrayXPI allElemNumber = ArrayXPI::Zero(ghostEnd - ghostStart + 1);
-  ierr = GetElemNumbers(ghostStart, ghostEnd, newElemNumber,
-                        allElemNumber); CHKERRQ(ierr);
+  ierr = Renumber_Filters(elmdist, newElemNumber, MinFI, MinFJ,
+                          MaxFI, MaxFJ); CHKERRQ(ierr);
 
   int ind = 0;
   for (int i = 0; i < MinFI.size(); i++)
   {
-    PetscInt newI = allElemNumber(MinFI(i) - ghostStart);
-    PetscInt newJ = allElemNumber(MinFJ(i) - ghostStart);
-    if (newI > 0 and newJ > 0)
+    if (MinFI(i) > 0 and MinFJ(i) > 0)
     {
-      MinFI(ind) = newI-1;
-      MinFJ(ind) = newJ-1;
+      MinFI(ind) = MinFI(i)-1;
+      MinFJ(ind) = MinFJ(i)-1;
       MinFK(ind) = MinFK(i);
       ind++;
     }
@@ -1225,22 +934,48 @@ PetscErrorCode TopOpt::ApplyDomain(Eigen::Array<bool, -1, 1> elemValidity,
   ind = 0;
   for (int i = 0; i < MaxFI.size(); i++)
   {
-    PetscInt newI = allElemNumber(MaxFI(i) - ghostStart);
-    PetscInt newJ = allElemNumber(MaxFJ(i) - ghostStart);
-    if (newI > 0 and newJ > 0)
+    if (MaxFI(i) > 0 and MaxFJ(i) > 0)
+    {
+      MaxFI(ind) = MaxFI(i)-1;
+      MaxFJ(ind) = MaxFJ(i)-1;
+      MaxFK(ind) = MaxFK(i);
+      ind++;
+    }
+  }
+  MaxFI.conservativeResize(ind);
+  MaxFJ.conservativeResize(ind);
+  MaxFK.conservativeResize(ind);
+
+  // Remove unwanted elements
+  EigLab::RemoveSlices(element, newElemNumber, 1);
+
+  /// Reassign node numbers to remaining elements and projection matrices
+  ierr = Renumber_Nodes(nddist, newNodeNumber, I, J, cList, mg_levels); CHKERRQ(ierr);
+  element -= 1;
+  for (int level = 0; level < mg_levels-1; level++)
+  { 
+    int IJKind = 0, cind = 0;
+    for (int j = 0; j < I[level].size(); j++)
     {
-      MaxFI(ind) = newI-1;
-      MaxFJ(ind) = newJ-1;
-      MaxFK(ind) = MaxFK(i);
-      ind++;
+      if ((I[level](j) > 0) && (J[level](j) > 0))
+      {
+        I[level](IJKind) = I[level](j)-1;
+        J[level](IJKind) = J[level](j)-1;
+        K[level](IJKind) = K[level](j);
+        IJKind++;
+      }
     }
+    for (int j = 0; j < cList[level].size(); j++)
+      if (cList[level](j) > 0)
+        cList[level](cind++) = cList[level](j)-1;
+    I[level].conservativeResize(IJKind); J[level].conservativeResize(IJKind);
+    K[level].conservativeResize(IJKind);
+    cList[level].conservativeResize(cind);
+    if (cind == 0)
+      mg_levels = level;
   }
-  MaxFI.conservativeResize(ind);
-  MaxFJ.conservativeResize(ind);
-  MaxFK.conservativeResize(ind);
 
   /// Reset element distribution array
-  number(this->myid) = elmdist(this->myid); // Save this value for assembling Proj below
   elmdist.setZero(nprocs+1);
   elmdist(myid+1) = element.rows();
   MPI_Allgather(MPI_IN_PLACE, 0, MPI_PETSCINT, elmdist.data()+1, 1, MPI_PETSCINT, comm);
@@ -1252,7 +987,6 @@ PetscErrorCode TopOpt::ApplyDomain(Eigen::Array<bool, -1, 1> elemValidity,
   nElem = elmdist(nprocs);
 
   /// Remove unwanted Nodes
-  newNodeNumber = newNodeNumber.segment(nddist(myid)-start,nLocNode).eval();
   EigLab::RemoveSlices(node, newNodeNumber, 1);
 
   /// Reset the node distribution array
@@ -1267,6 +1001,81 @@ PetscErrorCode TopOpt::ApplyDomain(Eigen::Array<bool, -1, 1> elemValidity,
   return ierr;
 }
 
+/********************************************************************
+ * Structured box partition of the full grid, similar to a DMDA. The
+ * process grid is chosen to minimize the area of the interfaces
+ * between boxes unless given with -box_partition_procs.
+ * 
+ * @param first: First element on this process in each dimension
+ * @param last: One past the last element on this process in each dimension
+ * @param Nel: Number of elements in each dimension
+ * @param partition: Box (process) that each local element belongs to
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ * @options: -box_partition_procs: Number of boxes in each dimension
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::BoxPartition(PetscInt *first, PetscInt *last, ArrayXPI Nel,
+                                    Eigen::Array<idx_t, -1, 1> &partition)
+{
+  PetscErrorCode ierr = 0;
+
+  /// Process grid
+  PetscInt procs[3] = {1, 1, 1}, nGiven = numDims;
+  PetscBool given = PETSC_FALSE;
+  ierr = PetscOptionsGetIntArray(NULL, NULL, "-box_partition_procs", procs,
+                                 &nGiven, &given); CHKERRQ(ierr);
+  if (given) {
+    if (procs[0]*procs[1]*procs[2] != nprocs)
+      SETERRQ2(comm, PETSC_ERR_ARG_SIZ, "Box partition has %i boxes for %i "
+               "processes", procs[0]*procs[1]*procs[2], nprocs);
+  }
+  else {
+    double bestArea = -1;
+    for (PetscInt p0 = 1; p0 <= nprocs; p0++) {
+      if (nprocs % p0 != 0)
+        continue;
+      for (PetscInt p1 = 1; p1 <= nprocs/p0; p1++) {
+        PetscInt p2 = nprocs/(p0*p1);
+        // Unused dimensions have a single element, so they get one box
+        if ((nprocs/p0) % p1 != 0 || p0 > Nel(0) || p1 > Nel(1) || p2 > Nel(2))
+          continue;
+        // Total area of the interfaces between boxes
+        double area = (p0-1.0)*Nel(1)*Nel(2) + (p1-1.0)*Nel(0)*Nel(2) +
+                      (p2-1.0)*Nel(0)*Nel(1);
+        if (bestArea < 0 || area < bestArea) {
+          bestArea = area;
+          procs[0] = p0; procs[1] = p1; procs[2] = p2;
+        }
+      }
+    }
+    if (bestArea < 0)
+      SETERRQ1(comm, PETSC_ERR_ARG_SIZ, "Mesh is too small for a box partition "
+               "on %i processes", nprocs);
+  }
+
+  if (this->verbose >= 2) {
+    ierr = PetscFPrintf(comm, output, "Box partition of %i x %i x %i processes\n",
+                        procs[0], procs[1], procs[2]); CHKERRQ(ierr);
+  }
+
+  /// Box of each local element, element i of n in a dimension is in
+  /// box k of p when k*n/p <= i < (k+1)*n/p
+  partition.resize(nLocElem);
+  PetscInt el = 0;
+  for (PetscInt k = first[2]; k < last[2]; k++) {
+    PetscInt bk = ((k+1)*procs[2]-1)/Nel(2);
+    for (PetscInt j = first[1]; j < last[1]; j++) {
+      PetscInt bj = ((j+1)*procs[1]-1)/Nel(1);
+      for (PetscInt i = first[0]; i < last[0]; i++)
+        partition(el++) = ((i+1)*procs[0]-1)/Nel(0) + procs[0]*(bj + procs[1]*bk);
+    }
+  }
+
+  return ierr;
+}
+
 /********************************************************************
  * Get partitioning with ParMETIS
  * 
@@ -1301,6 +1110,7 @@ idx_t TopOpt::ReorderParMetis(bool Reorder_Mesh,
 
   Eigen::Array<idx_t, -1, 1> partition =
     myid*Eigen::Array<idx_t, -1, 1>::Ones(nLocElem);
+  Eigen::Array<idx_t, -1, 1> weights;
 
   if (Reorder_Mesh)
   {
@@ -1321,7 +1131,19 @@ idx_t TopOpt::ReorderParMetis(bool Reorder_Mesh,
                                   checkpoints(i+1) - elmdist(myid)),
                                   elmdist(myid+1) - elmdist(myid)) ).setConstant(i);
     }
+    // Element weights travel with the elements as an extra column
+    short nCols = element.cols();
+    if (elmwgt != NULL) {
+      element.conservativeResize(nLocElem, nCols+1);
+      for (PetscInt el = 0; el < nLocElem; el++)
+        element(el, nCols) = elmwgt[el];
+    }
     ElemDist(partition, MinFI, MinFJ, MinFK, MaxFI, MaxFJ, MaxFK);
+    if (elmwgt != NULL) {
+      weights = element.col(nCols).cast<idx_t>();
+      element.conservativeResize(nLocElem, nCols);
+      elmwgt = weights.data();
+    }
   }
   
   /// Verify Inputs
@@ -1417,8 +1239,8 @@ PetscErrorCode TopOpt::ElemDist(Eigen::Array<idx_t, -1, 1> &partition,
   /// elmcpy = a copy of element reordered for continguous send buffers
   /// where = after initial sorting, the local number of each element
   /// permute = permutation vector for filter matrix (global)
-  // Initialize transfer Variables
-  short elementSize = pow(2,numDims);
+  // Initialize transfer Variables, any extra columns of element move too
+  short elementSize = element.cols();
   ArrayXPI where = EigLab::gensort(partition).cast<PetscInt>();
   ArrayXXPI transferSize = ArrayXXPI::Zero(nprocs,nprocs);
   ArrayXXPIRM elmcpy(element.rows(),element.cols());
@@ -1465,31 +1287,8 @@ PetscErrorCode TopOpt::ElemDist(Eigen::Array<idx_t, -1, 1> &partition,
     permute(where(i)) = indices(partition(i))++;
   }
 
-  /// Use a global Vec with ghost nodes to renumber filter matrix triplets
-  PetscInt ghostStart, ghostEnd;
-  if (MinFJ.size() > 0) {
-    ghostStart = std::min(MinFJ.minCoeff(), MaxFJ.minCoeff());
-    ghostEnd   = std::max(MinFJ.maxCoeff(), MaxFJ.maxCoeff());
-  }
-  else {
-    ghostStart = elmdist(myid);
-    ghostEnd  = elmdist(myid+1)-1;
-  }
-  ArrayXPI allElemNumber = ArrayXPI::Zero(ghostEnd - ghostStart + 1);
-  ierr = GetElemNumbers(ghostStart, ghostEnd, permute,
-                        allElemNumber); CHKERRQ(ierr);
-
-  for (int i = 0; i < MinFI.size(); i++)
-  {
-    MinFI(i) = allElemNumber(MinFI(i) - ghostStart);
-    MinFJ(i) = allElemNumber(MinFJ(i) - ghostStart);
-  }
-
-  for (int i = 0; i < MaxFI.size(); i++)
-  {
-    MaxFI(i) = allElemNumber(MaxFI(i) - ghostStart);
-    MaxFJ(i) = allElemNumber(MaxFJ(i) - ghostStart);
-  }
+  /// Renumber filter matrix triplets from the old owners of the elements
+  ierr = Renumber_Filters(elmdist, permute, MinFI, MinFJ, MaxFI, MaxFJ); CHKERRQ(ierr);
 
   // Update distribution across processes
   elmdist(myid+1) = element.rows();
@@ -1602,112 +1401,241 @@ PetscErrorCode TopOpt::ElemDist(Eigen::Array<idx_t, -1, 1> &partition,
 }
 
 /********************************************************************
- * Get new element numbers for nonlocal elements for reordering filters
+ * Exchange messages with only the processes that have something to
+ * send or receive
  * 
- * @param ghostStart: First column of global filter used by this process
- * @param ghostStart: Last column of global filter used by this process
- * @param newElemNumber: New element numberings for local elements
- * @param allElemNumber: New element numberings for each column of local
- *                       part of filter matrix (output)
+ * @param comm: MPI communicator
+ * @param type: MPI type of the values
+ * @param width: Number of values in each entry
+ * @param sendbuf: Values to send, grouped by destination process
+ * @param sendcnt: Number of entries to send to each process
+ * @param recvbuf: Values received, grouped by source process (output)
+ * @param recvcnt: Number of entries to receive from each process
  * 
  * @return ierr: PetscErrorCode
  * 
  *******************************************************************/
-PetscErrorCode TopOpt::GetElemNumbers(PetscInt ghostStart, PetscInt ghostEnd,
-                                      ArrayXPI &newElemNumber,
-                                      ArrayXPI &allElemNumber)
+template <typename Scalar>
+static PetscErrorCode Exchange(MPI_Comm comm, MPI_Datatype type, int width,
+                               Scalar *sendbuf, Eigen::ArrayXi &sendcnt,
+                               Scalar *recvbuf, Eigen::ArrayXi &recvcnt)
 {
   PetscErrorCode ierr = 0;
 
-  /// This function works by passing the new element numbers to adjacent
-  /// processes in a continuous fashion until all processes have the
-  /// new element numbers for every element in the global range
-  /// ghost Start through ghostEnd (inclusive)
-  
-  // Set up necessary data structures for communication
-  allElemNumber.segment(this->elmdist(this->myid) - ghostStart,
-                        this->nLocElem) = newElemNumber;
-  ArrayXPI lo2hi = newElemNumber, hi2lo = newElemNumber;
-  ArrayXPI lo2hi_buf = ArrayXPI::Zero(0), hi2lo_buf = ArrayXPI::Zero(0);
-  int lo2hi_tag = 0, hi2lo_tag = 1;
-  MPI_Request lo2hi_req, hi2lo_req;
-  MPI_Status lo2hi_stat, hi2lo_stat;
-  int lo2hi_tgt = this->myid+1, hi2lo_tgt = this->myid-1;
-  int lo2hi_src = hi2lo_tgt, hi2lo_src = lo2hi_tgt;
-  int lo2hi_cnt, hi2lo_cnt;
-  PetscInt lo = this->myid;
-  PetscInt hi = this->myid+1;
-
-  int max_pass = 0;
-  while (ghostStart < this->elmdist(std::max(0, this->myid-max_pass)) ||
-         ghostEnd >= this->elmdist(std::min(this->nprocs, this->myid+max_pass+1)))
-    max_pass++;
-
-  ierr = MPI_Allreduce(MPI_IN_PLACE, &max_pass, 1, MPI_INT, MPI_MAX, this->comm); CHKERRQ(ierr);
-  for (int i = 0; i < max_pass; i++)
-  {
-    // Send up
-    if (this->myid < this->nprocs-1) {
-      ierr = MPI_Issend(lo2hi.data(), lo2hi.size(), MPI_PETSCINT, lo2hi_tgt,
-                        lo2hi_tag, this->comm, &lo2hi_req); CHKERRQ(ierr);
+  std::vector<MPI_Request> requests;
+  for (int p = 0, dsp = 0; p < recvcnt.size(); dsp += width*recvcnt(p++)) {
+    if (recvcnt(p) > 0) {
+      requests.push_back(MPI_REQUEST_NULL);
+      ierr = MPI_Irecv(recvbuf+dsp, width*recvcnt(p), type, p, 0, comm,
+                       &requests.back()); CHKERRQ(ierr);
     }
-    // Send down
-    if (this->myid > 0) {
-      ierr = MPI_Issend(hi2lo.data(), hi2lo.size(), MPI_PETSCINT, hi2lo_tgt,
-                        hi2lo_tag, this->comm, &hi2lo_req); CHKERRQ(ierr);
+  }
+  for (int p = 0, dsp = 0; p < sendcnt.size(); dsp += width*sendcnt(p++)) {
+    if (sendcnt(p) > 0) {
+      requests.push_back(MPI_REQUEST_NULL);
+      ierr = MPI_Isend(sendbuf+dsp, width*sendcnt(p), type, p, 0, comm,
+                       &requests.back()); CHKERRQ(ierr);
     }
+  }
+  ierr = MPI_Waitall(requests.size(), requests.data(),
+                     MPI_STATUSES_IGNORE); CHKERRQ(ierr);
+
+  return ierr;
+}
 
-    // Receive from above
-    if (this->myid < this->nprocs-1) {
-      ierr = MPI_Probe(hi2lo_src, hi2lo_tag, this->comm, &hi2lo_stat); CHKERRQ(ierr);
-      ierr = MPI_Get_count(&hi2lo_stat, MPI_PETSCINT, &hi2lo_cnt); CHKERRQ(ierr);
-      hi2lo_buf.resize(hi2lo_cnt);
-      ierr = MPI_Recv(hi2lo_buf.data(), hi2lo_cnt, MPI_PETSCINT, hi2lo_src,
-                      hi2lo_tag, this->comm, &hi2lo_stat); CHKERRQ(ierr);
+/********************************************************************
+ * Exchange messages with only the processes that have something to
+ * send or receive
+ * 
+ * @param sendbuf: Values to send, grouped by destination process
+ * @param sendcnt: Number of values to send to each process
+ * @param recvbuf: Values received, grouped by source process (output)
+ * @param recvcnt: Number of values to receive from each process
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::Sparse_Exchange(ArrayXPI &sendbuf, Eigen::ArrayXi &sendcnt,
+                                       ArrayXPI &recvbuf, Eigen::ArrayXi &recvcnt)
+{
+  recvbuf.resize(recvcnt.sum());
+  return Exchange(comm, MPI_PETSCINT, 1, sendbuf.data(), sendcnt,
+                  recvbuf.data(), recvcnt);
+}
 
-      if (hi2lo_buf.size() > 0)
-      {
-        // Fill in the element numbers
-        PetscInt size = std::max(0, std::min((PetscInt)hi2lo_buf.size(),
-                                ghostEnd-this->elmdist(hi)+1));
-        allElemNumber.segment(std::max(0, std::min(this->elmdist(hi),ghostEnd) - ghostStart), size) =
-              hi2lo_buf.segment(0, size);
-      }
-    }
-    // Receive from below
-    if (this->myid > 0) {
-      ierr = MPI_Probe(lo2hi_src, lo2hi_tag, this->comm, &lo2hi_stat); CHKERRQ(ierr);
-      ierr = MPI_Get_count(&lo2hi_stat, MPI_PETSCINT, &lo2hi_cnt); CHKERRQ(ierr);
-      lo2hi_buf.resize(lo2hi_cnt);
-      ierr = MPI_Recv(lo2hi_buf.data(), lo2hi_cnt, MPI_PETSCINT, lo2hi_src,
-                      lo2hi_tag, this->comm, &lo2hi_stat); CHKERRQ(ierr);
-
-      if (lo2hi_buf.size() > 0)
-      {
-        // Fill in the element numbers
-        PetscInt size = std::max(0, std::min((PetscInt)lo2hi_buf.size(),
-                                this->elmdist(lo)-ghostStart));
-        allElemNumber.segment(std::max(this->elmdist(lo-1)-ghostStart, 0), size) =
-              lo2hi_buf.segment(lo2hi_buf.size() - std::max(size, 1), size);
-      }
-    }
+/********************************************************************
+ * Exchange rows of values with only the processes that have something
+ * to send or receive
+ * 
+ * @param sendbuf: Rows to send, grouped by destination process
+ * @param sendcnt: Number of rows to send to each process
+ * @param recvbuf: Rows received, grouped by source process (output)
+ * @param recvcnt: Number of rows to receive from each process
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::Sparse_Exchange(MatrixXdRM &sendbuf, Eigen::ArrayXi &sendcnt,
+                                       MatrixXdRM &recvbuf, Eigen::ArrayXi &recvcnt)
+{
+  recvbuf.resize(recvcnt.sum(), sendbuf.cols());
+  return Exchange(comm, MPI_PETSCSCALAR, sendbuf.cols(), sendbuf.data(), sendcnt,
+                  recvbuf.data(), recvcnt);
+}
 
+/********************************************************************
+ * Send a list of global indices to the processes that own them
+ * 
+ * @param dist: Distribution of the indices across processes
+ * @param keys: Global indices, sorted and made unique on output
+ * @param sendcnt: Number of keys sent to each process (output)
+ * @param requests: Keys received from each process, grouped by
+ *                  source process (output)
+ * @param recvcnt: Number of keys received from each process (output)
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::Owner_Requests(ArrayXPI &dist, ArrayXPI &keys,
+                                      Eigen::ArrayXi &sendcnt, ArrayXPI &requests,
+                                      Eigen::ArrayXi &recvcnt)
+{
+  PetscErrorCode ierr = 0;
 
-    // Bookkeeping/preparing for the next iteration
-    lo = std::max(lo-1, 0);
-    hi = std::min(hi+1, this->nprocs);
-    if (this->myid < this->nprocs-1) {
-      ierr = MPI_Wait(&lo2hi_req, MPI_STATUS_IGNORE); CHKERRQ(ierr);
-    }
-    if (this->myid > 0) {
-      ierr = MPI_Wait(&hi2lo_req, MPI_STATUS_IGNORE); CHKERRQ(ierr);
-    }
-    hi2lo = hi2lo_buf; lo2hi = lo2hi_buf;
+  std::sort(keys.data(), keys.data()+keys.size());
+  keys.conservativeResize(std::unique(keys.data(), keys.data()+keys.size()) -
+                          keys.data());
+
+  // Sorted keys are already grouped by owner
+  sendcnt.setZero(nprocs);
+  int owner = 0;
+  for (PetscInt i = 0; i < keys.size(); i++) {
+    while (keys(i) >= dist(owner+1))
+      owner++;
+    sendcnt(owner)++;
+  }
+  recvcnt.resize(nprocs);
+  ierr = MPI_Alltoall(sendcnt.data(), 1, MPI_INT, recvcnt.data(), 1, MPI_INT,
+                      comm); CHKERRQ(ierr);
+  ierr = Sparse_Exchange(keys, sendcnt, requests, recvcnt); CHKERRQ(ierr);
+
+  return ierr;
+}
+
+/********************************************************************
+ * Replace global indices with values held by the processes that own
+ * them, so that no process needs a global-size array
+ * 
+ * @param dist: Distribution of the indices across processes
+ * @param values: Value of each locally owned index
+ * @param query: Global indices to look up, replaced by their values
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::Lookup_Numbers(ArrayXPI &dist, ArrayXPI &values,
+                                      ArrayXPI &query)
+{
+  PetscErrorCode ierr = 0;
+
+  ArrayXPI keys = query, requests, replies;
+  Eigen::ArrayXi sendcnt, recvcnt;
+  ierr = Owner_Requests(dist, keys, sendcnt, requests, recvcnt); CHKERRQ(ierr);
+  for (PetscInt i = 0; i < requests.size(); i++)
+    requests(i) = values(requests(i) - dist(myid));
+  ierr = Sparse_Exchange(requests, recvcnt, replies, sendcnt); CHKERRQ(ierr);
+
+  for (PetscInt i = 0; i < query.size(); i++)
+    query(i) = replies(std::lower_bound(keys.data(), keys.data()+keys.size(),
+                                        query(i)) - keys.data());
+
+  return ierr;
+}
+
+/********************************************************************
+ * Give the nodes of the elements and GMG projection operators new
+ * numbers, looked up from the processes that own the nodes
+ * 
+ * @param dist: Distribution of the current node numbers
+ * @param newNumber: New number of each locally owned node
+ * @param I: list of row indices of each GMG projection operator
+ * @param J: list of column indices of each GMG projection operator
+ * @param cList: List of coarse nodes on each level of GMG hierarchy
+ * @param mg_levels: Number of levels in GMG hierarchy
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::Renumber_Nodes(ArrayXPI &dist, ArrayXPI &newNumber,
+                                      ArrayXPI *I, ArrayXPI *J, ArrayXPI *cList,
+                                      int mg_levels)
+{
+  PetscErrorCode ierr = 0;
+
+  // Look everything up at once
+  Eigen::Map<ArrayXPI> elem(element.data(), element.size());
+  PetscInt nQuery = elem.size();
+  for (int i = 0; i < mg_levels-1; i++)
+    nQuery += I[i].size() + J[i].size() + cList[i].size();
+  ArrayXPI query(nQuery);
+  query.segment(0, elem.size()) = elem;
+  nQuery = elem.size();
+  for (int i = 0; i < mg_levels-1; i++) {
+    query.segment(nQuery, I[i].size()) = I[i]; nQuery += I[i].size();
+    query.segment(nQuery, J[i].size()) = J[i]; nQuery += J[i].size();
+    query.segment(nQuery, cList[i].size()) = cList[i]; nQuery += cList[i].size();
+  }
+
+  ierr = Lookup_Numbers(dist, newNumber, query); CHKERRQ(ierr);
+
+  elem = query.segment(0, elem.size());
+  nQuery = elem.size();
+  for (int i = 0; i < mg_levels-1; i++) {
+    I[i] = query.segment(nQuery, I[i].size()); nQuery += I[i].size();
+    J[i] = query.segment(nQuery, J[i].size()); nQuery += J[i].size();
+    cList[i] = query.segment(nQuery, cList[i].size()); nQuery += cList[i].size();
   }
 
   return ierr;
 }
 
+/********************************************************************
+ * Give the filter matrix triplets new element numbers, looked up from
+ * the processes that own the elements
+ * 
+ * @param dist: Distribution of the current element numbers
+ * @param newNumber: New number of each locally owned element
+ * @param MinFI: row indices of minimum filter matrix triplets
+ * @param MinFJ: column indices of minimum filter matrix triplets
+ * @param MaxFI: row indices of maximum filter matrix triplets
+ * @param MaxFJ: column indices of maximum filter matrix triplets
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::Renumber_Filters(ArrayXPI &dist, ArrayXPI &newNumber,
+                                        ArrayXPI &MinFI, ArrayXPI &MinFJ,
+                                        ArrayXPI &MaxFI, ArrayXPI &MaxFJ)
+{
+  PetscErrorCode ierr = 0;
+
+  PetscInt nMin = MinFI.size(), nMax = MaxFI.size();
+  ArrayXPI query(2*nMin + 2*nMax);
+  query.segment(0, nMin) = MinFI;
+  query.segment(nMin, nMin) = MinFJ;
+  query.segment(2*nMin, nMax) = MaxFI;
+  query.segment(2*nMin+nMax, nMax) = MaxFJ;
+
+  ierr = Lookup_Numbers(dist, newNumber, query); CHKERRQ(ierr);
+
+  MinFI = query.segment(0, nMin);
+  MinFJ = query.segment(nMin, nMin);
+  MaxFI = query.segment(2*nMin, nMax);
+  MaxFJ = query.segment(2*nMin+nMax, nMax);
+
+  return ierr;
+}
+
 /********************************************************************
  * Redistribute nodes
  * 
@@ -1725,19 +1653,21 @@ PetscErrorCode TopOpt::NodeDist(ArrayXPI *I, ArrayXPI *J, ArrayXPS *K,
 {
     PetscErrorCode ierr = 0;
 
-    /// Find which nodes each process interacts with
-    Eigen::Array<short,-1,1> pckproc = Eigen::Array<short,-1,1>::Zero(nNode);
-    for (PetscInt el = 0; el < element.rows(); el++)
-    {
-        for (short nd = 0; nd < pow(2, numDims); nd++)
-            pckproc(element(el,nd)) = myid;
-    }
+    /// Tell the owners of the nodes which processes use them
+    ArrayXPI keys = Eigen::Map<ArrayXPI>(element.data(), element.size());
+    ArrayXPI requests;
+    Eigen::ArrayXi reqcnt, usecnt;
+    ierr = Owner_Requests(nddist, keys, reqcnt, requests, usecnt); CHKERRQ(ierr);
 
     // Assign nodes to the highest numbered processor that uses them
-    MPI_Allreduce(MPI_IN_PLACE, pckproc.data(), nNode, MPI_SHORT, MPI_MAX, comm);
+    Eigen::ArrayXi locpart = Eigen::ArrayXi::Zero(nLocNode);
+    for (int p = 0, k = 0; p < nprocs; p++)
+    {
+        for (int i = 0; i < usecnt(p); i++, k++)
+            locpart(requests(k) - nddist(myid)) = p;
+    }
 
     /// Sort nodes into chunks to go to each process
-    Eigen::Array<short,-1,1> locpart = pckproc.segment(nddist(myid),nLocNode);
     ArrayXPI reorder = EigLab::gensort(locpart).cast<PetscInt>();
     /// Package the nodes into a new array for sending to each process
     /// And track how many are being sent to each process
@@ -1749,6 +1679,14 @@ PetscErrorCode TopOpt::NodeDist(ArrayXPI *I, ArrayXPI *J, ArrayXPS *K,
         sendcnt(locpart(i))++;
     }
 
+    // Nodes keep their order on the receiving process, after the nodes
+    // sent there by lower numbered processes
+    ArrayXPI newStart = sendcnt.cast<PetscInt>();
+    ierr = MPI_Exscan(MPI_IN_PLACE, newStart.data(), nprocs, MPI_PETSCINT,
+                      MPI_SUM, comm); CHKERRQ(ierr);
+    if (myid == 0)
+        newStart.setZero();
+
     // How much to receive from every process
     Eigen::ArrayXi recvcnt(nprocs);
     MPI_Alltoall(sendcnt.data(), 1, MPI_INT, recvcnt.data(), 1, MPI_INT, comm);
@@ -1771,6 +1709,7 @@ PetscErrorCode TopOpt::NodeDist(ArrayXPI *I, ArrayXPI *J, ArrayXPS *K,
                   recvdsp.data(), MPI_DOUBLE, comm);
 
     /// Update the distribution of nodes
+    ArrayXPI olddist = nddist;
     nddist.setZero(nprocs+1);
     nLocNode = node.rows();
     nddist(myid+1) = node.rows();
@@ -1778,32 +1717,99 @@ PetscErrorCode TopOpt::NodeDist(ArrayXPI *I, ArrayXPI *J, ArrayXPS *K,
     for (short i = 1; i <= nprocs; i++)
         nddist(i) += nddist(i-1);
 
-    /// Renumber nodes in element array
-    reorder = EigLab::gensort(pckproc).cast<PetscInt>();
-    ArrayXPI invreorder(reorder.rows());
-    for (PetscInt i = 0; i < reorder.rows(); i++)
-      invreorder(reorder(i)) = i;
-    for (PetscInt el = 0; el < element.rows(); el++)
-    {
-        for (short nd = 0; nd < pow(2,numDims); nd++)
-        {
-            element(el,nd) = invreorder(element(el,nd));
-        }
-    }
+    /// Renumber nodes in element array and interpolation
+    newStart += nddist.segment(0, nprocs);
+    ArrayXPI newNumber(locpart.size());
+    for (PetscInt i = 0; i < locpart.size(); i++)
+        newNumber(reorder(i)) = newStart(locpart(i))++;
+    ierr = Renumber_Nodes(olddist, newNumber, I, J, cList, mg_levels); CHKERRQ(ierr);
 
-    // Give each node in the interpolation it's new number after redistribution
-    for (int i = mg_levels-2; i >= 0; i--)
-    {
-      for (int j = 0; j < I[i].size(); j++)
-      {
-        I[i](j) = invreorder(I[i](j));
-        J[i](j) = invreorder(J[i](j));
-      }
-      for (int j = 0; j < cList[i].size(); j++)
-        cList[i](j) = invreorder(cList[i](j));
+    return ierr;
+}
+
+/********************************************************************
+ * Morton (Z-order) key of a point from its quantized coordinates
+ * 
+ * @param q: Quantized coordinates
+ * @param numDims: Number of coordinates
+ * @param bits: Number of bits used in each coordinate
+ * 
+ * @return key: Interleaved bits of the coordinates
+ * 
+ *******************************************************************/
+static uint64_t Morton_Key(const PetscInt *q, short numDims, short bits)
+{
+  uint64_t key = 0;
+  for (short b = bits-1; b >= 0; b--) {
+    for (short d = numDims-1; d >= 0; d--)
+      key = (key << 1) | ((q[d] >> b) & 1);
+  }
+  return key;
+}
+
+/********************************************************************
+ * Renumber the nodes owned by each process along a Morton curve and
+ * the local elements by their first node on that curve. The ownership
+ * ranges are unchanged, so only the numbering inside each range moves.
+ * Ghost nodes are gathered in global order later, so they follow their
+ * owners' curves as well.
+ * 
+ * @param MinFI: row indices of minimum filter matrix triplets
+ * @param MinFJ: column indices of minimum filter matrix triplets
+ * @param MaxFI: row indices of maximum filter matrix triplets
+ * @param MaxFJ: column indices of maximum filter matrix triplets
+ * @param I: list of row indices of each GMG projection operator
+ * @param J: list of column indices of each GMG projection operator
+ * @param cList: List of coarse nodes on each level of GMG hierarchy
+ * @param mg_levels: Number of levels in GMG hierarchy
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::SFC_Order(ArrayXPI &MinFI, ArrayXPI &MinFJ,
+                                 ArrayXPI &MaxFI, ArrayXPI &MaxFJ,
+                                 ArrayXPI *I, ArrayXPI *J, ArrayXPI *cList,
+                                 int mg_levels)
+{
+  PetscErrorCode ierr = 0;
+
+  /// Curve position of each local node in the local bounding box
+  short bits = std::min(63/numDims, 20);
+  Eigen::Array<uint64_t, -1, 1> key(nLocNode);
+  if (nLocNode > 0) {
+    Eigen::RowVectorXd lo = node.colwise().minCoeff();
+    double range = (node.colwise().maxCoeff() - lo).maxCoeff();
+    double scale = (range > 0) ? ((1 << bits) - 1)/range : 0;
+    PetscInt q[3];
+    for (PetscInt i = 0; i < nLocNode; i++) {
+      for (short d = 0; d < numDims; d++)
+        q[d] = (node(i,d) - lo(d))*scale;
+      key(i) = Morton_Key(q, numDims, bits);
     }
+  }
+  Eigen::ArrayXi order = EigLab::gensort(key);
+  MatrixXdRM ndcpy = node;
+  ArrayXPI newLocal(nLocNode);
+  for (PetscInt i = 0; i < nLocNode; i++) {
+    node.row(i) = ndcpy.row(order(i));
+    newLocal(order(i)) = nddist(myid) + i;
+  }
 
-    return ierr;
+  ierr = Renumber_Nodes(nddist, newLocal, I, J, cList, mg_levels); CHKERRQ(ierr);
+
+  /// Order elements by their first node along the curve
+  ArrayXPI elKey = element.rowwise().minCoeff();
+  order = EigLab::gensort(elKey);
+  ArrayXXPIRM elmcpy = element;
+  ArrayXPI permute(nLocElem);
+  for (PetscInt i = 0; i < nLocElem; i++) {
+    element.row(i) = elmcpy.row(order(i));
+    permute(order(i)) = elmdist(myid) + i;
+  }
+
+  ierr = Renumber_Filters(elmdist, permute, MinFI, MinFJ, MaxFI, MaxFJ); CHKERRQ(ierr);
+
+  return ierr;
 }
 
 /********************************************************************
@@ -2063,6 +2069,208 @@ PetscErrorCode TopOpt::Localize()
     return ierr;
 }
 
+/********************************************************************
+ * Rebalance the mesh with ParMETIS using weights from the current
+ * design, so that material-rich regions are spread evenly across the
+ * processes. The mesh, filters, GMG hierarchy, and FE structures are
+ * rebuilt and the element-wise optimization state is moved to the new
+ * distribution.
+ * 
+ * @param optmma: The optimizer
+ * @param dfdx: Objective sensitivities, moved to the new distribution
+ * @param dgdx: Constraint sensitivities, moved to the new distribution
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::Repartition(MMA *optmma, VectorXPS &dfdx, MatrixXPS &dgdx)
+{
+  PetscErrorCode ierr = 0;
+  if (repartition_every <= 0 || optmma->Get_It() == 0 ||
+      (optmma->Get_It() % repartition_every) != 0)
+    return 0;
+  if (meshNel.size() == 0 || box_partition || !meshReorder) {
+    ierr = PetscFPrintf(comm, output, "Repartitioning needs a generated mesh "
+                        "partitioned with ParMETIS, skipping it\n"); CHKERRQ(ierr);
+    repartition_every = 0;
+    return 0;
+  }
+  double tStart = MPI_Wtime();
+
+  /// Gather everything that lives on the elements: the optimizer state,
+  /// which elements are active, and the latest sensitivities
+  Eigen::MatrixXd mmaState;
+  optmma->Get_State(mmaState);
+  short nState = mmaState.cols(), nCon = dgdx.cols();
+  MatrixXdRM state(nLocElem, nState+2+nCon);
+  state.leftCols(nState) = mmaState;
+  state.col(nState) = active.cast<PetscScalar>().matrix();
+  state.col(nState+1) = dfdx;
+  state.rightCols(nCon) = dgdx;
+
+  /// Send it to a directory of structured element indices
+  ArrayXPI index, dirDist(nprocs+1);
+  ierr = Structured_Index(index); CHKERRQ(ierr);
+  for (int p = 0; p <= nprocs; p++)
+    dirDist(p) = ((double)p/nprocs)*meshNel.prod();
+  MatrixXdRM dirState;
+  ierr = Migrate_State(dirDist, index, state, dirState); CHKERRQ(ierr);
+
+  // Solid active elements weigh more than void or passive ones
+  repartDist = dirDist;
+  repartWeight.setOnes(dirState.rows());
+  for (PetscInt i = 0; i < dirState.rows(); i++) {
+    if (dirState(i, nState) > 0.5)
+      repartWeight(i) += std::floor(repartition_weight*
+                                    std::max(dirState(i, 0), 0.0) + 0.5);
+  }
+
+  /// Rebuild the mesh and everything on it
+  ierr = Clear_Mesh(); CHKERRQ(ierr);
+  ierr = CreateMesh(meshDimensions, meshNel, meshRmin, meshRmax,
+                    meshReorder); CHKERRQ(ierr);
+  repartDist.resize(0); repartWeight.resize(0);
+  ierr = Def_BC(); CHKERRQ(ierr);
+  // Checkpoints from before this no longer match the mesh files
+  meshVersion++;
+  checkpointStale = (PetscBool)(checkpoint_every > 0);
+  ierr = MeshOut(); CHKERRQ(ierr);
+  ierr = FEInitialize(); CHKERRQ(ierr);
+
+  /// Get the state of the new local elements back from the directory
+  ierr = Structured_Index(index); CHKERRQ(ierr);
+  ierr = Fetch_State(dirDist, dirState, index, state); CHKERRQ(ierr);
+  mmaState = state.leftCols(nState);
+  optmma->Set_State(mmaState);
+  active = state.col(nState).array() > 0.5;
+  dfdx = state.col(nState+1);
+  dgdx = state.rightCols(nCon);
+
+  // Mode shapes are not moved, so eigensolvers start over
+  bucklingShape.resize(node.size(), 0);
+  dynamicShape.resize(node.size(), 0);
+  for (unsigned int i = 0; i < function_list.size(); i++) {
+    ierr = function_list[i]->Reset(); CHKERRQ(ierr);
+    ierr = function_list[i]->Initialize_Arrays(nLocElem); CHKERRQ(ierr);
+  }
+
+  if (verbose >= 1) {
+    PetscInt range[2] = {-nLocElem, nLocElem};
+    ierr = MPI_Allreduce(MPI_IN_PLACE, range, 2, MPI_PETSCINT, MPI_MAX,
+                         comm); CHKERRQ(ierr);
+    ierr = PetscFPrintf(comm, output, "Repartitioned mesh at iteration %u in "
+                        "%1.4g s, %i to %i elements per process\n",
+                        optmma->Get_It(), MPI_Wtime()-tStart, -range[0],
+                        range[1]); CHKERRQ(ierr);
+  }
+
+  return ierr;
+}
+
+/********************************************************************
+ * Get the index of each local element in the structured grid the mesh
+ * was generated from, which does not depend on the distribution
+ * 
+ * @param index: Structured index of each local element (output)
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::Structured_Index(ArrayXPI &index)
+{
+  PetscErrorCode ierr = 0;
+
+  MatrixXPS elemCenters = GetCentroids();
+  index.setZero(nLocElem);
+  PetscInt stride = 1;
+  for (short dim = 0; dim < numDims; dim++) {
+    PetscScalar lo = meshDimensions(2*dim);
+    PetscScalar dx = (meshDimensions(2*dim+1) - lo)/meshNel(dim);
+    for (PetscInt el = 0; el < nLocElem; el++) {
+      PetscInt i = std::floor((elemCenters(el, dim) - lo)/dx);
+      index(el) += stride*std::min(std::max(i, (PetscInt)0), meshNel(dim)-1);
+    }
+    stride *= meshNel(dim);
+  }
+
+  return ierr;
+}
+
+/********************************************************************
+ * Send rows of element data to the processes that own their keys
+ * 
+ * @param dist: Distribution of the keys across processes
+ * @param keys: Global key of each row
+ * @param state: Rows to send
+ * @param dirState: Row of each locally owned key, zero for keys that
+ *                  were not sent (output)
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::Migrate_State(ArrayXPI &dist, ArrayXPI &keys,
+                                     MatrixXdRM &state, MatrixXdRM &dirState)
+{
+  PetscErrorCode ierr = 0;
+
+  // Group the rows by the owner of their key
+  ArrayXPI sorted = keys;
+  ArrayXPI where = EigLab::gensort(sorted).cast<PetscInt>();
+  MatrixXdRM sendbuf(keys.size(), state.cols()), recvbuf;
+  Eigen::ArrayXi sendcnt = Eigen::ArrayXi::Zero(nprocs), recvcnt(nprocs);
+  int owner = 0;
+  for (PetscInt i = 0; i < sorted.size(); i++) {
+    sendbuf.row(i) = state.row(where(i));
+    while (sorted(i) >= dist(owner+1))
+      owner++;
+    sendcnt(owner)++;
+  }
+  ierr = MPI_Alltoall(sendcnt.data(), 1, MPI_INT, recvcnt.data(), 1, MPI_INT,
+                      comm); CHKERRQ(ierr);
+
+  ArrayXPI recvkeys;
+  ierr = Sparse_Exchange(sorted, sendcnt, recvkeys, recvcnt); CHKERRQ(ierr);
+  ierr = Sparse_Exchange(sendbuf, sendcnt, recvbuf, recvcnt); CHKERRQ(ierr);
+
+  dirState.setZero(dist(myid+1)-dist(myid), state.cols());
+  for (PetscInt i = 0; i < recvkeys.size(); i++)
+    dirState.row(recvkeys(i)-dist(myid)) = recvbuf.row(i);
+
+  return ierr;
+}
+
+/********************************************************************
+ * Get rows of element data from the processes that own their keys
+ * 
+ * @param dist: Distribution of the keys across processes
+ * @param dirState: Row of each locally owned key
+ * @param keys: Global key of each requested row
+ * @param state: Requested rows (output)
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::Fetch_State(ArrayXPI &dist, MatrixXdRM &dirState,
+                                   ArrayXPI &keys, MatrixXdRM &state)
+{
+  PetscErrorCode ierr = 0;
+
+  ArrayXPI sorted = keys, requests;
+  Eigen::ArrayXi sendcnt, recvcnt;
+  ierr = Owner_Requests(dist, sorted, sendcnt, requests, recvcnt); CHKERRQ(ierr);
+  MatrixXdRM replies(requests.size(), dirState.cols()), recvbuf;
+  for (PetscInt i = 0; i < requests.size(); i++)
+    replies.row(i) = dirState.row(requests(i)-dist(myid));
+  ierr = Sparse_Exchange(replies, recvcnt, recvbuf, sendcnt); CHKERRQ(ierr);
+
+  state.resize(keys.size(), dirState.cols());
+  for (PetscInt i = 0; i < keys.size(); i++)
+    state.row(i) = recvbuf.row(std::lower_bound(sorted.data(), sorted.data()+
+                               sorted.size(), keys(i)) - sorted.data());
+
+  return ierr;
+}
+
 /********************************************************************
  * Get centroids of all elements
  * 
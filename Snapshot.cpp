@@ -0,0 +1,531 @@
+#include "Snapshot.h"
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+using namespace std;
+
+static const char magic[8] = {'T','O','P','O','S','N','A','P'};
+
+/********************************************************************
+ * Main constructor
+ *
+ * @param comm: MPI communicator for the files
+ *
+ *******************************************************************/
+Snapshot::Snapshot(MPI_Comm comm)
+{
+  this->comm = comm;
+  MPI_Comm_rank(comm, &myid);
+  MPI_Comm_size(comm, &nprocs);
+  encoding = SNAP_DOUBLE;
+  keyframe = 10;
+}
+
+/********************************************************************
+ * Stage a copy of a parallel vector
+ *
+ * @param filename: Name of the file to write
+ * @param v: The vector
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode Snapshot::Add(const char *filename, Vec v)
+{
+  PetscErrorCode ierr = 0;
+
+  PetscInt nLocal;
+  const PetscScalar *p_v;
+  ierr = VecGetLocalSize(v, &nLocal); CHKERRQ(ierr);
+  ierr = VecGetArrayRead(v, &p_v); CHKERRQ(ierr);
+  ierr = Add(filename, p_v, nLocal); CHKERRQ(ierr);
+  ierr = VecRestoreArrayRead(v, &p_v); CHKERRQ(ierr);
+
+  return ierr;
+}
+
+/********************************************************************
+ * Stage a copy of the local part of a vector, to be written in full
+ * precision
+ *
+ * @param filename: Name of the file to write
+ * @param data: Local values
+ * @param nLocal: Number of local values
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode Snapshot::Add(const char *filename, const PetscScalar *data,
+                             PetscInt nLocal)
+{
+  PetscErrorCode ierr = 0;
+
+  staged.push_back(Field());
+  Field &field = staged.back();
+  field.filename = filename;
+  field.compact = false;
+  field.nLocal = nLocal;
+  field.data.assign((const char*)data, (const char*)(data+nLocal));
+  field.fh = MPI_FILE_NULL;
+
+  // PETSc binary files are big-endian
+#if !defined(PETSC_WORDS_BIGENDIAN)
+  ierr = PetscByteSwap(field.data.data(), PETSC_SCALAR, nLocal); CHKERRQ(ierr);
+#endif
+
+  return ierr;
+}
+
+/********************************************************************
+ * Stage a parallel vector in the compact encoding
+ *
+ * @param filename: Name of the file to write
+ * @param key: Name shared by successive snapshots of the same field
+ * @param v: The vector
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode Snapshot::Add_Compact(const char *filename, const char *key, Vec v)
+{
+  PetscErrorCode ierr = 0;
+
+  PetscInt nLocal;
+  const PetscScalar *p_v;
+  ierr = VecGetLocalSize(v, &nLocal); CHKERRQ(ierr);
+  ierr = VecGetArrayRead(v, &p_v); CHKERRQ(ierr);
+  ierr = Add_Compact(filename, key, p_v, nLocal); CHKERRQ(ierr);
+  ierr = VecRestoreArrayRead(v, &p_v); CHKERRQ(ierr);
+
+  return ierr;
+}
+
+/********************************************************************
+ * Stage the local part of a vector in the compact encoding. Values
+ * are stored as floats, or quantized over [0, 1] when they all lie in
+ * it and over [-2^k, 2^k] otherwise. Between keyframes each chunk is
+ * stored as the difference from the last snapshot with the same key,
+ * then all chunks are split into byte planes and run-length encoded.
+ *
+ * @param filename: Name of the file to write
+ * @param key: Name shared by successive snapshots of the same field
+ * @param data: Local values
+ * @param nLocal: Number of local values
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode Snapshot::Add_Compact(const char *filename, const char *key,
+                                     const PetscScalar *data, PetscInt nLocal)
+{
+  PetscErrorCode ierr = 0;
+  if (encoding == SNAP_DOUBLE) {
+    ierr = Add(filename, data, nLocal); CHKERRQ(ierr);
+    return ierr;
+  }
+
+  // Range of the quantization, chosen so it rarely changes between steps
+  SnapChunk chunk;
+  memset(&chunk, 0, sizeof(chunk));
+  chunk.nLocal = nLocal;
+  chunk.lo = 0; chunk.hi = 1;
+  if (encoding != SNAP_FLOAT) {
+    PetscScalar vmin = 0, vmax = 1, maxabs = 0;
+    for (PetscInt i = 0; i < nLocal; i++) {
+      vmin = min(vmin, data[i]);
+      vmax = max(vmax, data[i]);
+      maxabs = max(maxabs, (PetscScalar)fabs(data[i]));
+    }
+    if (vmin < 0 || vmax > 1) {
+      chunk.hi = pow(2, ceil(log2(maxabs)));
+      chunk.lo = -chunk.hi;
+    }
+  }
+
+  // Integer form of the values
+  int width = Width(encoding);
+  uint32_t Q = (width == 4) ? 0xFFFFFFFF : (1u << (8*width)) - 1;
+  vector<uint32_t> raw(nLocal);
+  for (PetscInt i = 0; i < nLocal; i++) {
+    if (encoding == SNAP_FLOAT) {
+      float value = data[i];
+      memcpy(raw.data()+i, &value, sizeof(value));
+    }
+    else {
+      double q = floor((data[i]-chunk.lo)/(chunk.hi-chunk.lo)*Q + 0.5);
+      raw[i] = (q > 0) ? (uint32_t)min(q, (double)Q) : 0;
+    }
+  }
+
+  // Store the change from the last snapshot when it can be undone exactly
+  History &hist = history[key];
+  bool keyed = hist.filename.size() > 0 && (hist.count % keyframe) != 0;
+  chunk.delta = keyed && (PetscInt)hist.raw.size() == nLocal &&
+                hist.lo == chunk.lo && hist.hi == chunk.hi;
+  vector<uint32_t> coded(raw);
+  if (chunk.delta) {
+    for (PetscInt i = 0; i < nLocal; i++) {
+      if (encoding == SNAP_FLOAT)
+        coded[i] ^= hist.raw[i];
+      else
+        coded[i] = (coded[i] - hist.raw[i]) & Q;
+    }
+  }
+
+  staged.push_back(Field());
+  Field &field = staged.back();
+  field.filename = filename;
+  field.compact = true;
+  field.nLocal = nLocal;
+  field.data.assign((char*)&chunk, (char*)(&chunk+1));
+  Pack(coded, width, field.data);
+  field.reference = keyed ? hist.filename : "";
+  field.fh = MPI_FILE_NULL;
+
+  hist.count = keyed ? hist.count+1 : 1;
+  hist.lo = chunk.lo; hist.hi = chunk.hi;
+  hist.raw.swap(raw);
+  // Decoders look for the reference next to the snapshot itself
+  hist.filename = filename;
+  if (hist.filename.rfind('/') != string::npos)
+    hist.filename = hist.filename.substr(hist.filename.rfind('/')+1);
+
+  return ierr;
+}
+
+/********************************************************************
+ * Open the files of all staged vectors and post the writes. Any
+ * earlier writes are finished first.
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode Snapshot::Start()
+{
+  PetscErrorCode ierr = 0;
+  ierr = Wait(); CHKERRQ(ierr);
+
+  writing.swap(staged);
+  for (unsigned int i = 0; i < writing.size(); i++) {
+    Field &field = writing[i];
+    int64_t size = field.data.size(), first = 0;
+    ierr = MPI_Exscan(&size, &first, 1, MPI_INT64_T, MPI_SUM, comm); CHKERRQ(ierr);
+    if (myid == 0)
+      first = 0;
+    PetscInt nGlobal = 0;
+    ierr = MPI_Allreduce(&field.nLocal, &nGlobal, 1, MPIU_INT, MPI_SUM, comm);
+           CHKERRQ(ierr);
+
+    if (!field.compact) {
+      // Same layout as VecView: class id and length, then the values
+      PetscInt header[2] = {VEC_FILE_CLASSID, nGlobal};
+#if !defined(PETSC_WORDS_BIGENDIAN)
+      ierr = PetscByteSwap(header, PETSC_INT, 2); CHKERRQ(ierr);
+#endif
+      field.header.assign((char*)header, (char*)(header+2));
+    }
+    else {
+      // Header and the offset of every chunk
+      vector<int64_t> offsets(nprocs+1, 0);
+      ierr = MPI_Gather(&size, 1, MPI_INT64_T, offsets.data()+1, 1, MPI_INT64_T,
+                        0, comm); CHKERRQ(ierr);
+      SnapHeader header;
+      memset(&header, 0, sizeof(header));
+      memcpy(header.magic, magic, sizeof(magic));
+      header.version = version;
+      header.encoding = encoding;
+      header.nChunks = nprocs;
+      header.endian = 0x01020304;
+      header.nGlobal = nGlobal;
+      strncpy(header.reference, field.reference.c_str(), sizeof(header.reference)-1);
+      offsets[0] = sizeof(header) + offsets.size()*sizeof(int64_t);
+      for (int p = 0; p < nprocs; p++)
+        offsets[p+1] += offsets[p];
+      field.header.assign((char*)&header, (char*)(&header+1));
+      field.header.insert(field.header.end(), (char*)offsets.data(),
+                          (char*)(offsets.data()+offsets.size()));
+    }
+
+    ierr = MPI_File_open(comm, field.filename.c_str(), MPI_MODE_CREATE |
+                         MPI_MODE_WRONLY, MPI_INFO_NULL, &field.fh);
+    if (ierr != 0)
+      SETERRQ1(comm, PETSC_ERR_FILE_OPEN, "Unable to open %s",
+               field.filename.c_str());
+    ierr = MPI_File_set_size(field.fh, 0); CHKERRQ(ierr);
+
+    MPI_Request request;
+    if (myid == 0) {
+      ierr = MPI_File_iwrite_at(field.fh, 0, field.header.data(), field.header.size(),
+                                MPI_BYTE, &request); CHKERRQ(ierr);
+      requests.push_back(request);
+    }
+    MPI_Offset offset = field.header.size() + first;
+    ierr = MPI_File_iwrite_at(field.fh, offset, field.data.data(), size,
+                              MPI_BYTE, &request); CHKERRQ(ierr);
+    requests.push_back(request);
+  }
+
+  return ierr;
+}
+
+/********************************************************************
+ * Test the outstanding writes so that they keep moving
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode Snapshot::Progress()
+{
+  PetscErrorCode ierr = 0;
+  if (requests.size() == 0)
+    return 0;
+
+  int done;
+  ierr = MPI_Testall(requests.size(), requests.data(), &done,
+                     MPI_STATUSES_IGNORE); CHKERRQ(ierr);
+
+  return ierr;
+}
+
+/********************************************************************
+ * Wait for all outstanding writes, then close their files
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode Snapshot::Wait()
+{
+  PetscErrorCode ierr = 0;
+
+  if (requests.size() > 0) {
+    ierr = MPI_Waitall(requests.size(), requests.data(),
+                       MPI_STATUSES_IGNORE); CHKERRQ(ierr);
+  }
+  requests.clear();
+  for (unsigned int i = 0; i < writing.size(); i++) {
+    ierr = MPI_File_close(&writing[i].fh); CHKERRQ(ierr);
+  }
+  writing.clear();
+
+  return ierr;
+}
+
+/********************************************************************
+ * Read all values of a compact snapshot, along with any snapshots it
+ * refers to
+ *
+ * @param filename: Name of the file
+ * @param values: All values in global order (output)
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode Snapshot::Decode(const char *filename, vector<PetscScalar> &values)
+{
+  PetscErrorCode ierr = 0;
+
+  SnapHeader header;
+  vector<SnapChunk> chunks;
+  vector<vector<uint32_t> > raw;
+  ierr = Decode_Raw(filename, header, chunks, raw); CHKERRQ(ierr);
+
+  int width = Width((SNAPSHOT_ENCODING)header.encoding);
+  uint32_t Q = (width == 4) ? 0xFFFFFFFF : (1u << (8*width)) - 1;
+  values.resize(header.nGlobal);
+  PetscScalar *p_values = values.data();
+  for (int p = 0; p < header.nChunks; p++) {
+    for (int64_t i = 0; i < chunks[p].nLocal; i++) {
+      if (header.encoding == SNAP_FLOAT) {
+        float value;
+        memcpy(&value, raw[p].data()+i, sizeof(value));
+        *(p_values++) = value;
+      }
+      else {
+        *(p_values++) = chunks[p].lo + raw[p][i]*(chunks[p].hi-chunks[p].lo)/Q;
+      }
+    }
+  }
+
+  return ierr;
+}
+
+/********************************************************************
+ * Read the integer form of each chunk of a compact snapshot
+ *
+ * @param filename: Name of the file
+ * @param header: The file header (output)
+ * @param chunks: The chunk headers (output)
+ * @param raw: Integer values of each chunk (output)
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode Snapshot::Decode_Raw(const string &filename, SnapHeader &header,
+                                    vector<SnapChunk> &chunks,
+                                    vector<vector<uint32_t> > &raw)
+{
+  PetscErrorCode ierr = 0;
+
+  ifstream file(filename.c_str(), ios::binary);
+  if (!file.is_open())
+    SETERRQ1(PETSC_COMM_SELF, PETSC_ERR_FILE_OPEN, "Unable to open %s",
+             filename.c_str());
+  file.read((char*)&header, sizeof(header));
+  if (!file || memcmp(header.magic, magic, sizeof(magic)))
+    SETERRQ1(PETSC_COMM_SELF, PETSC_ERR_FILE_UNEXPECTED, "%s is not a compact "
+             "snapshot", filename.c_str());
+  if (header.endian != 0x01020304 || header.version > version)
+    SETERRQ1(PETSC_COMM_SELF, PETSC_ERR_FILE_UNEXPECTED, "Snapshot %s was "
+             "written with a different byte order or newer version",
+             filename.c_str());
+  vector<int64_t> offsets(header.nChunks+1);
+  file.read((char*)offsets.data(), offsets.size()*sizeof(int64_t));
+
+  // Anything the chunks are relative to is in the same folder
+  header.reference[sizeof(header.reference)-1] = 0;
+  SnapHeader refHeader;
+  vector<SnapChunk> refChunks;
+  vector<vector<uint32_t> > refRaw;
+  if (strlen(header.reference) > 0) {
+    string reference = header.reference;
+    if (filename.rfind('/') != string::npos)
+      reference = filename.substr(0, filename.rfind('/')+1) + reference;
+    ierr = Decode_Raw(reference, refHeader, refChunks, refRaw); CHKERRQ(ierr);
+    if (refHeader.nChunks != header.nChunks || refHeader.encoding != header.encoding)
+      SETERRQ1(PETSC_COMM_SELF, PETSC_ERR_FILE_UNEXPECTED, "Snapshot %s does not "
+               "match its reference", filename.c_str());
+  }
+
+  int width = Width((SNAPSHOT_ENCODING)header.encoding);
+  uint32_t Q = (width == 4) ? 0xFFFFFFFF : (1u << (8*width)) - 1;
+  chunks.resize(header.nChunks);
+  raw.resize(header.nChunks);
+  vector<char> packed;
+  for (int p = 0; p < header.nChunks; p++) {
+    file.seekg(offsets[p]);
+    file.read((char*)&chunks[p], sizeof(SnapChunk));
+    packed.resize(offsets[p+1] - offsets[p] - sizeof(SnapChunk));
+    file.read(packed.data(), packed.size());
+    if (!file)
+      SETERRQ1(PETSC_COMM_SELF, PETSC_ERR_FILE_READ, "Snapshot %s is truncated",
+               filename.c_str());
+    raw[p].resize(chunks[p].nLocal);
+    ierr = Unpack(packed.data(), packed.size(), width, raw[p]); CHKERRQ(ierr);
+    if (!chunks[p].delta)
+      continue;
+    if (refRaw.size() == 0 || refRaw[p].size() != raw[p].size())
+      SETERRQ1(PETSC_COMM_SELF, PETSC_ERR_FILE_UNEXPECTED, "Snapshot %s does not "
+               "match its reference", filename.c_str());
+    for (size_t i = 0; i < raw[p].size(); i++) {
+      if (header.encoding == SNAP_FLOAT)
+        raw[p][i] ^= refRaw[p][i];
+      else
+        raw[p][i] = (raw[p][i] + refRaw[p][i]) & Q;
+    }
+  }
+
+  return ierr;
+}
+
+/********************************************************************
+ * Bytes used by each value of an encoding
+ *
+ * @param encoding: The encoding
+ *
+ * @return width: Bytes per value
+ *
+ *******************************************************************/
+int Snapshot::Width(SNAPSHOT_ENCODING encoding)
+{
+  switch (encoding) {
+    case SNAP_UINT8:
+      return 1;
+    case SNAP_UINT16:
+      return 2;
+    default:
+      return 4;
+  }
+}
+
+/********************************************************************
+ * Split values into byte planes and run-length encode them. A
+ * control byte c from 0 to 127 is followed by c+1 literal bytes, and
+ * one from -127 to -1 by a byte repeated 1-c times.
+ *
+ * @param raw: The values
+ * @param width: Bytes kept from each value
+ * @param out: Buffer the encoded bytes are appended to (output)
+ *
+ *******************************************************************/
+void Snapshot::Pack(const vector<uint32_t> &raw, int width, vector<char> &out)
+{
+  size_t n = raw.size()*width;
+  vector<unsigned char> planes(n);
+  for (int b = 0; b < width; b++) {
+    for (size_t i = 0; i < raw.size(); i++)
+      planes[b*raw.size()+i] = (raw[i] >> (8*b)) & 0xFF;
+  }
+
+  size_t i = 0;
+  while (i < n) {
+    size_t run = 1;
+    while (i+run < n && run < 128 && planes[i+run] == planes[i])
+      run++;
+    if (run >= 3) {
+      out.push_back((char)(1-(int)run));
+      out.push_back(planes[i]);
+      i += run;
+      continue;
+    }
+    // Literals until the next run of three
+    size_t start = i;
+    while (i < n && i-start < 128 && !(i+2 < n && planes[i] == planes[i+1] &&
+           planes[i] == planes[i+2]))
+      i++;
+    out.push_back((char)(i-start-1));
+    out.insert(out.end(), planes.begin()+start, planes.begin()+i);
+  }
+}
+
+/********************************************************************
+ * Undo Pack
+ *
+ * @param in: The encoded bytes
+ * @param size: Number of encoded bytes
+ * @param width: Bytes kept from each value
+ * @param raw: The values, already sized (output)
+ *
+ * @return ierr: PetscErrorCode
+ *
+ *******************************************************************/
+PetscErrorCode Snapshot::Unpack(const char *in, size_t size, int width,
+                                vector<uint32_t> &raw)
+{
+  size_t n = raw.size()*width;
+  vector<unsigned char> planes;
+  planes.reserve(n);
+  size_t i = 0;
+  while (i < size) {
+    int c = (signed char)in[i++];
+    if (c >= 0) {
+      if (i+c+1 > size)
+        break;
+      planes.insert(planes.end(), in+i, in+i+c+1);
+      i += c+1;
+    }
+    else if (c > -128 && i < size) {
+      planes.insert(planes.end(), 1-c, (unsigned char)in[i++]);
+    }
+  }
+  if (planes.size() != n)
+    SETERRQ(PETSC_COMM_SELF, PETSC_ERR_FILE_UNEXPECTED, "Corrupt snapshot chunk");
+
+  for (size_t j = 0; j < raw.size(); j++) {
+    raw[j] = 0;
+    for (int b = 0; b < width; b++)
+      raw[j] |= (uint32_t)planes[b*raw.size()+j] << (8*b);
+  }
+
+  return 0;
+}
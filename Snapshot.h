@@ -0,0 +1,116 @@
+#ifndef Snapshot_H_INCLUDED
+#define Snapshot_H_INCLUDED
+
+#include <petscvec.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+/// How compact snapshot values are stored
+enum SNAPSHOT_ENCODING {SNAP_DOUBLE, SNAP_FLOAT, SNAP_UINT16, SNAP_UINT8};
+
+/// Fixed header at the start of a compact snapshot, followed by the
+/// byte offsets of the nChunks+1 chunk boundaries
+struct SnapHeader
+{
+  char magic[8];          // "TOPOSNAP"
+  int32_t version;        // Format version
+  int32_t encoding;       // SNAPSHOT_ENCODING of the values
+  int32_t nChunks;        // Number of processes that wrote the file
+  int32_t endian;         // 0x01020304 in the byte order of the writer
+  int64_t nGlobal;        // Total number of values
+  char reference[64];     // Snapshot that delta chunks are relative to
+};
+
+/// Header of the chunk written by each process
+struct SnapChunk
+{
+  int64_t nLocal;         // Number of values in the chunk
+  int32_t delta;          // Whether the chunk is relative to the reference
+  int32_t reserved;
+  double lo, hi;          // Range of the quantized values
+};
+
+/// Writes vectors to PETSc binary files in the background. The values
+/// are copied to staging buffers when added, so the caller is free to
+/// change its vectors while the non-blocking MPI-IO writes proceed.
+/// Vectors added with a key may instead be written in a compact form:
+/// single precision or quantized, relative to the last snapshot with the
+/// same key, and run-length compressed.
+class Snapshot
+{
+public:
+  static const int32_t version = 1;
+
+  Snapshot(MPI_Comm comm);
+  ~Snapshot() {Wait();}
+
+  // Encoding of compact snapshots and how often to write one that
+  // does not depend on earlier snapshots
+  void Set_Encoding(SNAPSHOT_ENCODING encoding, int keyframe)
+    {this->encoding = encoding; this->keyframe = keyframe > 0 ? keyframe : 1;}
+  SNAPSHOT_ENCODING Get_Encoding() {return encoding;}
+
+  // Stage a vector, or the local part of one, for writing
+  PetscErrorCode Add(const char *filename, Vec v);
+  PetscErrorCode Add(const char *filename, const PetscScalar *data,
+                     PetscInt nLocal);
+  PetscErrorCode Add_Compact(const char *filename, const char *key, Vec v);
+  PetscErrorCode Add_Compact(const char *filename, const char *key,
+                             const PetscScalar *data, PetscInt nLocal);
+  // Post the writes of everything staged (collective)
+  PetscErrorCode Start();
+  // Let the writes progress without blocking
+  PetscErrorCode Progress();
+  // Finish the writes and close the files (collective)
+  PetscErrorCode Wait();
+
+  // Read all values of a compact snapshot (serial)
+  static PetscErrorCode Decode(const char *filename,
+                               std::vector<PetscScalar> &values);
+
+private:
+  struct Field
+  {
+    std::string filename;
+    bool compact;
+    PetscInt nLocal;
+    // Values or compact chunk of this process
+    std::vector<char> data;
+    // File header, written by the first process
+    std::vector<char> header;
+    std::string reference;
+    MPI_File fh;
+  };
+  // Last compact snapshot written with each key
+  struct History
+  {
+    std::string filename;
+    int count;
+    double lo, hi;
+    std::vector<uint32_t> raw;
+  };
+
+  static int Width(SNAPSHOT_ENCODING encoding);
+  static void Pack(const std::vector<uint32_t> &raw, int width,
+                   std::vector<char> &out);
+  static PetscErrorCode Unpack(const char *in, size_t size, int width,
+                               std::vector<uint32_t> &raw);
+  static PetscErrorCode Decode_Raw(const std::string &filename, SnapHeader &header,
+                                   std::vector<SnapChunk> &chunks,
+                                   std::vector<std::vector<uint32_t> > &raw);
+
+  MPI_Comm comm;
+  int myid, nprocs;
+  SNAPSHOT_ENCODING encoding;
+  int keyframe;
+  std::map<std::string, History> history;
+  // Fields staged since the last Start
+  std::vector<Field> staged;
+  // Fields being written
+  std::vector<Field> writing;
+  std::vector<MPI_Request> requests;
+};
+
+#endif // Snapshot_H_INCLUDED
@@ -1,7 +1,10 @@
 #include <mpi.h> // Has to precede Petsc includes to use MPI::BOOL
 #include "TopOpt.h"
+#include "MeshFile.h"
 #include <fstream>
+#include <sstream>
 #include <climits>
+#include <sys/resource.h>
 
 using namespace std;
 
@@ -20,14 +23,32 @@ PetscErrorCode TopOpt::Initialize()
   folder = "";
   print_every = INT_MAX;
   last_print = 0;
+  async_print = PETSC_TRUE;
+  print_encoding = SNAP_DOUBLE;
+  print_keyframe = 10;
+  visualize = PETSC_FALSE;
+  visMeshes = 0;
+  checkpoint_every = 0;
+  checkpointSlot = 0;
+  meshVersion = 0;
+  checkpointStale = PETSC_FALSE;
+  box_partition = PETSC_FALSE;
+  repartition_every = 0;
+  repartition_weight = 4;
   interpolation = SIMP;
   KUF_reason = KSP_CONVERGED_ITERATING;
+  KUF_its = 0;
+  KUF_solved = PETSC_FALSE;
+  telemetry = PETSC_FALSE;
+  telemetryFile = NULL;
+  ioTime = 0;
   minGeoHybrid = 2;
   ierr = PetscOptionsGetInt(NULL, NULL, "-hybrid_min_geo_levels",
                             &minGeoHybrid, NULL);
 
   ierr = PrepLog(); CHKERRQ(ierr);
   MPI_Set();
+  snapshot = new Snapshot(comm);
   char fname[200] = "Output.txt";
   ierr = PetscOptionsGetString(NULL, NULL, "-output", fname, 200, NULL); CHKERRQ(ierr);
   ierr = PetscFOpen(comm, "Output.txt", "w", &output); CHKERRQ(ierr);
@@ -47,6 +68,21 @@ PetscErrorCode TopOpt::PrepLog()
   ierr = PetscLogEventRegister("Optimization Update", 0, &UpdateEvent); CHKERRQ(ierr);
   ierr = PetscLogEventRegister("Functions", 0, &funcEvent); CHKERRQ(ierr);
   ierr = PetscLogEventRegister("FE Analysis", 0, &FEEvent); CHKERRQ(ierr);
+  ierr = PetscLogEventRegister("Interpolation", 0, &interpEvent); CHKERRQ(ierr);
+  ierr = PetscLogEventRegister("Filter", 0, &filterEvent); CHKERRQ(ierr);
+  ierr = PetscLogEventRegister("Filter Chain Rule", 0, &chainEvent); CHKERRQ(ierr);
+  ierr = PetscLogEventRegister("FE Assembly", 0, &assembleEvent); CHKERRQ(ierr);
+  ierr = PetscLogEventRegister("FE PC Setup", 0, &PCSetupEvent); CHKERRQ(ierr);
+  ierr = PetscLogEventRegister("FE Solve", 0, &solveEvent); CHKERRQ(ierr);
+  ierr = PetscLogEventRegister("Adjoint Solve", 0, &adjointEvent); CHKERRQ(ierr);
+  ierr = PetscLogEventRegister("Repartition", 0, &repartEvent); CHKERRQ(ierr);
+  ierr = PetscLogEventRegister("Checkpoint", 0, &checkpointEvent); CHKERRQ(ierr);
+  ierr = PetscLogEventRegister("Output", 0, &outputEvent); CHKERRQ(ierr);
+  ierr = PetscLogEventRegister("Print Values", 0, &printEvent); CHKERRQ(ierr);
+  for (int i = 0; i <= FREQUENCY; i++) {
+    ierr = PetscLogEventRegister(Function_Base::name[i], 0, functionEvent+i);
+           CHKERRQ(ierr);
+  }
   return ierr;
 }
 
@@ -57,13 +93,37 @@ PetscErrorCode TopOpt::PrepLog()
  * 
  *******************************************************************/
 PetscErrorCode TopOpt::Clear()
+{ 
+  PetscErrorCode ierr = 0;
+  ierr = Clear_Mesh(); CHKERRQ(ierr);
+  ierr = snapshot->Wait(); CHKERRQ(ierr);
+  delete snapshot;
+  for (unsigned int i = 0; i < function_list.size(); i++)
+    delete function_list[i];
+  ierr = PetscFClose(comm, output); CHKERRQ(ierr);
+  if (telemetryFile) {
+    ierr = PetscFClose(comm, telemetryFile); CHKERRQ(ierr);
+  }
+  return ierr;
+}
+
+/********************************************************************
+ * Clear out the mesh, boundary conditions, and every structure built
+ * on them so that the mesh can be created again
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::Clear_Mesh()
 { 
   PetscErrorCode ierr = 0;
   delete[] B; delete[] G; delete[] GT; delete[] W;
+  B = NULL; G = NULL; GT = NULL; W = NULL;
   ierr = VecDestroy(&F); CHKERRQ(ierr);
   ierr = VecDestroy(&U); CHKERRQ(ierr);
   //ierr = MatDestroy(&spK); CHKERRQ(ierr);
   ierr = VecDestroy(&spKVec); CHKERRQ(ierr);
+  ierr = VecDestroy(&MaxStiff); CHKERRQ(ierr);
   ierr = MatDestroy(&K); CHKERRQ(ierr);
   ierr = VecDestroy(&MLump); CHKERRQ(ierr);
   ierr = KSPDestroy(&KUF); CHKERRQ(ierr);
@@ -71,6 +131,15 @@ PetscErrorCode TopOpt::Clear()
   //ierr = KSPDestroy(&bucklingKSP); CHKERRQ(ierr);
   ierr = MatDestroy(&P); CHKERRQ(ierr);
   ierr = MatDestroy(&R); CHKERRQ(ierr);
+  for (unsigned int i = 0; i < PR.size(); i++) {
+    ierr = MatDestroy(PR.data()+i); CHKERRQ(ierr);
+  }
+  PR.clear();
+  for (unsigned int i = 0; i < MG_comms.size(); i++) {
+    if (MG_comms[i] != comm && MG_comms[i] != MPI_COMM_NULL)
+      MPI_Comm_free(MG_comms.data()+i);
+  }
+  MG_comms.clear();
   ierr = VecDestroy(&REdge); CHKERRQ(ierr);
   ierr = VecDestroy(&V); CHKERRQ(ierr);
   ierr = VecDestroy(&dVdrho); CHKERRQ(ierr);
@@ -82,19 +151,107 @@ PetscErrorCode TopOpt::Clear()
   ierr = VecDestroy(&y); CHKERRQ(ierr);
   ierr = VecDestroy(&rho); CHKERRQ(ierr);
   ierr = VecDestroy(&rhoq); CHKERRQ(ierr);
-  for (unsigned int i = 0; i < function_list.size(); i++)
-    delete function_list[i];
-  ierr = PetscFClose(comm, output); CHKERRQ(ierr);
+
+  // Boundary conditions are appended to by Set_BC
+  suppNode.resize(0); supports.resize(0, numDims);
+  eigenSuppNode.resize(0); eigenSupports.resize(0, numDims);
+  loadNode.resize(0); loads.resize(0, numDims);
+  massNode.resize(0); masses.resize(0, numDims);
+  springNode.resize(0); springs.resize(0, numDims);
   return ierr;
 }
 
 /********************************************************************
- * Print out the mesh information
+ * Print out the mesh information to a single container, Mesh.bin
  * 
  * @return ierr: PetscErrorCode
  * 
+ * @options: -mesh_files: Write the separate files of older versions
+ *           instead
+ * 
  *******************************************************************/
 PetscErrorCode TopOpt::MeshOut()
+{
+  PetscErrorCode ierr = 0;
+  if (visualize) {
+    ierr = Vis_Mesh(); CHKERRQ(ierr);
+  }
+
+  PetscBool separate = PETSC_FALSE;
+  ierr = PetscOptionsGetBool(NULL, NULL, "-mesh_files", &separate, NULL); CHKERRQ(ierr);
+  if (separate) {
+    ierr = MeshOut_Files(); CHKERRQ(ierr);
+    return ierr;
+  }
+
+  MeshFile file(this->comm);
+  ierr = file.Create("Mesh.bin"); CHKERRQ(ierr);
+
+  // Distributions are only written once
+  ierr = file.Write("elmdist", this->elmdist.data(),
+                    this->myid == 0 ? this->elmdist.size() : 0); CHKERRQ(ierr);
+  ierr = file.Write("nddist", this->nddist.data(),
+                    this->myid == 0 ? this->nddist.size() : 0); CHKERRQ(ierr);
+  ierr = file.Write("meshVersion", &this->meshVersion,
+                    this->myid == 0 ? 1 : 0); CHKERRQ(ierr);
+
+  // Elements with global node numbers, then the owned nodes
+  ArrayXXPIRM global_int(this->nLocElem, this->element.cols());
+  for (int el = 0; el < this->nLocElem; el++) {
+    for (int nd = 0; nd < this->element.cols(); nd++)
+      global_int(el,nd) = this->gNode(this->element(el,nd));
+  }
+  ierr = file.Write("elements", global_int.data(), this->nLocElem,
+                    this->element.cols()); CHKERRQ(ierr);
+  ierr = file.Write("nodes", this->node.data(), this->nLocNode,
+                    this->numDims); CHKERRQ(ierr);
+
+  // Boundary conditions, grouped by the process that owns the nodes
+  ArrayXPI *bcNodes[5] = {&this->loadNode, &this->suppNode, &this->eigenSuppNode,
+                          &this->springNode, &this->massNode};
+  const char *bcNames[5] = {"loadNodes", "supportNodes", "eigenSupportNodes",
+                            "springNodes", "massNodes"};
+  for (short i = 0; i < 5; i++) {
+    ArrayXPI global(bcNodes[i]->size());
+    for (PetscInt j = 0; j < global.size(); j++)
+      global(j) = this->gNode((*bcNodes[i])(j));
+    ierr = file.Write(bcNames[i], global.data(), global.size()); CHKERRQ(ierr);
+    ierr = file.Write_Index(bcNames[i], global.size()); CHKERRQ(ierr);
+  }
+  ierr = file.Write("loads", this->loads.data(), this->loads.rows(),
+                    this->numDims); CHKERRQ(ierr);
+  ierr = file.Write("supports", this->supports.data(), this->supports.rows(),
+                    this->numDims); CHKERRQ(ierr);
+  ierr = file.Write("eigenSupports", this->eigenSupports.data(),
+                    this->eigenSupports.rows(), this->numDims); CHKERRQ(ierr);
+  ierr = file.Write("springs", this->springs.data(), this->springs.rows(),
+                    this->numDims); CHKERRQ(ierr);
+  ierr = file.Write("masses", this->masses.data(), this->masses.rows(),
+                    this->numDims); CHKERRQ(ierr);
+
+  ierr = file.Write("active", this->active.data(), this->nLocElem); CHKERRQ(ierr);
+
+  // Filters and multigrid hierarchy
+  ierr = file.Write("Filter", this->P); CHKERRQ(ierr);
+  ierr = file.Write("Max_Filter", this->R); CHKERRQ(ierr);
+  ierr = file.Write("Void_Edge_Volume", this->REdge); CHKERRQ(ierr);
+  for (unsigned int i = 0; i < this->PR.size(); i++) {
+    stringstream level; level << "P" << i;
+    ierr = file.Write(level.str().c_str(), this->PR[i]); CHKERRQ(ierr);
+  }
+
+  ierr = file.Close(); CHKERRQ(ierr);
+
+  return ierr;
+}
+
+/********************************************************************
+ * Print out the mesh information to a separate file for each array
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::MeshOut_Files()
 {
   PetscErrorCode ierr = 0;
   ofstream file;
@@ -105,6 +262,9 @@ PetscErrorCode TopOpt::MeshOut()
     file.open("Node_Distribution.bin", ios::binary);
     file.write((char*)this->nddist.data(), this->nddist.size()*sizeof(PetscInt));
     file.close();
+    file.open("Mesh_Version.bin", ios::binary);
+    file.write((char*)&this->meshVersion, sizeof(PetscInt));
+    file.close();
   }
 
   // Getting distribution of loads, supports, springs, and masses
@@ -373,12 +533,13 @@ PetscErrorCode TopOpt::StepOut(const double &f, const Eigen::VectorXd &cons,
                                int it, long nactive)
 {
   PetscErrorCode ierr = 0;
+  ierr = snapshot->Progress(); CHKERRQ(ierr);
 
   // Print out values at every step if desired
   if ((print_every - ++last_print) == 0) {
     char name_suffix[30];
     sprintf(name_suffix, "_pen%1.4g_it%i", penal, it);
-    ierr = PrintVals(name_suffix); CHKERRQ(ierr);
+    ierr = PrintVals(name_suffix, PETSC_TRUE); CHKERRQ(ierr);
     last_print = 0;
   }
   // So we print at iteration 10, 20, 30, etc. instead of 9, 19, 29...
@@ -404,6 +565,251 @@ PetscErrorCode TopOpt::StepOut(const double &f, const Eigen::VectorXd &cons,
   return ierr;
 }
 
+/********************************************************************
+ * Add to the time spent in a phase since the last telemetry record
+ * 
+ * @param phase: Name of the phase
+ * @param time: Wall time spent in the phase
+ * @param io: Whether the time was spent writing files
+ * 
+ * @return void
+ * 
+ *******************************************************************/
+void TopOpt::Add_Time(const char *phase, double time, PetscBool io)
+{
+  if (io)
+    ioTime += time;
+  for (unsigned int i = 0; i < phaseTimes.size(); i++) {
+    if (phaseTimes[i].first == phase) {
+      phaseTimes[i].second += time;
+      return;
+    }
+  }
+  phaseTimes.push_back(make_pair(string(phase), time));
+}
+
+/********************************************************************
+ * Write a JSON-lines record of the iteration (the times are those of
+ * the slowest process) and start timing the next one
+ * 
+ * @param f: Objective value
+ * @param cons: Constraint values
+ * @param it: Iteration number
+ * @param optmma: The optimizer
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::Telemetry(const double &f, const Eigen::VectorXd &cons,
+                                 int it, MMA *optmma)
+{
+  PetscErrorCode ierr = 0;
+  if (!telemetry) {
+    phaseTimes.clear(); ioTime = 0;
+    KUF_solved = PETSC_FALSE;
+    return ierr;
+  }
+  if (telemetryFile == NULL) {
+    ierr = PetscFOpen(comm, "Telemetry.jsonl", "w", &telemetryFile); CHKERRQ(ierr);
+  }
+
+  // Phase times, I/O time, and the time of each function
+  unsigned int nPhase = phaseTimes.size(), nFunc = function_list.size();
+  vector<double> times(nPhase + 1 + nFunc);
+  for (unsigned int i = 0; i < nPhase; i++)
+    times[i] = phaseTimes[i].second;
+  times[nPhase] = ioTime;
+  for (unsigned int i = 0; i < nFunc; i++)
+    times[nPhase+1+i] = function_list[i]->time;
+  ierr = MPI_Allreduce(MPI_IN_PLACE, times.data(), times.size(), MPI_DOUBLE,
+                       MPI_MAX, comm); CHKERRQ(ierr);
+
+  // Memory high-water mark of the largest process and of all of them
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  double memory = 1024.0*usage.ru_maxrss, maxMemory, totMemory;
+  ierr = MPI_Allreduce(&memory, &maxMemory, 1, MPI_DOUBLE, MPI_MAX, comm); CHKERRQ(ierr);
+  ierr = MPI_Allreduce(&memory, &totMemory, 1, MPI_DOUBLE, MPI_SUM, comm); CHKERRQ(ierr);
+
+  ierr = PetscFPrintf(comm, telemetryFile, "{\"penalty\": %1.6g, \"iteration\": %i, "
+                      "\"objective\": %1.12g, \"constraints\": [", penal,
+                      it, f); CHKERRQ(ierr);
+  for (short i = 0; i < cons.size(); i++) {
+    ierr = PetscFPrintf(comm, telemetryFile, "%s%1.12g", i ? ", " : "", cons(i));
+           CHKERRQ(ierr);
+  }
+  ierr = PetscFPrintf(comm, telemetryFile, "], \"times\": {"); CHKERRQ(ierr);
+  for (unsigned int i = 0; i < nPhase; i++) {
+    ierr = PetscFPrintf(comm, telemetryFile, "%s\"%s\": %1.6e", i ? ", " : "",
+                        phaseTimes[i].first.c_str(), times[i]); CHKERRQ(ierr);
+  }
+  // Iterations without a displacement solve have no KSP results
+  ierr = PetscFPrintf(comm, telemetryFile, "}, \"io\": %1.6e, \"ksp\": ",
+                      times[nPhase]); CHKERRQ(ierr);
+  if (KUF_solved) {
+    ierr = PetscFPrintf(comm, telemetryFile, "{\"iterations\": %i, \"reason\": %i}",
+                        KUF_its, KUF_reason); CHKERRQ(ierr);
+  }
+  else {
+    ierr = PetscFPrintf(comm, telemetryFile, "null"); CHKERRQ(ierr);
+  }
+  ierr = PetscFPrintf(comm, telemetryFile, ", \"functions\": ["); CHKERRQ(ierr);
+  for (unsigned int i = 0; i < nFunc; i++) {
+    Function_Base *function = function_list[i];
+    ierr = PetscFPrintf(comm, telemetryFile, "%s{\"name\": \"%s\", \"value\": %1.12g, "
+                        "\"time\": %1.6e", i ? ", " : "",
+                        Function_Base::name[function->func_type],
+                        function->Get_Value(), times[nPhase+1+i]); CHKERRQ(ierr);
+    if (function->eigenReq > 0) {
+      ierr = PetscFPrintf(comm, telemetryFile, ", \"eigen\": {\"requested\": %i, "
+                          "\"converged\": %i, \"iterations\": %i, \"time\": %1.6e}, "
+                          "\"adjoint\": {\"iterations\": %i, \"reason\": %i, "
+                          "\"time\": %1.6e}", function->eigenReq, function->eigenConv,
+                          function->eigenIts, function->eigenTime, function->adjointIts,
+                          function->adjointReason, function->adjointTime); CHKERRQ(ierr);
+    }
+    ierr = PetscFPrintf(comm, telemetryFile, "}"); CHKERRQ(ierr);
+  }
+  ierr = PetscFPrintf(comm, telemetryFile, "], \"mma\": {\"change\": %1.6e, "
+                      "\"kkt\": %1.6e}, \"memory\": {\"max\": %1.0f, \"total\": %1.0f}}\n",
+                      optmma->Get_Change(), optmma->Get_Residual(), maxMemory,
+                      totMemory); CHKERRQ(ierr);
+  // So the stream can be followed while the job runs
+  if (myid == 0)
+    fflush(telemetryFile);
+
+  phaseTimes.clear(); ioTime = 0;
+  KUF_solved = PETSC_FALSE;
+  return ierr;
+}
+
+/********************************************************************
+ * Write a JSON-lines record of the phases timed since the last record
+ * that don't belong to an iteration (e.g. the output at the end of a
+ * penalty step), so they are not charged to the next iteration
+ * 
+ * @param event: Name of the record
+ * @param it: Iteration number
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::Telemetry_Flush(const char *event, int it)
+{
+  PetscErrorCode ierr = 0;
+  if (!telemetry || telemetryFile == NULL) {
+    phaseTimes.clear(); ioTime = 0;
+    return ierr;
+  }
+
+  unsigned int nPhase = phaseTimes.size();
+  vector<double> times(nPhase + 1);
+  for (unsigned int i = 0; i < nPhase; i++)
+    times[i] = phaseTimes[i].second;
+  times[nPhase] = ioTime;
+  ierr = MPI_Allreduce(MPI_IN_PLACE, times.data(), times.size(), MPI_DOUBLE,
+                       MPI_MAX, comm); CHKERRQ(ierr);
+
+  ierr = PetscFPrintf(comm, telemetryFile, "{\"penalty\": %1.6g, \"iteration\": %i, "
+                      "\"event\": \"%s\", \"times\": {", penal, it, event); CHKERRQ(ierr);
+  for (unsigned int i = 0; i < nPhase; i++) {
+    ierr = PetscFPrintf(comm, telemetryFile, "%s\"%s\": %1.6e", i ? ", " : "",
+                        phaseTimes[i].first.c_str(), times[i]); CHKERRQ(ierr);
+  }
+  ierr = PetscFPrintf(comm, telemetryFile, "}, \"io\": %1.6e}\n", times[nPhase]);
+            CHKERRQ(ierr);
+  if (myid == 0)
+    fflush(telemetryFile);
+
+  phaseTimes.clear(); ioTime = 0;
+  return ierr;
+}
+
+/********************************************************************
+ * Print the memory held by each data structure, with its minimum,
+ * maximum, and average over the processes
+ * 
+ * @param optmma: The optimizer
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::MemoryOut(MMA *optmma)
+{
+  PetscErrorCode ierr = 0;
+  vector<pair<string, double> > usage;
+  double bytes, total;
+
+  ierr = Mat_Memory(K, bytes); CHKERRQ(ierr);
+  usage.push_back(make_pair(string("K"), bytes));
+  total = 0;
+  for (unsigned int i = 0; i < PR.size(); i++) {
+    ierr = Mat_Memory(PR[i], bytes); CHKERRQ(ierr);
+    total += bytes;
+  }
+  usage.push_back(make_pair(string("PR"), total));
+  ierr = Mat_Memory(P, bytes); CHKERRQ(ierr);
+  usage.push_back(make_pair(string("P"), bytes));
+  ierr = Mat_Memory(R, bytes); CHKERRQ(ierr);
+  usage.push_back(make_pair(string("R"), bytes));
+
+  Vec ghosted[8] = {U, F, V, dVdrho, E, dEdz, Es, dEsdz};
+  total = 0;
+  for (short i = 0; i < 8; i++) {
+    ierr = Vec_Memory(ghosted[i], bytes); CHKERRQ(ierr);
+    total += bytes;
+  }
+  usage.push_back(make_pair(string("Ghosted vectors"), total));
+  Vec others[8] = {x, rho, rhoq, y, REdge, MaxStiff, MLump, spKVec};
+  total = 0;
+  for (short i = 0; i < 8; i++) {
+    ierr = Vec_Memory(others[i], bytes); CHKERRQ(ierr);
+    total += bytes;
+  }
+  usage.push_back(make_pair(string("Other vectors"), total));
+
+  total = node.size()*sizeof(PetscScalar) + element.size()*sizeof(PetscInt) +
+          (gElem.size() + gNode.size())*sizeof(PetscInt);
+  usage.push_back(make_pair(string("Mesh"), total));
+  total = 0;
+  for (unsigned int i = 0; i < ke.size(); i++)
+    total += ke[i].size()*sizeof(PetscScalar);
+  usage.push_back(make_pair(string("Element stiffness"), total));
+  total = (bucklingShape.size() + dynamicShape.size())*sizeof(PetscScalar);
+  usage.push_back(make_pair(string("Mode shapes"), total));
+
+  for (unsigned int i = 0; i < function_list.size(); i++) {
+    ierr = function_list[i]->Memory(usage); CHKERRQ(ierr);
+  }
+  usage.push_back(make_pair(string("MMA"), optmma->Memory()));
+
+  total = 0;
+  for (unsigned int i = 0; i < usage.size(); i++)
+    total += usage[i].second;
+  usage.push_back(make_pair(string("Total"), total));
+
+  // Every process lists the same structures in the same order
+  unsigned int n = usage.size();
+  vector<double> local(n), lo(n), hi(n), sum(n);
+  for (unsigned int i = 0; i < n; i++)
+    local[i] = usage[i].second;
+  ierr = MPI_Allreduce(local.data(), lo.data(), n, MPI_DOUBLE, MPI_MIN, comm); CHKERRQ(ierr);
+  ierr = MPI_Allreduce(local.data(), hi.data(), n, MPI_DOUBLE, MPI_MAX, comm); CHKERRQ(ierr);
+  ierr = MPI_Allreduce(local.data(), sum.data(), n, MPI_DOUBLE, MPI_SUM, comm); CHKERRQ(ierr);
+
+  double MB = 1024.0*1024.0;
+  ierr = PetscFPrintf(comm, output, "Memory per process (MB) %26s %10s %10s\n",
+                      "Min", "Max", "Avg"); CHKERRQ(ierr);
+  for (unsigned int i = 0; i < n; i++) {
+    ierr = PetscFPrintf(comm, output, "  %-36s %10.3f %10.3f %10.3f\n",
+                        usage[i].first.c_str(), lo[i]/MB, hi[i]/MB,
+                        sum[i]/nprocs/MB); CHKERRQ(ierr);
+  }
+  ierr = PetscFPrintf(comm, output, "\n"); CHKERRQ(ierr);
+
+  return ierr;
+}
+
 /********************************************************************
  * Print out result of a penalization increment
  * 
@@ -435,74 +841,362 @@ PetscErrorCode TopOpt::ResultOut(int it)
 }
 
 /********************************************************************
- * The actual printing of the optimization state
+ * The actual printing of the optimization state. The files are
+ * written in the background while the optimization continues.
  * 
  * @param name_suffix: Characters to append to the output file names
+ * @param compact: Whether to use the compact print encoding; restart
+ *                 files should always be written in full precision
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ * @options: -Async_Print: Whether to overlap the writes with the next
+ *           analysis (default true)
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::PrintVals(char *name_suffix, PetscBool compact)
+{
+  PetscErrorCode ierr = 0;
+  ierr = PetscLogEventBegin(printEvent, 0, 0, 0, 0); CHKERRQ(ierr);
+  char filename[50], key[20];
+  snapshot->Set_Encoding(print_encoding, print_keyframe);
+  compact = (PetscBool)(compact && print_encoding != SNAP_DOUBLE);
+  const char *ext = compact ? "snap" : "bin";
+
+  Vec fields[5] = {this->U, this->x, this->V, this->Es, this->E};
+  const char *names[5] = {"U", "x", "V", "Es", "E"};
+  for (short i = 0; i < 5; i++) {
+    sprintf(filename, "%s%s.%s", names[i], name_suffix, ext);
+    if (compact) {
+      ierr = snapshot->Add_Compact(filename, names[i], fields[i]); CHKERRQ(ierr);
+    }
+    else {
+      ierr = snapshot->Add(filename, fields[i]); CHKERRQ(ierr);
+    }
+  }
+
+  for (int i = 0; i < this->bucklingShape.cols(); i++) {
+    sprintf(filename,"phiB%s_mode%i.%s", name_suffix, i, ext);
+    sprintf(key, "phiB_mode%i", i);
+    PetscScalar *phi = this->bucklingShape.data() + this->bucklingShape.rows()*i;
+    if (compact) {
+      ierr = snapshot->Add_Compact(filename, key, phi,
+                                   this->numDims*this->nLocNode); CHKERRQ(ierr);
+    }
+    else {
+      ierr = snapshot->Add(filename, phi, this->numDims*this->nLocNode); CHKERRQ(ierr);
+    }
+  }
+
+  for (int i = 0; i < this->dynamicShape.cols(); i++) {
+    sprintf(filename,"phiD_%s_mode%i.%s", name_suffix, i, ext);
+    sprintf(key, "phiD_mode%i", i);
+    PetscScalar *phi = this->dynamicShape.data() + this->dynamicShape.rows()*i;
+    if (compact) {
+      ierr = snapshot->Add_Compact(filename, key, phi,
+                                   this->numDims*this->nLocNode); CHKERRQ(ierr);
+    }
+    else {
+      ierr = snapshot->Add(filename, phi, this->numDims*this->nLocNode); CHKERRQ(ierr);
+    }
+  }
+
+  // The values are already copied, so the writes can overlap the next
+  // analysis unless told otherwise
+  ierr = snapshot->Start(); CHKERRQ(ierr);
+  if (!async_print) {
+    ierr = snapshot->Wait(); CHKERRQ(ierr);
+  }
+
+  // Compact snapshots can't be read directly by visualization tools
+  if (visualize && !compact) {
+    ierr = Vis_Out(name_suffix); CHKERRQ(ierr);
+  }
+  ierr = PetscLogEventEnd(printEvent, 0, 0, 0, 0); CHKERRQ(ierr);
+
+  return ierr;
+}
+
+/********************************************************************
+ * Write the mesh in the layout XDMF expects, once for each mesh
+ * created, so printed values can be visualized in place
  * 
  * @return ierr: PetscErrorCode
  * 
  *******************************************************************/
-PetscErrorCode TopOpt::PrintVals(char *name_suffix)
+PetscErrorCode TopOpt::Vis_Mesh()
 {
   PetscErrorCode ierr = 0;
+
   char filename[30];
-  PetscViewer output;
-
-  sprintf(filename, "U%s.bin", name_suffix);
-  ierr = PetscViewerBinaryOpen(this->comm, filename,
-      FILE_MODE_WRITE, &output); CHKERRQ(ierr);
-  ierr = VecView(this->U, output); CHKERRQ(ierr);
-  ierr = PetscViewerDestroy(&output); CHKERRQ(ierr);
-
-  sprintf(filename, "x%s.bin", name_suffix);
-  ierr = PetscViewerBinaryOpen(this->comm, filename,
-      FILE_MODE_WRITE, &output); CHKERRQ(ierr);
-  ierr = VecView(this->x, output); CHKERRQ(ierr);
-  ierr = PetscViewerDestroy(&output); CHKERRQ(ierr);
-
-  sprintf(filename, "V%s.bin", name_suffix);
-  ierr = PetscViewerBinaryOpen(this->comm, filename,
-      FILE_MODE_WRITE, &output); CHKERRQ(ierr);
-  ierr = VecView(this->V, output); CHKERRQ(ierr);
-  ierr = PetscViewerDestroy(&output); CHKERRQ(ierr);
-
-  sprintf(filename, "Es%s.bin", name_suffix);
-  ierr = PetscViewerBinaryOpen(this->comm, filename,
-      FILE_MODE_WRITE, &output); CHKERRQ(ierr);
-  ierr = VecView(this->Es, output); CHKERRQ(ierr);
-  ierr = PetscViewerDestroy(&output); CHKERRQ(ierr);
-
-  sprintf(filename, "E%s.bin", name_suffix);
-  ierr = PetscViewerBinaryOpen(this->comm, filename,
-      FILE_MODE_WRITE, &output); CHKERRQ(ierr);
-  ierr = VecView(this->E, output); CHKERRQ(ierr);
-  ierr = PetscViewerDestroy(&output); CHKERRQ(ierr);
+  sprintf(filename, "Vis_Mesh%i.bin", visMeshes++);
+  MeshFile file(this->comm);
+  ierr = file.Create(filename, 2); CHKERRQ(ierr);
+
+  // Hexahedra and quadrilaterals are already numbered like XDMF's
+  ArrayXXPIRM global_int(this->nLocElem, this->element.cols());
+  for (int el = 0; el < this->nLocElem; el++) {
+    for (int nd = 0; nd < this->element.cols(); nd++)
+      global_int(el,nd) = this->gNode(this->element(el,nd));
+  }
+  ierr = file.Write("elements", global_int.data(), this->nLocElem,
+                    this->element.cols()); CHKERRQ(ierr);
+  ierr = file.Write("nodes", this->node.data(), this->nLocNode,
+                    this->numDims); CHKERRQ(ierr);
+  visElemOffset = file.Offset("elements");
+  visNodeOffset = file.Offset("nodes");
+  ierr = file.Close(); CHKERRQ(ierr);
+
+  return ierr;
+}
+
+/********************************************************************
+ * Describe the files of a print in XDMF and add them to the time
+ * series in Results.xmf, pointing at the binary data where it is
+ * 
+ * @param name_suffix: Characters appended to the output file names
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::Vis_Out(char *name_suffix)
+{
+  PetscErrorCode ierr = 0;
+  if (this->myid != 0 || this->numDims < 2 || visMeshes == 0)
+    return 0;
+
+#if defined(PETSC_WORDS_BIGENDIAN)
+  const char *native = "Big";
+#else
+  const char *native = "Little";
+#endif
+  const char *topology = (this->numDims == 3) ? "Hexahedron" : "Quadrilateral";
+  const char *geometry = (this->numDims == 3) ? "XYZ" : "XY";
+  // PETSc binary vectors are big-endian behind a class id and length
+  int seek = 2*sizeof(PetscInt);
+
+  stringstream grid;
+  grid << "   <Grid Name=\"" << name_suffix << "\" GridType=\"Uniform\">\n";
+  grid << "    <Time Value=\"" << visGrids.size() << "\"/>\n";
+  grid << "    <Topology TopologyType=\"" << topology << "\" NumberOfElements=\""
+       << this->nElem << "\">\n";
+  grid << "     <DataItem Dimensions=\"" << this->nElem << " " << this->element.cols()
+       << "\" NumberType=\"Int\" Precision=\"" << sizeof(PetscInt)
+       << "\" Format=\"Binary\" Endian=\"" << native << "\" Seek=\""
+       << visElemOffset << "\">Vis_Mesh" << visMeshes-1 << ".bin</DataItem>\n";
+  grid << "    </Topology>\n";
+  grid << "    <Geometry GeometryType=\"" << geometry << "\">\n";
+  grid << "     <DataItem Dimensions=\"" << this->nNode << " " << this->numDims
+       << "\" NumberType=\"Float\" Precision=\"8\" Format=\"Binary\" Endian=\""
+       << native << "\" Seek=\"" << visNodeOffset << "\">Vis_Mesh" << visMeshes-1
+       << ".bin</DataItem>\n";
+  grid << "    </Geometry>\n";
 
+  // Element values, then node values
+  const char *cellNames[4] = {"x", "V", "Es", "E"};
+  for (short i = 0; i < 4; i++) {
+    grid << "    <Attribute Name=\"" << cellNames[i] << "\" AttributeType=\"Scalar\""
+         << " Center=\"Cell\">\n";
+    grid << "     <DataItem Dimensions=\"" << this->nElem << "\" NumberType=\"Float\""
+         << " Precision=\"8\" Format=\"Binary\" Endian=\"Big\" Seek=\"" << seek
+         << "\">" << cellNames[i] << name_suffix << ".bin</DataItem>\n";
+    grid << "    </Attribute>\n";
+  }
+  vector<string> nodeNames(1, "U"), nodeFiles(1, string("U") + name_suffix + ".bin");
+  char filename[50];
   for (int i = 0; i < this->bucklingShape.cols(); i++) {
-    sprintf(filename,"phiB%s_mode%i.bin", name_suffix, i);
+    sprintf(filename, "phiB%s_mode%i.bin", name_suffix, i);
+    nodeFiles.push_back(filename);
+    sprintf(filename, "phiB_mode%i", i);
+    nodeNames.push_back(filename);
+  }
+  for (int i = 0; i < this->dynamicShape.cols(); i++) {
+    sprintf(filename, "phiD_%s_mode%i.bin", name_suffix, i);
+    nodeFiles.push_back(filename);
+    sprintf(filename, "phiD_mode%i", i);
+    nodeNames.push_back(filename);
+  }
+  for (unsigned int i = 0; i < nodeNames.size(); i++) {
+    grid << "    <Attribute Name=\"" << nodeNames[i] << "\" AttributeType=\"Vector\""
+         << " Center=\"Node\">\n";
+    grid << "     <DataItem Dimensions=\"" << this->nNode << " " << this->numDims
+         << "\" NumberType=\"Float\" Precision=\"8\" Format=\"Binary\""
+         << " Endian=\"Big\" Seek=\"" << seek << "\">" << nodeFiles[i]
+         << "</DataItem>\n";
+    grid << "    </Attribute>\n";
+  }
+  grid << "   </Grid>\n";
+  visGrids.push_back(grid.str());
+
+  // Rewrite the whole series, it is only a few lines per print
+  ofstream file("Results.xmf");
+  file << "<?xml version=\"1.0\" ?>\n";
+  file << "<Xdmf Version=\"2.0\">\n";
+  file << " <Domain>\n";
+  file << "  <Grid Name=\"Results\" GridType=\"Collection\" CollectionType=\"Temporal\">\n";
+  for (unsigned int i = 0; i < visGrids.size(); i++)
+    file << visGrids[i];
+  file << "  </Grid>\n";
+  file << " </Domain>\n";
+  file << "</Xdmf>\n";
+  file.close();
+
+  return ierr;
+}
+
+/********************************************************************
+ * Write everything needed to continue the optimization at the current
+ * iteration: the MMA state, the penalty index, and the latest mode
+ * shapes to warm start the eigensolvers. Checkpoints alternate between
+ * two sets of files, and the header naming the complete set is renamed
+ * into place last, so an interrupted checkpoint leaves the previous one
+ * usable. Preconditioners are not saved. The stiffness matrix changes
+ * every iteration, so the multigrid hierarchies and their Chebyshev
+ * estimates are set up again anyway. The eigen shell coarse solver
+ * keeps its eigenvectors between setups, but only as a starting point:
+ * after a restart it does one full decomposition instead of an update.
+ * A repartition renumbers the mesh, so the next call writes a checkpoint
+ * regardless of the schedule, and the header records the mesh version.
+ * 
+ * @param optmma: The optimizer
+ * @param pind: Index of the current penalty
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::Checkpoint(MMA *optmma, int pind)
+{
+  PetscErrorCode ierr = 0;
+  if (checkpoint_every <= 0 || (!checkpointStale &&
+      (optmma->Get_It() % checkpoint_every) != 0))
+    return 0;
+
+  char filename[40];
+  sprintf(filename, "MMA_State_%i.bin", checkpointSlot);
+  ierr = optmma->Write_State(filename);
+  if (ierr != 0)
+    SETERRQ(comm, PETSC_ERR_FILE_WRITE, "Unable to write optimizer state");
+
+  PetscViewer view;
+  for (int i = 0; i < this->bucklingShape.cols(); i++) {
+    sprintf(filename, "phiB_checkpoint%i_mode%i.bin", checkpointSlot, i);
     Vec phi;
     ierr = VecCreateMPIWithArray(this->comm, 1, this->numDims*this->nLocNode,
         this->numDims*this->nNode, this->bucklingShape.data() +
         this->bucklingShape.rows()*i, &phi); CHKERRQ(ierr);
     ierr = PetscViewerBinaryOpen(this->comm, filename,
-        FILE_MODE_WRITE, &output); CHKERRQ(ierr);
-    ierr = VecView(phi, output); CHKERRQ(ierr);
-    ierr = PetscViewerDestroy(&output); CHKERRQ(ierr);
+        FILE_MODE_WRITE, &view); CHKERRQ(ierr);
+    ierr = VecView(phi, view); CHKERRQ(ierr);
+    ierr = PetscViewerDestroy(&view); CHKERRQ(ierr);
     ierr = VecDestroy(&phi); CHKERRQ(ierr);
   }
-
   for (int i = 0; i < this->dynamicShape.cols(); i++) {
-    sprintf(filename,"phiD_%s_mode%i.bin", name_suffix, i);
+    sprintf(filename, "phiD_checkpoint%i_mode%i.bin", checkpointSlot, i);
     Vec phi;
     ierr = VecCreateMPIWithArray(this->comm, 1, this->numDims*this->nLocNode,
         this->numDims*this->nNode, this->dynamicShape.data() +
         this->dynamicShape.rows()*i, &phi); CHKERRQ(ierr);
     ierr = PetscViewerBinaryOpen(this->comm, filename,
-        FILE_MODE_WRITE, &output); CHKERRQ(ierr);
-    ierr = VecView(phi, output); CHKERRQ(ierr);
-    ierr = PetscViewerDestroy(&output); CHKERRQ(ierr);
+        FILE_MODE_WRITE, &view); CHKERRQ(ierr);
+    ierr = VecView(phi, view); CHKERRQ(ierr);
+    ierr = PetscViewerDestroy(&view); CHKERRQ(ierr);
     ierr = VecDestroy(&phi); CHKERRQ(ierr);
   }
 
+  ierr = MPI_Barrier(comm); CHKERRQ(ierr);
+  int failed = 0;
+  if (myid == 0) {
+    int header[5] = {pind, (int)bucklingShape.cols(), (int)dynamicShape.cols(),
+                     checkpointSlot, (int)meshVersion};
+    ofstream file("Checkpoint.bin.tmp", ios::binary);
+    file.write((char*)header, sizeof(header));
+    file.close();
+    failed = file.fail() || rename("Checkpoint.bin.tmp", "Checkpoint.bin");
+  }
+  ierr = MPI_Bcast(&failed, 1, MPI_INT, 0, comm); CHKERRQ(ierr);
+  if (failed)
+    SETERRQ(comm, PETSC_ERR_FILE_WRITE, "Unable to write checkpoint header");
+  checkpointSlot = 1 - checkpointSlot;
+  checkpointStale = PETSC_FALSE;
+  if (verbose >= 2) {
+    ierr = PetscFPrintf(comm, output, "Checkpoint written at iteration %u\n",
+                        optmma->Get_It()); CHKERRQ(ierr);
+  }
+
+  return ierr;
+}
+
+/********************************************************************
+ * Restore the state written by Checkpoint from the restart folder,
+ * if there is one. Must be called after the optimizer and the mode
+ * shape arrays have been sized.
+ * 
+ * @param optmma: The optimizer
+ * @param pind: Index of the penalty to resume at (output)
+ * @param resume: Whether a checkpoint was found (output)
+ * 
+ * @return ierr: PetscErrorCode
+ * 
+ *******************************************************************/
+PetscErrorCode TopOpt::LoadCheckpoint(MMA *optmma, int &pind, PetscBool &resume)
+{
+  PetscErrorCode ierr = 0;
+  resume = PETSC_FALSE;
+
+  int header[5];
+  string filename = folder + "/Checkpoint.bin";
+  ifstream file(filename.c_str(), ios::binary);
+  if (!file.is_open())
+    return 0;
+  file.read((char*)header, sizeof(header));
+  file.close();
+  // A repartition renumbers the elements and nodes, so the design and
+  // mode shapes only make sense on the mesh they were written with
+  if (header[4] != meshVersion)
+    SETERRQ2(comm, PETSC_ERR_FILE_UNEXPECTED, "Checkpoint was written for mesh "
+             "version %i but the restart mesh is version %i", header[4],
+             (int)meshVersion);
+
+  stringstream strslot; strslot << header[3];
+  filename = folder + "/MMA_State_" + strslot.str() + ".bin";
+  ierr = optmma->Read_State(filename.c_str());
+  if (ierr != 0)
+    SETERRQ(comm, PETSC_ERR_FILE_READ, "Unable to read optimizer state");
+  pind = header[0];
+  // Don't overwrite this checkpoint if restarting in the same folder
+  checkpointSlot = 1 - header[3];
+
+  PetscViewer view;
+  bucklingShape.setZero(node.size(), header[1]);
+  for (int i = 0; i < header[1]; i++) {
+    stringstream strmode; strmode << i;
+    filename = folder + "/phiB_checkpoint" + strslot.str() + "_mode" +
+               strmode.str() + ".bin";
+    Vec phi;
+    ierr = VecCreateMPIWithArray(comm, 1, numDims*nLocNode, numDims*nNode,
+        bucklingShape.data() + bucklingShape.rows()*i, &phi); CHKERRQ(ierr);
+    ierr = PetscViewerBinaryOpen(comm, filename.c_str(), FILE_MODE_READ, &view); CHKERRQ(ierr);
+    ierr = VecLoad(phi, view); CHKERRQ(ierr);
+    ierr = PetscViewerDestroy(&view); CHKERRQ(ierr);
+    ierr = VecDestroy(&phi); CHKERRQ(ierr);
+  }
+  dynamicShape.setZero(node.size(), header[2]);
+  for (int i = 0; i < header[2]; i++) {
+    stringstream strmode; strmode << i;
+    filename = folder + "/phiD_checkpoint" + strslot.str() + "_mode" +
+               strmode.str() + ".bin";
+    Vec phi;
+    ierr = VecCreateMPIWithArray(comm, 1, numDims*nLocNode, numDims*nNode,
+        dynamicShape.data() + dynamicShape.rows()*i, &phi); CHKERRQ(ierr);
+    ierr = PetscViewerBinaryOpen(comm, filename.c_str(), FILE_MODE_READ, &view); CHKERRQ(ierr);
+    ierr = VecLoad(phi, view); CHKERRQ(ierr);
+    ierr = PetscViewerDestroy(&view); CHKERRQ(ierr);
+    ierr = VecDestroy(&phi); CHKERRQ(ierr);
+  }
+
+  resume = PETSC_TRUE;
+  ierr = PetscFPrintf(comm, output, "Resuming from checkpoint at penalty %1.4g, "
+                      "iteration %u\n", penalties[pind], optmma->Get_It()); CHKERRQ(ierr);
+
   return ierr;
 }
@@ -3,9 +3,12 @@
 
 #include <slepceps.h>
 #include <vector>
+#include <map>
+#include <sstream>
 #include <Eigen/Eigen>
 #include "MMA.h"
 #include "Functions.h"
+#include "Snapshot.h"
 
 extern "C"
 {
@@ -40,12 +43,50 @@ public:
   int nprocs;
   //Input file name
   std::string filename;
+  //Sections of the input file by name, read once and shared by all processes
+  std::map<std::string, std::string> inputSections;
   //How much information to print
   int verbose;
   //How often to output results
   int print_every, last_print;
+  //Whether printing returns before the files are written
+  PetscBool async_print;
+  //Background writer for printed values
+  Snapshot *snapshot;
+  //Encoding of values printed during the optimization, and how often
+  //one is printed independently of the last
+  SNAPSHOT_ENCODING print_encoding;
+  int print_keyframe;
+  //Whether to describe printed values in XDMF for visualization
+  PetscBool visualize;
+  //Meshes written for visualization, where the latest is stored, and
+  //the XDMF grid of every visualized print
+  int visMeshes;
+  PetscInt visElemOffset, visNodeOffset;
+  std::vector<std::string> visGrids;
+  //How often to checkpoint the optimizer state (0 to never)
+  int checkpoint_every;
+  //Which of the two checkpoint slots is written next
+  int checkpointSlot;
+  //Number of times the mesh has been renumbered, so a checkpoint can be
+  //matched to the mesh files it was written with
+  PetscInt meshVersion;
+  //Whether the last checkpoint uses an old numbering of the mesh
+  PetscBool checkpointStale;
+  //Keep a structured box decomposition of the mesh instead of using ParMETIS
+  PetscBool box_partition;
+  //How often to repartition the mesh by element density (0 to never)
+  int repartition_every;
+  //Extra partitioning weight of a fully solid active element
+  PetscScalar repartition_weight;
   //File for outputing information
   FILE* output;
+  //Whether to write a JSON-lines record of every iteration, and where
+  PetscBool telemetry;
+  FILE* telemetryFile;
+  //Wall time of each phase and of I/O since the last record
+  std::vector<std::pair<std::string, double> > phaseTimes;
+  double ioTime;
   //Location of files for restart
   std::string folder;
 
@@ -70,6 +111,14 @@ public:
   VectorXPS elemSize;
   //Flag to indicate if all elements are identical
   bool regular;
+  //Parameters of a generated mesh, kept to rebuild it when repartitioning
+  VectorXPS meshDimensions;
+  ArrayXPI meshNel;
+  PetscScalar meshRmin, meshRmax;
+  bool meshReorder;
+  //Partitioning weight of each structured element index (block distributed
+  //by repartDist), only set while the mesh is rebuilt
+  ArrayXPI repartDist, repartWeight;
 
   /// FEM setup variables - only used for FEM initialization
   //Element characteristics, E0 in Pa
@@ -155,8 +204,12 @@ public:
   Vec MLump;
   //The FEM solver context
   KSP KUF;
-  // Convergence flag for KSP;
+  // Convergence flag and iterations for KSP;
   KSPConvergedReason KUF_reason;
+  PetscInt KUF_its;
+  // Whether the displacements were solved for since the last telemetry
+  // record (KUF_reason also tells if they were ever solved for)
+  PetscBool KUF_solved;
 
   /// Function information
   std::vector<Function_Base*> function_list;
@@ -193,6 +246,12 @@ public:
 
   /// Profiling variables
   int funcEvent, FEEvent, UpdateEvent;
+  // Phases within the analysis, sensitivities, and output
+  int interpEvent, filterEvent, chainEvent, assembleEvent, PCSetupEvent,
+      solveEvent, adjointEvent, repartEvent, checkpointEvent, outputEvent,
+      printEvent;
+  // Each type of function
+  int functionEvent[FREQUENCY+1];
 
   /// Class methods
   // Constructors
@@ -207,6 +266,8 @@ public:
   ~TopOpt() {Clear();}
 
   // Parsing the input file
+  PetscErrorCode Read_Input();
+  PetscErrorCode Get_Input(std::string section, std::istringstream &file);
   PetscErrorCode Def_Param(MMA *optmma, VectorXPS &Dimensions, ArrayXPI &Nel,
                            PetscScalar &Rmin, PetscScalar &Rmax,
                            PetscBool &Normalization, PetscBool &Reorder_Mesh);
@@ -226,14 +287,33 @@ public:
     G = new MatrixXPS[pow2]; GT = new MatrixXPS[pow2]; W = new PetscScalar[pow2];
   }
   PetscErrorCode Clear();
+  PetscErrorCode Clear_Mesh();
 
   // Printing information
   PetscErrorCode MeshOut();
+  PetscErrorCode MeshOut_Files();
   PetscErrorCode MeshOut(TopOpt *topOpt);
   PetscErrorCode StepOut(const PetscScalar &f, const VectorXPS &cons,
                          int it, long nactive);
   PetscErrorCode ResultOut(int it);
-  PetscErrorCode PrintVals(char *name_suffix);
+  void Add_Time(const char *phase, double time, PetscBool io=PETSC_FALSE);
+  PetscErrorCode Telemetry(const PetscScalar &f, const VectorXPS &cons,
+                           int it, MMA *optmma);
+  PetscErrorCode Telemetry_Flush(const char *event, int it);
+  PetscErrorCode MemoryOut(MMA *optmma);
+  PetscErrorCode PrintVals(char *name_suffix, PetscBool compact=PETSC_FALSE);
+  PetscErrorCode Vis_Mesh();
+  PetscErrorCode Vis_Out(char *name_suffix);
+  // Optimizer checkpoint and restart
+  PetscErrorCode Checkpoint(MMA *optmma, int pind);
+  PetscErrorCode LoadCheckpoint(MMA *optmma, int &pind, PetscBool &resume);
+  // Rebalance the mesh by element density during the optimization
+  PetscErrorCode Repartition(MMA *optmma, VectorXPS &dfdx, MatrixXPS &dgdx);
+  PetscErrorCode Structured_Index(ArrayXPI &index);
+  PetscErrorCode Migrate_State(ArrayXPI &dist, ArrayXPI &keys, MatrixXdRM &state,
+                               MatrixXdRM &dirState);
+  PetscErrorCode Fetch_State(ArrayXPI &dist, MatrixXdRM &dirState,
+                             ArrayXPI &keys, MatrixXdRM &state);
 
   // Mesh Creation
   PetscErrorCode RecFilter(PetscInt *first, PetscInt *last, PetscScalar *dx,
@@ -252,11 +332,13 @@ public:
   PetscErrorCode Assemble_Interpolation(ArrayXPI *I, ArrayXPI *J, ArrayXPS *K,
                                         ArrayXPI *cList, PetscInt mg_levels,
                                         PetscInt min_size);
-  PetscErrorCode ApplyDomain(Eigen::Array<bool, -1, 1> elemValidity, int padding,
-                             int nInterfaceNodes, ArrayXPI &MinFI, ArrayXPI &MinFJ,
-                             ArrayXPS &MinFK, ArrayXPI &MaxFI, ArrayXPI &MaxFJ,
-                             ArrayXPS &MaxFK, ArrayXPI *I, ArrayXPI *J,
-                             ArrayXPS *K, ArrayXPI *cList, int &mg_levels);
+  PetscErrorCode ApplyDomain(Eigen::Array<bool, -1, 1> elemValidity,
+                             ArrayXPI &MinFI, ArrayXPI &MinFJ, ArrayXPS &MinFK,
+                             ArrayXPI &MaxFI, ArrayXPI &MaxFJ, ArrayXPS &MaxFK,
+                             ArrayXPI *I, ArrayXPI *J, ArrayXPS *K,
+                             ArrayXPI *cList, int &mg_levels);
+  PetscErrorCode BoxPartition(PetscInt *first, PetscInt *last, ArrayXPI Nel,
+                              Eigen::Array<idx_t, -1, 1> &partition);
   idx_t ReorderParMetis(bool Reorder_Mesh, ArrayXPI &MinFI, ArrayXPI &MinFJ,
                         ArrayXPS &MinFK, ArrayXPI &MaxFI, ArrayXPI &MaxFJ,
                         ArrayXPS &MaxFK, idx_t nparts=0, idx_t ncommonnodes=0,
@@ -267,10 +349,24 @@ public:
   PetscErrorCode ElemDist(Eigen::Array<idx_t, -1, 1> &partition,
                           ArrayXPI &MinFI, ArrayXPI &MinFJ, ArrayXPS &MinFK,
                           ArrayXPI &MaxFI, ArrayXPI &MaxFJ, ArrayXPS &MaxFK);
-  PetscErrorCode GetElemNumbers(PetscInt ghostStart, PetscInt ghostEnd,
-                                ArrayXPI &newElemNumber, ArrayXPI &allElemNumber);
+  PetscErrorCode Sparse_Exchange(ArrayXPI &sendbuf, Eigen::ArrayXi &sendcnt,
+                                 ArrayXPI &recvbuf, Eigen::ArrayXi &recvcnt);
+  PetscErrorCode Sparse_Exchange(MatrixXdRM &sendbuf, Eigen::ArrayXi &sendcnt,
+                                 MatrixXdRM &recvbuf, Eigen::ArrayXi &recvcnt);
+  PetscErrorCode Owner_Requests(ArrayXPI &dist, ArrayXPI &keys,
+                                Eigen::ArrayXi &sendcnt, ArrayXPI &requests,
+                                Eigen::ArrayXi &recvcnt);
+  PetscErrorCode Lookup_Numbers(ArrayXPI &dist, ArrayXPI &values, ArrayXPI &query);
+  PetscErrorCode Renumber_Nodes(ArrayXPI &dist, ArrayXPI &newNumber, ArrayXPI *I,
+                                ArrayXPI *J, ArrayXPI *cList, int mg_levels);
+  PetscErrorCode Renumber_Filters(ArrayXPI &dist, ArrayXPI &newNumber,
+                                  ArrayXPI &MinFI, ArrayXPI &MinFJ,
+                                  ArrayXPI &MaxFI, ArrayXPI &MaxFJ);
   PetscErrorCode NodeDist(ArrayXPI *I, ArrayXPI *J, ArrayXPS *K,
                           ArrayXPI *cList, int mg_levels);
+  PetscErrorCode SFC_Order(ArrayXPI &MinFI, ArrayXPI &MinFJ, ArrayXPI &MaxFI,
+                           ArrayXPI &MaxFJ, ArrayXPI *I, ArrayXPI *J,
+                           ArrayXPI *cList, int mg_levels);
   PetscErrorCode Expand_Elem();
   PetscErrorCode Expand_Node();
   PetscErrorCode Initialize_Vectors();